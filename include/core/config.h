@@ -42,6 +42,9 @@ namespace ConfigKeys {
     constexpr const char* MAX_POSITION_SIZE = "limits.max_position_size";
     constexpr const char* ENABLE_PERSISTENCE = "persistence.enabled";
     constexpr const char* DB_PATH = "persistence.db_path";
+    constexpr const char* JOURNAL_BACKEND = "persistence.journal_backend";
+    constexpr const char* JOURNAL_SEGMENT_MB = "persistence.journal_segment_mb";
+    constexpr const char* JOURNAL_DIRECT_IO = "persistence.journal_direct_io";
     constexpr const char* ENABLE_METRICS = "metrics.enabled";
     constexpr const char* METRICS_PORT = "metrics.port";
 }
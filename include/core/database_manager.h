@@ -10,6 +10,8 @@
 
 namespace perpetual {
 
+class HistoryStore;
+
 // 数据库管理器（支持多种数据库）
 class DatabaseManager {
 public:
@@ -18,7 +20,8 @@ public:
         SQLITE,
         MYSQL,
         POSTGRESQL,
-        MONGODB
+        MONGODB,
+        EMBEDDED    // 本地列式历史存储（HistoryStore），connection_string 为数据目录
     };
     
     DatabaseManager(DBType type, const std::string& connection_string);
@@ -29,10 +32,10 @@ public:
     void disconnect();
     bool isConnected() const;
     
-    // 订单相关
+    // 订单相关（查询的 end_time 为 0 表示不限结束时间）
     bool insertOrder(const Order& order);
     bool updateOrder(const Order& order);
-    Order* getOrder(OrderID order_id);
+    Order* getOrder(OrderID order_id);    // 返回的指针在下一次 getOrder 前有效
     std::vector<Order> getOrdersByUser(UserID user_id, int64_t start_time = 0, 
                                       int64_t end_time = 0);
     
@@ -97,11 +100,15 @@ private:
     std::string connection_string_;
     void* connection_handle_;  // 数据库连接句柄（类型取决于DBType）
     
+    std::unique_ptr<HistoryStore> history_;    // EMBEDDED
+    std::unique_ptr<Order> fetched_order_;     // getOrder 的结果
+    
     // 数据库特定实现
     void* sqlite_connect();
     void* mysql_connect();
     void* postgresql_connect();
     void* mongodb_connect();
+    void* embedded_connect();
 };
 
 } // namespace perpetual
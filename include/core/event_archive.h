@@ -0,0 +1,155 @@
+#pragma once
+
+#include "event_sourcing.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace perpetual {
+
+// ============================================================================
+// Columnar event archive
+//
+// Cold history is stored in blocks of up to block_events events. Inside a
+// block every field is its own column: the type, sequence, timestamp and
+// instrument of all events, then the payload fields of each event type
+// present, in event order. Sequence and timestamp columns are
+// delta-of-delta encoded, other integers delta + zig-zag varint, and small
+// enums bit-packed. Blocks carry a CRC32C; the block index at the end of
+// the file records each block's sequence and timestamp range so scans skip
+// blocks without touching them.
+//
+// File: ArchiveFileHeader, blocks, ArchiveBlockInfo[], ArchiveFileFooter
+// ============================================================================
+
+constexpr size_t kArchiveBlockEvents = 4096;
+
+// Column type for the columns every event has
+constexpr uint8_t kArchiveAllTypes = 0xFF;
+
+enum class ArchiveField : uint8_t {
+    // Every event
+    TYPE = 0,
+    SEQUENCE = 1,
+    TIMESTAMP = 2,
+    INSTRUMENT = 3,
+
+    // Payload fields (which exist depends on the event type)
+    ORDER_ID = 10,
+    USER_ID = 11,
+    PRICE = 12,
+    QUANTITY = 13,
+    SIDE = 14,
+    ORDER_TYPE = 15,
+    TAKER_ORDER_ID = 16,
+    MAKER_ORDER_ID = 17,
+    OLD_STATUS = 18,
+    NEW_STATUS = 19,
+    REASON_ID = 20,
+    BUY_ORDER_ID = 21,
+    SELL_ORDER_ID = 22,
+    BUY_USER_ID = 23,
+    SELL_USER_ID = 24,
+    TRADE_TIMESTAMP = 25,
+    TRADE_SEQUENCE = 26,
+    TRADE_INSTRUMENT = 27,
+    TAKER_BUY = 28
+};
+
+enum class ArchiveEncoding : uint8_t {
+    DELTA_VARINT = 1,      // Zig-zag varint of the difference to the previous row
+    DELTA_OF_DELTA = 2,    // Zig-zag varint of the change in that difference
+    BIT_PACKED = 3         // Fixed bit width, LSB first
+};
+
+#pragma pack(push, 1)
+struct ArchiveBlockInfo {
+    uint64_t offset;             // File offset of the block
+    uint32_t length;             // Block bytes
+    uint32_t event_count;
+    SequenceID min_sequence;
+    SequenceID max_sequence;
+    Timestamp min_timestamp;
+    Timestamp max_timestamp;
+};
+#pragma pack(pop)
+
+// Writes an archive to <path>.tmp and renames it into place on close()
+class EventArchiveWriter {
+public:
+    explicit EventArchiveWriter(size_t block_events = kArchiveBlockEvents);
+    ~EventArchiveWriter();
+
+    EventArchiveWriter(const EventArchiveWriter&) = delete;
+    EventArchiveWriter& operator=(const EventArchiveWriter&) = delete;
+
+    bool open(const std::string& path);
+
+    // Events must be appended in sequence order
+    bool append(const Event& event);
+
+    // Write the last block and the index, sync and publish the file.
+    // Without close() (or on failure) no archive is left behind.
+    bool close();
+
+    size_t event_count() const { return event_count_; }
+    uint64_t bytes_written() const { return offset_; }
+
+private:
+    bool flush_block();
+    bool write(const void* data, size_t length);
+    void abandon();
+
+    size_t block_events_;
+    std::string path_;
+    int fd_ = -1;
+    uint64_t offset_ = 0;
+    size_t event_count_ = 0;
+    std::vector<Event> block_;
+    std::vector<ArchiveBlockInfo> index_;
+    std::string buffer_;
+};
+
+// Reads an archive through a read-only mapping
+class EventArchiveReader {
+public:
+    EventArchiveReader() = default;
+    ~EventArchiveReader();
+
+    EventArchiveReader(const EventArchiveReader&) = delete;
+    EventArchiveReader& operator=(const EventArchiveReader&) = delete;
+
+    // Validates the header, footer and block index
+    bool open(const std::string& path);
+    void close();
+
+    const std::vector<ArchiveBlockInfo>& blocks() const { return blocks_; }
+    size_t event_count() const { return event_count_; }
+
+    // Decode every event of a block
+    bool read_block(size_t block, std::vector<Event>& events) const;
+
+    // One column of a block without decoding the others. type is an
+    // EventType, or kArchiveAllTypes for TYPE/SEQUENCE/TIMESTAMP/
+    // INSTRUMENT. A block without events of that type yields no values.
+    bool read_column(size_t block, uint8_t type, ArchiveField field,
+                     std::vector<int64_t>& values) const;
+
+    // Events in [from, to]; blocks outside the range are skipped
+    bool read_events(SequenceID from, SequenceID to, std::vector<Event>& events) const;
+
+    // Whether path starts like a columnar archive
+    static bool is_archive(const std::string& path);
+
+private:
+    const char* block_data(size_t block) const;
+
+    int fd_ = -1;
+    const char* map_ = nullptr;
+    size_t size_ = 0;
+    size_t event_count_ = 0;
+    std::vector<ArchiveBlockInfo> blocks_;
+};
+
+} // namespace perpetual
@@ -2,12 +2,21 @@
 
 #include "order.h"
 #include "types.h"
+#include "journal_writer.h"
 #include <string>
 #include <vector>
 #include <memory>
 #include <functional>
 #include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <mutex>
 #include <shared_mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include <deque>
+#include <fstream>
 
 namespace perpetual {
 
@@ -22,9 +31,28 @@ enum class EventType : uint8_t {
     ORDER_FULLY_FILLED = 6
 };
 
+// Binary event format version written by Event::encode()
+constexpr uint8_t EVENT_FORMAT_VERSION = 1;
+
+// Fixed header in front of every encoded event. The payload that follows
+// is a packed, type-specific field list; length lets older readers skip
+// fields appended by newer format versions.
+#pragma pack(push, 1)
+struct EncodedEventHeader {
+    uint8_t type;
+    uint8_t version;
+    uint16_t length;            // Payload bytes after the header
+    InstrumentID instrument_id;
+    SequenceID sequence_id;
+    Timestamp event_timestamp;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(EncodedEventHeader) == 24, "encoded event header must be 24 bytes");
+
 // Base event structure for Event Sourcing
 // All events are immutable and deterministic
-struct alignas(64) Event {
+struct Event {
     EventType type;
     SequenceID sequence_id;  // Deterministic sequence number
     Timestamp event_timestamp;  // Deterministic timestamp (based on sequence)
@@ -58,7 +86,7 @@ struct alignas(64) Event {
         struct {
             OrderID order_id;
             UserID user_id;
-            char reason[256];  // Fixed-size string to avoid union issues
+            uint32_t reason_id;  // Interned in the EventStore's ReasonTable (0 = none)
         } order_rejected;
         
         struct {
@@ -66,11 +94,16 @@ struct alignas(64) Event {
         } trade_executed;
     } data;
     
-    // Serialization for persistence
+    // Binary encoding: EncodedEventHeader + packed payload
+    size_t encoded_size() const;
+    size_t encode(char* out) const;   // Writes encoded_size() bytes
+    static bool decode(const char* data, size_t length, Event& event);
+    
+    // Encoded form as a string (archives, versioned events)
     std::string serialize() const;
     static Event deserialize(const std::string& data);
     
-    // Deterministic hash for verification
+    // Deterministic hash of the encoded form (hash64)
     uint64_t hash() const;
     
     // Default constructor (required for containers)
@@ -105,19 +138,178 @@ struct alignas(64) Event {
         return *this;
     }
     
-    // Destructor (trivial - no cleanup needed with fixed-size arrays)
+    // Destructor (trivial - payload is plain data)
     ~Event() = default;
 };
 
+// Upper bound of Event::encoded_size()
+constexpr size_t kMaxEncodedEventSize = sizeof(EncodedEventHeader) + sizeof(Event::data);
+
+// An encoded event where it lies (e.g. in a mapped log segment). Header
+// fields are read in place; decode() materializes the full Event.
+class EventView {
+public:
+    EventView() = default;
+    EventView(const char* data, size_t length) : data_(data), length_(length) {}
+    
+    EventType type() const { return static_cast<EventType>(header().type); }
+    SequenceID sequence_id() const { return header().sequence_id; }
+    Timestamp event_timestamp() const { return header().event_timestamp; }
+    InstrumentID instrument_id() const { return header().instrument_id; }
+    
+    const char* data() const { return data_; }
+    size_t size() const { return length_; }
+    
+    bool decode(Event& event) const { return Event::decode(data_, length_, event); }
+    
+private:
+    EncodedEventHeader header() const {
+        EncodedEventHeader header{};
+        if (length_ >= sizeof(header)) {
+            memcpy(&header, data_, sizeof(header));
+        }
+        return header;
+    }
+    
+    const char* data_ = nullptr;
+    size_t length_ = 0;
+};
+
+// Interned rejection reasons. Events carry a 32-bit id instead of the text;
+// the strings live out of line and are persisted next to the event log.
+class ReasonTable {
+public:
+    // Load persisted reasons; ids are kept stable across restarts
+    bool open(const std::string& path);
+    
+    // Id for a reason, persisting it first if it is new. 0 for an empty reason.
+    uint32_t intern(const std::string& reason);
+    
+    // Reason text for an id (empty if unknown)
+    std::string lookup(uint32_t id) const;
+    
+    size_t size() const;
+    
+private:
+    bool persist(uint32_t id, const std::string& reason);
+    
+    std::string path_;
+    std::vector<std::string> reasons_;   // reasons_[id - 1]
+    std::unordered_map<std::string, uint32_t> ids_;
+    mutable std::shared_mutex mutex_;
+};
+
+// Event store configuration
+struct EventStoreConfig {
+    JournalWriterConfig journal;
+    size_t group_commit_bytes = 256 * 1024;   // Commit once this much is buffered
+    uint32_t group_commit_interval_ms = 10;   // Journaling thread commit cadence
+    uint32_t sparse_index_interval = 1024;    // Events per sequence->offset index entry
+    uint64_t index_checkpoint_interval = 1 << 20;   // Events between index checkpoints (0 = shutdown only)
+    size_t tail_ring_events = 64 * 1024;      // Recent events kept in memory for read_tail (0 = none)
+    
+    EventStoreConfig() {
+        // Preallocated 64MB segments written with O_DIRECT
+        journal.segment_bytes = 64ULL * 1024 * 1024;
+        journal.direct_io = true;
+    }
+};
+
+// Where an event lives in the log (sparse index and per-key indexes)
+struct EventLocation {
+    SequenceID sequence = 0;
+    JournalPosition position;
+};
+
+// Sparse index entry (events.idx): an event's location and the event
+// chain up to, but not including, that event
+struct SparseIndexEntry {
+    SequenceID sequence = 0;
+    JournalPosition position;
+    uint64_t chain = 0;
+};
+
+// Sealed log segment and the sequence range it holds (events.manifest)
+struct SegmentRange {
+    uint64_t segment = 0;
+    SequenceID first_sequence = 0;
+    SequenceID last_sequence = 0;
+    uint64_t last_chain = 0;     // Event chain through last_sequence (0 = unknown)
+};
+
+// The most recently appended events, encoded, in a fixed ring of slots.
+// The single writer (appends, serialized by the store) never waits for
+// readers: a reader copies a slot out and checks that it was not
+// overwritten meanwhile, as with a seqlock.
+class EventTailRing {
+public:
+    // Events up to base_sequence were appended before the ring existed
+    EventTailRing(size_t capacity, SequenceID base_sequence);
+    
+    void push(const char* data, size_t length);
+    
+    // Events pushed so far; event i is in the ring while i + capacity > head
+    uint64_t head() const { return head_.load(std::memory_order_acquire); }
+    size_t capacity() const { return capacity_; }
+    
+    // Copy event index out (buffer holds kMaxEncodedEventSize bytes).
+    // False if it has been overwritten or not pushed yet.
+    bool read(uint64_t index, char* buffer, size_t& length) const;
+    
+    // Index of the first event after sequence, if the ring still holds
+    // everything after it (head() when nothing newer was pushed yet)
+    bool find_after(SequenceID sequence, uint64_t& index) const;
+    
+private:
+    struct Slot {
+        std::atomic<uint64_t> index{UINT64_MAX};   // kBusy while being written
+        std::atomic<SequenceID> sequence{0};
+        uint32_t length = 0;
+        char data[kMaxEncodedEventSize];
+    };
+    
+    // Sequence of event index, if the slot still holds it
+    bool sequence_at(uint64_t index, SequenceID& sequence) const;
+    
+    std::unique_ptr<Slot[]> slots_;
+    size_t capacity_;
+    SequenceID base_sequence_;
+    std::atomic<uint64_t> head_{0};
+};
+
+// A subscriber's position in the event stream (see EventStore::read_tail)
+struct EventCursor {
+    static constexpr uint64_t kNoRingIndex = UINT64_MAX;
+    
+    SequenceID sequence = 0;               // Last event delivered
+    uint64_t ring_index = kNoRingIndex;    // Next event in the tail ring, once found
+    
+    EventCursor() = default;
+    explicit EventCursor(SequenceID after) : sequence(after) {}
+};
+
 // Event Store for Event Sourcing
 // Stores all events in append-only log
 class EventStore {
 public:
     EventStore();
-    ~EventStore();
+    virtual ~EventStore();
+    
+    // Initialize event store (VersionedEventStore also loads its version runs)
+    virtual bool initialize(const std::string& data_dir,
+                            const EventStoreConfig& config = EventStoreConfig());
     
-    // Initialize event store
-    bool initialize(const std::string& data_dir);
+    // Follower (standby) mode: load the indexes of a log another process
+    // is writing without touching any of its files. follow() indexes the
+    // records committed since and hands each to handler; it returns the
+    // number of events read (0 at the end of the log). take_over() indexes
+    // the rest and opens the log for appending, as initialize() would have.
+    bool open_follower(const std::string& data_dir,
+                       const EventStoreConfig& config = EventStoreConfig());
+    size_t follow(const std::function<void(const EventView&)>& handler,
+                  size_t max_events = SIZE_MAX);
+    bool take_over();
+    bool is_follower() const { return tail_reader_ != nullptr; }
     
     // Append event (immutable, append-only)
     bool append_event(const Event& event);
@@ -141,34 +333,236 @@ public:
     bool replay_events(SequenceID from, SequenceID to,
                       std::function<bool(const Event&)> handler) const;
     
-    // Create snapshot at a specific sequence
-    bool create_snapshot(SequenceID sequence, const std::string& snapshot_path);
+    // Visit events in [from, to] as views into the mapped log, without
+    // copying or decoding them. Handler returns false to stop.
+    bool scan_events(SequenceID from, SequenceID to,
+                     const std::function<bool(const EventView&)>& handler) const;
+    
+    // Deliver the events after cursor.sequence (at most max_events) and
+    // advance the cursor. Events still in the in-memory tail ring are
+    // copied from there, visible as soon as they are appended; a cursor
+    // the ring has moved past reads the log until it catches up. The view
+    // is only valid during the call. Returns the number of events delivered.
+    size_t read_tail(EventCursor& cursor, const std::function<void(const EventView&)>& handler,
+                     size_t max_events = SIZE_MAX) const;
+    
+    // Parallel replay for recovery. Log segments are decoded on
+    // decode_threads threads (0 = one per core) and partition_of routes
+    // each event to one of `partitions` worker threads, which call
+    // handler(partition, event) in sequence order. kReplayBarrier events
+    // are handled on the calling thread after every earlier event, for
+    // state shared across partitions; kReplayAll events are handed to
+    // every partition in its order, without waiting for the others;
+    // kReplaySkip events are dropped.
+    static constexpr size_t kReplayAll = SIZE_MAX - 2;
+    static constexpr size_t kReplaySkip = SIZE_MAX - 1;
+    static constexpr size_t kReplayBarrier = SIZE_MAX;
+    bool replay_events_parallel(SequenceID from, SequenceID to, size_t partitions,
+                                const std::function<size_t(const Event&)>& partition_of,
+                                const std::function<bool(size_t, const Event&)>& handler,
+                                size_t decode_threads = 0) const;
+    
+    // Create snapshot at a specific sequence. state is opaque to the store
+    // (e.g. MatchingEngineEventSourcing::serialize_state); the file is
+    // checksummed and replaced atomically.
+    bool create_snapshot(SequenceID sequence, const std::string& snapshot_path,
+                         const std::string& state = std::string());
+    
+    // Snapshot file contents as create_snapshot writes them (for writers
+    // that cannot use create_snapshot, e.g. a forked child)
+    static std::string encode_snapshot(SequenceID sequence, const std::string& state);
     
-    // Load snapshot
-    bool load_snapshot(const std::string& snapshot_path, SequenceID& sequence);
+    // Load snapshot. Fails on a missing, torn or corrupt file.
+    static bool load_snapshot(const std::string& snapshot_path, SequenceID& sequence);
+    static bool load_snapshot(const std::string& snapshot_path, SequenceID& sequence,
+                              std::string& state);
     
-    // Flush pending writes
+    // Journal directory of a store
+    static std::string event_log_dir(const std::string& data_dir);
+    
+    // Newest entry of a store's events.idx as another process sees it (the
+    // writer appends at every group commit): a lower bound of the log's head
+    static bool last_index_entry(const std::string& data_dir, SparseIndexEntry& entry);
+    
+    // Flush pending writes (commit the current batch and wait until durable)
     void flush();
     
+    // Persist the in-memory indexes (events.ckpt) so the next open only
+    // scans events appended after this point. Taken periodically by the
+    // journaling thread and on shutdown.
+    bool checkpoint_indexes();
+    
+    // Journal backend in use ("io_uring" or "pwrite")
+    const char* journal_backend() const { return journal_ ? journal_->backend_name() : "none"; }
+    
     // Get event count
     size_t event_count() const { return event_count_; }
     
+    // Retention: unlink the sealed segments whose events all precede
+    // sequence (e.g. one past a durable snapshot). No data is copied; the
+    // manifest records the new start first, so an interrupted truncation
+    // finishes on the next open. Returns the number of segments removed.
+    size_t truncate_before(SequenceID sequence);
+    
+    // Oldest event still in the log (0 when empty)
+    SequenceID first_sequence() const;
+    
+    // Sealed segments, oldest first
+    std::vector<SegmentRange> sealed_segments() const;
+    
+    // Rolling hash chain over the log: each event's chain is hash64 of its
+    // encoded bytes seeded with the chain before it (0 before the first
+    // event ever appended). Two logs with the same chain at a sequence hold
+    // the same events up to it, so replicas, backups and replays compare
+    // one number instead of their contents.
+    static uint64_t chain_step(uint64_t chain, const EventView& view) {
+        return hash64(view.data(), view.size(), chain);
+    }
+    
+    // Chain through the last appended event
+    uint64_t chain_hash() const;
+    
+    // Chain through the last event at or before sequence, rolled forward
+    // from the nearest sparse index entry. False if sequence precedes the log.
+    bool chain_hash_at(SequenceID sequence, uint64_t& chain) const;
+    
+    // Recompute the chain over the whole log and check it against the one
+    // recorded in the manifest and the indexes. Sealed segments are hashed
+    // on threads threads (0 = one per core), each seeded with the chain
+    // the manifest recorded for the segment before it. Returns false at
+    // the first segment that does not match.
+    bool verify_chain(size_t threads = 0) const;
+    
+    const std::string& data_dir() const { return data_dir_; }
+    
+    // Called with every appended event's encoded bytes, in log order,
+    // while appends are serialized; it must be quick and must not append.
+    // Returns the sequence of the last event appended before the listener
+    // was installed, so older events can be read from the log without a
+    // gap or overlap. Pass nullptr to remove it.
+    SequenceID set_append_listener(std::function<void(const EventView&)> listener);
+    
+    // Rejection reason interning (see ReasonTable)
+    uint32_t intern_reason(const std::string& reason) { return reasons_.intern(reason); }
+    std::string reason(uint32_t reason_id) const { return reasons_.lookup(reason_id); }
+    
+protected:
+    // Append, first calling prepare with the sequence the event will take
+    // while appends are serialized; prepare returns false to abandon the
+    // append without using the sequence.
+    bool append_event(const Event& event, const std::function<bool(SequenceID)>& prepare);
+    
 private:
-    void write_event_to_log(const Event& event);
-    Event read_event_from_log(std::ifstream& file) const;
+    bool write_event_to_log(const Event& event, JournalPosition& position, uint64_t& chain);
+    bool read_event_from_log(JournalReader& reader, Event& event) const;
+    bool read_event_view(JournalReader& reader, EventView& view) const;
+    
+    // Opening: indexes from the checkpoint and manifest, then the log
+    // after them through tail_reader_
+    bool load_indexes(const std::string& data_dir, const EventStoreConfig& config,
+                      bool writer);
+    size_t index_tail(const std::function<void(const EventView&)>& handler, size_t max_events);
+    bool open_writer();
+    
+    // Index maintenance (caller holds index_mutex_ exclusively)
+    void index_event(const Event& event, const JournalPosition& position, uint64_t chain);
+    void track_location(SequenceID sequence, const JournalPosition& position, uint64_t chain);
+    
+    // Start a reader at the last sparse index entry at or before sequence.
+    // Returns the chain before the event the reader resumes at.
+    uint64_t seek_to_sequence(JournalReader& reader, SequenceID sequence) const;
+    
+    // Point reads of indexed events
+    std::vector<Event> read_events_at(const std::vector<EventLocation>& locations) const;
+    
+    void rewrite_sparse_index_file();
+    
+    // Index checkpoint file (see checkpoint_indexes)
+    bool load_index_checkpoint();
+    void clear_indexes();
+    
+    // Drop index entries in segments below segment (after truncation)
+    void prune_indexes(uint64_t segment);
+    
+    // Segment manifest (caller holds index_mutex_ exclusively, except write)
+    bool load_manifest();
+    void reconcile_segments();
+    bool write_manifest();
+    
+    // Make everything appended so far visible to file readers
+    void sync_for_read() const;
+    
+    // Reads take the log through the durable watermark and newer events
+    // from the tail ring, so they do not cut a group commit short.
+    // sync_for_read is the fallback once the ring has moved past them.
+    SequenceID readable_sequence() const;
+    void ensure_readable(SequenceID through) const;
+    bool scan_log(SequenceID from, SequenceID to,
+                  const std::function<bool(const EventView&)>& handler) const;
+    enum class RingScan { DONE, STOPPED, MISSED };
+    RingScan scan_ring(SequenceID& from, SequenceID to,
+                       const std::function<bool(const EventView&)>& handler) const;
+    bool read_ring_event(SequenceID sequence, Event& event) const;
+    
+    // Commit the journal batch, remembering the sequence it ends at
+    // (caller holds event_log_mutex_)
+    uint64_t commit_journal() const;
+    void on_durable(uint64_t record);
+    
+    // Background group commit
+    void journal_worker();
+    void stop_journal_worker();
     
     std::string data_dir_;
     std::string event_log_path_;
-    std::unique_ptr<std::ofstream> event_log_;
-    std::mutex event_log_mutex_;
+    EventStoreConfig config_;
+    ReasonTable reasons_;
+    std::unique_ptr<JournalWriter> journal_;
+    mutable std::mutex event_log_mutex_;
+    std::function<void(const EventView&)> append_listener_;   // Guarded by event_log_mutex_
+    std::unique_ptr<EventTailRing> tail_ring_;   // Pushed to under event_log_mutex_
+    SequenceID logged_sequence_ = 0;             // Last event handed to journal_ (event_log_mutex_)
+    
+    // Journal record and sequence at each commit, popped as batches become
+    // durable (see readable_sequence)
+    mutable std::mutex commit_marks_mutex_;
+    mutable std::deque<std::pair<uint64_t, SequenceID>> commit_marks_;
+    std::atomic<SequenceID> durable_sequence_{0};
+    
+    std::thread journal_thread_;
+    std::atomic<bool> journal_running_{false};
+    std::mutex journal_wait_mutex_;
+    std::condition_variable journal_cv_;
     
     std::atomic<SequenceID> latest_sequence_{0};
     std::atomic<size_t> event_count_{0};
     
-    // Indexes for fast lookup
-    std::unordered_map<OrderID, std::vector<SequenceID>> order_index_;
-    std::unordered_map<InstrumentID, std::vector<SequenceID>> instrument_index_;
+    // Indexes for fast lookup (log positions, ordered by sequence)
+    std::unordered_map<OrderID, std::vector<EventLocation>> order_index_;
+    std::unordered_map<InstrumentID, std::vector<EventLocation>> instrument_index_;
+    std::vector<SparseIndexEntry> sparse_index_;   // Every sparse_index_interval events
+    EventLocation last_location_;               // Last indexed event
+    uint64_t chain_ = 0;                        // Event chain through last_location_
+    std::unique_ptr<JournalReader> tail_reader_;   // After last_location_ until the writer opens
     mutable std::shared_mutex index_mutex_;
+    uint64_t index_generation_ = 0;             // Bumped when index lists shrink (index_mutex_)
+    
+    // Sparse index persisted alongside the log (events.idx)
+    std::string sparse_index_path_;
+    mutable std::ofstream sparse_index_file_;   // Appended under event_log_mutex_
+    
+    std::string checkpoint_path_;
+    std::mutex checkpoint_mutex_;
+    std::atomic<size_t> checkpoint_count_{0};   // event_count_ at the last checkpoint
+    
+    // Segment manifest (guarded by index_mutex_)
+    std::string manifest_path_;
+    std::vector<SegmentRange> sealed_segments_;
+    SegmentRange open_segment_;                 // Segment being appended to
+    uint64_t retained_segment_ = 0;             // Segments below this were truncated
+    uint64_t base_chain_ = 0;                   // Event chain before retained_segment_
+    std::atomic<bool> manifest_dirty_{false};
+    std::mutex manifest_mutex_;                 // Serializes manifest writes
     
     bool initialized_ = false;
 };
@@ -183,7 +577,8 @@ public:
     void publish_order_matched(OrderID taker_id, OrderID maker_id, 
                                Price price, Quantity quantity);
     void publish_order_cancelled(OrderID order_id, UserID user_id,
-                                 OrderStatus old_status, OrderStatus new_status);
+                                 OrderStatus old_status, OrderStatus new_status,
+                                 InstrumentID instrument_id = 0);
     void publish_order_rejected(OrderID order_id, UserID user_id, 
                                 const std::string& reason);
     void publish_trade_executed(const Trade& trade);
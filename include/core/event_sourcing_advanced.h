@@ -1,6 +1,7 @@
 #pragma once
 
 #include "event_sourcing.h"
+#include "log_shipping.h"
 #include "orderbook.h"  // For PriceLevel
 #include "types.h"
 #include <string>
@@ -14,7 +15,9 @@
 #include <shared_mutex>
 #include <condition_variable>
 #include <map>
+#include <list>
 #include <unordered_map>
+#include <chrono>
 
 namespace perpetual {
     class MatchingEngineEventSourcing;  // Forward declaration
@@ -49,10 +52,11 @@ public:
     // Create snapshot and optionally delete old events
     bool create_snapshot_and_compress(SequenceID sequence, const std::string& snapshot_path);
     
-    // Archive old events to compressed file
+    // Archive old events to a columnar, delta-encoded file (EventArchiveWriter);
+    // read it column-wise with EventArchiveReader
     bool archive_events(SequenceID from, SequenceID to, const std::string& archive_path);
     
-    // Load archived events
+    // Load archived events (columnar or the older length-prefixed format)
     bool load_archived_events(const std::string& archive_path, std::vector<Event>& events);
     
     // Start background compression thread
@@ -62,10 +66,17 @@ public:
 private:
     void compression_worker();
     
+    // Highest sequence covered by a valid archive_<sequence>.arc in kArchiveDir
+    SequenceID last_archived_sequence() const;
+    
+    static constexpr const char* kArchiveDir = ".";
+    
     EventStore* event_store_;
     CompressionStrategy strategy_ = CompressionStrategy::SNAPSHOT_ONLY;
     SequenceID compression_interval_ = 100000;  // Compress every 100k events
     SequenceID retention_sequence_ = 0;       // Keep events after this sequence
+    SequenceID archived_sequence_ = 0;        // Last sequence in an archive
+    bool archived_sequence_loaded_ = false;   // archived_sequence_ read from disk yet
     
     std::thread compression_thread_;
     std::atomic<bool> running_{false};
@@ -77,15 +88,18 @@ private:
 // 2. Distributed Event Store (分布式事件存储)
 // ============================================================================
 
-// Node ID for distributed storage
-using NodeID = uint32_t;
-
 // Distributed event store configuration
 struct DistributedEventStoreConfig {
     NodeID node_id;
     std::vector<NodeID> replica_nodes;  // Other nodes for replication
-    size_t replication_factor = 3;      // Number of replicas
+    size_t replication_factor = 3;      // Copies of each event, this node included
     bool enable_consensus = true;      // Enable consensus protocol
+    
+    // Primary: ships its log to replicas connecting to shipping.listen_address.
+    // Replica: follows primary_address; local appends are refused.
+    LogShipperConfig shipping;
+    std::string primary_address;
+    std::chrono::microseconds replication_timeout{1000000};
 };
 
 // Distributed event store
@@ -106,12 +120,22 @@ public:
     // Get events from specific node
     std::vector<Event> get_events_from_node(NodeID node_id, SequenceID from, SequenceID to) const;
     
-    // Replicate event to other nodes
+    // Wait until as many replicas as target_nodes hold an appended event
+    // (bounded by replication_timeout)
     bool replicate_event(const Event& event, const std::vector<NodeID>& target_nodes);
     
-    // Consensus: get majority consensus on event sequence
+    // Consensus: highest sequence held by a majority of replication_factor
+    // copies (this node and its replicas)
     SequenceID get_consensus_sequence() const;
     
+    // Highest sequence acknowledged by at least k replicas, and waiting
+    // for it (see LogShipper)
+    SequenceID replicated_sequence(size_t k) const;
+    bool wait_replicated(SequenceID sequence, size_t k, std::chrono::microseconds timeout) const;
+    
+    // Replica connections (primary only)
+    std::vector<ReplicaStatus> replica_status() const;
+    
     // Check if node is available
     bool is_node_available(NodeID node_id) const;
     
@@ -125,24 +149,40 @@ private:
     DistributedEventStoreConfig config_;
     std::unique_ptr<EventStore> local_store_;
     
-    // Node availability tracking
-    std::unordered_map<NodeID, bool> node_availability_;
-    mutable std::shared_mutex node_mutex_;
-    
-    // Replication queue
-    std::queue<Event> replication_queue_;
-    std::mutex replication_mutex_;
-    std::thread replication_thread_;
-    std::atomic<bool> replication_running_{false};
-    
-    void replication_worker();
+    // Log shipping (one of them, depending on the role)
+    std::unique_ptr<LogShipper> shipper_;
+    std::unique_ptr<LogReplica> follower_;
 };
 
 // ============================================================================
 // 3. Event Stream Processing (事件流处理)
 // ============================================================================
 
-// Event stream processor for real-time event processing
+// Event types and instrument a subscription wants, checked on the encoded
+// event before it is decoded
+struct EventSelector {
+    uint32_t types = UINT32_MAX;       // Bit per EventType
+    InstrumentID instrument_id = 0;    // 0 = every instrument
+    
+    static EventSelector of(std::initializer_list<EventType> types, InstrumentID instrument_id = 0) {
+        EventSelector selector;
+        selector.types = 0;
+        for (EventType type : types) {
+            selector.types |= 1u << static_cast<uint32_t>(type);
+        }
+        selector.instrument_id = instrument_id;
+        return selector;
+    }
+    
+    bool matches(const EventView& view) const {
+        return (types & (1u << static_cast<uint32_t>(view.type()))) != 0 &&
+               (instrument_id == 0 || view.instrument_id() == instrument_id);
+    }
+};
+
+// Event stream processor for real-time event processing. Every
+// subscription reads the store through its own EventCursor, normally from
+// the store's in-memory tail ring.
 class EventStreamProcessor {
 public:
     using EventHandler = std::function<void(const Event&)>;
@@ -151,9 +191,10 @@ public:
     EventStreamProcessor(EventStore* event_store);
     ~EventStreamProcessor();
     
-    // Subscribe to event stream
-    // Returns subscription ID
-    uint64_t subscribe(EventHandler handler, EventFilter filter = nullptr);
+    // Subscribe to event stream. The selector is applied before decoding,
+    // the filter to the decoded event. Returns subscription ID.
+    uint64_t subscribe(EventHandler handler, EventFilter filter = nullptr,
+                       EventSelector selector = EventSelector());
     
     // Unsubscribe
     void unsubscribe(uint64_t subscription_id);
@@ -178,6 +219,8 @@ private:
         uint64_t id;
         EventHandler handler;
         EventFilter filter;
+        EventSelector selector;
+        EventCursor cursor;
     };
     
     void processing_worker();
@@ -264,7 +307,11 @@ struct QueryResult {
 // Query handler (read-only, optimized for queries)
 class QueryHandler {
 public:
-    QueryHandler(EventStore* event_store);
+    // Orders held in the read model cache; past this the least recently
+    // touched order is dropped
+    static constexpr size_t kOrderCacheCapacity = 1 << 20;
+    
+    QueryHandler(EventStore* event_store, size_t order_cache_capacity = kOrderCacheCapacity);
     
     // Execute query
     QueryResult execute_query(const Query& query);
@@ -280,14 +327,27 @@ public:
 private:
     EventStore* event_store_;
     
-    // Read model cache (materialized views)
-    std::unordered_map<OrderID, Order> order_cache_;
+    // Read model cache (materialized views). Only open orders are kept:
+    // cancels, rejects and full fills evict, and lru_ caps the rest.
+    struct CachedOrder {
+        Order order;
+        std::list<OrderID>::iterator lru;
+    };
+    std::unordered_map<OrderID, CachedOrder> order_cache_;
+    std::list<OrderID> order_lru_;  // Most recently touched first
+    size_t order_cache_capacity_;
     std::unordered_map<InstrumentID, std::vector<PriceLevel>> orderbook_cache_;
     mutable std::shared_mutex cache_mutex_;
     
+    void cache_order(const Order& order);
+    void apply_fill(OrderID order_id, Quantity quantity);
+    void evict_order(OrderID order_id);
+    
 public:
     // Update cache from events (public for implementation)
     void update_cache_from_events(const std::vector<Event>& events);
+    
+    size_t cached_order_count() const;
 };
 
 // CQRS Manager
@@ -343,6 +403,27 @@ struct VersionedEvent {
     VersionedEvent migrate_to_version(EventVersion target_version) const;
 };
 
+// Migration of events of one type by one version step, in place, over a
+// contiguous array of decoded events
+using BatchMigrationFunc = std::function<void(Event* events, size_t count)>;
+
+// Migration between two versions of one event type, resolved once into
+// the steps to run. Applying it runs each step over the whole array, so
+// upcasting a batch costs one call per step instead of a lookup and a
+// call per event.
+struct UpcastPlan {
+    EventVersion from = 0;
+    EventVersion to = 0;
+    std::vector<BatchMigrationFunc> steps;  // In order; empty = nothing to change
+    
+    bool empty() const { return steps.empty(); }
+    void apply(Event* events, size_t count) const {
+        for (const auto& step : steps) {
+            step(events, count);
+        }
+    }
+};
+
 // Event version manager
 class EventVersionManager {
 public:
@@ -368,40 +449,93 @@ public:
                                                 EventVersion from, 
                                                 EventVersion to) const;
     
+    // Register migration function between adjacent versions. Steps with
+    // no migration registered leave the payload as it is.
+    using MigrationFunc = std::function<VersionedEvent(const VersionedEvent&)>;
+    void register_migration(EventType event_type, 
+                           EventVersion from_version, 
+                           EventVersion to_version,
+                           MigrationFunc migration);
+    void register_batch_migration(EventType event_type,
+                                  EventVersion from_version,
+                                  EventVersion to_version,
+                                  BatchMigrationFunc migration);
+    
+    // Resolve the migration path and its functions once, for upcasting
+    // many events
+    UpcastPlan plan_migration(EventType event_type, EventVersion from, EventVersion to) const;
+    
+    // Bumped by every registration, so cached plans can be checked
+    uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+    
 private:
     // Event type -> version -> schema
     std::unordered_map<EventType, std::map<EventVersion, EventSchema>> schemas_;
     std::unordered_map<EventType, EventVersion> current_versions_;
     mutable std::shared_mutex schema_mutex_;
     
-    // Migration functions
-    using MigrationFunc = std::function<VersionedEvent(const VersionedEvent&)>;
-    std::unordered_map<EventType, std::map<std::pair<EventVersion, EventVersion>, MigrationFunc>> migrations_;
-    
-    // Register migration function
-    void register_migration(EventType event_type, 
-                           EventVersion from_version, 
-                           EventVersion to_version,
-                           MigrationFunc migration);
+    // Migration functions (per-event ones are wrapped to run over batches)
+    std::unordered_map<EventType, std::map<std::pair<EventVersion, EventVersion>, BatchMigrationFunc>> migrations_;
+    std::atomic<uint64_t> generation_{0};
+};
+
+constexpr size_t kEventTypeCount = static_cast<size_t>(EventType::ORDER_FULLY_FILLED) + 1;
+
+// Schema versions events were written with, from first_sequence until the
+// next run. A run starts whenever any event type's version changes, so a
+// log holds a handful of runs and versions are resolved once per run.
+struct EventVersionRun {
+    SequenceID first_sequence;
+    EventVersion versions[kEventTypeCount];
 };
 
 // Versioned event store (extends EventStore with versioning)
+//
+// The journal carries no schema version per event; the store keeps the
+// version runs in <data_dir>/event_versions instead. Reads decode events
+// into batches that never span two runs and upcast each batch per event
+// type with the plan resolved for its run.
 class VersionedEventStore : public EventStore {
 public:
+    static constexpr size_t kUpcastBatchSize = 1024;
+    
     VersionedEventStore();
     
-    // Append versioned event
+    // Open the store and its version runs
+    bool initialize(const std::string& data_dir,
+                    const EventStoreConfig& config = EventStoreConfig()) override;
+    
+    // Append versioned event. A version differing from the current run's
+    // starts a new run at the next sequence.
     bool append_versioned_event(const VersionedEvent& event);
     
-    // Get events with version migration
+    // Get events with version migration (target 0 = each type's current version)
     std::vector<VersionedEvent> get_versioned_events(SequenceID from, SequenceID to, 
                                                      EventVersion target_version = 0) const;
     
+    // Replay [from, to] upcast to target_version (0 = each type's current
+    // version), handing the events over in batches of up to batch_size.
+    // Handler returns false to stop.
+    bool replay_upcast(SequenceID from, SequenceID to, EventVersion target_version,
+                       const std::function<bool(const Event* events, size_t count)>& handler,
+                       size_t batch_size = kUpcastBatchSize) const;
+    
+    // Version event_type events were written with at sequence
+    EventVersion version_at(SequenceID sequence, EventType event_type) const;
+    
+    std::vector<EventVersionRun> version_runs() const;
+    
     // Set version manager
     void set_version_manager(EventVersionManager* manager) { version_manager_ = manager; }
     
 private:
+    bool load_version_runs();
+    bool write_version_runs() const;
+    
     EventVersionManager* version_manager_ = nullptr;
+    std::string version_runs_path_;
+    std::vector<EventVersionRun> version_runs_;    // By first_sequence; never empty
+    mutable std::shared_mutex version_runs_mutex_;
 };
 
 } // namespace perpetual
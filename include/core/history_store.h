@@ -0,0 +1,150 @@
+#pragma once
+
+#include "types.h"
+#include "order.h"
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace perpetual {
+
+// ============================================================================
+// Embedded, append-only columnar history of trades, orders, balances and
+// positions (the local backend of DatabaseManager)
+//
+// Each table is a directory of immutable segment files plus a row log:
+//
+//   <table>/active.log       Rows appended since the last seal, in arrival
+//                            order; replayed into memory on open.
+//   <table>/<partition>-<epoch>.hseg
+//                            Rows of one time partition, sorted by (time,
+//                            id) and stored column by column, with a zone
+//                            map (min/max time and id) and posting lists
+//                            (user -> rows, and instrument -> rows).
+//   commit.pending           A committed transaction's rows for every table,
+//                            kept until all the row logs hold them.
+//
+// A time partition covers partition_span nanoseconds. Buffered rows are
+// sealed into one segment per partition they touch once seal_rows rows are
+// buffered, when time moves on to a new partition, and on close. A query
+// over a time range opens only the partitions in that range and, inside
+// them, only the segments whose zone maps overlap it; user and instrument
+// lookups then read just the rows their posting lists name.
+//
+// Rows are never changed in place: a later row for the same order, balance
+// or position supersedes the earlier ones. Queries may run concurrently
+// with each other and with appends.
+// ============================================================================
+
+struct HistoryStoreConfig {
+    int64_t partition_span = 3600LL * 1000000000LL;   // One hour of history per partition
+    size_t seal_rows = 256 * 1024;                   // Buffered rows per table before sealing
+};
+
+// Order fields kept in the history (no book links)
+struct OrderHistoryRow {
+    OrderID order_id;
+    UserID user_id;
+    InstrumentID instrument_id;
+    OrderSide side;
+    OrderType order_type;
+    OffsetFlag offset_flag;
+    OrderStatus status;
+    PositionSide position_side;
+    Price price;
+    Quantity quantity;
+    Quantity filled_quantity;
+    Quantity remaining_quantity;
+    Timestamp timestamp;        // Placement time: every revision of an order shares its partition
+    SequenceID sequence_id;
+};
+
+struct AccountHistoryRow {
+    UserID user_id;
+    double balance;
+    double frozen;
+    double margin;
+    int64_t timestamp;
+};
+
+struct PositionHistoryRow {
+    UserID user_id;
+    InstrumentID instrument_id;
+    Quantity size;
+    Price entry_price;
+    int64_t timestamp;
+};
+
+// Time bounds of the history queries are inclusive
+constexpr int64_t kHistoryBeginning = INT64_MIN;
+constexpr int64_t kHistoryEnd = INT64_MAX;
+
+class HistoryStore {
+public:
+    explicit HistoryStore(const HistoryStoreConfig& config = HistoryStoreConfig());
+    ~HistoryStore();
+
+    HistoryStore(const HistoryStore&) = delete;
+    HistoryStore& operator=(const HistoryStore&) = delete;
+
+    bool open(const std::string& dir);
+    void close();       // Seals what is buffered
+    bool is_open() const { return open_; }
+
+    // Appends are buffered; flush() makes them durable
+    bool append_trade(const Trade& trade);
+    bool append_order(const Order& order);
+    bool append_account(const AccountHistoryRow& row);
+    bool append_position(const PositionHistoryRow& row);
+    bool flush();
+
+    // Seal every table's buffered rows into segments now
+    bool seal();
+
+    // Appends made inside a transaction are held back until commit, which
+    // writes them to every table at once: a crash part way through the
+    // commit is completed on the next open, and no query sees some
+    // tables' rows without the others'
+    void begin_transaction();
+    bool commit_transaction();
+    void rollback_transaction();
+
+    // Trades a user was either side of, oldest first
+    std::vector<Trade> trades_by_user(UserID user_id, int64_t start_time, int64_t end_time) const;
+    std::vector<Trade> trades_by_instrument(InstrumentID instrument_id, int64_t start_time,
+                                            int64_t end_time) const;
+
+    // Latest revision of each of a user's orders placed in the range, newest first
+    std::vector<OrderHistoryRow> orders_by_user(UserID user_id, int64_t start_time,
+                                                int64_t end_time) const;
+    bool find_order(OrderID order_id, OrderHistoryRow& row) const;
+
+    // Newest row at or before timestamp
+    bool account_at(UserID user_id, int64_t timestamp, AccountHistoryRow& row) const;
+    std::vector<AccountHistoryRow> account_history(UserID user_id, int64_t start_time,
+                                                   int64_t end_time) const;
+    bool position_at(UserID user_id, InstrumentID instrument_id, int64_t timestamp,
+                     PositionHistoryRow& row) const;
+    std::vector<PositionHistoryRow> position_history(UserID user_id, InstrumentID instrument_id,
+                                                     int64_t start_time, int64_t end_time) const;
+
+    // Segments opened by queries so far (how well partitions and zone maps prune)
+    uint64_t segments_scanned() const;
+    size_t segment_count() const;
+
+private:
+    class Table;
+
+    HistoryStoreConfig config_;
+    std::unique_ptr<Table> trades_;
+    std::unique_ptr<Table> orders_;
+    std::unique_ptr<Table> accounts_;
+    std::unique_ptr<Table> positions_;
+    std::string dir_;
+    bool open_ = false;
+};
+
+} // namespace perpetual
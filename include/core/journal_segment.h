@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace perpetual {
+
+// CRC32C (Castagnoli). Uses the SSE4.2 instruction when compiled in.
+uint32_t crc32c(const void* data, size_t length, uint32_t crc = 0);
+
+// 64-bit non-cryptographic hash (XXH64). Fast enough to run over every
+// record; seeding it with a previous result chains hashes together.
+uint64_t hash64(const void* data, size_t length, uint64_t seed = 0);
+
+// ============================================================================
+// Segmented journal layout
+//
+// A segmented journal is a directory of fixed-size files named
+// <segment id>.seg. Segments are preallocated and zero-filled before the
+// writer reaches them, so commits never change file size or extent state and
+// fdatasync only has data to flush.
+//
+// Records are framed with JournalRecordHeader. A record never crosses a
+// segment, and every commit is padded to a block boundary so O_DIRECT
+// writes stay aligned: a PADDING record when the gap can hold a header,
+// otherwise the gap is skipped implicitly. The end of the log is the first
+// header that is zero, fails its CRC, or carries an older epoch than the
+// record before it (stale data from a previous writer after a crash).
+// ============================================================================
+
+constexpr size_t kJournalBlockSize = 4096;
+
+enum class JournalRecordKind : uint16_t {
+    DATA = 1,
+    PADDING = 2    // Skipped by readers; payload is not checksummed
+};
+
+struct JournalRecordHeader {
+    uint32_t crc;        // CRC32C over the fields below and (DATA only) the payload
+    uint32_t length;     // Payload bytes following the header
+    uint16_t kind;
+    uint16_t reserved;
+    uint32_t epoch;      // Writer generation, bumped on every open
+};
+
+static_assert(sizeof(JournalRecordHeader) == 16, "journal record header must be 16 bytes");
+
+// Checksum of a record (header fields after crc, then payload)
+uint32_t journal_record_crc(const JournalRecordHeader& header, const char* payload);
+
+std::string journal_segment_path(const std::string& dir, uint64_t segment_id);
+
+// Ids of all complete segments in dir, ascending
+std::vector<uint64_t> list_journal_segments(const std::string& dir);
+
+// fsync a directory so renames and new entries in it are durable
+void sync_directory(const std::string& dir);
+
+// Replace path with data durably: written to a temporary file, synced,
+// renamed over path and the directory synced
+bool write_file_atomic(const std::string& path, const void* data, size_t length);
+
+struct JournalPosition {
+    uint64_t segment = 0;
+    uint64_t offset = 0;
+};
+
+// Creates preallocated, zero-filled segments ahead of the writer on a
+// background thread. Segments are built under a temporary name and renamed
+// into place once synced, so a crash never leaves a short segment behind.
+class SegmentPreallocator {
+public:
+    SegmentPreallocator(const std::string& dir, uint64_t segment_bytes, size_t segments_ahead);
+    ~SegmentPreallocator();
+
+    // Begin preparing segments from first_missing on; ids below it must exist
+    void start(uint64_t first_missing);
+    void stop();
+
+    // Wait until segment_id is ready. Returns false if preparation failed.
+    // A rotation that has to wait is counted as a stall.
+    bool acquire(uint64_t segment_id, bool rotation = true);
+
+    uint64_t stalls() const { return stalls_.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+    bool prepare(uint64_t segment_id);
+
+    std::string dir_;
+    uint64_t segment_bytes_;
+    size_t segments_ahead_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool running_ = false;
+    bool failed_ = false;
+    uint64_t ready_id_ = 0;        // Highest segment known to be complete
+    uint64_t wanted_id_ = 0;       // Highest segment the writer has asked for
+    std::atomic<uint64_t> stalls_{0};
+};
+
+// Sequential reader over the DATA records of a segmented journal. Segments
+// are memory-mapped (pread into a window if mmap fails) and records are
+// returned in place, without copying.
+class JournalReader {
+public:
+    explicit JournalReader(const std::string& dir);
+    ~JournalReader();
+
+    JournalReader(const JournalReader&) = delete;
+    JournalReader& operator=(const JournalReader&) = delete;
+
+    // Next DATA record. The pointer stays valid until the reader moves to
+    // another segment (at the latest until the following call).
+    // Returns false at the end of the log.
+    bool next(const char*& data, size_t& length);
+
+    // Continue reading at a record position previously reported by the
+    // writer or by record_position(). Returns false if the segment is gone.
+    bool seek(const JournalPosition& position);
+
+    // Keep reading after next() reported the end of a log another process
+    // is still appending to: the position and epoch are kept, segments the
+    // writer created since are picked up, and nothing cached is trusted.
+    void resume();
+
+    // Position of the record returned by the last next()
+    JournalPosition record_position() const { return record_position_; }
+
+    // Where the writer resumes once the log has ended. A torn write leaves
+    // this in the middle of a block, which the writer then rewrites.
+    JournalPosition tail() const;
+
+    // Epoch of the last valid record (0 for an empty log)
+    uint32_t last_epoch() const { return epoch_; }
+
+    bool empty() const { return segments_.empty(); }
+
+private:
+    bool open_segment(size_t index);
+    void close_segment();
+    const char* fetch(uint64_t offset, size_t length);
+
+    std::string dir_;
+    std::vector<uint64_t> segments_;
+    size_t segment_index_ = 0;
+    int fd_ = -1;
+    const char* map_ = nullptr;    // Whole current segment, or nullptr
+    uint64_t segment_size_ = 0;
+    uint64_t offset_ = 0;
+    uint32_t epoch_ = 0;
+    bool ended_ = false;
+    JournalPosition record_position_;
+
+    std::vector<char> buffer_;
+    uint64_t buffer_offset_ = 0;   // File offset of buffer_[0]
+    size_t buffer_length_ = 0;
+};
+
+} // namespace perpetual
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "journal_segment.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace perpetual {
+
+// Journal I/O backend
+enum class JournalBackend : uint8_t {
+    AUTO = 0,       // io_uring if the kernel supports it, otherwise pwrite
+    PWRITE = 1,     // Blocking pwrite + fdatasync on the committing thread
+    IO_URING = 2    // Registered buffers, linked write+fsync, batches in flight
+};
+
+struct JournalWriterConfig {
+    JournalBackend backend = JournalBackend::AUTO;
+    size_t batch_bytes = 1 << 20;     // Capacity of one batch buffer (1MB)
+    size_t max_in_flight = 4;         // Batches being made durable concurrently
+    bool sync_on_commit = true;       // fdatasync after every batch write
+    
+    // Segmented journals (segment_bytes > 0): open() takes a directory of
+    // preallocated fixed-size segments and records are CRC-framed
+    uint64_t segment_bytes = 0;
+    size_t segments_ahead = 2;        // Segments kept preallocated ahead of the writer
+    bool direct_io = false;           // O_DIRECT writes (segmented journals only)
+};
+
+// Parse "auto" / "pwrite" / "io_uring" (used by persistence.journal_backend)
+JournalBackend parse_journal_backend(const std::string& name);
+
+// Append-only journal writer with group commit
+//
+// Records are appended into a batch buffer; commit() hands the batch to the
+// backend which writes and syncs it while the caller keeps filling the next
+// buffer. Every appended record gets a 1-based record number, and
+// durable_record() is the watermark below which all records are on disk.
+//
+// Threading: append/reserve/commit must be serialized by the caller (one
+// journaling thread or an external mutex). durable_record() and
+// wait_durable() may be called from any thread.
+class JournalWriter {
+public:
+    struct Stats {
+        uint64_t records_appended = 0;
+        uint64_t batches_committed = 0;
+        uint64_t bytes_written = 0;
+        uint64_t durable_record = 0;
+        uint64_t write_errors = 0;
+        uint64_t segment_rolls = 0;
+        uint64_t preallocation_stalls = 0;   // Rolls that waited for a segment
+    };
+
+    // Create a writer for the configured backend. AUTO (and IO_URING when the
+    // kernel refuses the ring, here or when the journal is opened) fall back
+    // to the pwrite backend.
+    static std::unique_ptr<JournalWriter> create(
+        const JournalWriterConfig& config = JournalWriterConfig());
+
+    virtual ~JournalWriter();
+
+    // Open (or create) a journal file and position at its end. Segmented
+    // journals take a directory and resume after the last valid record;
+    // resume_from (a known-valid record, e.g. from an index checkpoint)
+    // lets the tail search skip everything before it.
+    bool open(const std::string& path, const JournalPosition& resume_from = JournalPosition());
+
+    // Close the file after committing and draining all batches
+    void close();
+
+    bool is_open() const { return fd_ >= 0; }
+
+    // Reserve len bytes for one record in the current batch. The caller
+    // writes exactly len bytes at the returned pointer. Returns nullptr if
+    // len exceeds the batch capacity or the journal has failed.
+    char* reserve(size_t len);
+
+    // Append one record (reserve + memcpy). Returns its record number, 0 on error.
+    uint64_t append(const void* data, size_t len);
+    
+    // Where the record from the last reserve()/append() starts (segment 0
+    // for single-file journals); readers can seek() straight to it
+    JournalPosition last_position() const { return last_position_; }
+
+    // Submit the current batch (write + sync). Returns the last record
+    // number included in the batch (the last appended record).
+    uint64_t commit();
+
+    // Block until every record <= record is durable.
+    // Returns false if record was never committed, or if it is at or after
+    // the first record of a batch that failed (the watermark stops there).
+    bool wait_durable(uint64_t record);
+
+    // Commit and wait for everything appended so far
+    bool sync();
+
+    uint64_t durable_record() const { return durable_record_.load(std::memory_order_acquire); }
+
+    // Called with the new watermark after every group commit that advances
+    // it, and when the journal fails. Runs on whichever thread completes the
+    // batch (the committing thread for pwrite, the completion thread for
+    // io_uring), so it must be quick. Set before the first append.
+    void set_durable_listener(std::function<void(uint64_t)> listener) {
+        durable_listener_ = std::move(listener);
+    }
+    uint64_t appended_record() const { return appended_record_; }
+    uint64_t committed_record() const { return committed_record_.load(std::memory_order_acquire); }
+
+    // Logical end of the file (of the current segment when segmented)
+    // including bytes not yet committed
+    uint64_t offset() const { return file_offset_ + (current_ ? current_->length : 0); }
+
+    // Bytes sitting in the current (uncommitted) batch
+    size_t pending_bytes() const { return current_ ? current_->length : 0; }
+
+    bool healthy() const { return !failed_.load(std::memory_order_acquire); }
+
+    // Largest record reserve() accepts
+    size_t batch_capacity() const {
+        return segmented() ? config_.batch_bytes - sizeof(JournalRecordHeader) : config_.batch_bytes;
+    }
+
+    bool segmented() const { return config_.segment_bytes > 0; }
+
+    Stats get_stats() const;
+
+    virtual const char* backend_name() const = 0;
+
+protected:
+    enum class BatchState : uint8_t {
+        FREE = 0,
+        FILLING = 1,
+        IN_FLIGHT = 2,
+        DONE = 3
+    };
+
+    struct Batch {
+        char* data = nullptr;
+        size_t length = 0;
+        int fd = -1;
+        uint64_t offset = 0;
+        uint64_t first_record = 0;
+        uint64_t last_record = 0;
+        uint16_t index = 0;
+        BatchState state = BatchState::FREE;
+        bool ok = true;
+    };
+
+    explicit JournalWriter(const JournalWriterConfig& config);
+
+    // Backend hooks
+    virtual bool start() { return true; }          // Called once buffers exist
+    virtual void stop() {}                         // Called after draining
+    virtual bool submit(Batch& batch) = 0;         // Write + sync (may complete later)
+
+    // Backend reports a finished batch (any thread). Advances the
+    // durability watermark over contiguous finished batches.
+    void complete_batch(Batch& batch, bool ok);
+
+    // Write + sync a whole batch on the calling thread and complete it
+    bool submit_sync(Batch& batch);
+
+    // Synchronous write + sync of a batch range (pwrite backend and fallbacks)
+    bool write_and_sync(int fd, const char* data, size_t length, uint64_t offset);
+
+    const JournalWriterConfig& config() const { return config_; }
+    std::vector<Batch>& batches() { return batches_; }
+
+private:
+    bool allocate_buffers();
+    Batch* acquire_batch();
+    void drain();
+    
+    bool open_file(const std::string& path);
+    bool open_segments(const std::string& dir, const JournalPosition& resume_from);
+    int open_segment_file(uint64_t segment_id, uint64_t& size);
+    bool roll_segment();
+    void close_sealed_segments(bool all);
+    
+    // Framing (segmented journals). Headers never start in the last bytes
+    // of a block where readers expect an implicit gap.
+    size_t header_gap() const;
+    void skip_header_gap();
+    void finalize_record();
+    void append_padding(size_t payload);
+    void pad_to_block();
+
+    JournalWriterConfig config_;
+    int fd_ = -1;
+    uint64_t file_offset_ = 0;     // Offset where the current batch starts
+
+    std::vector<Batch> batches_;
+    Batch* current_ = nullptr;
+    size_t next_batch_ = 0;        // Round-robin slot for the next batch
+    size_t retire_batch_ = 0;      // Oldest slot not yet retired
+
+    uint64_t appended_record_ = 0;
+    JournalPosition last_position_;
+    std::atomic<uint64_t> committed_record_{0};
+    std::atomic<uint64_t> durable_record_{0};
+    std::atomic<bool> failed_{false};
+    uint64_t failed_record_ = UINT64_MAX;   // First record that can never become durable (state_mutex_)
+    std::function<void(uint64_t)> durable_listener_;
+
+    mutable std::mutex state_mutex_;
+    std::condition_variable state_cv_;
+    Stats stats_;
+    
+    // Segmented journal state
+    std::string dir_;
+    uint64_t segment_id_ = 0;
+    uint64_t segment_size_ = 0;
+    uint32_t epoch_ = 0;
+    size_t open_record_ = SIZE_MAX;      // Batch offset of the record awaiting its CRC
+    std::unique_ptr<SegmentPreallocator> preallocator_;
+    std::vector<int> sealed_fds_;        // Previous segments with writes still in flight
+};
+
+} // namespace perpetual
@@ -2,6 +2,7 @@
 
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <thread>
 #ifdef __APPLE__
 #include <mach/thread_policy.h>
@@ -73,6 +74,9 @@ public:
         return (write - read) & mask_;
     }
     
+    // One slot stays free to tell a full queue from an empty one
+    size_t capacity() const { return capacity_ - 1; }
+    
 private:
     T* buffer_;
     size_t capacity_;
@@ -81,7 +85,9 @@ private:
     alignas(64) std::atomic<size_t> read_pos_;   // Cache line aligned
 };
 
-// Lock-free multi-producer multi-consumer queue (using CAS)
+// Lock-free bounded multi-producer multi-consumer queue. Items are stored
+// in place (no allocation per item); each slot carries a sequence number
+// that tells producers and consumers whose turn it is.
 template<typename T>
 class LockFreeMPMCQueue {
 public:
@@ -95,9 +101,9 @@ public:
             mask_ = capacity_ - 1;
         }
         
-        buffer_ = new std::atomic<T*>[capacity_];
+        slots_ = new Slot[capacity_];
         for (size_t i = 0; i < capacity_; ++i) {
-            buffer_[i].store(nullptr, std::memory_order_relaxed);
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
         }
         
         write_pos_.store(0, std::memory_order_relaxed);
@@ -105,44 +111,69 @@ public:
     }
     
     ~LockFreeMPMCQueue() {
-        delete[] buffer_;
+        delete[] slots_;
     }
     
+    // Returns false if the queue is full
     bool push(const T& item) {
-        T* item_ptr = new T(item);
-        size_t pos = write_pos_.fetch_add(1, std::memory_order_relaxed);
-        size_t index = pos & mask_;
-        
-        // Wait until slot is available
-        T* expected = nullptr;
-        while (!buffer_[index].compare_exchange_weak(expected, item_ptr,
-                                                     std::memory_order_release,
-                                                     std::memory_order_relaxed)) {
-            expected = nullptr;
-            std::this_thread::yield();
+        size_t pos = write_pos_.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots_[pos & mask_];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (write_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.item = item;
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Queue full
+            } else {
+                pos = write_pos_.load(std::memory_order_relaxed);
+            }
         }
-        
-        return true;
     }
     
+    // Returns false if the queue is empty
     bool pop(T& item) {
-        size_t pos = read_pos_.fetch_add(1, std::memory_order_relaxed);
-        size_t index = pos & mask_;
-        
-        // Wait until item is available
-        T* item_ptr = nullptr;
-        while (!(item_ptr = buffer_[index].exchange(nullptr,
-                                                    std::memory_order_acquire))) {
-            std::this_thread::yield();
+        size_t pos = read_pos_.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots_[pos & mask_];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (read_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    item = slot.item;
+                    slot.sequence.store(pos + capacity_, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Queue empty
+            } else {
+                pos = read_pos_.load(std::memory_order_relaxed);
+            }
         }
-        
-        item = *item_ptr;
-        delete item_ptr;
-        return true;
     }
     
+    // Approximate while producers or consumers are active
+    size_t size() const {
+        size_t write = write_pos_.load(std::memory_order_acquire);
+        size_t read = read_pos_.load(std::memory_order_acquire);
+        return write > read ? write - read : 0;
+    }
+    
+    bool empty() const { return size() == 0; }
+    
+    size_t capacity() const { return capacity_; }
+    
 private:
-    std::atomic<T*>* buffer_;
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+    
+    Slot* slots_;
     size_t capacity_;
     size_t mask_;
     alignas(64) std::atomic<size_t> write_pos_;
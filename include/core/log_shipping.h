@@ -0,0 +1,193 @@
+#pragma once
+
+#include "event_sourcing.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+namespace perpetual {
+
+// ============================================================================
+// Event log shipping
+//
+// The primary streams the encoded events of its EventStore (the bytes the
+// journal holds) to replica processes over TCP or Unix-domain sockets.
+// Events are cut into batches as they are appended; each replica has up to
+// max_in_flight batches outstanding and acknowledges the last sequence it
+// has applied (and made durable). A replica that connects behind the
+// in-memory window is caught up from the primary's log first.
+//
+// Addresses are "unix:<path>" or "<host>:<port>".
+//
+// Frames: ShipFrameHeader followed by length payload bytes. A BATCH payload
+// is count x { uint32_t length; encoded event }.
+// ============================================================================
+
+using NodeID = uint32_t;
+
+enum class ShipFrameKind : uint16_t {
+    HELLO = 1,    // Replica -> primary: node, last_sequence it holds
+    BATCH = 2,    // Primary -> replica: events first_sequence..last_sequence
+    ACK = 3       // Replica -> primary: applied through last_sequence
+};
+
+#pragma pack(push, 1)
+struct ShipFrameHeader {
+    uint32_t magic;
+    uint16_t kind;
+    uint16_t reserved;
+    NodeID node;
+    uint32_t count;
+    SequenceID first_sequence;
+    SequenceID last_sequence;
+    uint32_t length;
+    uint32_t crc;               // CRC32C of the payload
+};
+#pragma pack(pop)
+
+constexpr uint32_t kShipFrameMagic = 0x50494853;   // "SHIP"
+
+struct LogShipperConfig {
+    std::string listen_address;
+    size_t batch_bytes = 64 * 1024;           // Seal a batch at this size
+    size_t max_in_flight = 8;                 // Unacknowledged batches per replica
+    size_t window_bytes = 64 * 1024 * 1024;   // Sealed batches kept for replicas
+};
+
+struct ReplicaStatus {
+    NodeID node = 0;
+    bool connected = false;
+    SequenceID acked_sequence = 0;
+    size_t in_flight = 0;
+    uint64_t batches_sent = 0;
+};
+
+// Primary side: accepts replicas and ships the events appended to a store
+class LogShipper {
+public:
+    LogShipper() = default;
+    ~LogShipper();
+
+    LogShipper(const LogShipper&) = delete;
+    LogShipper& operator=(const LogShipper&) = delete;
+
+    // Listen and install the store's append listener
+    bool start(EventStore* store, const LogShipperConfig& config);
+    void stop();
+
+    // Highest sequence acknowledged by at least k replicas (0 if none)
+    SequenceID replicated_sequence(size_t k) const;
+
+    // Block until k replicas acknowledged sequence. False on timeout.
+    bool wait_replicated(SequenceID sequence, size_t k, std::chrono::microseconds timeout) const;
+
+    bool is_connected(NodeID node) const;
+    std::vector<ReplicaStatus> replicas() const;
+
+    uint64_t batches_sealed() const { return batches_sealed_.load(std::memory_order_relaxed); }
+    uint64_t bytes_shipped() const { return bytes_shipped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Batch {
+        SequenceID prev_sequence;   // Event before the batch in log order
+        SequenceID last_sequence;
+        std::string frame;          // Header and payload
+    };
+
+    struct Replica {
+        int fd = -1;
+        ReplicaStatus status;
+        bool hello = false;
+        SequenceID sent_sequence = 0;               // Last sequence queued to the socket
+        std::deque<SequenceID> in_flight;           // last_sequence of unacked batches
+        std::shared_ptr<const Batch> sending;       // Frame being written
+        size_t sent_bytes = 0;
+        std::string input;                          // Partial frames from the replica
+    };
+
+    // Append listener (runs under the store's append lock)
+    void on_append(const EventView& view);
+
+    void run();
+    void accept_replicas();
+    bool read_replica(Replica& replica);
+    bool write_replica(Replica& replica);
+    void schedule(Replica& replica);
+    void seal();
+    std::shared_ptr<const Batch> catch_up_batch(SequenceID after, SequenceID through) const;
+    void trim_window();
+    void wake();
+
+    EventStore* store_ = nullptr;
+    LogShipperConfig config_;
+    int listen_fd_ = -1;
+    int wake_fd_ = -1;
+    std::string unix_path_;
+
+    // Batch being filled by appends
+    std::mutex open_mutex_;
+    std::string open_;
+    SequenceID open_first_ = 0;
+    SequenceID open_last_ = 0;
+    uint32_t open_count_ = 0;
+    SequenceID sealed_sequence_ = 0;    // Last sequence in a sealed batch
+
+    // Sealed batches still needed by some replica (shipper thread only)
+    std::deque<std::shared_ptr<const Batch>> window_;
+    size_t window_size_ = 0;
+
+    std::vector<std::unique_ptr<Replica>> replicas_;
+    mutable std::mutex status_mutex_;               // Guards status of replicas_
+    mutable std::condition_variable ack_cv_;
+
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::atomic<uint64_t> batches_sealed_{0};
+    std::atomic<uint64_t> bytes_shipped_{0};
+};
+
+struct LogReplicaConfig {
+    std::string primary_address;
+    NodeID node_id = 0;
+    bool durable_ack = true;          // Acknowledge only after the local flush
+    uint32_t reconnect_ms = 100;
+};
+
+// Replica side: follows a primary and appends what it ships to a store
+class LogReplica {
+public:
+    LogReplica() = default;
+    ~LogReplica();
+
+    LogReplica(const LogReplica&) = delete;
+    LogReplica& operator=(const LogReplica&) = delete;
+
+    bool start(EventStore* store, const LogReplicaConfig& config);
+    void stop();
+
+    SequenceID applied_sequence() const { return store_ ? store_->get_latest_sequence() : 0; }
+    bool connected() const { return connected_.load(std::memory_order_acquire); }
+    uint64_t batches_applied() const { return batches_applied_.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+    bool follow(int fd);
+    bool apply_batch(const ShipFrameHeader& header, const char* payload);
+
+    EventStore* store_ = nullptr;
+    LogReplicaConfig config_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> connected_{false};
+    std::atomic<uint64_t> batches_applied_{0};
+};
+
+} // namespace perpetual
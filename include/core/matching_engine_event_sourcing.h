@@ -4,13 +4,26 @@
 #include "event_sourcing.h"
 #include "deterministic_calculator.h"
 #include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
 
 namespace perpetual {
 
+// How create_snapshot() captures state
+enum class SnapshotMode : uint8_t {
+    INLINE = 0,   // Serialize and write on the calling (matcher) thread
+    FORK = 1      // fork(); the child serializes a copy-on-write image
+};
+
 // Matching Engine with Event Sourcing and Deterministic Calculation
 // This version emits all events to EventStore and uses deterministic calculations
 class MatchingEngineEventSourcing : public MatchingEngine {
 public:
+    // A non-null event_store is borrowed, not owned: the caller keeps it
+    // alive (and flushes it) for as long as the engine exists. Without
+    // one, initialize() opens a store the engine owns.
     MatchingEngineEventSourcing(InstrumentID instrument_id, 
                                 EventStore* event_store = nullptr);
     ~MatchingEngineEventSourcing();
@@ -24,11 +37,77 @@ public:
     // Cancel order with event sourcing
     bool cancel_order_es(OrderID order_id, UserID user_id);
     
-    // Replay events to rebuild state
+    // Replay events to rebuild state (applies events without re-publishing)
     bool replay_events(SequenceID from = 0, SequenceID to = UINT64_MAX);
     
+    // Apply one stored event (orders of other instruments are ignored)
+    bool apply_event(const Event& event);
+    
+    // Replay into engines of different instruments sharing one event
+    // store: segments are decoded in parallel and each engine is fed its
+    // own instrument's events on a worker thread. Cancels without an
+    // instrument (older logs) are applied in global order on every engine.
+    static bool replay_parallel(const std::vector<MatchingEngineEventSourcing*>& engines,
+                                SequenceID from = 0, SequenceID to = UINT64_MAX);
+    
+    // Binary snapshot of the engine state (resting orders per level in
+    // priority order, counters), tagged with the last applied sequence.
+    // Everything up to that sequence is flushed to the event store first.
+    bool create_snapshot(const std::string& snapshot_path);
+    
+    // Snapshot into <event store dir>/snapshots, keeping the newest few.
+    // In FORK mode the matcher only pauses for fork(); the snapshot is
+    // published in the background once the log is durable up to it.
+    // Returns false if a background snapshot is still running.
+    bool create_snapshot();
+    
+    void set_snapshot_mode(SnapshotMode mode) { snapshot_mode_ = mode; }
+    bool snapshot_in_progress() const { return snapshot_running_.load(); }
+    
+    // Wait for a background snapshot; returns whether it was published
+    bool wait_for_snapshot();
+    
+    // Time the matcher was stopped for the last snapshot (also reported as
+    // the snapshot_pause_us histogram)
+    uint64_t last_snapshot_pause_us() const { return last_snapshot_pause_us_.load(); }
+    
+    // Replace the engine state with a snapshot's
+    bool load_snapshot(const std::string& snapshot_path, SequenceID& sequence);
+    
+    // Load the newest valid snapshot and replay only the events after it
+    // (everything when there is no snapshot)
+    bool recover();
+    
+    // recover() for engines sharing one event store: each loads its own
+    // snapshot, then a single parallel replay covers every engine's tail
+    static bool recover_parallel(const std::vector<MatchingEngineEventSourcing*>& engines);
+    
+    // Hot standby: follow the event log another process writes to data_dir
+    // (EventStore follower mode) and apply it to this engine's book,
+    // starting from the newest snapshot there. The log is either shared
+    // with the primary on local storage or kept current by a LogReplica
+    // appending to a store in data_dir. The book must not be touched
+    // until promote().
+    bool start_standby(const std::string& data_dir);
+    bool is_standby() const { return standby_running_.load(); }
+    
+    // Sequence of the last stored event applied to the book (by the
+    // standby, recovery or promotion)
+    SequenceID applied_sequence() const { return applied_sequence_.load(std::memory_order_acquire); }
+    
+    // Events logged in data_dir that the standby has not applied yet.
+    // Approximate: the head is taken from the sparse index.
+    SequenceID standby_lag() const;
+    
+    // Become the primary: apply the rest of the log, stop following, then
+    // take the log over for writing and publish events from here on. The
+    // old primary must have stopped writing. With a LogReplica feeding
+    // data_dir, stop it and pass its store instead. Time taken is reported
+    // as the standby_promote_us histogram.
+    bool promote(EventStore* store = nullptr);
+    
     // Get event store
-    EventStore* get_event_store() const { return event_store_.get(); }
+    EventStore* get_event_store() const { return event_store_; }
     
     // Get event publisher
     EventPublisher* get_event_publisher() const { return event_publisher_.get(); }
@@ -55,15 +134,54 @@ private:
     void emit_order_matched_event(OrderID taker_id, OrderID maker_id,
                                   Price price, Quantity quantity);
     void emit_order_cancelled_event(OrderID order_id, UserID user_id,
-                                    OrderStatus old_status, OrderStatus new_status);
+                                    OrderStatus old_status, OrderStatus new_status,
+                                    InstrumentID instrument_id = 0);
     void emit_trade_executed_event(const Trade& trade);
     void emit_order_rejected_event(OrderID order_id, UserID user_id,
                                    const std::string& reason);
     
-    std::unique_ptr<EventStore> event_store_;
+    // Snapshot state encoding
+    std::string serialize_state() const;
+    bool restore_state(const std::string& state);
+    void clear_state();
+    bool load_latest_snapshot(SequenceID& sequence);
+    
+    // Parallel replay; engine i skips events at or below applied[i]
+    static bool replay_engines(const std::vector<MatchingEngineEventSourcing*>& engines,
+                               SequenceID from, SequenceID to,
+                               const std::vector<SequenceID>& applied);
+    std::string snapshot_dir() const;
+    std::string next_snapshot_path() const;
+    void prune_snapshots() const;
+    bool fork_snapshot(const std::string& path);
+    void record_snapshot_pause(std::chrono::steady_clock::time_point start);
+    
+    // Standby thread: apply events as the primary logs them
+    void standby_loop();
+    void stop_standby();
+    
+    // Orders created by replay or restore are owned by the engine (orders_)
+    void adopt_order(std::unique_ptr<Order> order);
+    void release_if_owned(Order* order);
+    
+    EventStore* event_store_ = nullptr;       // Shared with other engines or owned below
+    std::unique_ptr<EventStore> owned_event_store_;
     std::unique_ptr<EventPublisher> event_publisher_;
     bool deterministic_mode_ = true;
-    bool owns_event_store_ = false;
+    bool replaying_ = false;     // Applying stored events: publish nothing
+    
+    SnapshotMode snapshot_mode_ = SnapshotMode::INLINE;
+    std::thread snapshot_thread_;             // Waits for the forked child
+    std::atomic<bool> snapshot_running_{false};
+    std::atomic<bool> snapshot_published_{false};
+    std::atomic<uint64_t> last_snapshot_pause_us_{0};
+    
+    std::string standby_dir_;                 // Log followed in standby (by owned_event_store_)
+    std::thread standby_thread_;
+    std::atomic<bool> standby_running_{false};
+    std::atomic<bool> standby_draining_{false};   // Promotion: stop at the end of the log
+    std::atomic<bool> standby_stop_{false};
+    std::atomic<SequenceID> applied_sequence_{0};
 };
 
 } // namespace perpetual
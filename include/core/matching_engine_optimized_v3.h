@@ -33,10 +33,17 @@ public:
     // 停止后台线程
     void stop();
     
+    // 待持久化交易积压上限：超过时先重试提交，仍超限则拒绝新订单（背压），
+    // 已成交的交易保留在积压中直到入队，不会丢弃
+    static constexpr size_t DEFAULT_MAX_PENDING_TRADES = 1 << 18;
+    void setMaxPendingTrades(size_t limit) { max_pending_trades_ = limit; }
+    
     // 获取统计信息
     struct Statistics {
         uint64_t orders_processed = 0;
         uint64_t trades_executed = 0;
+        uint64_t orders_rejected = 0;      // 因持久化积压被拒绝的订单
+        uint64_t pending_trades = 0;       // 已成交、尚未入队持久化的交易
         double avg_matching_latency_ns = 0;
         double avg_persistence_latency_ns = 0;
         AsyncPersistenceManager::Statistics persistence_stats;
@@ -51,6 +58,12 @@ private:
     // 批量持久化交易
     void persistTradesBatch(const std::vector<Trade>& trades);
     
+    // 提交积压的交易，只移除已入队的部分（调用方持有batch_mutex_）
+    bool flushPendingTrades();
+    
+    // 积压未超限时接受新订单
+    bool admitOrder();
+    
     // 异步持久化管理器
     std::unique_ptr<AsyncPersistenceManager> async_persistence_;
     
@@ -59,8 +72,10 @@ private:
     
     // 批量缓冲区
     std::vector<Trade> trade_batch_;
-    std::mutex batch_mutex_;
+    mutable std::mutex batch_mutex_;
     static constexpr size_t BATCH_SIZE = 100;
+    static constexpr int STOP_FLUSH_RETRIES = 50;   // stop()时无进展的最大重试次数
+    size_t max_pending_trades_ = DEFAULT_MAX_PENDING_TRADES;
     
     // 统计信息
     mutable std::mutex stats_mutex_;
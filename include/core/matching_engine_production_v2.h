@@ -15,6 +15,9 @@
 #include <memory>
 #include <atomic>
 #include <thread>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 
 namespace perpetual {
 
@@ -60,6 +63,7 @@ private:
     // Async persistence
     void persistenceWorker();
     void enqueuePersistence(const Order& order, const std::vector<Trade>& trades);
+    bool persistenceAccepting() const;
     
     // Lock-free metrics
     void updateMetricsLockFree(const std::string& metric, uint64_t value = 1);
@@ -70,12 +74,28 @@ private:
         Timestamp timestamp;
     };
     
+    void persistTask(const PersistenceTask& task);
+    
     // Async persistence
     std::unique_ptr<OptimizedPersistenceManager> persistence_;
     LockFreeSPSCQueue<PersistenceTask> persistence_queue_;
     std::thread persistence_thread_;
     std::atomic<bool> persistence_running_{false};
     
+    // Backpressure: tasks the queue cannot take wait in an overflow list
+    // that the worker drains in order (see PersistenceOverflowPolicy). The
+    // list holds at most persistence_overflow_limit_ tasks; past that the
+    // matching thread waits for the worker and new orders are rejected.
+    PersistenceOverflowConfig persistence_overflow_config_;
+    size_t persistence_overflow_limit_ = 64 * 1024;
+    std::deque<PersistenceTask> persistence_overflow_;
+    std::mutex persistence_overflow_mutex_;
+    std::condition_variable persistence_overflow_cv_;   // Signalled when the worker drains
+    std::atomic<size_t> persistence_overflow_size_{0};
+    std::atomic<uint64_t> persistence_overflow_waits_{0};
+    std::atomic<uint64_t> persistence_spin_waits_{0};
+    std::atomic<uint64_t> persistence_tasks_overflowed_{0};
+    
     // Rate limiter with caching
     std::unique_ptr<RateLimiter> global_rate_limiter_;
     std::unique_ptr<RateLimiter> user_rate_limiter_;
@@ -106,6 +126,7 @@ private:
     std::atomic<uint64_t> orders_processed_{0};
     std::atomic<uint64_t> orders_rejected_{0};
     std::atomic<uint64_t> trades_executed_{0};
+    std::atomic<uint64_t> orders_rejected_backpressure_{0};
     
     std::atomic<bool> shutting_down_{false};
 };
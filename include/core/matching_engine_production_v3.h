@@ -6,6 +6,9 @@
 #include <atomic>
 #include <vector>
 #include <mutex>
+#include <deque>
+#include <functional>
+#include <condition_variable>
 
 namespace perpetual {
 
@@ -20,9 +23,25 @@ public:
     // Initialize with WAL enabled
     bool initialize(const std::string& config_file, bool enable_wal = true);
     
-    // Process order with WAL protection
+    // Process order with WAL protection. Returns as soon as the order is
+    // matched; its WAL record becomes durable with the next group commit.
     std::vector<Trade> process_order_safe(Order* order);
     
+    // Response released by process_order_durable: durable is true once the
+    // order's WAL record is on disk, false if the WAL failed or is disabled
+    using DurableCallback = std::function<void(const Order& order,
+                                               const std::vector<Trade>& trades,
+                                               bool durable)>;
+    
+    // Ack-on-durable: match now, acknowledge later. The matcher never waits
+    // for fsync; on_durable runs on the flush worker once the journal's
+    // durable watermark passes the order. Returns the order's journal record
+    // (0 without WAL, in which case on_durable runs inline).
+    uint64_t process_order_durable(Order* order, DurableCallback on_durable);
+    
+    // Every journal record <= this is durable
+    uint64_t durable_watermark() const;
+    
     // Recover from WAL after crash
     bool recover_from_wal();
     
@@ -34,10 +53,21 @@ public:
         uint64_t wal_size;
         uint64_t uncommitted_count;
         uint64_t flush_count;
-        double avg_flush_time_us;
+        double avg_flush_time_us;          // Group commit: commit to durable
+        uint64_t durable_watermark;
+        uint64_t awaiting_durable;         // Orders committed, not yet durable
+        uint64_t acks_released;
+        double avg_durable_latency_us;     // Order matched to durable ack
+        double durable_latency_p50_us;
+        double durable_latency_p99_us;
     };
     WALStats get_wal_stats() const;
     
+    // Per-order durable latency: bucket i counts acks that took
+    // [2^i, 2^(i+1)) microseconds (bucket 0 also holds anything faster)
+    static constexpr size_t kDurableLatencyBuckets = 32;
+    std::vector<uint64_t> get_durable_latency_histogram() const;
+    
 private:
     // Batch flush worker
     void flush_worker();
@@ -48,10 +78,25 @@ private:
     // Flush batch to persistent storage
     void flush_batch();
     
+    // Release responses covered by the durable watermark (flush worker)
+    void release_durable(bool failed);
+    
+    std::vector<Trade> process_and_track(Order* order, DurableCallback on_durable, uint64_t& record);
+    
     struct BatchEntry {
+        uint64_t journal_record = 0;
         Order order;
         std::vector<Trade> trades;
         Timestamp timestamp;
+        DurableCallback on_durable;
+    };
+    
+    // One group commit waiting for durability
+    struct CommitGroup {
+        uint64_t last_record;
+        size_t orders;
+        Timestamp commit_time;
+        Timestamp last_timestamp;
     };
     
     // WAL for durability
@@ -65,13 +110,23 @@ private:
     std::chrono::milliseconds batch_timeout_{10};
     Timestamp last_flush_time_ = 0;
     
-    // Flush worker thread
+    // Flush worker thread, woken by full batches and watermark advances
     std::thread flush_thread_;
     std::atomic<bool> flush_running_{false};
+    std::condition_variable flush_cv_;
+    uint64_t notified_watermark_ = 0;      // Guarded by batch_mutex_
+    
+    // Committed entries and groups waiting for the watermark (flush worker only)
+    std::deque<BatchEntry> awaiting_durable_;
+    std::deque<CommitGroup> commit_groups_;
+    std::atomic<uint64_t> awaiting_count_{0};
     
     // Statistics
     std::atomic<uint64_t> flush_count_{0};
     std::atomic<uint64_t> total_flush_time_us_{0};
+    std::atomic<uint64_t> acks_released_{0};
+    std::atomic<uint64_t> total_durable_latency_us_{0};
+    std::atomic<uint64_t> durable_latency_buckets_[kDurableLatencyBuckets] = {};
 };
 
 } // namespace perpetual
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "trading_views.h"
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <shared_mutex>
+#include <string>
+
+namespace perpetual {
+
+// ============================================================================
+// On-disk table of terminal orders
+//
+// Orders that are filled, cancelled or rejected and no longer recent are
+// moved here out of TradingViews, so resident memory follows the open
+// orders rather than the history. Both files are memory-mapped:
+//
+//   orders.dat  OrderArchiveHeader, then fixed-size OrderArchiveRecords in
+//               the order they were archived. Each record links to the
+//               previous archived order of the same user.
+//   orders.idx  Open-addressing hash table: order id -> record, and
+//               user id (tagged) -> the user's newest record.
+//
+// The index is derived from the records: if it is missing or does not
+// cover every record (e.g. after a crash) it is rebuilt on open.
+// ============================================================================
+
+#pragma pack(push, 1)
+struct OrderArchiveHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t count;             // Records written
+};
+
+struct OrderIndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;          // Slots (power of two)
+    uint64_t used;              // Occupied slots
+    uint64_t records;           // Records of orders.dat the index covers
+};
+
+struct OrderIndexSlot {
+    uint64_t key;               // Order id, or user id | kOrderIndexUserTag
+    uint64_t record;            // Record number + 1 (0 = empty slot)
+};
+#pragma pack(pop)
+
+struct OrderArchiveRecord {
+    OrderView view;
+    uint64_t older;             // User's previous archived record + 1 (0 = none)
+};
+
+constexpr uint64_t kOrderIndexUserTag = 1ULL << 63;
+
+class OrderArchive {
+public:
+    OrderArchive() = default;
+    ~OrderArchive();
+
+    OrderArchive(const OrderArchive&) = delete;
+    OrderArchive& operator=(const OrderArchive&) = delete;
+
+    bool open(const std::string& dir);
+    void close();
+    bool is_open() const { return data_fd_ >= 0; }
+
+    // Store an order's final view. An order archived before (e.g. placed
+    // again by a replay) is overwritten in place.
+    bool put(const OrderView& view);
+
+    bool get(OrderID order_id, OrderView& view) const;
+
+    // A user's archived orders, most recently archived first, until visit
+    // returns false
+    void for_each_user_order(UserID user_id, const std::function<bool(const OrderView&)>& visit) const;
+
+    // The same, starting after record `after` (0 = from the newest) and
+    // passing each record's number + 1, for resuming a listing
+    void for_each_user_order(UserID user_id, uint64_t after,
+                             const std::function<bool(uint64_t, const OrderView&)>& visit) const;
+
+    size_t size() const;
+
+    // msync both files
+    void flush();
+
+private:
+    bool map_data(uint64_t capacity);
+    bool map_index(const std::string& path, uint64_t capacity, bool create);
+    bool rebuild_index(uint64_t capacity);
+    uint64_t find_slot(uint64_t key) const;
+    void set_slot(uint64_t key, uint64_t record);
+
+    OrderArchiveHeader* data_header() const { return reinterpret_cast<OrderArchiveHeader*>(data_); }
+    OrderArchiveRecord* records() const {
+        return reinterpret_cast<OrderArchiveRecord*>(data_ + sizeof(OrderArchiveHeader));
+    }
+    OrderIndexHeader* index_header() const { return reinterpret_cast<OrderIndexHeader*>(index_); }
+    OrderIndexSlot* slots() const {
+        return reinterpret_cast<OrderIndexSlot*>(index_ + sizeof(OrderIndexHeader));
+    }
+
+    std::string dir_;
+    int data_fd_ = -1;
+    char* data_ = nullptr;
+    size_t data_size_ = 0;
+    uint64_t data_capacity_ = 0;        // Records the mapping holds
+    int index_fd_ = -1;
+    char* index_ = nullptr;
+    size_t index_size_ = 0;
+    mutable std::shared_mutex mutex_;
+};
+
+} // namespace perpetual
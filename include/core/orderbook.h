@@ -6,6 +6,7 @@
 #include <mutex>
 #include <atomic>
 #include <vector>
+#include <functional>
 
 namespace perpetual {
 
@@ -63,6 +64,10 @@ public:
     // Get top N price levels for market data
     void get_depth(size_t n, std::vector<PriceLevel>& levels) const;
     
+    // Visit every resting order, best price first and in time priority
+    // within a level (snapshots)
+    void for_each_order(const std::function<void(const Order*)>& visit) const;
+    
 private:
     // Red-black tree operations
     void rotate_left(Order* node);
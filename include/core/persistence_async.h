@@ -3,6 +3,7 @@
 #include "types.h"
 #include "order.h"
 #include "lockfree_queue.h"
+#include "journal_writer.h"
 #include <thread>
 #include <atomic>
 #include <vector>
@@ -11,6 +12,8 @@
 #include <chrono>
 #include <fstream>
 #include <string>
+#include <algorithm>
+#include <cstdint>
 
 namespace perpetual {
 
@@ -22,16 +25,24 @@ public:
     ~AsyncPersistenceManager();
     
     // 初始化
-    bool initialize(const std::string& data_dir);
+    bool initialize(const std::string& data_dir,
+                    const JournalWriterConfig& journal_config = JournalWriterConfig());
+    
+    // 队列或arena满时最多等待ENQUEUE_TIMEOUT_US（worker未运行则不等待），
+    // 超时返回false并计入items_rejected，调用方据此施加背压
     
     // 异步持久化订单（非阻塞）
-    void persistOrderAsync(const Order& order);
+    bool persistOrderAsync(const Order& order);
     
     // 异步持久化交易（非阻塞）
-    void persistTradeAsync(const Trade& trade);
+    bool persistTradeAsync(const Trade& trade);
+    
+    // 批量持久化（非阻塞，交易拷贝到共享arena，不分配堆内存）
+    // 返回false时，从第一个被拒绝的分段起的交易均未入队
+    bool persistBatchAsync(const std::vector<Trade>& trades);
     
-    // 批量持久化（非阻塞）
-    void persistBatchAsync(const std::vector<Trade>& trades);
+    // 同上，enqueued返回已入队的前缀长度，调用方保留其余交易稍后重试
+    bool persistBatchAsync(const Trade* trades, size_t count, size_t& enqueued);
     
     // 启动后台线程
     void start();
@@ -48,43 +59,98 @@ public:
         uint64_t trades_persisted = 0;
         uint64_t batches_persisted = 0;
         uint64_t queue_size = 0;
+        uint64_t items_rejected = 0;     // 背压：等待超时未能入队的项
         double avg_persist_latency_ns = 0;
     };
     Statistics getStatistics() const;
     
 private:
     // 持久化项类型
-    enum class PersistType {
+    enum class PersistType : uint8_t {
         ORDER = 0,
         TRADE = 1,
         BATCH = 2
     };
     
+    // 订单中需要持久化的字段（不携带订单簿指针等运行时状态）
+    struct OrderRecord {
+        OrderID order_id;
+        UserID user_id;
+        Price price;
+        Quantity quantity;
+        Timestamp timestamp;
+        InstrumentID instrument_id;
+        OrderSide side;
+        OrderType order_type;
+    };
+    
+    // 队列项：固定头部 + 按类型使用的payload
+    // BATCH的交易不放在队列项里，而是引用arena中的chunk链
     struct PersistItem {
-        PersistType type;
-        Order order;
-        Trade trade;
-        std::vector<Trade> batch;
+        PersistType type = PersistType::TRADE;
+        uint32_t count = 0;          // BATCH: 交易数
+        uint32_t first_chunk = 0;    // BATCH: arena中第一个chunk
+        union {
+            OrderRecord order;
+            Trade trade;
+        };
+        
+        PersistItem() : trade() {}
+    };
+    
+    // 批量交易的共享arena：固定大小chunk，空闲链表复用，运行期不分配内存
+    class TradeArena {
+    public:
+        static constexpr size_t CHUNK_TRADES = 64;
+        static constexpr uint32_t NO_CHUNK = UINT32_MAX;
+        
+        explicit TradeArena(size_t chunks);
         
-        PersistItem() : type(PersistType::TRADE) {}
-        PersistItem(const PersistItem& other) 
-            : type(other.type), order(other.order), trade(other.trade), batch(other.batch) {}
-        PersistItem& operator=(const PersistItem& other) {
-            if (this != &other) {
-                type = other.type;
-                order = other.order;
-                trade = other.trade;
-                batch = other.batch;
+        // 拷贝交易到chunk链，返回第一个chunk；空间不足返回NO_CHUNK
+        uint32_t store(const Trade* trades, size_t count);
+        
+        // 按顺序访问chunk链中的交易
+        template<typename Visit>
+        void forEach(uint32_t first, size_t count, Visit visit) const {
+            for (uint32_t chunk = first; chunk != NO_CHUNK && count > 0; chunk = chunks_[chunk].next) {
+                size_t n = std::min(count, CHUNK_TRADES);
+                for (size_t i = 0; i < n; ++i) {
+                    visit(chunks_[chunk].trades[i]);
+                }
+                count -= n;
             }
-            return *this;
         }
+        
+        // 归还chunk链
+        void release(uint32_t first);
+        
+        size_t capacityTrades() const { return chunks_.size() * CHUNK_TRADES; }
+        
+    private:
+        struct Chunk {
+            Trade trades[CHUNK_TRADES];
+            uint32_t next = NO_CHUNK;
+        };
+        
+        std::vector<Chunk> chunks_;
+        std::vector<uint32_t> free_;
+        std::mutex mutex_;
     };
     
+    // 入队（队列满时等待至deadline，超时返回false）
+    bool enqueue(const PersistItem& item, std::chrono::steady_clock::time_point deadline);
+    
+    // 队列/arena已满：让出CPU，超时或worker未运行时返回false
+    bool waitForSpace(std::chrono::steady_clock::time_point deadline) const;
+    
+    // 记录被拒绝的项
+    void reject(uint64_t items);
+    
     // 后台持久化线程
     void persistenceWorker();
     
     // 持久化单个订单
-    void persistOrder(const Order& order);
+    void persistOrder(const OrderRecord& order);
     
     // 持久化单个交易
     void persistTrade(const Trade& trade);
@@ -103,21 +169,25 @@ private:
     std::string trades_log_path_;
     std::string wal_path_;
     
-    // Lock-Free MPMC队列 (容量: 1M，必须是2的幂)
-    LockFreeMPMCQueue<PersistItem> persist_queue_{1048576};  // 2^20
+    // Lock-Free MPMC队列，队列项原地存储 (容量必须是2的幂)
+    static constexpr size_t QUEUE_CAPACITY = 1 << 16;
+    static constexpr size_t ARENA_CHUNKS = 1024;           // 64K笔交易
+    static constexpr int ENQUEUE_TIMEOUT_US = 100000;      // 满时最长等待100ms
+    LockFreeMPMCQueue<PersistItem> persist_queue_{QUEUE_CAPACITY};
+    TradeArena trade_arena_{ARENA_CHUNKS};
+    std::atomic<uint64_t> enqueued_{0};
+    std::atomic<uint64_t> processed_{0};
     
     // 后台线程
     std::thread persistence_thread_;
     std::atomic<bool> running_{false};
     
-    // 批量缓冲区
-    std::vector<PersistItem> batch_buffer_;
-    std::mutex batch_mutex_;
+    // 批量参数
     static constexpr size_t BATCH_SIZE = 1000;
     static constexpr int BATCH_TIMEOUT_MS = 10;  // 10ms超时
     
-    // WAL文件
-    std::unique_ptr<std::ofstream> wal_file_;
+    // WAL日志 (io_uring/pwrite journal, 批量提交)
+    std::unique_ptr<JournalWriter> wal_journal_;
     std::mutex wal_mutex_;
     
     // 统计信息
@@ -10,22 +10,74 @@
 #include <thread>
 #include <condition_variable>
 #include <mutex>
-#include <fstream>
+#include <sys/uio.h>
+#include <future>
 #include <chrono>
 
 namespace perpetual {
 
-// Optimized log entry with pre-serialized data
-struct OptimizedLogEntry {
-    std::string data;           // Pre-serialized CSV data
-    Timestamp timestamp;        // Entry timestamp
-    bool is_trade;              // true for trade, false for order
-    
-    OptimizedLogEntry() = default;
-    OptimizedLogEntry(const std::string& d, Timestamp ts, bool trade)
-        : data(d), timestamp(ts), is_trade(trade) {}
+// On-disk format of the trade and order logs
+enum class PersistenceLogFormat : uint8_t {
+    TEXT = 0,      // CSV lines (readable by ops tooling)
+    BINARY = 1     // PersistenceLogHeader followed by fixed-width records
 };
 
+// What logTrade/logOrder do when the writer falls behind and a queue is
+// full. No policy drops records: whatever the queue cannot take is spilled
+// to an overflow file in data_dir that the writer drains in order.
+enum class PersistenceOverflowPolicy : uint8_t {
+    SPIN = 0,      // Spin up to spin_limit_us for queue space, then spill
+    SPILL = 1,     // Spill right away
+    REJECT = 2     // Spill, and acceptingOrders() turns false until the backlog clears
+};
+
+struct PersistenceOverflowConfig {
+    PersistenceOverflowPolicy policy = PersistenceOverflowPolicy::SPIN;
+    uint32_t spin_limit_us = 50;
+    double reject_watermark = 0.75;    // REJECT: queue fill ratio that stops new orders
+};
+
+// "spin", "spill" or "reject"
+bool parsePersistenceOverflowPolicy(const std::string& name, PersistenceOverflowPolicy& policy);
+
+constexpr uint32_t kTradeLogMagic = 0x474c5254;  // "TRLG"
+constexpr uint32_t kOrderLogMagic = 0x474c524f;  // "ORLG"
+constexpr uint16_t kPersistenceLogVersion = 1;
+
+#pragma pack(push, 1)
+struct PersistenceLogHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+};
+
+// Queued and (in binary mode) written as is
+struct TradeLogRecord {
+    SequenceID sequence_id;
+    OrderID buy_order_id;
+    OrderID sell_order_id;
+    UserID buy_user_id;
+    UserID sell_user_id;
+    InstrumentID instrument_id;
+    Price price;
+    Quantity quantity;
+    Timestamp timestamp;
+    uint8_t is_taker_buy;
+};
+
+struct OrderLogRecord {
+    OrderID order_id;
+    UserID user_id;
+    InstrumentID instrument_id;
+    Price price;
+    Quantity quantity;
+    Timestamp timestamp;
+    uint8_t side;
+    uint8_t status;
+    char event_type[14];    // Truncated, NUL-padded
+};
+#pragma pack(pop)
+
 // High-performance persistence manager with async writing
 class OptimizedPersistenceManager {
 public:
@@ -34,13 +86,22 @@ public:
     
     bool initialize(const std::string& data_dir, 
                     size_t buffer_size = 10000,
-                    size_t flush_interval_ms = 100);
+                    size_t flush_interval_ms = 100,
+                    PersistenceLogFormat format = PersistenceLogFormat::TEXT,
+                    const PersistenceOverflowConfig& overflow = PersistenceOverflowConfig());
     
-    // High-performance logging (non-blocking)
+    // High-performance logging (non-blocking, no allocation). Records are
+    // copied into the queues as is and formatted on the writer thread.
     void logTrade(const Trade& trade);
     void logOrder(const Order& order, const std::string& event_type);
     
-    // Force flush (blocking)
+    // Whether the gateway should take new orders. Always true unless the
+    // overflow policy is REJECT and the queues are past the watermark or
+    // records are spilled.
+    bool acceptingOrders() const;
+    
+    // Force flush (blocking): everything logged before the call is written
+    // to the log files
     void flush();
     
     // Statistics
@@ -51,6 +112,13 @@ public:
         uint64_t bytes_written = 0;
         uint64_t write_errors = 0;
         double avg_write_latency_us = 0.0;
+        
+        // Backpressure
+        uint64_t trade_queue_depth = 0;
+        uint64_t order_queue_depth = 0;
+        uint64_t spin_waits = 0;           // Pushes that had to spin for space
+        uint64_t records_spilled = 0;
+        uint64_t spill_bytes_pending = 0;  // Spilled, not yet drained by the writer
     };
     
     Stats getStats() const;
@@ -62,53 +130,178 @@ private:
     // Background writer thread
     void writerThread();
     
-    // Serialize trade to string (optimized)
-    std::string serializeTrade(const Trade& trade);
+    // Writer-owned output buffer: page-aligned pages allocated once, a
+    // record never spans two pages, and a batch goes out with one writev
+    class OutputBuffer {
+    public:
+        static constexpr size_t PAGE_BYTES = 64 * 1024;
+        
+        OutputBuffer() = default;
+        ~OutputBuffer();
+        
+        OutputBuffer(const OutputBuffer&) = delete;
+        OutputBuffer& operator=(const OutputBuffer&) = delete;
+        
+        bool allocate(size_t bytes);
+        
+        // Room for up to max_bytes, or nullptr when the buffer is full
+        char* reserve(size_t max_bytes);
+        // End of the bytes written into the reserved space
+        void commit(const char* end) { used_[current_] = end - pages_[current_]; }
+        
+        size_t size() const;
+        bool empty() const { return current_ == 0 && used_[0] == 0; }
+        
+        bool writeTo(int fd);
+        void clear();
+        
+    private:
+        std::vector<char*> pages_;
+        std::vector<size_t> used_;
+        std::vector<struct iovec> iov_;
+        size_t current_ = 0;
+    };
+    
+    // Overflow file of one queue. The producer appends what the queue could
+    // not take, the writer reads it back once the queue is empty and
+    // releases records once the batch holding them has been written. The
+    // file is truncated when everything in it is released, so records left
+    // in it at startup were never written to the logs and are replayed (at
+    // least once). Like the logs, appends are not synced: the spill
+    // survives a process crash, not a power loss.
+    class SpillFile {
+    public:
+        SpillFile() = default;
+        ~SpillFile();
+        
+        SpillFile(const SpillFile&) = delete;
+        SpillFile& operator=(const SpillFile&) = delete;
+        
+        bool open(const std::string& path, size_t record_size);
+        void close();
+        
+        // Producer side
+        bool append(const void* record);
+        
+        // Writer side: up to max_bytes of whole records, oldest first
+        size_t read(char* out, size_t max_bytes);
+        // The oldest bytes handed out by read() are in the logs now
+        void release(uint64_t bytes);
+        
+        // Appended, not yet read
+        uint64_t pending() const { return pending_.load(std::memory_order_acquire); }
+        
+    private:
+        int fd_ = -1;
+        size_t record_size_ = 0;
+        std::mutex mutex_;
+        uint64_t release_offset_ = 0;   // Records before this are in the logs
+        uint64_t read_offset_ = 0;
+        uint64_t write_offset_ = 0;
+        std::atomic<uint64_t> pending_{0};
+    };
+    
+    // Push a record, applying the overflow policy when the queue is full
+    template<typename Record>
+    bool enqueueRecord(LockFreeSPSCQueue<Record>& queue, SpillFile& spill, const Record& record);
+    
+    // Append spilled records to the output buffer (queue must be empty)
+    template<typename Record, typename Append>
+    bool drainSpill(SpillFile& spill, uint64_t max_bytes, Append append);
+    
+    // Export queue depth and spill metrics
+    void publishMetrics();
     
-    // Serialize order to string (optimized)
-    std::string serializeOrder(const Order& order, const std::string& event_type);
+    // Format a record into the output buffer, writing the buffer out first
+    // when it is full
+    void appendTrade(const TradeLogRecord& trade);
+    void appendOrder(const OrderLogRecord& order);
     
-    // Write batch to file
-    void writeBatch(const std::vector<OptimizedLogEntry>& batch);
+    // Write both output buffers to their files
+    void writeBatches();
+    
+    // Write one output buffer to a log file
+    void writeBatch(OutputBuffer& buffer, size_t records, bool is_trade);
     
     // Rotate log files if needed
     void rotateLogFiles();
     
+    // Next log file, created and preallocated in the background so that
+    // rotation only swaps streams instead of creating files inline
+    struct PreparedLogFile {
+        std::string path;
+        int fd = -1;
+        uint64_t size = 0;       // Including a binary header written on creation
+        bool created = false;
+    };
+    static PreparedLogFile prepareLogFile(const std::string& path, const std::string& header);
+    std::string logFileHeader(bool is_trade) const;
+    std::future<PreparedLogFile> prepareNextLogFile(const std::string& prefix);
+    PreparedLogFile takePreparedLogFile(std::future<PreparedLogFile>& next, const std::string& prefix);
+    void discardPreparedLogFile(std::future<PreparedLogFile>& next);
+    
     // Configuration
     std::string data_dir_;
     size_t buffer_size_;
     size_t flush_interval_ms_;
+    PersistenceLogFormat format_ = PersistenceLogFormat::TEXT;
+    PersistenceOverflowConfig overflow_;
     std::atomic<bool> initialized_{false};
     std::atomic<bool> shutdown_requested_{false};
     
     // Lock-free queues for async writing
-    std::unique_ptr<LockFreeSPSCQueue<OptimizedLogEntry>> trade_queue_;
-    std::unique_ptr<LockFreeSPSCQueue<OptimizedLogEntry>> order_queue_;
+    std::unique_ptr<LockFreeSPSCQueue<TradeLogRecord>> trade_queue_;
+    std::unique_ptr<LockFreeSPSCQueue<OrderLogRecord>> order_queue_;
+    size_t queue_capacity_ = 0;
+    
+    // Overflow files and backpressure counters
+    SpillFile trade_spill_;
+    SpillFile order_spill_;
+    std::vector<char> spill_buffer_;   // Writer thread only
+    uint64_t trade_spill_buffered_ = 0;   // Spilled bytes in trade_output_ (writer thread)
+    uint64_t order_spill_buffered_ = 0;
+    static constexpr size_t SPILL_READ_BYTES = 64 * 1024;
+    std::atomic<uint64_t> spin_waits_{0};
+    std::atomic<uint64_t> records_spilled_{0};
+    uint64_t published_spin_waits_ = 0;
+    uint64_t published_records_spilled_ = 0;
     
     // Writer thread
     std::thread writer_thread_;
     std::condition_variable writer_cv_;
     std::mutex writer_mutex_;
+    bool writer_running_ = false;
+    
+    // flush() takes a ticket; the writer completes it once everything
+    // queued before the ticket is written
+    std::atomic<uint64_t> flush_requested_{0};
+    uint64_t flush_completed_ = 0;
+    std::condition_variable flush_cv_;
     
-    // Buffers for batching
-    std::vector<OptimizedLogEntry> trade_buffer_;
-    std::vector<OptimizedLogEntry> order_buffer_;
+    // Formatted records waiting for the next batch write (writer thread only)
+    OutputBuffer trade_output_;
+    OutputBuffer order_output_;
+    size_t pending_trades_ = 0;
+    size_t pending_orders_ = 0;
+    static constexpr size_t MAX_TEXT_RECORD = 256;
+    static constexpr size_t MAX_OUTPUT_BYTES = 8 * 1024 * 1024;
     
-    // File streams (with rotation)
-    std::unique_ptr<std::ofstream> trade_log_;
-    std::unique_ptr<std::ofstream> order_log_;
+    // Log files (with rotation)
+    int trade_fd_ = -1;
+    int order_fd_ = -1;
     std::string current_trade_file_;
     std::string current_order_file_;
+    std::string log_extension_;
     std::atomic<uint64_t> trade_file_size_{0};
     std::atomic<uint64_t> order_file_size_{0};
     static constexpr uint64_t MAX_FILE_SIZE = 100 * 1024 * 1024; // 100MB
+    std::future<PreparedLogFile> next_trade_log_;
+    std::future<PreparedLogFile> next_order_log_;
+    uint64_t log_file_index_ = 0;
     
     // Statistics
     mutable std::mutex stats_mutex_;
     Stats stats_;
-    
-    // Pre-allocated string buffers for serialization
-    thread_local static std::string serialization_buffer_;
 };
 
 } // namespace perpetual
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "event_sourcing.h"
+#include "types.h"
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace perpetual {
+
+class OrderArchive;
+
+// ============================================================================
+// Materialized trading views (read models built from events)
+//
+// Views are sharded by user id. Each shard is guarded by a seqlock: the
+// writer bumps the shard's sequence around every change, readers copy what
+// they need without taking any lock and retry if the sequence moved. Tables
+// are open-addressing arrays of plain records. An array replaced by growth
+// or shrinking is retired, not freed: each shard counts the optimistic
+// readers in flight, and the writer frees retired arrays only once that
+// count is zero. A reader registers before it loads the array pointer, so
+// an array it may be probing is never freed under it; it can read stale
+// bytes while racing the writer, which the sequence check then discards.
+//
+// Writers for different shards may run concurrently; writers of one shard
+// are serialized by the shard's mutex.
+//
+// With an archive open, terminal orders (filled, cancelled, rejected)
+// beyond the most recent few per shard are moved to an on-disk
+// OrderArchive; order lookups and listings fall through to it, so
+// resident memory follows the open orders rather than the history.
+//
+// Resident orders are indexed by (user, status, instrument): each order
+// sits on a newest-first chain per combination of those filters, so a
+// page of a user's orders costs the size of the page rather than the
+// size of the user's history. Open orders are never archived, so pages
+// of open orders never touch the disk.
+//
+// Checkpoints of the views are written next to the engine snapshots
+// (<store dir>/snapshots/views). At startup the newest one is loaded and
+// the rest of the log is replayed on several threads, each owning the
+// users of a subset of the shards.
+// ============================================================================
+
+// Materialized Views (Read Models)
+struct OrderView {
+    OrderID order_id;
+    UserID user_id;
+    InstrumentID instrument_id;
+    OrderSide side;
+    OrderType order_type;
+    Price price;
+    Quantity quantity;
+    Quantity filled_quantity;
+    Quantity remaining_quantity;
+    OrderStatus status;
+    int64_t timestamp;
+    int64_t updated_at;
+};
+
+struct AccountView {
+    UserID user_id;
+    double balance;
+    double frozen;
+    double available;
+    double used_margin;
+    double total_equity;
+    int64_t last_updated;
+};
+
+struct PositionView {
+    UserID user_id;
+    InstrumentID instrument_id;
+    Quantity size;
+    Price entry_price;
+    Price mark_price;
+    double unrealized_pnl;
+    double margin_used;
+    int64_t last_updated;
+};
+
+// Status filter value matching every order
+constexpr OrderStatus kAnyOrderStatus = static_cast<OrderStatus>(255);
+
+// Status filter value matching pending and partially filled orders
+constexpr OrderStatus kOpenOrderStatus = static_cast<OrderStatus>(254);
+
+constexpr uint32_t kDefaultOrderPageSize = 100;
+constexpr uint32_t kMaxOrderPageSize = 1000;
+
+struct UserOrderQuery {
+    UserID user_id = 0;
+    InstrumentID instrument_id = 0;         // 0 = all instruments
+    OrderStatus status = kAnyOrderStatus;
+    uint32_t limit = kDefaultOrderPageSize; // Capped at kMaxOrderPageSize
+    std::string page_token;                 // Empty = first page
+};
+
+struct UserOrderPage {
+    std::vector<OrderView> orders;          // Newest first
+    std::string next_page_token;            // Empty on the last page
+};
+
+constexpr size_t kTradingViewShards = 64;
+
+class TradingViews {
+public:
+    TradingViews();
+    ~TradingViews();
+
+    TradingViews(const TradingViews&) = delete;
+    TradingViews& operator=(const TradingViews&) = delete;
+
+    // Write side. Events are applied one at a time in log order.
+    void apply(const Event& event);
+    void update_account(const AccountView& account);
+    void clear();
+
+    // Sequence of the last event applied (or covered by a checkpoint)
+    SequenceID applied_sequence() const { return applied_sequence_.load(std::memory_order_acquire); }
+
+    // Views as of applied_sequence() (returned in sequence), and back.
+    // restore_state spreads the shards over `partitions` threads.
+    std::string serialize_state(SequenceID& sequence) const;
+    bool restore_state(const std::string& state, SequenceID sequence, size_t partitions = 1);
+
+    // Checkpoint into <store dir>/snapshots/views, keeping the newest few
+    bool write_checkpoint(EventStore& store) const;
+
+    // Replace the views with the newest valid checkpoint (empty views and
+    // sequence 0 if there is none)
+    bool load_checkpoint(const EventStore& store, SequenceID& sequence, size_t partitions = 0);
+
+    // Apply the store's events after `after` on `partitions` threads
+    // (0 = one per core). Each thread owns the users of some shards; a
+    // trade between users of two threads is applied by both, each to its
+    // own side. Nothing else may write the views meanwhile.
+    bool replay(const EventStore& store, SequenceID after, size_t partitions = 0);
+
+    // Newest checkpoint, then a parallel replay of the events after it
+    bool recover(const EventStore& store, size_t partitions = 0);
+
+    // Read side. Lock-free unless the writer keeps changing the shard
+    // being read; after a few retries the reader waits for it instead.
+    bool get_order(OrderID order_id, OrderView& view) const;
+
+    // A user's orders, oldest first
+    std::vector<OrderView> get_user_orders(UserID user_id, InstrumentID instrument_id = 0,
+                                           OrderStatus status = kAnyOrderStatus) const;
+
+    // One page of a user's orders, newest first: resident orders by
+    // placement time (by time of entering the status when filtering on a
+    // status), then archived ones. Returns false for a page token that
+    // does not belong to the query. An order archived while a listing is
+    // in progress may be listed twice.
+    bool query_user_orders(const UserOrderQuery& query, UserOrderPage& page) const;
+
+    bool get_account(UserID user_id, AccountView& view) const;
+    bool get_position(UserID user_id, InstrumentID instrument_id, PositionView& view) const;
+    std::vector<PositionView> get_user_positions(UserID user_id) const;
+
+    // Move terminal orders beyond the newest resident_terminal_orders to
+    // an archive in dir. Call before applying events.
+    bool open_archive(const std::string& dir, size_t resident_terminal_orders);
+    bool has_archive() const { return archive_ != nullptr; }
+
+    // Orders resident in memory, and orders on disk
+    size_t order_count() const;
+    size_t archived_order_count() const;
+
+    // Reads that gave up on the seqlock and waited for the shard's writer
+    uint64_t locked_reads() const { return locked_reads_.load(std::memory_order_relaxed); }
+
+private:
+    struct Shard;
+    struct OwnerShard;
+
+    static size_t shard_index(UserID user_id);
+    Shard& shard_of(UserID user_id) const;
+    OwnerShard& owner_shard_of(OrderID order_id) const;
+
+    // Apply the parts of event that concern users owned by partition
+    void apply_owned(const Event& event, size_t partition, size_t partitions);
+    bool owns(UserID user_id, size_t partition, size_t partitions) const {
+        return shard_index(user_id) % partitions == partition;
+    }
+
+    void insert_order(const OrderView& view);
+    void retire_order(Shard& shard, OrderID order_id);
+    bool is_resident(OrderID order_id) const;
+    std::string serialize_locked(SequenceID& sequence) const;   // Caller holds apply_mutex_
+    void insert_position(const PositionView& view);
+    void apply_order_cancelled(const Event& event);
+    void fill_order(UserID user_id, OrderID order_id, Quantity quantity, int64_t timestamp);
+    void move_position(UserID user_id, InstrumentID instrument_id, Quantity delta, Price price,
+                       int64_t timestamp);
+
+    std::unique_ptr<Shard[]> shards_;
+    std::unique_ptr<OwnerShard[]> owner_shards_;   // order id -> user id, sharded by order id
+    mutable std::atomic<uint64_t> locked_reads_{0};
+
+    std::unique_ptr<OrderArchive> archive_;
+    size_t resident_terminal_per_shard_ = 0;
+
+    mutable std::mutex apply_mutex_;        // apply() against checkpoints
+    std::atomic<SequenceID> applied_sequence_{0};
+};
+
+} // namespace perpetual
@@ -2,11 +2,13 @@
 
 #include "types.h"
 #include "order.h"  // For Order struct
+#include "journal_writer.h"
 #include <string>
 #include <vector>
 #include <fstream>
 #include <atomic>
 #include <mutex>
+#include <memory>
 
 namespace perpetual {
 
@@ -16,13 +18,18 @@ struct Trade;
 // Write-Ahead Log for data durability
 class WriteAheadLog {
 public:
-    explicit WriteAheadLog(const std::string& path);
+    explicit WriteAheadLog(const std::string& path,
+                           const JournalWriterConfig& journal_config = JournalWriterConfig());
     ~WriteAheadLog();
     
     // Append a record to WAL with fsync
     bool append(const Order& order);
     bool append(const Trade& trade);
     
+    // Append an order and report its journal record number. The record is
+    // durable once durable_record() reaches it.
+    bool append(const Order& order, uint64_t& record);
+    
     // Mark records as committed (can be truncated)
     void mark_committed(Timestamp timestamp);
     
@@ -33,9 +40,27 @@ public:
     // Truncate committed portion of WAL
     void truncate();
     
-    // Sync to disk
+    // Sync to disk (commits the current batch; appends continue into the
+    // next batch while this one is being made durable)
     void sync();
     
+    // Group commit without waiting: hands the current batch to the journal
+    // and returns the last record in it (0 if nothing was appended yet)
+    uint64_t commit();
+    
+    // Every record <= durable_record() is on disk
+    uint64_t durable_record() const { return journal_->durable_record(); }
+    bool wait_durable(uint64_t record) { return journal_->wait_durable(record); }
+    bool healthy() const { return journal_->healthy(); }
+    
+    // Durability notifications (see JournalWriter::set_durable_listener)
+    void set_durable_listener(std::function<void(uint64_t)> listener) {
+        journal_->set_durable_listener(std::move(listener));
+    }
+    
+    // Journal backend in use ("io_uring" or "pwrite")
+    const char* backend_name() const { return journal_->backend_name(); }
+    
     // Get WAL statistics
     uint64_t size() const { return current_offset_.load(); }
     uint64_t uncommitted_count() const;
@@ -69,7 +94,7 @@ private:
     void write_last_committed(Timestamp ts);
     
     std::string path_;
-    int wal_fd_;
+    std::unique_ptr<JournalWriter> journal_;
     std::atomic<uint64_t> current_offset_{0};
     std::mutex write_mutex_;
     Timestamp last_committed_ts_{0};
@@ -2,11 +2,21 @@
 #include "core/order.h"
 #include "core/types.h"
 #include "core/matching_engine_event_sourcing.h"
+#include "core/logger.h"
 #include <grpcpp/grpcpp.h>
+#include <chrono>
 
 namespace perpetual {
 namespace trading {
 
+namespace {
+// Events between view checkpoints
+constexpr SequenceID kViewCheckpointInterval = 1000000;
+
+// Terminal orders kept in memory; older ones are served from the order archive
+constexpr size_t kResidentTerminalOrders = 256 * 1024;
+}
+
 // TradingCommandHandler Implementation
 TradingCommandHandler::TradingCommandHandler(const std::string& matching_service_address)
     : matching_service_address_(matching_service_address) {
@@ -153,144 +163,73 @@ CommandResult TradingCommandHandler::handleCancelOrder(const TradingCommand& com
 // TradingQueryHandler Implementation
 TradingQueryHandler::TradingQueryHandler(EventStore* event_store)
     : event_store_(event_store) {
-    // Rebuild views from events on initialization
-    rebuildViewsFromEvents();
+    // Views are rebuilt once the event store is open (TradingServiceCQRS::initialize)
 }
 
 OrderView TradingQueryHandler::getOrder(OrderID order_id) {
-    std::shared_lock<std::shared_mutex> lock(views_mutex_);
-    auto it = order_views_.find(order_id);
-    if (it != order_views_.end()) {
-        return it->second;
+    OrderView view{};
+    if (!views_.get_order(order_id, view)) {
+        return OrderView{};  // Return empty view
     }
-    return OrderView{};  // Return empty view
+    return view;
 }
 
 std::vector<OrderView> TradingQueryHandler::getUserOrders(UserID user_id,
                                                           InstrumentID instrument_id,
                                                           OrderStatus status) {
-    std::shared_lock<std::shared_mutex> lock(views_mutex_);
-    std::vector<OrderView> orders;
-    
-    auto it = user_order_index_.find(user_id);
-    if (it == user_order_index_.end()) {
-        return orders;
-    }
-    
-    for (OrderID order_id : it->second) {
-        auto order_it = order_views_.find(order_id);
-        if (order_it == order_views_.end()) continue;
-        
-        const OrderView& view = order_it->second;
-        
-        // Filter by instrument
-        if (instrument_id != 0 && view.instrument_id != instrument_id) {
-            continue;
-        }
-        
-        // Filter by status
-        if (status != static_cast<OrderStatus>(255) && view.status != status) {
-            continue;
-        }
-        
-        orders.push_back(view);
-    }
-    
-    return orders;
+    return views_.get_user_orders(user_id, instrument_id, status);
+}
+
+bool TradingQueryHandler::queryUserOrders(const UserOrderQuery& query, UserOrderPage& page) {
+    return views_.query_user_orders(query, page);
 }
 
 AccountView TradingQueryHandler::getAccount(UserID user_id) {
-    std::shared_lock<std::shared_mutex> lock(views_mutex_);
-    auto it = account_views_.find(user_id);
-    if (it != account_views_.end()) {
-        return it->second;
+    AccountView view{};
+    if (!views_.get_account(user_id, view)) {
+        return AccountView{};  // Return empty view
     }
-    return AccountView{};  // Return empty view
+    return view;
 }
 
 PositionView TradingQueryHandler::getPosition(UserID user_id, InstrumentID instrument_id) {
-    std::shared_lock<std::shared_mutex> lock(views_mutex_);
-    auto user_it = position_views_.find(user_id);
-    if (user_it == position_views_.end()) {
+    PositionView view{};
+    if (!views_.get_position(user_id, instrument_id, view)) {
         return PositionView{};
     }
-    
-    auto inst_it = user_it->second.find(instrument_id);
-    if (inst_it != user_it->second.end()) {
-        return inst_it->second;
-    }
-    
-    return PositionView{};
+    return view;
 }
 
 std::vector<PositionView> TradingQueryHandler::getUserPositions(UserID user_id) {
-    std::shared_lock<std::shared_mutex> lock(views_mutex_);
-    std::vector<PositionView> positions;
-    
-    auto user_it = position_views_.find(user_id);
-    if (user_it == position_views_.end()) {
-        return positions;
-    }
-    
-    for (const auto& pair : user_it->second) {
-        positions.push_back(pair.second);
-    }
-    
-    return positions;
+    return views_.get_user_positions(user_id);
 }
 
 void TradingQueryHandler::updateViewsFromEvent(const Event& event) {
-    std::unique_lock<std::shared_mutex> lock(views_mutex_);
-    
-    switch (event.type) {
-        case EventType::ORDER_PLACED:
-        case EventType::ORDER_UPDATED:
-        case EventType::ORDER_CANCELLED:
-            updateOrderView(event);
-            break;
-        case EventType::TRADE_EXECUTED:
-            updateOrderView(event);
-            updateAccountView(event);
-            updatePositionView(event);
-            break;
-        default:
-            break;
-    }
+    views_.apply(event);
 }
 
-void TradingQueryHandler::rebuildViewsFromEvents() {
+bool TradingQueryHandler::rebuildViewsFromEvents() {
     if (!event_store_) {
-        return;
+        views_.clear();
+        return false;
     }
     
-    // Get all events and rebuild views
-    auto events = event_store_->get_events(0, UINT64_MAX);
-    
-    std::unique_lock<std::shared_mutex> lock(views_mutex_);
-    order_views_.clear();
-    account_views_.clear();
-    position_views_.clear();
-    user_order_index_.clear();
-    
-    for (const auto& event : events) {
-        updateViewsFromEvent(event);
+    if (!views_.has_archive() &&
+        !views_.open_archive(event_store_->data_dir() + "/order_archive", kResidentTerminalOrders)) {
+        LOG_WARN("Order archive unavailable; terminal orders stay in memory");
     }
+    
+    auto start = std::chrono::steady_clock::now();
+    bool ok = views_.recover(*event_store_);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("Views rebuilt through sequence " + std::to_string(views_.applied_sequence()) +
+             " in " + std::to_string(elapsed) + " ms");
+    return ok;
 }
 
-void TradingQueryHandler::updateOrderView(const Event& event) {
-    // Update order view from event
-    // Implementation depends on event structure
-    // Placeholder implementation
-}
-
-void TradingQueryHandler::updateAccountView(const Event& event) {
-    // Update account view from event
-    // Placeholder implementation
-}
-
-void TradingQueryHandler::updatePositionView(const Event& event) {
-    // Update position view from event
-    // Placeholder implementation
+bool TradingQueryHandler::checkpointViews() {
+    return event_store_ && views_.write_checkpoint(*event_store_);
 }
 
 // TradingServiceCQRS Implementation
@@ -318,6 +257,7 @@ TradingServiceCQRS::TradingServiceCQRS(const std::string& matching_service_addre
 
 TradingServiceCQRS::~TradingServiceCQRS() {
     stop();
+    stopViewCheckpoints();
     if (owns_event_store_ && event_store_) {
         delete event_store_;
     }
@@ -330,12 +270,30 @@ bool TradingServiceCQRS::initialize() {
         }
     }
     
-    // Subscribe to events for view updates
+    // Bring the views up from their checkpoint, then follow the log
+    if (!query_handler_->rebuildViewsFromEvents()) {
+        LOG_ERROR("Failed to rebuild trading views");
+        return false;
+    }
+    last_view_checkpoint_ = query_handler_->viewsSequence();
+    view_checkpoint_stop_ = false;
+    view_checkpoint_thread_ = std::thread(&TradingServiceCQRS::viewCheckpointWorker, this);
+    
+    // Subscribe to events for view updates (the types the views use)
     event_processor_->subscribe([this](const Event& event) {
         query_handler_->updateViewsFromEvent(event);
-    });
+        if (event.sequence_id >= last_view_checkpoint_ + kViewCheckpointInterval) {
+            last_view_checkpoint_ = event.sequence_id;
+            {
+                std::lock_guard<std::mutex> lock(view_checkpoint_mutex_);
+                view_checkpoint_requested_ = true;
+            }
+            view_checkpoint_cv_.notify_one();
+        }
+    }, nullptr, EventSelector::of({EventType::ORDER_PLACED, EventType::ORDER_CANCELLED,
+                                   EventType::TRADE_EXECUTED}));
     
-    event_processor_->start_processing();
+    event_processor_->start_processing(query_handler_->viewsSequence());
     
     return true;
 }
@@ -364,6 +322,10 @@ void TradingServiceCQRS::stop() {
     if (event_processor_) {
         event_processor_->stop_processing();
     }
+    stopViewCheckpoints();
+    if (query_handler_) {
+        query_handler_->checkpointViews();
+    }
     if (grpc_server_) {
         grpc_server_->Shutdown();
     }
@@ -448,11 +410,30 @@ grpc::Status TradingServiceCQRS::QueryOrder(grpc::ServerContext* context,
 grpc::Status TradingServiceCQRS::QueryUserOrders(grpc::ServerContext* context,
                                                 const QueryUserOrdersRequest* request,
                                                 QueryUserOrdersResponse* response) {
-    auto views = query_handler_->getUserOrders(
-        request->user_id(),
-        request->instrument_id(),
-        static_cast<OrderStatus>(request->status())
-    );
+    std::vector<OrderView> views;
+    if (request->limit() == 0 && request->page_token().empty()) {
+        // Unpaged: the whole list, oldest first
+        views = query_handler_->getUserOrders(
+            request->user_id(),
+            request->instrument_id(),
+            static_cast<OrderStatus>(request->status())
+        );
+    } else {
+        UserOrderQuery query;
+        query.user_id = request->user_id();
+        query.instrument_id = request->instrument_id();
+        query.status = static_cast<OrderStatus>(request->status());
+        query.limit = request->limit();
+        query.page_token = request->page_token();
+        UserOrderPage page;
+        if (!query_handler_->queryUserOrders(query, page)) {
+            response->set_success(false);
+            response->set_error_message("Invalid page token");
+            return grpc::Status::OK;
+        }
+        views = std::move(page.orders);
+        response->set_next_page_token(page.next_page_token);
+    }
     
     for (const auto& view : views) {
         OrderInfo* order_info = response->add_orders();
@@ -518,6 +499,37 @@ grpc::Status TradingServiceCQRS::QueryPosition(grpc::ServerContext* context,
     return grpc::Status::OK;
 }
 
+void TradingServiceCQRS::viewCheckpointWorker() {
+    std::unique_lock<std::mutex> lock(view_checkpoint_mutex_);
+    while (true) {
+        view_checkpoint_cv_.wait(lock, [this] {
+            return view_checkpoint_requested_ || view_checkpoint_stop_;
+        });
+        if (view_checkpoint_stop_) {
+            return;
+        }
+        view_checkpoint_requested_ = false;
+        
+        // Requests arriving meanwhile collapse into the next checkpoint
+        lock.unlock();
+        if (!query_handler_->checkpointViews()) {
+            LOG_WARN("View checkpoint failed; retrying at the next interval");
+        }
+        lock.lock();
+    }
+}
+
+void TradingServiceCQRS::stopViewCheckpoints() {
+    {
+        std::lock_guard<std::mutex> lock(view_checkpoint_mutex_);
+        view_checkpoint_stop_ = true;
+    }
+    view_checkpoint_cv_.notify_all();
+    if (view_checkpoint_thread_.joinable()) {
+        view_checkpoint_thread_.join();
+    }
+}
+
 void TradingServiceCQRS::startViewUpdate() {
     if (event_processor_) {
         event_processor_->start_processing();
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/event_sourcing_advanced.h"
+#include "core/trading_views.h"
 #include "core/order_validator.h"
 #include "core/account_manager.h"
 #include "core/position_manager.h"
@@ -12,6 +13,8 @@
 #include <unordered_map>
 #include <mutex>
 #include <shared_mutex>
+#include <thread>
+#include <condition_variable>
 
 namespace perpetual {
 namespace trading {
@@ -68,42 +71,8 @@ struct TradingQuery {
     InstrumentID instrument_id;
 };
 
-// Materialized Views (Read Models)
-struct OrderView {
-    OrderID order_id;
-    UserID user_id;
-    InstrumentID instrument_id;
-    OrderSide side;
-    OrderType order_type;
-    Price price;
-    Quantity quantity;
-    Quantity filled_quantity;
-    Quantity remaining_quantity;
-    OrderStatus status;
-    int64_t timestamp;
-    int64_t updated_at;
-};
-
-struct AccountView {
-    UserID user_id;
-    double balance;
-    double frozen;
-    double available;
-    double used_margin;
-    double total_equity;
-    int64_t last_updated;
-};
-
-struct PositionView {
-    UserID user_id;
-    InstrumentID instrument_id;
-    Quantity size;
-    Price entry_price;
-    Price mark_price;
-    double unrealized_pnl;
-    double margin_used;
-    int64_t last_updated;
-};
+// Materialized Views (Read Models): OrderView, AccountView and
+// PositionView are defined in core/trading_views.h
 
 // Command Handler (Write side)
 class TradingCommandHandler {
@@ -151,7 +120,10 @@ public:
     // Query user orders (from materialized view)
     std::vector<OrderView> getUserOrders(UserID user_id, 
                                         InstrumentID instrument_id = 0,
-                                        OrderStatus status = static_cast<OrderStatus>(255));
+                                        OrderStatus status = kAnyOrderStatus);
+    
+    // Query one page of user orders, newest first (from materialized view)
+    bool queryUserOrders(const UserOrderQuery& query, UserOrderPage& page);
     
     // Query account (from materialized view)
     AccountView getAccount(UserID user_id);
@@ -165,30 +137,22 @@ public:
     // Update materialized views from events
     void updateViewsFromEvent(const Event& event);
     
-private:
-    EventStore* event_store_;
-    
-    // Materialized views (Read Models)
-    std::unordered_map<OrderID, OrderView> order_views_;
-    std::unordered_map<UserID, AccountView> account_views_;
-    std::unordered_map<UserID, std::unordered_map<InstrumentID, PositionView>> position_views_;
-    
-    // Indexes for fast lookup
-    std::unordered_map<UserID, std::vector<OrderID>> user_order_index_;
-    
-    mutable std::shared_mutex views_mutex_;
+    // Rebuild views from the newest checkpoint plus the events after it
+    // (replayed in parallel, partitioned by user)
+    bool rebuildViewsFromEvents();
     
-    // Rebuild views from events
-    void rebuildViewsFromEvents();
+    // Checkpoint the views next to the engine snapshots
+    bool checkpointViews();
     
-    // Update order view
-    void updateOrderView(const Event& event);
+    // Sequence of the last event reflected in the views
+    SequenceID viewsSequence() const { return views_.applied_sequence(); }
     
-    // Update account view
-    void updateAccountView(const Event& event);
+private:
+    EventStore* event_store_;
     
-    // Update position view
-    void updatePositionView(const Event& event);
+    // Materialized views (Read Models), sharded by user; queries never
+    // wait for the event applier
+    TradingViews views_;
 };
 
 // Trading Service with CQRS
@@ -253,6 +217,18 @@ private:
     std::atomic<bool> running_{false};
     
     std::atomic<uint64_t> next_order_id_{1000000};
+    
+    // Views are checkpointed every kViewCheckpointInterval events. The
+    // subscriber only requests it; a background thread writes it, so
+    // applying events never waits for the snapshot file or the log sync.
+    void viewCheckpointWorker();
+    void stopViewCheckpoints();
+    SequenceID last_view_checkpoint_ = 0;
+    std::thread view_checkpoint_thread_;
+    std::mutex view_checkpoint_mutex_;
+    std::condition_variable view_checkpoint_cv_;
+    bool view_checkpoint_requested_ = false;   // Guarded by view_checkpoint_mutex_
+    bool view_checkpoint_stop_ = false;
 };
 
 } // namespace trading
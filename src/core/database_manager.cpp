@@ -1,9 +1,38 @@
 #include "core/database_manager.h"
+#include "core/history_store.h"
 #include "core/types.h"
 #include <sstream>
 
 namespace perpetual {
 
+namespace {
+
+// 0 means an open end, as in the SQL queries above
+int64_t history_end(int64_t end_time) {
+    return end_time == 0 ? kHistoryEnd : end_time;
+}
+
+Order order_from_history(const OrderHistoryRow& row) {
+    Order order;
+    order.order_id = row.order_id;
+    order.user_id = row.user_id;
+    order.instrument_id = row.instrument_id;
+    order.side = row.side;
+    order.order_type = row.order_type;
+    order.offset_flag = row.offset_flag;
+    order.status = row.status;
+    order.position_side = row.position_side;
+    order.price = row.price;
+    order.quantity = row.quantity;
+    order.filled_quantity = row.filled_quantity;
+    order.remaining_quantity = row.remaining_quantity;
+    order.timestamp = row.timestamp;
+    order.sequence_id = row.sequence_id;
+    return order;
+}
+
+} // namespace
+
 DatabaseManager::DatabaseManager(DBType type, const std::string& connection_string)
     : db_type_(type), connection_string_(connection_string), connection_handle_(nullptr) {
 }
@@ -26,6 +55,9 @@ bool DatabaseManager::connect() {
         case MONGODB:
             connection_handle_ = mongodb_connect();
             break;
+        case EMBEDDED:
+            connection_handle_ = embedded_connect();
+            break;
     }
     return connection_handle_ != nullptr;
 }
@@ -35,6 +67,10 @@ void DatabaseManager::disconnect() {
         // In production, properly close database connection
         connection_handle_ = nullptr;
     }
+    if (history_) {
+        history_->close();
+        history_.reset();
+    }
 }
 
 bool DatabaseManager::isConnected() const {
@@ -46,6 +82,10 @@ bool DatabaseManager::insertOrder(const Order& order) {
         return false;
     }
     
+    if (history_) {
+        return history_->append_order(order);
+    }
+    
     // In production, use prepared statements and proper SQL
     // For now, simplified placeholder
     // INSERT INTO orders (order_id, user_id, instrument_id, side, price, quantity, ...) VALUES (...)
@@ -58,6 +98,11 @@ bool DatabaseManager::updateOrder(const Order& order) {
         return false;
     }
     
+    // A new revision supersedes the stored one
+    if (history_) {
+        return history_->append_order(order);
+    }
+    
     // UPDATE orders SET status=?, filled_quantity=?, ... WHERE order_id=?
     
     return true;
@@ -68,6 +113,15 @@ Order* DatabaseManager::getOrder(OrderID order_id) {
         return nullptr;
     }
     
+    if (history_) {
+        OrderHistoryRow row;
+        if (!history_->find_order(order_id, row)) {
+            return nullptr;
+        }
+        fetched_order_ = std::make_unique<Order>(order_from_history(row));
+        return fetched_order_.get();
+    }
+    
     // SELECT * FROM orders WHERE order_id=?
     // In production, use proper query and construct Order object
     
@@ -81,6 +135,13 @@ std::vector<Order> DatabaseManager::getOrdersByUser(UserID user_id, int64_t star
         return orders;
     }
     
+    if (history_) {
+        for (const OrderHistoryRow& row : history_->orders_by_user(user_id, start_time, history_end(end_time))) {
+            orders.push_back(order_from_history(row));
+        }
+        return orders;
+    }
+    
     // SELECT * FROM orders WHERE user_id=? AND timestamp BETWEEN ? AND ? ORDER BY timestamp DESC
     
     return orders;
@@ -91,6 +152,10 @@ bool DatabaseManager::insertTrade(const Trade& trade) {
         return false;
     }
     
+    if (history_) {
+        return history_->append_trade(trade);
+    }
+    
     // INSERT INTO trades (trade_id, buy_order_id, sell_order_id, price, quantity, ...) VALUES (...)
     
     return true;
@@ -103,6 +168,10 @@ std::vector<Trade> DatabaseManager::getTradesByUser(UserID user_id, int64_t star
         return trades;
     }
     
+    if (history_) {
+        return history_->trades_by_user(user_id, start_time, history_end(end_time));
+    }
+    
     // SELECT * FROM trades WHERE (buy_user_id=? OR sell_user_id=?) AND timestamp BETWEEN ? AND ?
     
     return trades;
@@ -116,6 +185,10 @@ std::vector<Trade> DatabaseManager::getTradesByInstrument(InstrumentID instrumen
         return trades;
     }
     
+    if (history_) {
+        return history_->trades_by_instrument(instrument_id, start_time, history_end(end_time));
+    }
+    
     // SELECT * FROM trades WHERE instrument_id=? AND timestamp BETWEEN ? AND ?
     
     return trades;
@@ -127,6 +200,10 @@ bool DatabaseManager::insertAccountBalance(UserID user_id, double balance, doubl
         return false;
     }
     
+    if (history_) {
+        return history_->append_account(AccountHistoryRow{user_id, balance, frozen, margin, timestamp});
+    }
+    
     // INSERT INTO account_balance_history (user_id, balance, frozen, margin, timestamp) VALUES (...)
     
     return true;
@@ -137,19 +214,29 @@ bool DatabaseManager::updateAccountBalance(UserID user_id, double balance, doubl
         return false;
     }
     
+    if (history_) {
+        return history_->append_account(AccountHistoryRow{user_id, balance, frozen, margin,
+                                                          get_current_timestamp()});
+    }
+    
     // UPDATE accounts SET balance=?, frozen=?, margin=? WHERE user_id=?
     
     return true;
 }
 
 DatabaseManager::AccountSnapshot DatabaseManager::getAccountSnapshot(UserID user_id, int64_t timestamp) {
-    AccountSnapshot snapshot;
+    AccountSnapshot snapshot{};
     snapshot.user_id = user_id;
     
     if (!isConnected()) {
         return snapshot;
     }
     
+    AccountHistoryRow row;
+    if (history_ && history_->account_at(user_id, timestamp, row)) {
+        snapshot = AccountSnapshot{row.user_id, row.balance, row.frozen, row.margin, row.timestamp};
+    }
+    
     // SELECT * FROM account_balance_history WHERE user_id=? AND timestamp<=? ORDER BY timestamp DESC LIMIT 1
     
     return snapshot;
@@ -164,6 +251,13 @@ std::vector<DatabaseManager::AccountSnapshot> DatabaseManager::getAccountHistory
         return history;
     }
     
+    if (history_) {
+        for (const AccountHistoryRow& row : history_->account_history(user_id, start_time, history_end(end_time))) {
+            history.push_back(AccountSnapshot{row.user_id, row.balance, row.frozen, row.margin, row.timestamp});
+        }
+        return history;
+    }
+    
     // SELECT * FROM account_balance_history WHERE user_id=? AND timestamp BETWEEN ? AND ?
     
     return history;
@@ -175,6 +269,10 @@ bool DatabaseManager::insertPosition(UserID user_id, InstrumentID instrument_id,
         return false;
     }
     
+    if (history_) {
+        return history_->append_position(PositionHistoryRow{user_id, instrument_id, size, entry_price, timestamp});
+    }
+    
     // INSERT INTO position_history (user_id, instrument_id, size, entry_price, timestamp) VALUES (...)
     
     return true;
@@ -186,6 +284,11 @@ bool DatabaseManager::updatePosition(UserID user_id, InstrumentID instrument_id,
         return false;
     }
     
+    if (history_) {
+        return history_->append_position(PositionHistoryRow{user_id, instrument_id, size, entry_price,
+                                                            get_current_timestamp()});
+    }
+    
     // UPDATE positions SET size=?, entry_price=? WHERE user_id=? AND instrument_id=?
     
     return true;
@@ -194,7 +297,7 @@ bool DatabaseManager::updatePosition(UserID user_id, InstrumentID instrument_id,
 DatabaseManager::PositionSnapshot DatabaseManager::getPositionSnapshot(UserID user_id,
                                                                       InstrumentID instrument_id,
                                                                       int64_t timestamp) {
-    PositionSnapshot snapshot;
+    PositionSnapshot snapshot{};
     snapshot.user_id = user_id;
     snapshot.instrument_id = instrument_id;
     
@@ -202,6 +305,11 @@ DatabaseManager::PositionSnapshot DatabaseManager::getPositionSnapshot(UserID us
         return snapshot;
     }
     
+    PositionHistoryRow row;
+    if (history_ && history_->position_at(user_id, instrument_id, timestamp, row)) {
+        snapshot = PositionSnapshot{row.user_id, row.instrument_id, row.size, row.entry_price, row.timestamp};
+    }
+    
     // SELECT * FROM position_history WHERE user_id=? AND instrument_id=? AND timestamp<=? ORDER BY timestamp DESC LIMIT 1
     
     return snapshot;
@@ -217,6 +325,15 @@ std::vector<DatabaseManager::PositionSnapshot> DatabaseManager::getPositionHisto
         return history;
     }
     
+    if (history_) {
+        for (const PositionHistoryRow& row :
+             history_->position_history(user_id, instrument_id, start_time, history_end(end_time))) {
+            history.push_back(PositionSnapshot{row.user_id, row.instrument_id, row.size, row.entry_price,
+                                               row.timestamp});
+        }
+        return history;
+    }
+    
     // SELECT * FROM position_history WHERE user_id=? AND instrument_id=? AND timestamp BETWEEN ? AND ?
     
     return history;
@@ -262,6 +379,11 @@ bool DatabaseManager::beginTransaction() {
         return false;
     }
     
+    if (history_) {
+        history_->begin_transaction();
+        return true;
+    }
+    
     // BEGIN TRANSACTION (SQLite/MySQL/PostgreSQL specific)
     
     return true;
@@ -272,6 +394,10 @@ bool DatabaseManager::commitTransaction() {
         return false;
     }
     
+    if (history_) {
+        return history_->commit_transaction();
+    }
+    
     // COMMIT (SQLite/MySQL/PostgreSQL specific)
     
     return true;
@@ -282,6 +408,11 @@ bool DatabaseManager::rollbackTransaction() {
         return false;
     }
     
+    if (history_) {
+        history_->rollback_transaction();
+        return true;
+    }
+    
     // ROLLBACK (SQLite/MySQL/PostgreSQL specific)
     
     return true;
@@ -292,6 +423,11 @@ void DatabaseManager::createIndexes() {
         return;
     }
     
+    // The embedded store keeps its own zone maps and posting lists
+    if (history_) {
+        return;
+    }
+    
     // Create indexes for better query performance
     // CREATE INDEX idx_orders_user_id ON orders(user_id);
     // CREATE INDEX idx_orders_timestamp ON orders(timestamp);
@@ -321,5 +457,17 @@ void* DatabaseManager::mongodb_connect() {
     return nullptr;  // Placeholder
 }
 
+void* DatabaseManager::embedded_connect() {
+    if (history_) {
+        return history_.get();
+    }
+    history_ = std::make_unique<HistoryStore>();
+    if (!history_->open(connection_string_)) {
+        history_.reset();
+        return nullptr;
+    }
+    return history_.get();
+}
+
 } // namespace perpetual
 
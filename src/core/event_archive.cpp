@@ -0,0 +1,654 @@
+#include "core/event_archive.h"
+#include "core/journal_segment.h"
+#include "core/logger.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <filesystem>
+
+namespace perpetual {
+
+namespace {
+
+constexpr uint32_t kArchiveMagic = 0x43524145;     // "EARC"
+constexpr uint16_t kArchiveVersion = 1;
+constexpr const char* kTempSuffix = ".tmp";
+constexpr size_t kEventTypes = 7;
+
+#pragma pack(push, 1)
+struct ArchiveFileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t block_events;
+};
+
+struct ArchiveFileFooter {
+    uint64_t index_offset;
+    uint32_t block_count;
+    uint32_t index_crc;          // CRC32C of the ArchiveBlockInfo array
+    uint32_t magic;
+};
+
+struct ArchiveBlockHeader {
+    uint32_t crc;                // CRC32C of everything after this field
+    uint32_t event_count;
+    uint16_t column_count;
+    uint16_t reserved;
+    uint32_t data_bytes;         // Column data after the directory
+};
+
+struct ArchiveColumnEntry {
+    uint8_t type;                // EventType or kArchiveAllTypes
+    uint8_t field;               // ArchiveField
+    uint8_t encoding;            // ArchiveEncoding
+    uint8_t bit_width;           // BIT_PACKED only
+    uint32_t rows;
+    uint32_t bytes;
+};
+#pragma pack(pop)
+
+// How one field maps onto an Event
+struct ColumnSpec {
+    uint8_t type;
+    ArchiveField field;
+    ArchiveEncoding encoding;
+    int64_t (*get)(const Event&);
+    void (*set)(Event&, int64_t);
+};
+
+#define ARCHIVE_COLUMN(type, field, encoding, member, cast)                          \
+    ColumnSpec{static_cast<uint8_t>(type), ArchiveField::field, ArchiveEncoding::encoding, \
+               [](const Event& e) { return static_cast<int64_t>(e.member); },        \
+               [](Event& e, int64_t v) { e.member = static_cast<cast>(v); }}
+
+const ColumnSpec kColumns[] = {
+    ARCHIVE_COLUMN(kArchiveAllTypes, TYPE, BIT_PACKED, type, EventType),
+    ARCHIVE_COLUMN(kArchiveAllTypes, SEQUENCE, DELTA_OF_DELTA, sequence_id, SequenceID),
+    ARCHIVE_COLUMN(kArchiveAllTypes, TIMESTAMP, DELTA_OF_DELTA, event_timestamp, Timestamp),
+    ARCHIVE_COLUMN(kArchiveAllTypes, INSTRUMENT, DELTA_VARINT, instrument_id, InstrumentID),
+
+    ARCHIVE_COLUMN(EventType::ORDER_PLACED, ORDER_ID, DELTA_VARINT, data.order_placed.order_id, OrderID),
+    ARCHIVE_COLUMN(EventType::ORDER_PLACED, USER_ID, DELTA_VARINT, data.order_placed.user_id, UserID),
+    ARCHIVE_COLUMN(EventType::ORDER_PLACED, PRICE, DELTA_VARINT, data.order_placed.price, Price),
+    ARCHIVE_COLUMN(EventType::ORDER_PLACED, QUANTITY, DELTA_VARINT, data.order_placed.quantity, Quantity),
+    ARCHIVE_COLUMN(EventType::ORDER_PLACED, SIDE, BIT_PACKED, data.order_placed.side, OrderSide),
+    ARCHIVE_COLUMN(EventType::ORDER_PLACED, ORDER_TYPE, BIT_PACKED, data.order_placed.order_type, OrderType),
+
+    ARCHIVE_COLUMN(EventType::ORDER_MATCHED, TAKER_ORDER_ID, DELTA_VARINT, data.order_matched.taker_order_id, OrderID),
+    ARCHIVE_COLUMN(EventType::ORDER_MATCHED, MAKER_ORDER_ID, DELTA_VARINT, data.order_matched.maker_order_id, OrderID),
+    ARCHIVE_COLUMN(EventType::ORDER_MATCHED, PRICE, DELTA_VARINT, data.order_matched.match_price, Price),
+    ARCHIVE_COLUMN(EventType::ORDER_MATCHED, QUANTITY, DELTA_VARINT, data.order_matched.match_quantity, Quantity),
+
+    ARCHIVE_COLUMN(EventType::ORDER_CANCELLED, ORDER_ID, DELTA_VARINT, data.order_cancelled.order_id, OrderID),
+    ARCHIVE_COLUMN(EventType::ORDER_CANCELLED, USER_ID, DELTA_VARINT, data.order_cancelled.user_id, UserID),
+    ARCHIVE_COLUMN(EventType::ORDER_CANCELLED, OLD_STATUS, BIT_PACKED, data.order_cancelled.old_status, OrderStatus),
+    ARCHIVE_COLUMN(EventType::ORDER_CANCELLED, NEW_STATUS, BIT_PACKED, data.order_cancelled.new_status, OrderStatus),
+
+    ARCHIVE_COLUMN(EventType::ORDER_REJECTED, ORDER_ID, DELTA_VARINT, data.order_rejected.order_id, OrderID),
+    ARCHIVE_COLUMN(EventType::ORDER_REJECTED, USER_ID, DELTA_VARINT, data.order_rejected.user_id, UserID),
+    ARCHIVE_COLUMN(EventType::ORDER_REJECTED, REASON_ID, DELTA_VARINT, data.order_rejected.reason_id, uint32_t),
+
+    ARCHIVE_COLUMN(EventType::TRADE_EXECUTED, BUY_ORDER_ID, DELTA_VARINT, data.trade_executed.trade.buy_order_id, OrderID),
+    ARCHIVE_COLUMN(EventType::TRADE_EXECUTED, SELL_ORDER_ID, DELTA_VARINT, data.trade_executed.trade.sell_order_id, OrderID),
+    ARCHIVE_COLUMN(EventType::TRADE_EXECUTED, BUY_USER_ID, DELTA_VARINT, data.trade_executed.trade.buy_user_id, UserID),
+    ARCHIVE_COLUMN(EventType::TRADE_EXECUTED, SELL_USER_ID, DELTA_VARINT, data.trade_executed.trade.sell_user_id, UserID),
+    ARCHIVE_COLUMN(EventType::TRADE_EXECUTED, PRICE, DELTA_VARINT, data.trade_executed.trade.price, Price),
+    ARCHIVE_COLUMN(EventType::TRADE_EXECUTED, QUANTITY, DELTA_VARINT, data.trade_executed.trade.quantity, Quantity),
+    ARCHIVE_COLUMN(EventType::TRADE_EXECUTED, TRADE_TIMESTAMP, DELTA_OF_DELTA, data.trade_executed.trade.timestamp, Timestamp),
+    ARCHIVE_COLUMN(EventType::TRADE_EXECUTED, TRADE_SEQUENCE, DELTA_OF_DELTA, data.trade_executed.trade.sequence_id, SequenceID),
+    ARCHIVE_COLUMN(EventType::TRADE_EXECUTED, TRADE_INSTRUMENT, DELTA_VARINT, data.trade_executed.trade.instrument_id, InstrumentID),
+    ARCHIVE_COLUMN(EventType::TRADE_EXECUTED, TAKER_BUY, BIT_PACKED, data.trade_executed.trade.is_taker_buy, bool),
+};
+
+#undef ARCHIVE_COLUMN
+
+const ColumnSpec* find_column(uint8_t type, uint8_t field) {
+    for (const auto& spec : kColumns) {
+        if (spec.type == type && static_cast<uint8_t>(spec.field) == field) {
+            return &spec;
+        }
+    }
+    return nullptr;
+}
+
+// Differences are taken in unsigned arithmetic so ids near the top of the
+// range wrap instead of overflowing
+inline uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+inline void put_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t bit_width(const std::vector<int64_t>& values) {
+    uint64_t max = 0;
+    for (int64_t value : values) {
+        max = std::max(max, static_cast<uint64_t>(value));
+    }
+    uint8_t width = 0;
+    while (width < 64 && (max >> width) != 0) {
+        ++width;
+    }
+    return width;
+}
+
+void encode_column(ArchiveEncoding encoding, uint8_t width,
+                   const std::vector<int64_t>& values, std::string& out) {
+    switch (encoding) {
+        case ArchiveEncoding::DELTA_VARINT: {
+            uint64_t previous = 0;
+            for (int64_t value : values) {
+                put_varint(out, zigzag(static_cast<int64_t>(static_cast<uint64_t>(value) - previous)));
+                previous = static_cast<uint64_t>(value);
+            }
+            break;
+        }
+        case ArchiveEncoding::DELTA_OF_DELTA: {
+            uint64_t previous = 0;
+            uint64_t previous_delta = 0;
+            for (int64_t value : values) {
+                uint64_t delta = static_cast<uint64_t>(value) - previous;
+                put_varint(out, zigzag(static_cast<int64_t>(delta - previous_delta)));
+                previous = static_cast<uint64_t>(value);
+                previous_delta = delta;
+            }
+            break;
+        }
+        case ArchiveEncoding::BIT_PACKED: {
+            uint64_t acc = 0;
+            unsigned bits = 0;
+            for (int64_t value : values) {
+                uint64_t v = static_cast<uint64_t>(value);
+                acc |= v << bits;
+                bits += width;
+                if (bits >= 64) {
+                    for (int i = 0; i < 8; ++i) {
+                        out.push_back(static_cast<char>(acc >> (8 * i)));
+                    }
+                    bits -= 64;
+                    acc = bits > 0 ? v >> (width - bits) : 0;  // Bits that did not fit
+                }
+            }
+            for (unsigned i = 0; i * 8 < bits; ++i) {
+                out.push_back(static_cast<char>(acc >> (8 * i)));
+            }
+            break;
+        }
+    }
+}
+
+bool decode_column(const ArchiveColumnEntry& entry, const char* data,
+                   std::vector<int64_t>& values) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    const uint8_t* end = p + entry.bytes;
+    values.resize(entry.rows);
+
+    switch (static_cast<ArchiveEncoding>(entry.encoding)) {
+        case ArchiveEncoding::DELTA_VARINT: {
+            uint64_t previous = 0;
+            for (auto& value : values) {
+                uint64_t raw;
+                if (!get_varint(p, end, raw)) {
+                    return false;
+                }
+                previous += static_cast<uint64_t>(unzigzag(raw));
+                value = static_cast<int64_t>(previous);
+            }
+            return true;
+        }
+        case ArchiveEncoding::DELTA_OF_DELTA: {
+            uint64_t previous = 0;
+            uint64_t delta = 0;
+            for (auto& value : values) {
+                uint64_t raw;
+                if (!get_varint(p, end, raw)) {
+                    return false;
+                }
+                delta += static_cast<uint64_t>(unzigzag(raw));
+                previous += delta;
+                value = static_cast<int64_t>(previous);
+            }
+            return true;
+        }
+        case ArchiveEncoding::BIT_PACKED: {
+            unsigned width = entry.bit_width;
+            if (width > 64 || (static_cast<uint64_t>(entry.rows) * width + 7) / 8 > entry.bytes) {
+                return false;
+            }
+            uint64_t mask = width == 64 ? ~0ULL : (1ULL << width) - 1;
+            uint64_t bit = 0;
+            for (auto& value : values) {
+                uint64_t v = 0;
+                for (unsigned i = 0; i < width; ) {
+                    uint64_t byte = p[(bit + i) / 8];
+                    unsigned shift = (bit + i) % 8;
+                    unsigned take = std::min(8 - shift, width - i);
+                    v |= ((byte >> shift) & ((1ULL << take) - 1)) << i;
+                    i += take;
+                }
+                value = static_cast<int64_t>(v & mask);
+                bit += width;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// Walks the column directory of a validated block
+struct BlockColumns {
+    const ArchiveColumnEntry* entries = nullptr;
+    const char* data = nullptr;
+    uint16_t count = 0;
+    uint32_t event_count = 0;
+};
+
+bool parse_block(const char* block, size_t length, BlockColumns& columns) {
+    if (length < sizeof(ArchiveBlockHeader)) {
+        return false;
+    }
+    ArchiveBlockHeader header;
+    memcpy(&header, block, sizeof(header));
+    size_t directory = static_cast<size_t>(header.column_count) * sizeof(ArchiveColumnEntry);
+    if (sizeof(header) + directory + header.data_bytes != length ||
+        crc32c(block + sizeof(uint32_t), length - sizeof(uint32_t)) != header.crc) {
+        return false;
+    }
+
+    columns.entries = reinterpret_cast<const ArchiveColumnEntry*>(block + sizeof(header));
+    columns.data = block + sizeof(header) + directory;
+    columns.count = header.column_count;
+    columns.event_count = header.event_count;
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < columns.count; ++i) {
+        total += columns.entries[i].bytes;
+    }
+    return total == header.data_bytes;
+}
+
+} // namespace
+
+// ============================================================================
+// EventArchiveWriter
+// ============================================================================
+
+EventArchiveWriter::EventArchiveWriter(size_t block_events)
+    : block_events_(std::max<size_t>(1, block_events)) {
+    block_.reserve(block_events_);
+}
+
+EventArchiveWriter::~EventArchiveWriter() {
+    abandon();
+}
+
+bool EventArchiveWriter::open(const std::string& path) {
+    abandon();
+    path_ = path;
+    std::string temp = path + kTempSuffix;
+    fd_ = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        LOG_ERROR("Failed to create archive " + temp + ": " + strerror(errno));
+        return false;
+    }
+
+    offset_ = 0;
+    event_count_ = 0;
+    block_.clear();
+    index_.clear();
+
+    ArchiveFileHeader header{kArchiveMagic, kArchiveVersion, 0,
+                             static_cast<uint32_t>(block_events_)};
+    return write(&header, sizeof(header));
+}
+
+bool EventArchiveWriter::append(const Event& event) {
+    if (fd_ < 0) {
+        return false;
+    }
+    block_.push_back(event);
+    ++event_count_;
+    return block_.size() < block_events_ || flush_block();
+}
+
+bool EventArchiveWriter::close() {
+    if (fd_ < 0) {
+        return false;
+    }
+    if (!block_.empty() && !flush_block()) {
+        abandon();
+        return false;
+    }
+
+    ArchiveFileFooter footer;
+    footer.index_offset = offset_;
+    footer.block_count = static_cast<uint32_t>(index_.size());
+    footer.index_crc = crc32c(index_.data(), index_.size() * sizeof(ArchiveBlockInfo));
+    footer.magic = kArchiveMagic;
+    if (!write(index_.data(), index_.size() * sizeof(ArchiveBlockInfo)) ||
+        !write(&footer, sizeof(footer)) || ::fdatasync(fd_) != 0) {
+        LOG_ERROR("Failed to write archive " + path_ + ": " + strerror(errno));
+        abandon();
+        return false;
+    }
+    ::close(fd_);
+    fd_ = -1;
+
+    std::string temp = path_ + kTempSuffix;
+    if (::rename(temp.c_str(), path_.c_str()) != 0) {
+        LOG_ERROR("Failed to publish archive " + path_ + ": " + strerror(errno));
+        ::unlink(temp.c_str());
+        return false;
+    }
+    std::string dir = std::filesystem::path(path_).parent_path().string();
+    sync_directory(dir.empty() ? "." : dir);
+    return true;
+}
+
+bool EventArchiveWriter::flush_block() {
+    // Rows of each event type, in event order
+    std::vector<size_t> rows[kEventTypes];
+    for (size_t i = 0; i < block_.size(); ++i) {
+        size_t type = static_cast<size_t>(block_[i].type);
+        if (type < kEventTypes) {
+            rows[type].push_back(i);
+        }
+    }
+
+    std::vector<ArchiveColumnEntry> directory;
+    std::string data;
+    std::vector<int64_t> values;
+    for (const auto& spec : kColumns) {
+        values.clear();
+        if (spec.type == kArchiveAllTypes) {
+            for (const auto& event : block_) {
+                values.push_back(spec.get(event));
+            }
+        } else {
+            for (size_t row : rows[spec.type]) {
+                values.push_back(spec.get(block_[row]));
+            }
+            if (values.empty()) {
+                continue;  // Type not present in this block
+            }
+        }
+
+        ArchiveColumnEntry entry;
+        entry.type = spec.type;
+        entry.field = static_cast<uint8_t>(spec.field);
+        entry.encoding = static_cast<uint8_t>(spec.encoding);
+        entry.bit_width = spec.encoding == ArchiveEncoding::BIT_PACKED ? bit_width(values) : 0;
+        entry.rows = static_cast<uint32_t>(values.size());
+        size_t before = data.size();
+        encode_column(spec.encoding, entry.bit_width, values, data);
+        entry.bytes = static_cast<uint32_t>(data.size() - before);
+        directory.push_back(entry);
+    }
+
+    ArchiveBlockHeader header;
+    header.event_count = static_cast<uint32_t>(block_.size());
+    header.column_count = static_cast<uint16_t>(directory.size());
+    header.reserved = 0;
+    header.data_bytes = static_cast<uint32_t>(data.size());
+
+    buffer_.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer_.append(reinterpret_cast<const char*>(directory.data()),
+                   directory.size() * sizeof(ArchiveColumnEntry));
+    buffer_.append(data);
+    header.crc = crc32c(buffer_.data() + sizeof(uint32_t), buffer_.size() - sizeof(uint32_t));
+    memcpy(&buffer_[0], &header.crc, sizeof(header.crc));
+
+    ArchiveBlockInfo info;
+    info.offset = offset_;
+    info.length = static_cast<uint32_t>(buffer_.size());
+    info.event_count = header.event_count;
+    info.min_sequence = info.max_sequence = block_.front().sequence_id;
+    info.min_timestamp = info.max_timestamp = block_.front().event_timestamp;
+    for (const auto& event : block_) {
+        info.min_sequence = std::min(info.min_sequence, event.sequence_id);
+        info.max_sequence = std::max(info.max_sequence, event.sequence_id);
+        info.min_timestamp = std::min(info.min_timestamp, event.event_timestamp);
+        info.max_timestamp = std::max(info.max_timestamp, event.event_timestamp);
+    }
+
+    block_.clear();
+    if (!write(buffer_.data(), buffer_.size())) {
+        LOG_ERROR("Failed to write archive " + path_ + ": " + strerror(errno));
+        return false;
+    }
+    index_.push_back(info);
+    return true;
+}
+
+bool EventArchiveWriter::write(const void* data, size_t length) {
+    const char* p = static_cast<const char*>(data);
+    size_t written = 0;
+    while (written < length) {
+        ssize_t n = ::write(fd_, p + written, length - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    offset_ += length;
+    return true;
+}
+
+void EventArchiveWriter::abandon() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+        ::unlink((path_ + kTempSuffix).c_str());
+    }
+}
+
+// ============================================================================
+// EventArchiveReader
+// ============================================================================
+
+EventArchiveReader::~EventArchiveReader() {
+    close();
+}
+
+bool EventArchiveReader::open(const std::string& path) {
+    close();
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0 ||
+        static_cast<size_t>(st.st_size) < sizeof(ArchiveFileHeader) + sizeof(ArchiveFileFooter)) {
+        close();
+        return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) {
+        close();
+        return false;
+    }
+    map_ = static_cast<const char*>(map);
+
+    ArchiveFileHeader header;
+    ArchiveFileFooter footer;
+    memcpy(&header, map_, sizeof(header));
+    memcpy(&footer, map_ + size_ - sizeof(footer), sizeof(footer));
+    uint64_t index_bytes = static_cast<uint64_t>(footer.block_count) * sizeof(ArchiveBlockInfo);
+    if (header.magic != kArchiveMagic || header.version != kArchiveVersion ||
+        footer.magic != kArchiveMagic ||
+        footer.index_offset + index_bytes + sizeof(footer) != size_ ||
+        crc32c(map_ + footer.index_offset, index_bytes) != footer.index_crc) {
+        LOG_WARN("Invalid event archive " + path);
+        close();
+        return false;
+    }
+
+    blocks_.resize(footer.block_count);
+    memcpy(blocks_.data(), map_ + footer.index_offset, index_bytes);
+    for (const auto& block : blocks_) {
+        if (block.offset < sizeof(header) || block.offset + block.length > footer.index_offset) {
+            LOG_WARN("Invalid event archive index " + path);
+            close();
+            return false;
+        }
+        event_count_ += block.event_count;
+    }
+    ::madvise(const_cast<char*>(map_), size_, MADV_SEQUENTIAL);
+    return true;
+}
+
+void EventArchiveReader::close() {
+    if (map_) {
+        ::munmap(const_cast<char*>(map_), size_);
+        map_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    size_ = 0;
+    event_count_ = 0;
+    blocks_.clear();
+}
+
+const char* EventArchiveReader::block_data(size_t block) const {
+    return block < blocks_.size() ? map_ + blocks_[block].offset : nullptr;
+}
+
+bool EventArchiveReader::read_block(size_t block, std::vector<Event>& events) const {
+    BlockColumns columns;
+    const char* data = block_data(block);
+    if (!data || !parse_block(data, blocks_[block].length, columns)) {
+        return false;
+    }
+
+    // The type column comes first and says which rows the payload columns fill
+    size_t first = events.size();
+    events.resize(first + columns.event_count);
+    std::vector<size_t> rows[kEventTypes];
+    std::vector<int64_t> values;
+    const char* column = columns.data;
+    for (size_t i = 0; i < columns.count; ++i) {
+        const ArchiveColumnEntry& entry = columns.entries[i];
+        const char* column_data = column;
+        column += entry.bytes;
+
+        const ColumnSpec* spec = find_column(entry.type, entry.field);
+        if (!spec) {
+            continue;  // Written by a newer version
+        }
+        if (!decode_column(entry, column_data, values)) {
+            events.resize(first);
+            return false;
+        }
+
+        if (entry.type == kArchiveAllTypes) {
+            if (values.size() != columns.event_count) {
+                events.resize(first);
+                return false;
+            }
+            for (size_t row = 0; row < values.size(); ++row) {
+                spec->set(events[first + row], values[row]);
+            }
+            if (spec->field == ArchiveField::TYPE) {
+                for (size_t row = 0; row < values.size(); ++row) {
+                    if (static_cast<uint64_t>(values[row]) < kEventTypes) {
+                        rows[values[row]].push_back(first + row);
+                    }
+                }
+            }
+            continue;
+        }
+
+        const auto& type_rows = rows[entry.type < kEventTypes ? entry.type : 0];
+        if (entry.type >= kEventTypes || values.size() != type_rows.size()) {
+            events.resize(first);
+            return false;
+        }
+        for (size_t row = 0; row < values.size(); ++row) {
+            spec->set(events[type_rows[row]], values[row]);
+        }
+    }
+    return true;
+}
+
+bool EventArchiveReader::read_column(size_t block, uint8_t type, ArchiveField field,
+                                     std::vector<int64_t>& values) const {
+    BlockColumns columns;
+    const char* data = block_data(block);
+    if (!data || !parse_block(data, blocks_[block].length, columns)) {
+        return false;
+    }
+
+    values.clear();
+    const char* column = columns.data;
+    for (size_t i = 0; i < columns.count; ++i) {
+        const ArchiveColumnEntry& entry = columns.entries[i];
+        if (entry.type == type && entry.field == static_cast<uint8_t>(field)) {
+            return decode_column(entry, column, values);
+        }
+        column += entry.bytes;
+    }
+    return true;
+}
+
+bool EventArchiveReader::read_events(SequenceID from, SequenceID to,
+                                     std::vector<Event>& events) const {
+    std::vector<Event> block_events;
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+        if (blocks_[i].max_sequence < from || blocks_[i].min_sequence > to) {
+            continue;
+        }
+        block_events.clear();
+        if (!read_block(i, block_events)) {
+            return false;
+        }
+        for (const auto& event : block_events) {
+            if (event.sequence_id >= from && event.sequence_id <= to) {
+                events.push_back(event);
+            }
+        }
+    }
+    return true;
+}
+
+bool EventArchiveReader::is_archive(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    uint32_t magic = 0;
+    bool ok = ::pread(fd, &magic, sizeof(magic), 0) == static_cast<ssize_t>(sizeof(magic));
+    ::close(fd);
+    return ok && magic == kArchiveMagic;
+}
+
+} // namespace perpetual
@@ -1,190 +1,372 @@
 #include "core/event_sourcing.h"
 #include "core/deterministic_calculator.h"
+#include "core/logger.h"
 #include <fstream>
-#include <sstream>
-#include <iomanip>
 #include <algorithm>
 #include <shared_mutex>
 #include <mutex>
 #include <unordered_map>
 #include <cstring>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace perpetual {
 
-// Event serialization
-std::string Event::serialize() const {
-    std::ostringstream oss;
-    oss << static_cast<uint8_t>(type) << ","
-        << sequence_id << ","
-        << event_timestamp << ","
-        << instrument_id << ",";
+namespace {
+
+// Packed field access (encoded events are not aligned)
+template<typename T>
+inline void put(char*& out, T value) {
+    memcpy(out, &value, sizeof(T));
+    out += sizeof(T);
+}
+
+template<typename T>
+inline T get(const char*& in) {
+    T value;
+    memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+    return value;
+}
+
+// Payload size per event type (format version 1)
+constexpr size_t kOrderPlacedPayload = 8 + 8 + 8 + 8 + 1 + 1;
+constexpr size_t kOrderMatchedPayload = 8 + 8 + 8 + 8;
+constexpr size_t kOrderCancelledPayload = 8 + 8 + 1 + 1;
+constexpr size_t kOrderRejectedPayload = 8 + 8 + 4;
+constexpr size_t kTradeExecutedPayload = 8 * 4 + 8 * 4 + 4 + 1;
+
+size_t payload_size(EventType type) {
+    switch (type) {
+        case EventType::ORDER_PLACED: return kOrderPlacedPayload;
+        case EventType::ORDER_MATCHED: return kOrderMatchedPayload;
+        case EventType::ORDER_CANCELLED: return kOrderCancelledPayload;
+        case EventType::ORDER_REJECTED: return kOrderRejectedPayload;
+        case EventType::TRADE_EXECUTED: return kTradeExecutedPayload;
+        default: return 0;
+    }
+}
+
+} // namespace
+
+// Binary encoding
+size_t Event::encoded_size() const {
+    return sizeof(EncodedEventHeader) + payload_size(type);
+}
+
+size_t Event::encode(char* out) const {
+    EncodedEventHeader header;
+    header.type = static_cast<uint8_t>(type);
+    header.version = EVENT_FORMAT_VERSION;
+    header.length = static_cast<uint16_t>(payload_size(type));
+    header.instrument_id = instrument_id;
+    header.sequence_id = sequence_id;
+    header.event_timestamp = event_timestamp;
+    memcpy(out, &header, sizeof(header));
     
+    char* p = out + sizeof(header);
     switch (type) {
         case EventType::ORDER_PLACED:
-            oss << data.order_placed.order_id << ","
-                << data.order_placed.user_id << ","
-                << static_cast<uint8_t>(data.order_placed.side) << ","
-                << static_cast<uint8_t>(data.order_placed.order_type) << ","
-                << data.order_placed.price << ","
-                << data.order_placed.quantity;
+            put(p, data.order_placed.order_id);
+            put(p, data.order_placed.user_id);
+            put(p, data.order_placed.price);
+            put(p, data.order_placed.quantity);
+            put(p, static_cast<uint8_t>(data.order_placed.side));
+            put(p, static_cast<uint8_t>(data.order_placed.order_type));
             break;
         case EventType::ORDER_MATCHED:
-            oss << data.order_matched.taker_order_id << ","
-                << data.order_matched.maker_order_id << ","
-                << data.order_matched.match_price << ","
-                << data.order_matched.match_quantity;
+            put(p, data.order_matched.taker_order_id);
+            put(p, data.order_matched.maker_order_id);
+            put(p, data.order_matched.match_price);
+            put(p, data.order_matched.match_quantity);
             break;
         case EventType::ORDER_CANCELLED:
-            oss << data.order_cancelled.order_id << ","
-                << data.order_cancelled.user_id << ","
-                << static_cast<uint8_t>(data.order_cancelled.old_status) << ","
-                << static_cast<uint8_t>(data.order_cancelled.new_status);
+            put(p, data.order_cancelled.order_id);
+            put(p, data.order_cancelled.user_id);
+            put(p, static_cast<uint8_t>(data.order_cancelled.old_status));
+            put(p, static_cast<uint8_t>(data.order_cancelled.new_status));
             break;
         case EventType::ORDER_REJECTED:
-            oss << data.order_rejected.order_id << ","
-                << data.order_rejected.user_id << ","
-                << std::string(data.order_rejected.reason);
+            put(p, data.order_rejected.order_id);
+            put(p, data.order_rejected.user_id);
+            put(p, data.order_rejected.reason_id);
             break;
-        case EventType::TRADE_EXECUTED:
-            oss << data.trade_executed.trade.buy_order_id << ","
-                << data.trade_executed.trade.sell_order_id << ","
-                << data.trade_executed.trade.buy_user_id << ","
-                << data.trade_executed.trade.sell_user_id << ","
-                << data.trade_executed.trade.instrument_id << ","
-                << data.trade_executed.trade.price << ","
-                << data.trade_executed.trade.quantity << ","
-                << data.trade_executed.trade.timestamp << ","
-                << data.trade_executed.trade.sequence_id << ","
-                << (data.trade_executed.trade.is_taker_buy ? 1 : 0);
+        case EventType::TRADE_EXECUTED: {
+            const Trade& trade = data.trade_executed.trade;
+            put(p, trade.buy_order_id);
+            put(p, trade.sell_order_id);
+            put(p, trade.buy_user_id);
+            put(p, trade.sell_user_id);
+            put(p, trade.price);
+            put(p, trade.quantity);
+            put(p, trade.timestamp);
+            put(p, trade.sequence_id);
+            put(p, trade.instrument_id);
+            put(p, static_cast<uint8_t>(trade.is_taker_buy ? 1 : 0));
             break;
+        }
         default:
             break;
     }
     
-    return oss.str();
+    return static_cast<size_t>(p - out);
 }
 
-// Event deserialization
-Event Event::deserialize(const std::string& data_str) {
-    Event event;
-    std::istringstream iss(data_str);
-    std::string token;
-    
-    // Parse type
-    std::getline(iss, token, ',');
-    event.type = static_cast<EventType>(std::stoul(token));
-    
-    // Parse sequence_id
-    std::getline(iss, token, ',');
-    event.sequence_id = std::stoull(token);
+bool Event::decode(const char* data_in, size_t length, Event& event) {
+    EncodedEventHeader header;
+    if (length < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data_in, sizeof(header));
+    if (header.version == 0 || header.version > EVENT_FORMAT_VERSION ||
+        sizeof(header) + header.length > length) {
+        return false;
+    }
     
-    // Parse timestamp
-    std::getline(iss, token, ',');
-    event.event_timestamp = std::stoll(token);
+    event = Event();
+    event.type = static_cast<EventType>(header.type);
+    event.sequence_id = header.sequence_id;
+    event.event_timestamp = header.event_timestamp;
+    event.instrument_id = header.instrument_id;
     
-    // Parse instrument_id
-    std::getline(iss, token, ',');
-    event.instrument_id = std::stoul(token);
+    // Newer versions may append fields; read the ones this version knows
+    if (header.length < payload_size(event.type)) {
+        return false;
+    }
     
-    // Parse type-specific data
+    const char* p = data_in + sizeof(header);
     switch (event.type) {
         case EventType::ORDER_PLACED:
-            std::getline(iss, token, ',');
-            event.data.order_placed.order_id = std::stoull(token);
-            std::getline(iss, token, ',');
-            event.data.order_placed.user_id = std::stoull(token);
-            std::getline(iss, token, ',');
-            event.data.order_placed.side = static_cast<OrderSide>(std::stoul(token));
-            std::getline(iss, token, ',');
-            event.data.order_placed.order_type = static_cast<OrderType>(std::stoul(token));
-            std::getline(iss, token, ',');
-            event.data.order_placed.price = std::stoll(token);
-            std::getline(iss, token, ',');
-            event.data.order_placed.quantity = std::stoll(token);
+            event.data.order_placed.order_id = get<OrderID>(p);
+            event.data.order_placed.user_id = get<UserID>(p);
+            event.data.order_placed.price = get<Price>(p);
+            event.data.order_placed.quantity = get<Quantity>(p);
+            event.data.order_placed.side = static_cast<OrderSide>(get<uint8_t>(p));
+            event.data.order_placed.order_type = static_cast<OrderType>(get<uint8_t>(p));
             break;
         case EventType::ORDER_MATCHED:
-            std::getline(iss, token, ',');
-            event.data.order_matched.taker_order_id = std::stoull(token);
-            std::getline(iss, token, ',');
-            event.data.order_matched.maker_order_id = std::stoull(token);
-            std::getline(iss, token, ',');
-            event.data.order_matched.match_price = std::stoll(token);
-            std::getline(iss, token, ',');
-            event.data.order_matched.match_quantity = std::stoll(token);
+            event.data.order_matched.taker_order_id = get<OrderID>(p);
+            event.data.order_matched.maker_order_id = get<OrderID>(p);
+            event.data.order_matched.match_price = get<Price>(p);
+            event.data.order_matched.match_quantity = get<Quantity>(p);
             break;
         case EventType::ORDER_CANCELLED:
-            std::getline(iss, token, ',');
-            event.data.order_cancelled.order_id = std::stoull(token);
-            std::getline(iss, token, ',');
-            event.data.order_cancelled.user_id = std::stoull(token);
-            std::getline(iss, token, ',');
-            event.data.order_cancelled.old_status = static_cast<OrderStatus>(std::stoul(token));
-            std::getline(iss, token, ',');
-            event.data.order_cancelled.new_status = static_cast<OrderStatus>(std::stoul(token));
+            event.data.order_cancelled.order_id = get<OrderID>(p);
+            event.data.order_cancelled.user_id = get<UserID>(p);
+            event.data.order_cancelled.old_status = static_cast<OrderStatus>(get<uint8_t>(p));
+            event.data.order_cancelled.new_status = static_cast<OrderStatus>(get<uint8_t>(p));
             break;
         case EventType::ORDER_REJECTED:
-            std::getline(iss, token, ',');
-            event.data.order_rejected.order_id = std::stoull(token);
-            std::getline(iss, token, ',');
-            event.data.order_rejected.user_id = std::stoull(token);
-            std::getline(iss, token);
-            strncpy(event.data.order_rejected.reason, token.c_str(), sizeof(event.data.order_rejected.reason) - 1);
-            event.data.order_rejected.reason[sizeof(event.data.order_rejected.reason) - 1] = '\0';
+            event.data.order_rejected.order_id = get<OrderID>(p);
+            event.data.order_rejected.user_id = get<UserID>(p);
+            event.data.order_rejected.reason_id = get<uint32_t>(p);
             break;
-        case EventType::TRADE_EXECUTED:
-            std::getline(iss, token, ',');
-            event.data.trade_executed.trade.buy_order_id = std::stoull(token);
-            std::getline(iss, token, ',');
-            event.data.trade_executed.trade.sell_order_id = std::stoull(token);
-            std::getline(iss, token, ',');
-            event.data.trade_executed.trade.buy_user_id = std::stoull(token);
-            std::getline(iss, token, ',');
-            event.data.trade_executed.trade.sell_user_id = std::stoull(token);
-            std::getline(iss, token, ',');
-            event.data.trade_executed.trade.instrument_id = std::stoul(token);
-            std::getline(iss, token, ',');
-            event.data.trade_executed.trade.price = std::stoll(token);
-            std::getline(iss, token, ',');
-            event.data.trade_executed.trade.quantity = std::stoll(token);
-            std::getline(iss, token, ',');
-            event.data.trade_executed.trade.timestamp = std::stoll(token);
-            std::getline(iss, token, ',');
-            event.data.trade_executed.trade.sequence_id = std::stoull(token);
-            std::getline(iss, token, ',');
-            event.data.trade_executed.trade.is_taker_buy = (std::stoul(token) == 1);
+        case EventType::TRADE_EXECUTED: {
+            Trade& trade = event.data.trade_executed.trade;
+            trade.buy_order_id = get<OrderID>(p);
+            trade.sell_order_id = get<OrderID>(p);
+            trade.buy_user_id = get<UserID>(p);
+            trade.sell_user_id = get<UserID>(p);
+            trade.price = get<Price>(p);
+            trade.quantity = get<Quantity>(p);
+            trade.timestamp = get<Timestamp>(p);
+            trade.sequence_id = get<SequenceID>(p);
+            trade.instrument_id = get<InstrumentID>(p);
+            trade.is_taker_buy = get<uint8_t>(p) != 0;
             break;
+        }
         default:
             break;
     }
     
+    return true;
+}
+
+std::string Event::serialize() const {
+    std::string out(encoded_size(), '\0');
+    encode(&out[0]);
+    return out;
+}
+
+Event Event::deserialize(const std::string& data_str) {
+    Event event;
+    decode(data_str.data(), data_str.size(), event);
     return event;
 }
 
+// ReasonTable implementation
+// File layout: repeated { uint32_t id; uint32_t length; char text[length]; }
+bool ReasonTable::open(const std::string& path) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    path_ = path;
+    reasons_.clear();
+    ids_.clear();
+    
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return true;  // Nothing interned yet
+    }
+    
+    uint32_t id = 0;
+    uint32_t length = 0;
+    while (file.read(reinterpret_cast<char*>(&id), sizeof(id)) &&
+           file.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+        std::string reason(length, '\0');
+        if (!file.read(&reason[0], length) || id != reasons_.size() + 1) {
+            break;  // Torn tail from a crash while interning
+        }
+        ids_.emplace(reason, id);
+        reasons_.push_back(std::move(reason));
+    }
+    return true;
+}
+
+uint32_t ReasonTable::intern(const std::string& reason) {
+    if (reason.empty()) {
+        return 0;
+    }
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = ids_.find(reason);
+        if (it != ids_.end()) {
+            return it->second;
+        }
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto it = ids_.find(reason);
+    if (it != ids_.end()) {
+        return it->second;
+    }
+    
+    // New reasons are rare; persist before any event can reference the id
+    uint32_t id = static_cast<uint32_t>(reasons_.size() + 1);
+    if (!path_.empty() && !persist(id, reason)) {
+        return 0;
+    }
+    reasons_.push_back(reason);
+    ids_.emplace(reason, id);
+    return id;
+}
+
+std::string ReasonTable::lookup(uint32_t id) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (id == 0 || id > reasons_.size()) {
+        return std::string();
+    }
+    return reasons_[id - 1];
+}
+
+size_t ReasonTable::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return reasons_.size();
+}
+
+bool ReasonTable::persist(uint32_t id, const std::string& reason) {
+    int fd = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    uint32_t length = static_cast<uint32_t>(reason.size());
+    std::string record(sizeof(id) + sizeof(length), '\0');
+    memcpy(&record[0], &id, sizeof(id));
+    memcpy(&record[sizeof(id)], &length, sizeof(length));
+    record += reason;
+    bool ok = ::write(fd, record.data(), record.size()) == static_cast<ssize_t>(record.size()) &&
+              ::fdatasync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
 // Deterministic hash
 uint64_t Event::hash() const {
-    uint64_t h = static_cast<uint64_t>(type);
-    h = h * 31 + sequence_id;
-    h = h * 31 + event_timestamp;
-    h = h * 31 + instrument_id;
+    char buffer[sizeof(EncodedEventHeader) + sizeof(data)];
+    size_t length = encode(buffer);
+    return hash64(buffer, length);
+}
+
+// EventTailRing implementation
+namespace {
+constexpr uint64_t kSlotBusy = UINT64_MAX - 1;
+}
+
+EventTailRing::EventTailRing(size_t capacity, SequenceID base_sequence)
+    : slots_(new Slot[std::max<size_t>(capacity, 1)]),
+      capacity_(std::max<size_t>(capacity, 1)),
+      base_sequence_(base_sequence) {
+}
+
+void EventTailRing::push(const char* data, size_t length) {
+    uint64_t index = head_.load(std::memory_order_relaxed);
+    Slot& slot = slots_[index % capacity_];
+    EventView view(data, length);
     
-    switch (type) {
-        case EventType::ORDER_PLACED:
-            h = h * 31 + data.order_placed.order_id;
-            h = h * 31 + data.order_placed.user_id;
-            break;
-        case EventType::ORDER_MATCHED:
-            h = h * 31 + data.order_matched.taker_order_id;
-            h = h * 31 + data.order_matched.maker_order_id;
-            break;
-        case EventType::TRADE_EXECUTED:
-            h = h * 31 + data.trade_executed.trade.buy_order_id;
-            h = h * 31 + data.trade_executed.trade.sell_order_id;
-            break;
-        default:
-            break;
+    // Readers that see kBusy, or another index afterwards, drop their copy
+    slot.index.store(kSlotBusy, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.sequence.store(view.sequence_id(), std::memory_order_relaxed);
+    slot.length = static_cast<uint32_t>(length);
+    memcpy(slot.data, data, length);
+    slot.index.store(index, std::memory_order_release);
+    head_.store(index + 1, std::memory_order_release);
+}
+
+bool EventTailRing::read(uint64_t index, char* buffer, size_t& length) const {
+    const Slot& slot = slots_[index % capacity_];
+    if (slot.index.load(std::memory_order_acquire) != index) {
+        return false;
+    }
+    length = std::min<size_t>(slot.length, kMaxEncodedEventSize);
+    memcpy(buffer, slot.data, length);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.index.load(std::memory_order_relaxed) == index;
+}
+
+bool EventTailRing::sequence_at(uint64_t index, SequenceID& sequence) const {
+    const Slot& slot = slots_[index % capacity_];
+    if (slot.index.load(std::memory_order_acquire) != index) {
+        return false;
+    }
+    sequence = slot.sequence.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.index.load(std::memory_order_relaxed) == index;
+}
+
+bool EventTailRing::find_after(SequenceID sequence, uint64_t& index) const {
+    uint64_t head = this->head();
+    uint64_t low = head > capacity_ ? head - capacity_ : 0;
+    
+    // Everything after sequence must be in the ring: the ring reaches back
+    // to the first append, or its oldest event is not after sequence
+    SequenceID oldest = 0;
+    if (low == 0) {
+        if (sequence < base_sequence_) {
+            return false;
+        }
+    } else if (!sequence_at(low, oldest) || oldest > sequence) {
+        return false;
     }
     
-    return h;
+    // Sequences grow with the index. A slot overwritten while searching
+    // means the cursor is about to fall behind anyway.
+    uint64_t high = head;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        SequenceID at = 0;
+        if (!sequence_at(mid, at)) {
+            return false;
+        }
+        if (at <= sequence) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    index = low;
+    return true;
 }
 
 // EventStore implementation
@@ -192,62 +374,195 @@ EventStore::EventStore() {
 }
 
 EventStore::~EventStore() {
+    stop_journal_worker();
     flush();
-    if (event_log_) {
-        event_log_->close();
+    if (initialized_ && event_count_ != checkpoint_count_) {
+        checkpoint_indexes();
+    }
+    if (initialized_ && manifest_dirty_) {
+        write_manifest();
+    }
+    if (journal_) {
+        journal_->close();
+    }
+}
+
+bool EventStore::initialize(const std::string& data_dir, const EventStoreConfig& config) {
+    return load_indexes(data_dir, config, true) && open_writer();
+}
+
+bool EventStore::open_follower(const std::string& data_dir, const EventStoreConfig& config) {
+    if (!load_indexes(data_dir, config, false)) {
+        return false;
+    }
+    index_tail(nullptr, SIZE_MAX);
+    return true;
+}
+
+size_t EventStore::follow(const std::function<void(const EventView&)>& handler,
+                          size_t max_events) {
+    if (!tail_reader_ || initialized_) {
+        return 0;
+    }
+    tail_reader_->resume();
+    return index_tail(handler, max_events);
+}
+
+bool EventStore::take_over() {
+    if (!tail_reader_ || initialized_) {
+        return false;
+    }
+    
+    // Reasons the writer interned while this store followed it
+    if (!reasons_.open(data_dir_ + "/reasons.tbl")) {
+        return false;
     }
+    {
+        // Segments the writer truncated meanwhile
+        std::unique_lock<std::shared_mutex> index_lock(index_mutex_);
+        std::vector<uint64_t> on_disk = list_journal_segments(event_log_path_);
+        uint64_t oldest = on_disk.empty() ? 0 : on_disk.front();
+        while (!sealed_segments_.empty() && sealed_segments_.front().segment < oldest) {
+            base_chain_ = sealed_segments_.front().last_chain;
+            retained_segment_ = sealed_segments_.front().segment + 1;
+            sealed_segments_.erase(sealed_segments_.begin());
+        }
+        prune_indexes(retained_segment_);
+    }
+    tail_reader_->resume();
+    return open_writer();
 }
 
-bool EventStore::initialize(const std::string& data_dir) {
+bool EventStore::load_indexes(const std::string& data_dir, const EventStoreConfig& config,
+                              bool writer) {
     data_dir_ = data_dir;
-    event_log_path_ = data_dir + "/events.log";
+    event_log_path_ = event_log_dir(data_dir);
+    sparse_index_path_ = data_dir + "/events.idx";
+    checkpoint_path_ = data_dir + "/events.ckpt";
+    manifest_path_ = data_dir + "/events.manifest";
+    config_ = config;
+    if (config_.sparse_index_interval == 0) {
+        config_.sparse_index_interval = 1;
+    }
     
-    // Open event log in append mode
-    event_log_ = std::make_unique<std::ofstream>(event_log_path_, 
-                                                 std::ios::app | std::ios::binary);
-    if (!event_log_->is_open()) {
+    if (!reasons_.open(data_dir + "/reasons.tbl")) {
         return false;
     }
     
-    // Read existing events to rebuild indexes and get latest sequence
-    std::ifstream read_file(event_log_path_, std::ios::binary);
-    if (read_file.is_open()) {
-        SequenceID max_seq = 0;
-        size_t count = 0;
-        while (read_file.peek() != EOF) {
-            Event event = read_event_from_log(read_file);
-            if (event.sequence_id > max_seq) {
-                max_seq = event.sequence_id;
-            }
-            
-            // Rebuild indexes
-            if (event.type == EventType::ORDER_PLACED || 
-                event.type == EventType::ORDER_MATCHED ||
-                event.type == EventType::ORDER_CANCELLED) {
-                OrderID order_id = (event.type == EventType::ORDER_PLACED) ?
-                    event.data.order_placed.order_id :
-                    (event.type == EventType::ORDER_MATCHED) ?
-                    event.data.order_matched.taker_order_id :
-                    event.data.order_cancelled.order_id;
-                order_index_[order_id].push_back(event.sequence_id);
+    // Start from the index checkpoint when there is one; only the events
+    // after it are read to bring the indexes up to date
+    std::unique_lock<std::shared_mutex> index_lock(index_mutex_);
+    
+    // Finish a truncation that was interrupted after its manifest
+    load_manifest();
+    if (writer) {
+        for (uint64_t segment : list_journal_segments(event_log_path_)) {
+            if (segment < retained_segment_) {
+                ::unlink(journal_segment_path(event_log_path_, segment).c_str());
             }
-            instrument_index_[event.instrument_id].push_back(event.sequence_id);
-            count++;
         }
-        latest_sequence_ = max_seq;
-        event_count_ = count;
+    }
+    chain_ = base_chain_;
+    
+    tail_reader_ = std::make_unique<JournalReader>(event_log_path_);
+    Event event;
+    if (load_index_checkpoint() && event_count_ > 0) {
+        // The checkpointed tail record must still be in the log
+        if (!tail_reader_->seek(last_location_.position) ||
+            !read_event_from_log(*tail_reader_, event) ||
+            event.sequence_id != last_location_.sequence) {
+            LOG_WARN("EventStore: index checkpoint does not match the log, rebuilding");
+            clear_indexes();
+            tail_reader_ = std::make_unique<JournalReader>(event_log_path_);
+        }
+    }
+    checkpoint_count_ = event_count_.load();
+    prune_indexes(retained_segment_);
+    reconcile_segments();
+    return true;
+}
+
+size_t EventStore::index_tail(const std::function<void(const EventView&)>& handler,
+                              size_t max_events) {
+    std::unique_lock<std::shared_mutex> index_lock(index_mutex_);
+    SequenceID max_seq = latest_sequence_;
+    size_t count = event_count_;
+    size_t read = 0;
+    Event event;
+    EventView view;
+    while (read < max_events && read_event_view(*tail_reader_, view)) {
+        SequenceID sequence = view.sequence_id();
+        if (sequence > max_seq) {
+            max_seq = sequence;
+        }
+        if (count % config_.sparse_index_interval == 0) {
+            sparse_index_.push_back(
+                SparseIndexEntry{sequence, tail_reader_->record_position(), chain_});
+        }
+        if (view.decode(event)) {
+            index_event(event, tail_reader_->record_position(), chain_step(chain_, view));
+        } else {
+            // Unknown format version: the record keeps its place in the log
+            // and the chain but is not indexed under any order
+            LOG_ERROR("EventStore: event " + std::to_string(sequence) + " cannot be decoded, not indexed");
+            track_location(sequence, tail_reader_->record_position(), chain_step(chain_, view));
+        }
+        count++;
+        read++;
+        if (handler) {
+            handler(view);
+        }
+    }
+    latest_sequence_ = max_seq;
+    event_count_ = count;
+    return read;
+}
+
+bool EventStore::open_writer() {
+    {
+        std::unique_lock<std::shared_mutex> index_lock(index_mutex_);
+        
+        // Open event log journal (resumes after the last valid record)
+        journal_ = JournalWriter::create(config_.journal);
+        journal_->set_durable_listener([this](uint64_t record) { on_durable(record); });
+        if (!journal_->open(event_log_path_, last_location_.position)) {
+            return false;
+        }
+    }
+    index_tail(nullptr, SIZE_MAX);
+    tail_reader_.reset();
+    logged_sequence_ = latest_sequence_;
+    durable_sequence_ = latest_sequence_.load();
+    if (config_.tail_ring_events > 0) {
+        tail_ring_ = std::make_unique<EventTailRing>(config_.tail_ring_events, latest_sequence_);
     }
     
+    // The rebuilt sparse index replaces whatever was on disk (it may
+    // point past a torn tail)
+    rewrite_sparse_index_file();
+    write_manifest();
+    
+    // Journaling thread commits buffered events on a fixed cadence
+    journal_running_ = true;
+    journal_thread_ = std::thread(&EventStore::journal_worker, this);
+    
     initialized_ = true;
     return true;
 }
 
 bool EventStore::append_event(const Event& event) {
+    return append_event(event, nullptr);
+}
+
+bool EventStore::append_event(const Event& event, const std::function<bool(SequenceID)>& prepare) {
     if (!initialized_) {
         return false;
     }
     
     std::lock_guard<std::mutex> lock(event_log_mutex_);
+    if (prepare && !prepare(event.sequence_id != 0 ? event.sequence_id : latest_sequence_ + 1)) {
+        return false;
+    }
     
     // Assign sequence if not set
     Event event_copy = event;
@@ -263,187 +578,1369 @@ bool EventStore::append_event(const Event& event) {
             event_copy.sequence_id);
     }
     
-    write_event_to_log(event_copy);
+    JournalPosition position;
+    uint64_t chain = 0;
+    if (!write_event_to_log(event_copy, position, chain)) {
+        return false;
+    }
     
     // Update indexes
     {
         std::unique_lock<std::shared_mutex> index_lock(index_mutex_);
-        if (event_copy.type == EventType::ORDER_PLACED || 
-            event_copy.type == EventType::ORDER_MATCHED ||
-            event_copy.type == EventType::ORDER_CANCELLED) {
-            OrderID order_id = (event_copy.type == EventType::ORDER_PLACED) ?
-                event_copy.data.order_placed.order_id :
-                (event_copy.type == EventType::ORDER_MATCHED) ?
-                event_copy.data.order_matched.taker_order_id :
-                event_copy.data.order_cancelled.order_id;
-            order_index_[order_id].push_back(event_copy.sequence_id);
+        if (event_count_ % config_.sparse_index_interval == 0) {
+            SparseIndexEntry entry{event_copy.sequence_id, position, chain_};
+            sparse_index_.push_back(entry);
+            if (sparse_index_file_.is_open()) {
+                sparse_index_file_.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+            }
         }
-        instrument_index_[event_copy.instrument_id].push_back(event_copy.sequence_id);
+        index_event(event_copy, position, chain);
+        event_count_++;
     }
     
-    event_count_++;
     return true;
 }
 
-std::vector<Event> EventStore::get_events(SequenceID from, SequenceID to) const {
-    std::vector<Event> events;
-    
-    std::ifstream file(event_log_path_, std::ios::binary);
-    if (!file.is_open()) {
-        return events;
-    }
-    
-    while (file.peek() != EOF) {
-        Event event = read_event_from_log(file);
-        if (event.sequence_id >= from && event.sequence_id <= to) {
-            events.push_back(event);
-        }
-        if (event.sequence_id > to) {
+void EventStore::index_event(const Event& event, const JournalPosition& position, uint64_t chain) {
+    EventLocation location{event.sequence_id, position};
+    switch (event.type) {
+        case EventType::ORDER_PLACED:
+            order_index_[event.data.order_placed.order_id].push_back(location);
+            break;
+        case EventType::ORDER_MATCHED:
+            order_index_[event.data.order_matched.taker_order_id].push_back(location);
+            if (event.data.order_matched.maker_order_id != event.data.order_matched.taker_order_id) {
+                order_index_[event.data.order_matched.maker_order_id].push_back(location);
+            }
+            break;
+        case EventType::ORDER_CANCELLED:
+            order_index_[event.data.order_cancelled.order_id].push_back(location);
             break;
+        default:
+            break;
+    }
+    instrument_index_[event.instrument_id].push_back(location);
+    track_location(event.sequence_id, position, chain);
+}
+
+void EventStore::track_location(SequenceID sequence, const JournalPosition& position, uint64_t chain) {
+    // The writer rolled over: the previous segment is sealed
+    if (position.segment != open_segment_.segment) {
+        if (open_segment_.segment != 0) {
+            open_segment_.last_sequence = last_location_.sequence;
+            open_segment_.last_chain = chain_;
+            sealed_segments_.push_back(open_segment_);
+            manifest_dirty_ = true;
         }
+        open_segment_ = SegmentRange{position.segment, sequence, sequence};
     }
-    
-    return events;
+    last_location_ = EventLocation{sequence, position};
+    chain_ = chain;
 }
 
-std::vector<Event> EventStore::get_order_events(OrderID order_id) const {
-    std::vector<Event> events;
-    
+uint64_t EventStore::seek_to_sequence(JournalReader& reader, SequenceID sequence) const {
     std::shared_lock<std::shared_mutex> lock(index_mutex_);
-    auto it = order_index_.find(order_id);
-    if (it == order_index_.end()) {
-        return events;
-    }
-    
-    std::ifstream file(event_log_path_, std::ios::binary);
-    if (!file.is_open()) {
-        return events;
+    auto it = std::upper_bound(sparse_index_.begin(), sparse_index_.end(), sequence,
+                               [](SequenceID seq, const SparseIndexEntry& entry) {
+                                   return seq < entry.sequence;
+                               });
+    if (it == sparse_index_.begin()) {
+        return base_chain_;
     }
+    reader.seek(std::prev(it)->position);
+    return std::prev(it)->chain;
+}
+
+std::vector<Event> EventStore::read_events_at(const std::vector<EventLocation>& locations) const {
+    std::vector<Event> events;
+    events.reserve(locations.size());
     
-    // Read all events and filter by order_id
-    while (file.peek() != EOF) {
-        Event event = read_event_from_log(file);
-        if (event.sequence_id == 0) continue;
-        
-        OrderID event_order_id = 0;
-        if (event.type == EventType::ORDER_PLACED) {
-            event_order_id = event.data.order_placed.order_id;
-        } else if (event.type == EventType::ORDER_MATCHED) {
-            if (event.data.order_matched.taker_order_id == order_id ||
-                event.data.order_matched.maker_order_id == order_id) {
+    // Events past the durable watermark come from the tail ring; the log
+    // is synced only if the ring has already dropped one of them
+    SequenceID readable = readable_sequence();
+    JournalReader reader(event_log_path_);
+    Event event;
+    for (const auto& location : locations) {
+        if (location.sequence > readable) {
+            if (read_ring_event(location.sequence, event)) {
                 events.push_back(event);
+                continue;
             }
-            continue;
-        } else if (event.type == EventType::ORDER_CANCELLED) {
-            event_order_id = event.data.order_cancelled.order_id;
+            sync_for_read();
+            readable = UINT64_MAX;
         }
-        
-        if (event_order_id == order_id) {
+        if (reader.seek(location.position) && read_event_from_log(reader, event)) {
             events.push_back(event);
         }
     }
-    
     return events;
 }
 
-std::vector<Event> EventStore::get_instrument_events(InstrumentID instrument_id, 
-                                                     SequenceID from, 
-                                                     SequenceID to) const {
-    std::vector<Event> events;
+void EventStore::rewrite_sparse_index_file() {
+    std::shared_lock<std::shared_mutex> lock(index_mutex_);
+    sparse_index_file_.close();
+    sparse_index_file_.open(sparse_index_path_, std::ios::binary | std::ios::trunc);
+    if (!sparse_index_file_.is_open()) {
+        return;
+    }
+    sparse_index_file_.write(reinterpret_cast<const char*>(sparse_index_.data()),
+                             sparse_index_.size() * sizeof(SparseIndexEntry));
+    sparse_index_file_.flush();
+}
+
+// Index checkpoint layout (native endianness):
+//   IndexCheckpointHeader
+//   SparseIndexEntry sparse[sparse_count]
+//   order_count x { OrderID id; uint64_t n; EventLocation locations[n]; }
+//   instrument_count x { InstrumentID id; uint64_t n; EventLocation locations[n]; }
+//   uint32_t crc32c of everything above
+namespace {
+
+constexpr uint32_t kIndexCheckpointMagic = 0x58444945;   // "EIDX"
+constexpr uint32_t kIndexCheckpointVersion = 2;   // 2: event chain
+
+struct IndexCheckpointHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t event_count;
+    uint64_t latest_sequence;
+    EventLocation last_location;
+    uint64_t chain;
+    uint64_t sparse_count;
+    uint64_t order_count;
+    uint64_t instrument_count;
+};
+
+template<typename T>
+void append_pod(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Bounds-checked reads over a checkpoint buffer
+struct CheckpointCursor {
+    const char* pos;
+    const char* end;
     
-    std::ifstream file(event_log_path_, std::ios::binary);
-    if (!file.is_open()) {
-        return events;
+    template<typename T>
+    bool read(T& value) {
+        return read_array(&value, 1);
     }
     
-    while (file.peek() != EOF) {
-        Event event = read_event_from_log(file);
-        if (event.instrument_id == instrument_id &&
-            event.sequence_id >= from && event.sequence_id <= to) {
-            events.push_back(event);
-        }
-        if (event.sequence_id > to) {
-            break;
+    template<typename T>
+    bool read_array(T* values, uint64_t count) {
+        if (count > static_cast<uint64_t>(end - pos) / sizeof(T)) {
+            return false;
         }
+        memcpy(values, pos, count * sizeof(T));
+        pos += count * sizeof(T);
+        return true;
     }
-    
-    return events;
-}
+};
 
-bool EventStore::replay_events(SequenceID from, SequenceID to,
-                              std::function<bool(const Event&)> handler) const {
-    std::ifstream file(event_log_path_, std::ios::binary);
-    if (!file.is_open()) {
-        return false;
+// Index lists as of the checkpoint: each key and its list length
+template<typename Key>
+using IndexLengths = std::vector<std::pair<Key, uint64_t>>;
+
+template<typename Key>
+IndexLengths<Key> index_lengths(const std::unordered_map<Key, std::vector<EventLocation>>& index) {
+    IndexLengths<Key> lengths;
+    lengths.reserve(index.size());
+    for (const auto& entry : index) {
+        lengths.emplace_back(entry.first, entry.second.size());
     }
-    
-    while (file.peek() != EOF) {
-        Event event = read_event_from_log(file);
-        if (event.sequence_id >= from && event.sequence_id <= to) {
-            if (!handler(event)) {
-                return false;  // Handler requested stop
-            }
+    return lengths;
+}
+
+// Copy the first `length` locations of every list. Lists only grow while
+// the generation is unchanged, so the prefixes are stable and are copied
+// in slices, each under a short shared lock. False if the indexes were
+// pruned or cleared in between.
+template<typename Key>
+bool append_index(std::string& out,
+                  const std::unordered_map<Key, std::vector<EventLocation>>& index,
+                  const IndexLengths<Key>& lengths, std::shared_mutex& mutex,
+                  const uint64_t& generation, uint64_t expected_generation) {
+    constexpr uint64_t kLocationsPerLock = 64 * 1024;
+    size_t next = 0;
+    uint64_t copied = 0;   // Of lengths[next]
+    while (next < lengths.size()) {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (generation != expected_generation) {
+            return false;
         }
-        if (event.sequence_id > to) {
-            break;
+        uint64_t budget = kLocationsPerLock;
+        while (next < lengths.size() && budget > 0) {
+            const Key& key = lengths[next].first;
+            uint64_t length = lengths[next].second;
+            auto it = index.find(key);
+            if (it == index.end() || it->second.size() < length) {
+                return false;
+            }
+            if (copied == 0) {
+                append_pod(out, key);
+                append_pod(out, length);
+            }
+            uint64_t n = std::min(length - copied, budget);
+            out.append(reinterpret_cast<const char*>(it->second.data() + copied),
+                       n * sizeof(EventLocation));
+            copied += n;
+            budget -= std::min(budget, n + 1);
+            if (copied == length) {
+                next++;
+                copied = 0;
+            }
         }
     }
-    
     return true;
 }
 
-bool EventStore::create_snapshot(SequenceID sequence, const std::string& snapshot_path) {
-    // Snapshot creation would serialize current state
-    // For now, just mark the sequence
-    std::ofstream snapshot(snapshot_path);
-    if (!snapshot.is_open()) {
-        return false;
+template<typename Key>
+bool read_index(CheckpointCursor& cursor, uint64_t count,
+                std::unordered_map<Key, std::vector<EventLocation>>& index) {
+    index.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        Key key;
+        uint64_t n = 0;
+        if (!cursor.read(key) || !cursor.read(n) ||
+            n > static_cast<uint64_t>(cursor.end - cursor.pos) / sizeof(EventLocation)) {
+            return false;
+        }
+        auto& locations = index[key];
+        locations.resize(n);
+        if (!cursor.read_array(locations.data(), n)) {
+            return false;
+        }
     }
-    snapshot << sequence << std::endl;
     return true;
 }
 
-bool EventStore::load_snapshot(const std::string& snapshot_path, SequenceID& sequence) {
-    std::ifstream snapshot(snapshot_path);
-    if (!snapshot.is_open()) {
+} // namespace
+
+bool EventStore::checkpoint_indexes() {
+    std::lock_guard<std::mutex> checkpoint_lock(checkpoint_mutex_);
+    
+    // Only the header, the sparse index and the list lengths are taken in
+    // one go; the lists are copied afterwards without stalling appends
+    std::string buffer;
+    size_t count = 0;
+    uint64_t generation = 0;
+    IndexLengths<OrderID> orders;
+    IndexLengths<InstrumentID> instruments;
+    {
+        std::shared_lock<std::shared_mutex> lock(index_mutex_);
+        count = event_count_;
+        generation = index_generation_;
+        IndexCheckpointHeader header{};
+        header.magic = kIndexCheckpointMagic;
+        header.version = kIndexCheckpointVersion;
+        header.event_count = count;
+        header.latest_sequence = latest_sequence_;
+        header.last_location = last_location_;
+        header.chain = chain_;
+        header.sparse_count = sparse_index_.size();
+        header.order_count = order_index_.size();
+        header.instrument_count = instrument_index_.size();
+        
+        orders = index_lengths(order_index_);
+        instruments = index_lengths(instrument_index_);
+        
+        size_t locations = 0;
+        for (const auto& entry : orders) {
+            locations += entry.second;
+        }
+        for (const auto& entry : instruments) {
+            locations += entry.second;
+        }
+        buffer.reserve(sizeof(header) + sparse_index_.size() * sizeof(SparseIndexEntry) +
+                       locations * sizeof(EventLocation) +
+                       orders.size() * 16 + instruments.size() * 12 + sizeof(uint32_t));
+        
+        append_pod(buffer, header);
+        buffer.append(reinterpret_cast<const char*>(sparse_index_.data()),
+                      sparse_index_.size() * sizeof(SparseIndexEntry));
+    }
+    
+    // A truncation pruned the lists meanwhile; it checkpoints afterwards
+    if (!append_index(buffer, order_index_, orders, index_mutex_, index_generation_, generation) ||
+        !append_index(buffer, instrument_index_, instruments, index_mutex_, index_generation_,
+                      generation)) {
+        return false;
+    }
+    append_pod(buffer, crc32c(buffer.data(), buffer.size()));
+    
+    // Everything the checkpoint references must be durable before it is
+    sync_for_read();
+    if (!write_file_atomic(checkpoint_path_, buffer.data(), buffer.size())) {
         return false;
     }
-    snapshot >> sequence;
+    checkpoint_count_ = count;
     return true;
 }
 
-void EventStore::flush() {
-    std::lock_guard<std::mutex> lock(event_log_mutex_);
-    if (event_log_ && event_log_->is_open()) {
-        event_log_->flush();
+bool EventStore::load_index_checkpoint() {
+    std::ifstream file(checkpoint_path_, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return false;
     }
-}
-
-void EventStore::write_event_to_log(const Event& event) {
-    if (event_log_ && event_log_->is_open()) {
-        std::string serialized = event.serialize();
-        size_t len = serialized.length();
-        event_log_->write(reinterpret_cast<const char*>(&len), sizeof(len));
-        event_log_->write(serialized.c_str(), len);
-        event_log_->flush();
+    std::string buffer(static_cast<size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    if (!file.read(&buffer[0], buffer.size())) {
+        return false;
+    }
+    
+    uint32_t crc = 0;
+    if (buffer.size() < sizeof(IndexCheckpointHeader) + sizeof(crc)) {
+        LOG_WARN("EventStore: truncated index checkpoint " + checkpoint_path_);
+        return false;
+    }
+    size_t body = buffer.size() - sizeof(crc);
+    memcpy(&crc, buffer.data() + body, sizeof(crc));
+    if (crc32c(buffer.data(), body) != crc) {
+        LOG_WARN("EventStore: index checkpoint checksum mismatch " + checkpoint_path_);
+        return false;
     }
-}
-
-Event EventStore::read_event_from_log(std::ifstream& file) const {
-    Event event;
-    size_t len = 0;
     
-    if (!file.read(reinterpret_cast<char*>(&len), sizeof(len))) {
-        return event;  // EOF or error
+    CheckpointCursor cursor{buffer.data(), buffer.data() + body};
+    IndexCheckpointHeader header;
+    cursor.read(header);
+    if (header.magic != kIndexCheckpointMagic || header.version != kIndexCheckpointVersion) {
+        LOG_WARN("EventStore: unsupported index checkpoint " + checkpoint_path_);
+        return false;
     }
     
-    std::string data(len, '\0');
-    if (!file.read(&data[0], len)) {
-        return event;  // Error
+    clear_indexes();
+    sparse_index_.resize(header.sparse_count);
+    if (header.sparse_count > body / sizeof(SparseIndexEntry) ||
+        !cursor.read_array(sparse_index_.data(), header.sparse_count) ||
+        !read_index(cursor, header.order_count, order_index_) ||
+        !read_index(cursor, header.instrument_count, instrument_index_)) {
+        LOG_WARN("EventStore: malformed index checkpoint " + checkpoint_path_);
+        clear_indexes();
+        return false;
     }
     
-    event = Event::deserialize(data);
-    return event;
+    event_count_ = header.event_count;
+    latest_sequence_ = header.latest_sequence;
+    last_location_ = header.last_location;
+    chain_ = header.chain;
+    return true;
+}
+
+// Segment manifest layout: ManifestHeader, SegmentRange[count], uint32_t crc32c.
+// Version 1 had no chains: its header ends before base_chain and its
+// ranges before last_chain, which load as unknown.
+namespace {
+
+constexpr uint32_t kManifestMagic = 0x4e414d45;   // "EMAN"
+constexpr uint32_t kManifestVersion = 2;
+
+struct ManifestHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    uint64_t retained_segment;
+    uint64_t base_chain;
+};
+
+struct ManifestHeaderV1 {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    uint64_t retained_segment;
+};
+
+struct SegmentRangeV1 {
+    uint64_t segment;
+    SequenceID first_sequence;
+    SequenceID last_sequence;
+};
+
+} // namespace
+
+bool EventStore::load_manifest() {
+    std::ifstream file(manifest_path_, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::string buffer(static_cast<size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    if (!file.read(&buffer[0], buffer.size())) {
+        return false;
+    }
+    
+    uint32_t crc = 0;
+    if (buffer.size() < sizeof(ManifestHeaderV1) + sizeof(crc)) {
+        LOG_WARN("EventStore: truncated segment manifest " + manifest_path_);
+        return false;
+    }
+    size_t body = buffer.size() - sizeof(crc);
+    memcpy(&crc, buffer.data() + body, sizeof(crc));
+    if (crc32c(buffer.data(), body) != crc) {
+        LOG_WARN("EventStore: segment manifest checksum mismatch " + manifest_path_);
+        return false;
+    }
+    
+    CheckpointCursor cursor{buffer.data(), buffer.data() + body};
+    ManifestHeaderV1 prefix;
+    cursor.read(prefix);
+    ManifestHeader header{prefix.magic, prefix.version, prefix.count, prefix.retained_segment, 0};
+    size_t range_size = header.version == 1 ? sizeof(SegmentRangeV1) : sizeof(SegmentRange);
+    if (header.magic != kManifestMagic || header.version == 0 ||
+        header.version > kManifestVersion || header.count > body / range_size ||
+        (header.version > 1 && !cursor.read(header.base_chain))) {
+        LOG_WARN("EventStore: unsupported segment manifest " + manifest_path_);
+        return false;
+    }
+    std::vector<SegmentRange> ranges(header.count);
+    for (auto& range : ranges) {
+        SegmentRangeV1 v1;
+        bool ok = header.version == 1 ? cursor.read(v1) : cursor.read(range);
+        if (!ok) {
+            return false;
+        }
+        if (header.version == 1) {
+            range.segment = v1.segment;
+            range.first_sequence = v1.first_sequence;
+            range.last_sequence = v1.last_sequence;
+        }
+    }
+    
+    sealed_segments_ = std::move(ranges);
+    retained_segment_ = header.retained_segment;
+    base_chain_ = header.base_chain;
+    return true;
+}
+
+void EventStore::reconcile_segments() {
+    if (event_count_ == 0) {
+        // Full scan ahead; index_event rebuilds every range
+        sealed_segments_.clear();
+        open_segment_ = SegmentRange();
+        return;
+    }
+    
+    std::vector<uint64_t> on_disk = list_journal_segments(event_log_path_);
+    uint64_t open = last_location_.position.segment;
+    
+    // Manifest entries still backed by a sealed segment
+    std::vector<SegmentRange> ranges;
+    for (const auto& range : sealed_segments_) {
+        if (range.segment < open &&
+            std::binary_search(on_disk.begin(), on_disk.end(), range.segment)) {
+            ranges.push_back(range);
+        }
+    }
+    
+    // Segments sealed after the manifest was last written start where
+    // their first record says and end where the next segment starts
+    JournalReader reader(event_log_path_);
+    auto first_sequence_in = [&](uint64_t segment, SequenceID& sequence) {
+        EventView view;
+        if (!reader.seek(JournalPosition{segment, 0}) || !read_event_view(reader, view)) {
+            return false;
+        }
+        sequence = view.sequence_id();
+        return true;
+    };
+    size_t known = ranges.size();
+    for (uint64_t segment : on_disk) {
+        if (segment >= open) {
+            break;
+        }
+        auto listed = std::find_if(ranges.begin(), ranges.begin() + known,
+                                   [segment](const SegmentRange& range) {
+                                       return range.segment == segment;
+                                   });
+        SegmentRange range;
+        range.segment = segment;
+        if (segment >= retained_segment_ && listed == ranges.begin() + known &&
+            first_sequence_in(segment, range.first_sequence)) {
+            ranges.push_back(range);
+        }
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const SegmentRange& a, const SegmentRange& b) {
+        return a.segment < b.segment;
+    });
+    
+    open_segment_ = SegmentRange{open, last_location_.sequence, last_location_.sequence};
+    first_sequence_in(open, open_segment_.first_sequence);
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        if (ranges[i].last_sequence == 0) {
+            SequenceID next = i + 1 < ranges.size() ? ranges[i + 1].first_sequence
+                                                    : open_segment_.first_sequence;
+            ranges[i].last_sequence = next - 1;
+        }
+    }
+    sealed_segments_ = std::move(ranges);
+}
+
+bool EventStore::write_manifest() {
+    std::lock_guard<std::mutex> manifest_lock(manifest_mutex_);
+    
+    std::string buffer;
+    {
+        std::shared_lock<std::shared_mutex> lock(index_mutex_);
+        manifest_dirty_ = false;
+        ManifestHeader header{kManifestMagic, kManifestVersion,
+                              sealed_segments_.size(), retained_segment_, base_chain_};
+        append_pod(buffer, header);
+        buffer.append(reinterpret_cast<const char*>(sealed_segments_.data()),
+                      sealed_segments_.size() * sizeof(SegmentRange));
+    }
+    append_pod(buffer, crc32c(buffer.data(), buffer.size()));
+    
+    if (!write_file_atomic(manifest_path_, buffer.data(), buffer.size())) {
+        manifest_dirty_ = true;
+        return false;
+    }
+    return true;
+}
+
+size_t EventStore::truncate_before(SequenceID sequence) {
+    if (!initialized_) {
+        return 0;
+    }
+    
+    std::vector<uint64_t> removed;
+    {
+        std::unique_lock<std::shared_mutex> lock(index_mutex_);
+        uint64_t base_chain = base_chain_;
+        while (!sealed_segments_.empty() && sealed_segments_.front().last_sequence < sequence) {
+            removed.push_back(sealed_segments_.front().segment);
+            base_chain = sealed_segments_.front().last_chain;
+            sealed_segments_.erase(sealed_segments_.begin());
+        }
+        if (removed.empty()) {
+            return 0;
+        }
+        base_chain_ = base_chain;
+        retained_segment_ = removed.back() + 1;
+        prune_indexes(retained_segment_);
+    }
+    
+    // Record the new start before any file disappears
+    if (!write_manifest()) {
+        return 0;
+    }
+    for (uint64_t segment : removed) {
+        ::unlink(journal_segment_path(event_log_path_, segment).c_str());
+    }
+    sync_directory(event_log_path_);
+    
+    {
+        std::lock_guard<std::mutex> lock(event_log_mutex_);
+        rewrite_sparse_index_file();
+    }
+    checkpoint_indexes();
+    
+    LOG_INFO("EventStore: truncated " + std::to_string(removed.size()) +
+             " segments before sequence " + std::to_string(sequence));
+    return removed.size();
+}
+
+SequenceID EventStore::first_sequence() const {
+    std::shared_lock<std::shared_mutex> lock(index_mutex_);
+    if (!sealed_segments_.empty()) {
+        return sealed_segments_.front().first_sequence;
+    }
+    return event_count_ > 0 ? open_segment_.first_sequence : 0;
+}
+
+std::vector<SegmentRange> EventStore::sealed_segments() const {
+    std::shared_lock<std::shared_mutex> lock(index_mutex_);
+    return sealed_segments_;
+}
+
+SequenceID EventStore::set_append_listener(std::function<void(const EventView&)> listener) {
+    std::lock_guard<std::mutex> lock(event_log_mutex_);
+    append_listener_ = std::move(listener);
+    std::shared_lock<std::shared_mutex> index_lock(index_mutex_);
+    return last_location_.sequence;
+}
+
+uint64_t EventStore::chain_hash() const {
+    std::shared_lock<std::shared_mutex> lock(index_mutex_);
+    return chain_;
+}
+
+bool EventStore::chain_hash_at(SequenceID sequence, uint64_t& chain) const {
+    ensure_readable(sequence);
+    JournalReader reader(event_log_path_);
+    uint64_t rolled = seek_to_sequence(reader, sequence);
+    bool found = false;
+    EventView view;
+    while (read_event_view(reader, view) && view.sequence_id() <= sequence) {
+        rolled = chain_step(rolled, view);
+        found = true;
+    }
+    if (found) {
+        chain = rolled;
+    }
+    return found;
+}
+
+namespace {
+
+// Consecutive segments hashed by one verification task: seeded with the
+// chain recorded before the first and checked against the chain recorded
+// through the last (sealed segments without a recorded chain join the
+// next run)
+struct ChainRun {
+    uint64_t first_segment;
+    JournalPosition end;       // Last record covered
+    uint64_t seed;
+    uint64_t expected;
+};
+
+} // namespace
+
+bool EventStore::verify_chain(size_t threads) const {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    sync_for_read();
+    
+    std::vector<ChainRun> runs;
+    {
+        std::shared_lock<std::shared_mutex> lock(index_mutex_);
+        if (event_count_ == 0) {
+            return true;
+        }
+        uint64_t seed = base_chain_;
+        bool pending = false;
+        uint64_t first = 0;
+        for (const auto& range : sealed_segments_) {
+            if (!pending) {
+                first = range.segment;
+                pending = true;
+            }
+            if (range.last_chain != 0) {
+                runs.push_back(ChainRun{first, JournalPosition{range.segment, UINT64_MAX},
+                                        seed, range.last_chain});
+                seed = range.last_chain;
+                pending = false;
+            }
+        }
+        if (!pending) {
+            first = open_segment_.segment;
+        }
+        runs.push_back(ChainRun{first, last_location_.position, seed, chain_});
+    }
+    
+    auto roll = [this](const ChainRun& run) {
+        uint64_t chain = run.seed;
+        JournalReader reader(event_log_path_);
+        if (!reader.seek(JournalPosition{run.first_segment, 0})) {
+            return chain;
+        }
+        EventView view;
+        while (read_event_view(reader, view)) {
+            JournalPosition position = reader.record_position();
+            if (position.segment > run.end.segment ||
+                (position.segment == run.end.segment && position.offset > run.end.offset)) {
+                break;
+            }
+            chain = chain_step(chain, view);
+        }
+        return chain;
+    };
+    
+    // Runs are independent, so each worker takes the next one
+    std::vector<uint64_t> actual(runs.size());
+    std::atomic<size_t> next{0};
+    std::vector<std::future<void>> workers;
+    for (size_t i = 0; i < std::min(threads, runs.size()); ++i) {
+        workers.push_back(std::async(std::launch::async, [&]() {
+            for (size_t run = next++; run < runs.size(); run = next++) {
+                actual[run] = roll(runs[run]);
+            }
+        }));
+    }
+    for (auto& worker : workers) {
+        worker.get();
+    }
+    
+    for (size_t i = 0; i < runs.size(); ++i) {
+        if (actual[i] != runs[i].expected) {
+            LOG_WARN("EventStore: event chain mismatch in segments " +
+                     std::to_string(runs[i].first_segment) + "-" +
+                     std::to_string(runs[i].end.segment));
+            return false;
+        }
+    }
+    return true;
+}
+
+void EventStore::prune_indexes(uint64_t segment) {
+    if (segment == 0) {
+        return;
+    }
+    auto before = [segment](const auto& location) {
+        return location.position.segment < segment;
+    };
+    // Locations are in log order, so the pruned entries are a prefix
+    auto prune = [&](auto& locations) {
+        locations.erase(locations.begin(),
+                        std::find_if_not(locations.begin(), locations.end(), before));
+    };
+    index_generation_++;
+    
+    prune(sparse_index_);
+    for (auto it = order_index_.begin(); it != order_index_.end(); ) {
+        prune(it->second);
+        it = it->second.empty() ? order_index_.erase(it) : std::next(it);
+    }
+    for (auto it = instrument_index_.begin(); it != instrument_index_.end(); ) {
+        prune(it->second);
+        it = it->second.empty() ? instrument_index_.erase(it) : std::next(it);
+    }
+}
+
+void EventStore::clear_indexes() {
+    index_generation_++;
+    order_index_.clear();
+    instrument_index_.clear();
+    sparse_index_.clear();
+    last_location_ = EventLocation();
+    chain_ = base_chain_;
+    event_count_ = 0;
+    latest_sequence_ = 0;
+}
+
+std::vector<Event> EventStore::get_events(SequenceID from, SequenceID to) const {
+    std::vector<Event> events;
+    SequenceID last = std::min<SequenceID>(to, latest_sequence_);
+    if (last >= from) {
+        events.reserve(static_cast<size_t>(last - from + 1));
+    }
+    
+    Event event;
+    scan_events(from, to, [&](const EventView& view) {
+        if (!view.decode(event)) {
+            LOG_ERROR("EventStore: event " + std::to_string(view.sequence_id()) + " cannot be decoded, skipped");
+            return true;
+        }
+        events.push_back(event);
+        return true;
+    });
+    return events;
+}
+
+std::vector<Event> EventStore::get_order_events(OrderID order_id) const {
+    std::vector<EventLocation> locations;
+    {
+        std::shared_lock<std::shared_mutex> lock(index_mutex_);
+        auto it = order_index_.find(order_id);
+        if (it == order_index_.end()) {
+            return {};
+        }
+        locations = it->second;
+    }
+    
+    return read_events_at(locations);
+}
+
+std::vector<Event> EventStore::get_instrument_events(InstrumentID instrument_id, 
+                                                     SequenceID from, 
+                                                     SequenceID to) const {
+    std::vector<EventLocation> locations;
+    {
+        std::shared_lock<std::shared_mutex> lock(index_mutex_);
+        auto it = instrument_index_.find(instrument_id);
+        if (it == instrument_index_.end()) {
+            return {};
+        }
+        auto by_sequence = [](const EventLocation& location, SequenceID seq) {
+            return location.sequence < seq;
+        };
+        auto begin = std::lower_bound(it->second.begin(), it->second.end(), from, by_sequence);
+        auto end = begin;
+        while (end != it->second.end() && end->sequence <= to) {
+            ++end;
+        }
+        locations.assign(begin, end);
+    }
+    
+    return read_events_at(locations);
+}
+
+bool EventStore::replay_events(SequenceID from, SequenceID to,
+                              std::function<bool(const Event&)> handler) const {
+    Event event;
+    return scan_events(from, to, [&](const EventView& view) {
+        if (!view.decode(event)) {
+            LOG_ERROR("EventStore: event " + std::to_string(view.sequence_id()) + " cannot be decoded, skipped");
+            return true;
+        }
+        return handler(event);  // false: handler requested stop
+    });
+}
+
+bool EventStore::scan_events(SequenceID from, SequenceID to,
+                             const std::function<bool(const EventView&)>& handler) const {
+    // Durable events from the log, the rest from the tail ring
+    SequenceID readable = readable_sequence();
+    if (!scan_log(from, std::min(to, readable), handler)) {
+        return false;
+    }
+    if (to <= readable) {
+        return true;
+    }
+    from = std::max(from, readable + 1);
+    switch (scan_ring(from, to, handler)) {
+        case RingScan::DONE:
+            return true;
+        case RingScan::STOPPED:
+            return false;
+        case RingScan::MISSED:
+            break;
+    }
+    
+    // The ring no longer holds them: make them readable in the log
+    sync_for_read();
+    return scan_log(from, to, handler);
+}
+
+bool EventStore::scan_log(SequenceID from, SequenceID to,
+                          const std::function<bool(const EventView&)>& handler) const {
+    if (from > to) {
+        return true;
+    }
+    JournalReader reader(event_log_path_);
+    seek_to_sequence(reader, from);
+    EventView view;
+    while (read_event_view(reader, view)) {
+        SequenceID sequence = view.sequence_id();
+        if (sequence > to) {
+            break;
+        }
+        if (sequence >= from && !handler(view)) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+size_t EventStore::read_tail(EventCursor& cursor,
+                             const std::function<void(const EventView&)>& handler,
+                             size_t max_events) const {
+    constexpr size_t kRingProbeInterval = 1024;   // Log events between checks for the ring
+    char buffer[kMaxEncodedEventSize];
+    size_t delivered = 0;
+    
+    while (delivered < max_events) {
+        if (tail_ring_ && (cursor.ring_index != EventCursor::kNoRingIndex ||
+                           tail_ring_->find_after(cursor.sequence, cursor.ring_index))) {
+            uint64_t head = tail_ring_->head();
+            size_t length = 0;
+            while (delivered < max_events && cursor.ring_index < head &&
+                   tail_ring_->read(cursor.ring_index, buffer, length)) {
+                EventView view(buffer, length);
+                cursor.sequence = view.sequence_id();
+                cursor.ring_index++;
+                handler(view);
+                delivered++;
+            }
+            if (cursor.ring_index >= head || delivered >= max_events) {
+                return delivered;
+            }
+            // The writer lapped this cursor
+            cursor.ring_index = EventCursor::kNoRingIndex;
+        }
+        
+        // Behind the ring: read the log until the ring covers the cursor again
+        size_t from_log = 0;
+        scan_events(cursor.sequence + 1, latest_sequence_, [&](const EventView& view) {
+            cursor.sequence = view.sequence_id();
+            handler(view);
+            delivered++;
+            from_log++;
+            return delivered < max_events &&
+                   (!tail_ring_ || from_log % kRingProbeInterval != 0 ||
+                    !tail_ring_->find_after(cursor.sequence, cursor.ring_index));
+        });
+        if (from_log == 0) {
+            break;
+        }
+    }
+    return delivered;
+}
+
+// Snapshot layout: SnapshotHeader, state bytes, uint32_t crc32c of both
+namespace {
+
+constexpr uint32_t kSnapshotMagic = 0x50414e53;   // "SNAP"
+constexpr uint32_t kSnapshotVersion = 1;
+
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    SequenceID sequence;
+    uint64_t state_length;
+};
+
+} // namespace
+
+std::string EventStore::encode_snapshot(SequenceID sequence, const std::string& state) {
+    SnapshotHeader header{kSnapshotMagic, kSnapshotVersion, sequence, state.size()};
+    
+    std::string buffer;
+    buffer.reserve(sizeof(header) + state.size() + sizeof(uint32_t));
+    append_pod(buffer, header);
+    buffer += state;
+    append_pod(buffer, crc32c(buffer.data(), buffer.size()));
+    return buffer;
+}
+
+bool EventStore::create_snapshot(SequenceID sequence, const std::string& snapshot_path,
+                                 const std::string& state) {
+    std::string buffer = encode_snapshot(sequence, state);
+    return write_file_atomic(snapshot_path, buffer.data(), buffer.size());
+}
+
+bool EventStore::load_snapshot(const std::string& snapshot_path, SequenceID& sequence) {
+    std::string state;
+    return load_snapshot(snapshot_path, sequence, state);
+}
+
+bool EventStore::load_snapshot(const std::string& snapshot_path, SequenceID& sequence,
+                               std::string& state) {
+    std::ifstream file(snapshot_path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::string buffer(static_cast<size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    if (!file.read(&buffer[0], buffer.size())) {
+        return false;
+    }
+    
+    SnapshotHeader header;
+    uint32_t crc = 0;
+    if (buffer.size() < sizeof(header) + sizeof(crc)) {
+        return false;
+    }
+    memcpy(&header, buffer.data(), sizeof(header));
+    size_t body = buffer.size() - sizeof(crc);
+    memcpy(&crc, buffer.data() + body, sizeof(crc));
+    if (header.magic != kSnapshotMagic || header.version != kSnapshotVersion ||
+        header.state_length != body - sizeof(header) ||
+        crc32c(buffer.data(), body) != crc) {
+        LOG_WARN("EventStore: invalid snapshot " + snapshot_path);
+        return false;
+    }
+    
+    sequence = header.sequence;
+    state.assign(buffer.data() + sizeof(header), header.state_length);
+    return true;
+}
+
+std::string EventStore::event_log_dir(const std::string& data_dir) {
+    return data_dir + "/events";
+}
+
+bool EventStore::last_index_entry(const std::string& data_dir, SparseIndexEntry& entry) {
+    std::ifstream file(data_dir + "/events.idx", std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return false;
+    }
+    auto count = static_cast<uint64_t>(file.tellg()) / sizeof(SparseIndexEntry);
+    if (count == 0) {
+        return false;
+    }
+    file.seekg(static_cast<std::streamoff>((count - 1) * sizeof(SparseIndexEntry)));
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(&entry), sizeof(entry)));
+}
+
+namespace {
+
+constexpr size_t kReplayBatch = 1024;        // Events handed to a worker at once
+constexpr size_t kReplayQueueDepth = 64;     // Batches queued per worker
+
+// One worker of a parallel replay, fed batches by the dispatching thread
+struct ReplayPartition {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::vector<Event>> queue;
+    std::vector<Event> pending;    // Batch being filled by the dispatcher
+    size_t queued = 0;             // Batches pushed
+    size_t done = 0;               // Batches handled
+    bool closed = false;
+    std::thread thread;
+};
+
+// Decoded events of one segment within [from, to]
+struct DecodedSegment {
+    std::vector<Event> events;
+    bool end = false;              // Log ended or passed `to` in this segment
+};
+
+} // namespace
+
+bool EventStore::replay_events_parallel(SequenceID from, SequenceID to, size_t partitions,
+                                        const std::function<size_t(const Event&)>& partition_of,
+                                        const std::function<bool(size_t, const Event&)>& handler,
+                                        size_t decode_threads) const {
+    if (partitions == 0) {
+        return false;
+    }
+    if (decode_threads == 0) {
+        decode_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    ensure_readable(std::min<SequenceID>(to, latest_sequence_));
+    
+    // Segments from the one holding `from` on
+    JournalPosition start;
+    {
+        JournalReader reader(event_log_path_);
+        seek_to_sequence(reader, from);
+        start = reader.record_position();
+    }
+    std::vector<uint64_t> segments = list_journal_segments(event_log_path_);
+    auto first = std::lower_bound(segments.begin(), segments.end(), start.segment);
+    segments.erase(segments.begin(), first);
+    
+    auto decode = [this, from, to, start](uint64_t segment) {
+        DecodedSegment decoded;
+        JournalReader reader(event_log_path_);
+        JournalPosition position{segment, segment == start.segment ? start.offset : 0};
+        if (!reader.seek(position)) {
+            decoded.end = true;
+            return decoded;
+        }
+        EventView view;
+        Event event;
+        while (true) {
+            if (!read_event_view(reader, view)) {
+                decoded.end = true;
+                break;
+            }
+            if (reader.record_position().segment != segment) {
+                break;  // Next segment belongs to another decoder
+            }
+            if (view.sequence_id() > to) {
+                decoded.end = true;
+                break;
+            }
+            if (view.sequence_id() >= from) {
+                if (!view.decode(event)) {
+                    LOG_ERROR("EventStore: event " + std::to_string(view.sequence_id()) +
+                              " cannot be decoded, skipped");
+                    continue;
+                }
+                decoded.events.push_back(event);
+            }
+        }
+        return decoded;
+    };
+    
+    std::atomic<bool> failed{false};
+    std::vector<std::unique_ptr<ReplayPartition>> workers;
+    for (size_t i = 0; i < partitions; ++i) {
+        workers.push_back(std::make_unique<ReplayPartition>());
+    }
+    for (size_t i = 0; i < partitions; ++i) {
+        ReplayPartition* worker = workers[i].get();
+        worker->thread = std::thread([worker, i, &handler, &failed]() {
+            while (true) {
+                std::vector<Event> batch;
+                {
+                    std::unique_lock<std::mutex> lock(worker->mutex);
+                    worker->cv.wait(lock, [worker] { return !worker->queue.empty() || worker->closed; });
+                    if (worker->queue.empty()) {
+                        return;
+                    }
+                    batch = std::move(worker->queue.front());
+                    worker->queue.pop_front();
+                }
+                worker->cv.notify_all();
+                for (const auto& event : batch) {
+                    if (failed.load(std::memory_order_relaxed)) {
+                        break;
+                    }
+                    if (!handler(i, event)) {
+                        failed = true;
+                    }
+                }
+                {
+                    std::lock_guard<std::mutex> lock(worker->mutex);
+                    ++worker->done;
+                }
+                worker->cv.notify_all();
+            }
+        });
+    }
+    
+    auto push = [](ReplayPartition& worker) {
+        if (worker.pending.empty()) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        worker.cv.wait(lock, [&worker] { return worker.queue.size() < kReplayQueueDepth; });
+        worker.queue.push_back(std::move(worker.pending));
+        ++worker.queued;
+        lock.unlock();
+        worker.cv.notify_all();
+        worker.pending.clear();
+        worker.pending.reserve(kReplayBatch);
+    };
+    
+    // Decode a window of segments while the previous window is dispatched
+    std::deque<std::future<DecodedSegment>> window;
+    size_t next_segment = 0;
+    auto refill = [&]() {
+        while (window.size() < decode_threads && next_segment < segments.size()) {
+            window.push_back(std::async(std::launch::async, decode, segments[next_segment++]));
+        }
+    };
+    
+    refill();
+    bool end = false;
+    while (!window.empty() && !end && !failed) {
+        DecodedSegment decoded = window.front().get();
+        window.pop_front();
+        end = decoded.end;
+        if (!end) {
+            refill();
+        }
+        
+        for (const auto& event : decoded.events) {
+            size_t partition = partition_of(event);
+            if (partition == kReplaySkip) {
+                continue;
+            }
+            if (partition == kReplayBarrier) {
+                // Drain every worker, then handle in global order
+                for (auto& worker : workers) {
+                    push(*worker);
+                    std::unique_lock<std::mutex> lock(worker->mutex);
+                    worker->cv.wait(lock, [&worker] { return worker->done == worker->queued; });
+                }
+                if (!failed && !handler(kReplayBarrier, event)) {
+                    failed = true;
+                }
+                continue;
+            }
+            if (partition == kReplayAll) {
+                for (auto& worker : workers) {
+                    worker->pending.push_back(event);
+                    if (worker->pending.size() >= kReplayBatch) {
+                        push(*worker);
+                    }
+                }
+                continue;
+            }
+            ReplayPartition& worker = *workers[partition % partitions];
+            worker.pending.push_back(event);
+            if (worker.pending.size() >= kReplayBatch) {
+                push(worker);
+            }
+        }
+    }
+    
+    for (auto& worker : workers) {
+        push(*worker);
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->closed = true;
+        }
+        worker->cv.notify_all();
+        worker->thread.join();
+    }
+    for (auto& pending : window) {
+        pending.wait();
+    }
+    return !failed;
+}
+
+void EventStore::flush() {
+    sync_for_read();
+}
+
+void EventStore::sync_for_read() const {
+    uint64_t record = 0;
+    {
+        std::lock_guard<std::mutex> lock(event_log_mutex_);
+        if (!journal_ || !journal_->is_open()) {
+            return;
+        }
+        record = commit_journal();
+        if (sparse_index_file_.is_open()) {
+            sparse_index_file_.flush();
+        }
+    }
+    // Wait outside the lock so appends keep filling the next batch
+    journal_->wait_durable(record);
+}
+
+SequenceID EventStore::readable_sequence() const {
+    // Without a writer (follower) the log holds everything there is
+    if (!journal_) {
+        return UINT64_MAX;
+    }
+    return durable_sequence_.load(std::memory_order_acquire);
+}
+
+void EventStore::ensure_readable(SequenceID through) const {
+    if (through > readable_sequence()) {
+        sync_for_read();
+    }
+}
+
+EventStore::RingScan EventStore::scan_ring(SequenceID& from, SequenceID to,
+                                           const std::function<bool(const EventView&)>& handler) const {
+    uint64_t index = 0;
+    if (!tail_ring_ || !tail_ring_->find_after(from - 1, index)) {
+        return RingScan::MISSED;
+    }
+    char buffer[kMaxEncodedEventSize];
+    size_t length = 0;
+    for (uint64_t head = tail_ring_->head(); index < head; ++index) {
+        if (!tail_ring_->read(index, buffer, length)) {
+            return RingScan::MISSED;   // Lapped: from is the next event to deliver
+        }
+        EventView view(buffer, length);
+        SequenceID sequence = view.sequence_id();
+        if (sequence > to) {
+            break;
+        }
+        if (sequence >= from) {
+            if (!handler(view)) {
+                return RingScan::STOPPED;
+            }
+            from = sequence + 1;
+        }
+    }
+    return RingScan::DONE;
+}
+
+bool EventStore::read_ring_event(SequenceID sequence, Event& event) const {
+    uint64_t index = 0;
+    char buffer[kMaxEncodedEventSize];
+    size_t length = 0;
+    if (!tail_ring_ || !tail_ring_->find_after(sequence - 1, index) ||
+        !tail_ring_->read(index, buffer, length)) {
+        return false;
+    }
+    EventView view(buffer, length);
+    return view.sequence_id() == sequence && view.decode(event);
+}
+
+uint64_t EventStore::commit_journal() const {
+    {
+        std::lock_guard<std::mutex> lock(commit_marks_mutex_);
+        uint64_t record = journal_->appended_record();
+        if (commit_marks_.empty() || commit_marks_.back().first < record) {
+            commit_marks_.emplace_back(record, logged_sequence_);
+        }
+    }
+    return journal_->commit();
+}
+
+void EventStore::on_durable(uint64_t record) {
+    std::lock_guard<std::mutex> lock(commit_marks_mutex_);
+    SequenceID durable = durable_sequence_.load(std::memory_order_relaxed);
+    while (!commit_marks_.empty() && commit_marks_.front().first <= record) {
+        durable = std::max(durable, commit_marks_.front().second);
+        commit_marks_.pop_front();
+    }
+    durable_sequence_.store(durable, std::memory_order_release);
+}
+
+bool EventStore::write_event_to_log(const Event& event, JournalPosition& position,
+                                    uint64_t& chain) {
+    if (!journal_ || !journal_->is_open()) {
+        return false;
+    }
+    
+    // Encode straight into the journal batch (framed with length and CRC)
+    size_t length = event.encoded_size();
+    char* record = journal_->reserve(length);
+    if (!record) {
+        return false;
+    }
+    event.encode(record);
+    position = journal_->last_position();
+    logged_sequence_ = std::max(logged_sequence_, event.sequence_id);
+    
+    // Appends are serialized by event_log_mutex_, so chain_ is the
+    // predecessor's chain
+    chain = hash64(record, length, chain_);
+    if (append_listener_) {
+        append_listener_(EventView(record, length));
+    }
+    if (tail_ring_) {
+        tail_ring_->push(record, length);
+    }
+    
+    // Group commit: hand the batch to the backend once it is large enough
+    if (journal_->pending_bytes() >= config_.group_commit_bytes) {
+        commit_journal();
+    }
+    return true;
+}
+
+void EventStore::journal_worker() {
+    while (journal_running_) {
+        {
+            std::unique_lock<std::mutex> lock(journal_wait_mutex_);
+            journal_cv_.wait_for(lock, std::chrono::milliseconds(config_.group_commit_interval_ms),
+                                 [this] { return !journal_running_; });
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(event_log_mutex_);
+            if (journal_ && journal_->pending_bytes() > 0) {
+                commit_journal();
+            }
+            if (sparse_index_file_.is_open()) {
+                sparse_index_file_.flush();
+            }
+        }
+        
+        if (manifest_dirty_) {
+            write_manifest();
+        }
+        
+        if (config_.index_checkpoint_interval > 0 &&
+            event_count_ - checkpoint_count_ >= config_.index_checkpoint_interval) {
+            checkpoint_indexes();
+        }
+    }
+}
+
+void EventStore::stop_journal_worker() {
+    if (!journal_running_.exchange(false)) {
+        return;
+    }
+    journal_cv_.notify_all();
+    if (journal_thread_.joinable()) {
+        journal_thread_.join();
+    }
+}
+
+bool EventStore::read_event_from_log(JournalReader& reader, Event& event) const {
+    EventView view;
+    if (!read_event_view(reader, view)) {
+        return false;
+    }
+    
+    if (!view.decode(event)) {
+        LOG_ERROR("EventStore: event " + std::to_string(view.sequence_id()) + " cannot be decoded");
+        return false;
+    }
+    return true;
+}
+
+bool EventStore::read_event_view(JournalReader& reader, EventView& view) const {
+    const char* data = nullptr;
+    size_t len = 0;
+    if (!reader.next(data, len)) {
+        return false;  // End of log (or first torn record)
+    }
+    view = EventView(data, len);
+    return true;
 }
 
 // EventPublisher implementation
@@ -478,9 +1975,11 @@ void EventPublisher::publish_order_matched(OrderID taker_id, OrderID maker_id,
 }
 
 void EventPublisher::publish_order_cancelled(OrderID order_id, UserID user_id,
-                                             OrderStatus old_status, OrderStatus new_status) {
+                                             OrderStatus old_status, OrderStatus new_status,
+                                             InstrumentID instrument_id) {
     Event event;
     event.type = EventType::ORDER_CANCELLED;
+    event.instrument_id = instrument_id;
     event.data.order_cancelled.order_id = order_id;
     event.data.order_cancelled.user_id = user_id;
     event.data.order_cancelled.old_status = old_status;
@@ -495,8 +1994,7 @@ void EventPublisher::publish_order_rejected(OrderID order_id, UserID user_id,
     event.type = EventType::ORDER_REJECTED;
     event.data.order_rejected.order_id = order_id;
     event.data.order_rejected.user_id = user_id;
-    strncpy(event.data.order_rejected.reason, reason.c_str(), sizeof(event.data.order_rejected.reason) - 1);
-    event.data.order_rejected.reason[sizeof(event.data.order_rejected.reason) - 1] = '\0';
+    event.data.order_rejected.reason_id = event_store_->intern_reason(reason);
     
     event_store_->append_event(event);
 }
@@ -526,8 +2024,7 @@ void EventPublisher::publish_order_status_changed(OrderID order_id, OrderStatus
     } else if (new_status == OrderStatus::REJECTED) {
         event.type = EventType::ORDER_REJECTED;
         event.data.order_rejected.order_id = order_id;
-        strncpy(event.data.order_rejected.reason, "Status changed", sizeof(event.data.order_rejected.reason) - 1);
-        event.data.order_rejected.reason[sizeof(event.data.order_rejected.reason) - 1] = '\0';
+        event.data.order_rejected.reason_id = event_store_->intern_reason("Status changed");
     }
     
     if (event.type != EventType::ORDER_PLACED) {  // Valid event type
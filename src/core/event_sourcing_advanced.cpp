@@ -1,11 +1,17 @@
 #include "core/event_sourcing_advanced.h"
+#include "core/event_archive.h"
 #include "core/matching_engine_event_sourcing.h"
 #include "core/orderbook.h"
 #include "core/deterministic_calculator.h"
+#include "core/journal_segment.h"
+#include "core/logger.h"
 #include <fstream>
 #include <sstream>
 #include <algorithm>
 #include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
 #include <thread>
 
 namespace perpetual {
@@ -45,17 +51,27 @@ size_t EventCompressor::compress_events(SequenceID up_to_sequence) {
             std::string snapshot_path = "./snapshot_" + 
                                        std::to_string(up_to_sequence) + ".snap";
             if (create_snapshot_and_compress(up_to_sequence, snapshot_path)) {
-                // In production, would delete events from log file
+                // Whole sealed segments covered by the snapshot are unlinked
+                event_store_->truncate_before(up_to_sequence + 1);
                 compressed_count = up_to_sequence;
             }
             break;
         }
         case CompressionStrategy::ARCHIVE: {
-            // Archive events to compressed file
-            std::string archive_path = "./archive_" + 
+            // Archive the events since the previous archive (found on disk
+            // after a restart)
+            if (!archived_sequence_loaded_) {
+                archived_sequence_ = last_archived_sequence();
+                archived_sequence_loaded_ = true;
+            }
+            if (up_to_sequence <= archived_sequence_) {
+                break;
+            }
+            std::string archive_path = kArchiveDir + std::string("/archive_") +
                                      std::to_string(up_to_sequence) + ".arc";
-            if (archive_events(0, up_to_sequence, archive_path)) {
-                compressed_count = up_to_sequence;
+            if (archive_events(archived_sequence_ + 1, up_to_sequence, archive_path)) {
+                compressed_count = up_to_sequence - archived_sequence_;
+                archived_sequence_ = up_to_sequence;
             }
             break;
         }
@@ -81,34 +97,61 @@ bool EventCompressor::archive_events(SequenceID from, SequenceID to,
         return false;
     }
     
-    // Get events to archive
-    auto events = event_store_->get_events(from, to);
-    
-    // Write to archive file (compressed)
-    std::ofstream archive(archive_path, std::ios::binary);
-    if (!archive.is_open()) {
+    // Columnar archive (see event_archive.h), streamed from the log
+    EventArchiveWriter writer;
+    if (!writer.open(archive_path)) {
         return false;
     }
     
-    // Write header
-    archive.write(reinterpret_cast<const char*>(&from), sizeof(from));
-    archive.write(reinterpret_cast<const char*>(&to), sizeof(to));
-    size_t count = events.size();
-    archive.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    // An undecodable event fails the run; the writer drops the partial file
+    Event event;
+    bool decoded = true;
+    bool ok = event_store_->scan_events(from, to, [&](const EventView& view) {
+        if (!view.decode(event)) {
+            LOG_ERROR("Archive " + archive_path + ": event " + std::to_string(view.sequence_id()) +
+                      " cannot be decoded");
+            decoded = false;
+            return false;
+        }
+        return writer.append(event);
+    });
     
-    // Write events
-    for (const auto& event : events) {
-        std::string serialized = event.serialize();
-        size_t len = serialized.length();
-        archive.write(reinterpret_cast<const char*>(&len), sizeof(len));
-        archive.write(serialized.c_str(), len);
+    return ok && decoded && writer.close();
+}
+
+SequenceID EventCompressor::last_archived_sequence() const {
+    // Archives are named after the last sequence they cover; only files
+    // that open as complete archives count
+    SequenceID last = 0;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(kArchiveDir, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() <= 12 || name.compare(0, 8, "archive_") != 0 ||
+            name.compare(name.size() - 4, 4, ".arc") != 0) {
+            continue;
+        }
+        std::string digits = name.substr(8, name.size() - 12);
+        if (digits.find_first_not_of("0123456789") != std::string::npos) {
+            continue;
+        }
+        SequenceID sequence = std::stoull(digits);
+        EventArchiveReader reader;
+        if (sequence > last && reader.open(entry.path().string())) {
+            last = sequence;
+        }
     }
-    
-    return true;
+    return last;
 }
 
 bool EventCompressor::load_archived_events(const std::string& archive_path, 
                                           std::vector<Event>& events) {
+    if (EventArchiveReader::is_archive(archive_path)) {
+        EventArchiveReader reader;
+        return reader.open(archive_path) &&
+               reader.read_events(0, UINT64_MAX, events);
+    }
+    
+    // Archives written before the columnar format
     std::ifstream archive(archive_path, std::ios::binary);
     if (!archive.is_open()) {
         return false;
@@ -195,18 +238,14 @@ void EventCompressor::compression_worker() {
 
 DistributedEventStore::DistributedEventStore(const DistributedEventStoreConfig& config)
     : config_(config) {
-    // Initialize node availability
-    for (NodeID node_id : config_.replica_nodes) {
-        node_availability_[node_id] = true;  // Assume available initially
-    }
 }
 
 DistributedEventStore::~DistributedEventStore() {
-    if (replication_running_) {
-        replication_running_ = false;
-        if (replication_thread_.joinable()) {
-            replication_thread_.join();
-        }
+    if (shipper_) {
+        shipper_->stop();
+    }
+    if (follower_) {
+        follower_->stop();
     }
 }
 
@@ -216,26 +255,28 @@ bool DistributedEventStore::initialize(const std::string& data_dir) {
         return false;
     }
     
-    // Start replication thread
-    replication_running_ = true;
-    replication_thread_ = std::thread(&DistributedEventStore::replication_worker, this);
-    
+    if (!config_.primary_address.empty()) {
+        LogReplicaConfig replica_config;
+        replica_config.primary_address = config_.primary_address;
+        replica_config.node_id = config_.node_id;
+        follower_ = std::make_unique<LogReplica>();
+        return follower_->start(local_store_.get(), replica_config);
+    }
+    if (!config_.shipping.listen_address.empty()) {
+        shipper_ = std::make_unique<LogShipper>();
+        return shipper_->start(local_store_.get(), config_.shipping);
+    }
     return true;
 }
 
 bool DistributedEventStore::append_event(const Event& event) {
-    // Append to local store
-    if (!local_store_->append_event(event)) {
-        return false;
-    }
-    
-    // Queue for replication
-    {
-        std::lock_guard<std::mutex> lock(replication_mutex_);
-        replication_queue_.push(event);
+    if (follower_) {
+        return false;  // Replicas only take what the primary ships
     }
     
-    return true;
+    // The shipper picks the encoded event up from the store's append
+    // listener; no copy is queued here
+    return local_store_->append_event(event);
 }
 
 std::vector<Event> DistributedEventStore::get_events(SequenceID from, SequenceID to) const {
@@ -265,24 +306,50 @@ std::vector<Event> DistributedEventStore::get_events_from_node(NodeID node_id,
 
 bool DistributedEventStore::replicate_event(const Event& event, 
                                             const std::vector<NodeID>& target_nodes) {
-    // In production, would send event to target nodes via network
-    // For now, just mark as replicated
-    return true;
+    if (target_nodes.empty()) {
+        return true;
+    }
+    SequenceID sequence = event.sequence_id != 0 ? event.sequence_id
+                                                 : local_store_->get_latest_sequence();
+    return wait_replicated(sequence, target_nodes.size(), config_.replication_timeout);
 }
 
 SequenceID DistributedEventStore::get_consensus_sequence() const {
-    // In production, would query multiple nodes and get majority consensus
-    // For now, return local sequence
-    return local_store_->get_latest_sequence();
+    SequenceID local = local_store_->get_latest_sequence();
+    size_t majority = config_.replication_factor / 2 + 1;
+    if (!shipper_ || majority <= 1) {
+        return local;
+    }
+    return std::min(local, shipper_->replicated_sequence(majority - 1));
+}
+
+SequenceID DistributedEventStore::replicated_sequence(size_t k) const {
+    if (!shipper_) {
+        return k == 0 ? local_store_->get_latest_sequence() : 0;
+    }
+    return shipper_->replicated_sequence(k);
+}
+
+bool DistributedEventStore::wait_replicated(SequenceID sequence, size_t k,
+                                            std::chrono::microseconds timeout) const {
+    if (k == 0) {
+        return true;
+    }
+    return shipper_ && shipper_->wait_replicated(sequence, k, timeout);
+}
+
+std::vector<ReplicaStatus> DistributedEventStore::replica_status() const {
+    return shipper_ ? shipper_->replicas() : std::vector<ReplicaStatus>();
 }
 
 bool DistributedEventStore::is_node_available(NodeID node_id) const {
-    std::shared_lock<std::shared_mutex> lock(node_mutex_);
-    auto it = node_availability_.find(node_id);
-    if (it != node_availability_.end()) {
-        return it->second;
+    if (node_id == config_.node_id) {
+        return true;
     }
-    return false;
+    if (shipper_) {
+        return shipper_->is_connected(node_id);
+    }
+    return follower_ && follower_->connected();
 }
 
 std::string DistributedEventStore::get_data_dir() const {
@@ -290,30 +357,6 @@ std::string DistributedEventStore::get_data_dir() const {
     return "./";
 }
 
-void DistributedEventStore::replication_worker() {
-    while (replication_running_) {
-        std::vector<Event> events_to_replicate;
-        
-        // Batch events for replication
-        {
-            std::lock_guard<std::mutex> lock(replication_mutex_);
-            while (!replication_queue_.empty() && events_to_replicate.size() < 100) {
-                events_to_replicate.push_back(replication_queue_.front());
-                replication_queue_.pop();
-            }
-        }
-        
-        // Replicate to other nodes
-        if (!events_to_replicate.empty()) {
-            for (const auto& event : events_to_replicate) {
-                replicate_event(event, config_.replica_nodes);
-            }
-        }
-        
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    }
-}
-
 // ============================================================================
 // 3. Event Stream Processing Implementation
 // ============================================================================
@@ -326,13 +369,17 @@ EventStreamProcessor::~EventStreamProcessor() {
     stop_processing();
 }
 
-uint64_t EventStreamProcessor::subscribe(EventHandler handler, EventFilter filter) {
+uint64_t EventStreamProcessor::subscribe(EventHandler handler, EventFilter filter,
+                                         EventSelector selector) {
     std::lock_guard<std::mutex> lock(subscriptions_mutex_);
     
+    // New subscriptions start where the processor is
     Subscription sub;
     sub.id = next_subscription_id_++;
     sub.handler = handler;
     sub.filter = filter;
+    sub.selector = selector;
+    sub.cursor = EventCursor(last_processed_);
     
     subscriptions_.push_back(sub);
     
@@ -357,6 +404,12 @@ void EventStreamProcessor::start_processing(SequenceID from_sequence) {
     }
     
     last_processed_ = from_sequence;
+    {
+        std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+        for (auto& sub : subscriptions_) {
+            sub.cursor = EventCursor(from_sequence);
+        }
+    }
     processing_ = true;
     processing_thread_ = std::thread(&EventStreamProcessor::processing_worker, this);
 }
@@ -377,32 +430,38 @@ void EventStreamProcessor::process_new_events() {
         return;
     }
     
-    SequenceID current_sequence = event_store_->get_latest_sequence();
-    SequenceID from = last_processed_ + 1;
-    
-    if (from > current_sequence) {
-        return;  // No new events
-    }
-    
-    auto events = event_store_->get_events(from, current_sequence);
-    
     std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+    if (subscriptions_.empty()) {
+        last_processed_ = event_store_->get_latest_sequence();
+        return;
+    }
     
-    for (const auto& event : events) {
-        for (const auto& sub : subscriptions_) {
-            // Apply filter if present
+    // Each subscription catches up through its own cursor; only events its
+    // selector accepts are decoded
+    Event event;
+    SequenceID last = last_processed_;
+    size_t read = 0;
+    for (auto& sub : subscriptions_) {
+        size_t count = event_store_->read_tail(sub.cursor, [&](const EventView& view) {
+            if (!sub.selector.matches(view)) {
+                return;
+            }
+            if (!view.decode(event)) {
+                LOG_ERROR("EventStreamProcessor: event " + std::to_string(view.sequence_id()) +
+                          " cannot be decoded, skipped");
+                return;
+            }
             if (sub.filter && !sub.filter(event)) {
-                continue;
+                return;
             }
-            
-            // Call handler
             sub.handler(event);
-        }
-        
-        events_processed_++;
+        });
+        read = std::max(read, count);
+        last = std::max(last, sub.cursor.sequence);
     }
     
-    last_processed_ = current_sequence;
+    events_processed_ += read;
+    last_processed_ = last;
 }
 
 void EventStreamProcessor::processing_worker() {
@@ -508,6 +567,11 @@ bool CommandHandler::validate_command(const Command& command) const {
 }
 
 
+QueryHandler::QueryHandler(EventStore* event_store, size_t order_cache_capacity)
+    : event_store_(event_store),
+      order_cache_capacity_(order_cache_capacity > 0 ? order_cache_capacity : 1) {
+}
+
 QueryResult QueryHandler::execute_query(const Query& query) {
     QueryResult result;
     result.success = false;
@@ -573,29 +637,99 @@ void QueryHandler::update_cache_from_events(const std::vector<Event>& events) {
     std::unique_lock<std::shared_mutex> lock(cache_mutex_);
     
     for (const auto& event : events) {
-        if (event.type == EventType::ORDER_PLACED) {
-            Order order(event.data.order_placed.order_id,
-                       event.data.order_placed.user_id,
-                       event.instrument_id,
-                       event.data.order_placed.side,
-                       event.data.order_placed.price,
-                       event.data.order_placed.quantity,
-                       event.data.order_placed.order_type);
-            order_cache_[order.order_id] = order;
+        switch (event.type) {
+            case EventType::ORDER_PLACED: {
+                Order order(event.data.order_placed.order_id,
+                           event.data.order_placed.user_id,
+                           event.instrument_id,
+                           event.data.order_placed.side,
+                           event.data.order_placed.price,
+                           event.data.order_placed.quantity,
+                           event.data.order_placed.order_type);
+                cache_order(order);
+                break;
+            }
+            case EventType::ORDER_CANCELLED:
+                evict_order(event.data.order_cancelled.order_id);
+                break;
+            case EventType::ORDER_REJECTED:
+                evict_order(event.data.order_rejected.order_id);
+                break;
+            case EventType::TRADE_EXECUTED: {
+                const Trade& trade = event.data.trade_executed.trade;
+                apply_fill(trade.buy_order_id, trade.quantity);
+                apply_fill(trade.sell_order_id, trade.quantity);
+                break;
+            }
+            default:
+                break;
         }
     }
 }
 
+size_t QueryHandler::cached_order_count() const {
+    std::shared_lock<std::shared_mutex> lock(cache_mutex_);
+    return order_cache_.size();
+}
+
+// Callers hold cache_mutex_ exclusively
+void QueryHandler::cache_order(const Order& order) {
+    auto it = order_cache_.find(order.order_id);
+    if (it != order_cache_.end()) {
+        it->second.order = order;
+        order_lru_.splice(order_lru_.begin(), order_lru_, it->second.lru);
+        return;
+    }
+    
+    while (order_cache_.size() >= order_cache_capacity_) {
+        order_cache_.erase(order_lru_.back());
+        order_lru_.pop_back();
+    }
+    order_lru_.push_front(order.order_id);
+    order_cache_.emplace(order.order_id, CachedOrder{order, order_lru_.begin()});
+}
+
+void QueryHandler::apply_fill(OrderID order_id, Quantity quantity) {
+    auto it = order_cache_.find(order_id);
+    if (it == order_cache_.end()) {
+        return;
+    }
+    
+    Order& order = it->second.order;
+    Quantity fill = std::min(quantity, order.remaining_quantity);
+    order.filled_quantity += fill;
+    order.remaining_quantity -= fill;
+    if (order.remaining_quantity <= 0) {
+        evict_order(order_id);
+        return;
+    }
+    order.status = OrderStatus::PARTIAL_FILLED;
+    order_lru_.splice(order_lru_.begin(), order_lru_, it->second.lru);
+}
+
+void QueryHandler::evict_order(OrderID order_id) {
+    auto it = order_cache_.find(order_id);
+    if (it == order_cache_.end()) {
+        return;
+    }
+    order_lru_.erase(it->second.lru);
+    order_cache_.erase(it);
+}
+
 CQRSManager::CQRSManager(MatchingEngineEventSourcing* engine, EventStore* event_store)
     : command_handler_(std::make_unique<CommandHandler>(engine)),
       query_handler_(std::make_unique<QueryHandler>(event_store)),
       stream_processor_(std::make_unique<EventStreamProcessor>(event_store)) {
     
-    // Subscribe to events for cache update
+    // Subscribe to events for cache update (placements add, terminal
+    // transitions and full fills evict)
     stream_processor_->subscribe(
         [this](const Event& event) {
             cache_update_handler(event);
-        }
+        },
+        nullptr,
+        EventSelector::of({EventType::ORDER_PLACED, EventType::ORDER_CANCELLED,
+                           EventType::ORDER_REJECTED, EventType::TRADE_EXECUTED})
     );
 }
 
@@ -675,16 +809,9 @@ VersionedEvent EventVersionManager::migrate_to_version(const VersionedEvent& eve
         return event;
     }
     
-    // Find migration path
-    auto path = get_migration_path(event.event.type, event.version, target_version);
-    
     VersionedEvent result = event;
-    for (EventVersion version : path) {
-        // Apply migration
-        // In production, would call registered migration function
-        result.version = version;
-    }
-    
+    plan_migration(event.event.type, event.version, target_version).apply(&result.event, 1);
+    result.version = target_version;
     return result;
 }
 
@@ -725,8 +852,51 @@ void EventVersionManager::register_migration(EventType event_type,
                                             EventVersion from_version,
                                             EventVersion to_version,
                                             MigrationFunc migration) {
+    register_batch_migration(event_type, from_version, to_version,
+        [migration, from_version](Event* events, size_t count) {
+            VersionedEvent versioned;
+            versioned.version = from_version;
+            versioned.min_supported_version = 1;
+            versioned.max_supported_version = from_version;
+            for (size_t i = 0; i < count; ++i) {
+                versioned.event = events[i];
+                events[i] = migration(versioned).event;
+            }
+        });
+}
+
+void EventVersionManager::register_batch_migration(EventType event_type,
+                                                  EventVersion from_version,
+                                                  EventVersion to_version,
+                                                  BatchMigrationFunc migration) {
     std::unique_lock<std::shared_mutex> lock(schema_mutex_);
-    migrations_[event_type][{from_version, to_version}] = migration;
+    migrations_[event_type][{from_version, to_version}] = std::move(migration);
+    generation_.fetch_add(1, std::memory_order_acq_rel);
+}
+
+UpcastPlan EventVersionManager::plan_migration(EventType event_type, EventVersion from,
+                                               EventVersion to) const {
+    UpcastPlan plan;
+    plan.from = from;
+    plan.to = to;
+    if (from == to || from == 0 || to == 0) {
+        return plan;
+    }
+    
+    std::shared_lock<std::shared_mutex> lock(schema_mutex_);
+    auto it = migrations_.find(event_type);
+    if (it == migrations_.end()) {
+        return plan;
+    }
+    EventVersion previous = from;
+    for (EventVersion version : get_migration_path(event_type, from, to)) {
+        auto step = it->second.find({previous, version});
+        if (step != it->second.end()) {
+            plan.steps.push_back(step->second);
+        }
+        previous = version;
+    }
+    return plan;
 }
 
 std::string VersionedEvent::serialize(EventVersion target_version) const {
@@ -763,37 +933,272 @@ VersionedEvent VersionedEvent::migrate_to_version(EventVersion target_version) c
     return result;
 }
 
+namespace {
+
+constexpr uint32_t kVersionRunsMagic = 0x53525645;    // "EVRS"
+constexpr uint32_t kVersionRunsFormat = 1;
+
+#pragma pack(push, 1)
+struct VersionRunsHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t type_count;
+    uint32_t run_count;
+};
+#pragma pack(pop)
+
+EventVersionRun initial_version_run() {
+    EventVersionRun run{};
+    run.first_sequence = 0;
+    std::fill(std::begin(run.versions), std::end(run.versions), 1);
+    return run;
+}
+
+// Run each event type's plan over that type's events in the batch. A batch
+// of a single type is upcast in place; otherwise each type that needs it is
+// gathered into a contiguous array, upcast and scattered back.
+void upcast_batch(std::vector<Event>& batch, const std::vector<UpcastPlan>& plans,
+                  std::vector<Event>& scratch, std::vector<uint32_t>& positions) {
+    size_t counts[kEventTypeCount] = {};
+    for (const Event& event : batch) {
+        size_t type = static_cast<size_t>(event.type);
+        if (type < kEventTypeCount) {
+            counts[type]++;
+        }
+    }
+    for (size_t type = 0; type < kEventTypeCount; ++type) {
+        if (plans[type].empty() || counts[type] == 0) {
+            continue;
+        }
+        if (counts[type] == batch.size()) {
+            plans[type].apply(batch.data(), batch.size());
+            continue;
+        }
+        scratch.clear();
+        positions.clear();
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (static_cast<size_t>(batch[i].type) == type) {
+                positions.push_back(static_cast<uint32_t>(i));
+                scratch.push_back(batch[i]);
+            }
+        }
+        plans[type].apply(scratch.data(), scratch.size());
+        for (size_t k = 0; k < positions.size(); ++k) {
+            batch[positions[k]] = scratch[k];
+        }
+    }
+}
+
+} // namespace
+
+bool VersionedEventStore::initialize(const std::string& data_dir, const EventStoreConfig& config) {
+    if (!EventStore::initialize(data_dir, config)) {
+        return false;
+    }
+    version_runs_path_ = data_dir + "/event_versions";
+    return load_version_runs();
+}
+
+bool VersionedEventStore::load_version_runs() {
+    std::unique_lock<std::shared_mutex> lock(version_runs_mutex_);
+    version_runs_.assign(1, initial_version_run());
+    
+    std::ifstream file(version_runs_path_, std::ios::binary);
+    if (!file) {
+        return true;  // Nothing recorded: every event is version 1
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    VersionRunsHeader header;
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != kVersionRunsMagic || header.format != kVersionRunsFormat ||
+        header.type_count > kEventTypeCount ||
+        data.size() != sizeof(header) + header.run_count * (sizeof(SequenceID) +
+                                                            header.type_count * sizeof(EventVersion))) {
+        return false;
+    }
+    
+    // Types added since the file was written were at version 1
+    version_runs_.clear();
+    const char* in = data.data() + sizeof(header);
+    for (uint32_t i = 0; i < header.run_count; ++i) {
+        EventVersionRun run = initial_version_run();
+        memcpy(&run.first_sequence, in, sizeof(SequenceID));
+        in += sizeof(SequenceID);
+        memcpy(run.versions, in, header.type_count * sizeof(EventVersion));
+        in += header.type_count * sizeof(EventVersion);
+        version_runs_.push_back(run);
+    }
+    if (version_runs_.empty()) {
+        version_runs_.push_back(initial_version_run());
+    }
+    return true;
+}
+
+bool VersionedEventStore::write_version_runs() const {
+    VersionRunsHeader header{kVersionRunsMagic, kVersionRunsFormat,
+                             static_cast<uint32_t>(kEventTypeCount),
+                             static_cast<uint32_t>(version_runs_.size())};
+    std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const EventVersionRun& run : version_runs_) {
+        data.append(reinterpret_cast<const char*>(&run.first_sequence), sizeof(SequenceID));
+        data.append(reinterpret_cast<const char*>(run.versions), sizeof(run.versions));
+    }
+    return write_file_atomic(version_runs_path_, data.data(), data.size());
+}
+
 bool VersionedEventStore::append_versioned_event(const VersionedEvent& event) {
-    // Append as regular event (version info stored in serialization)
-    return append_event(event.event);
+    size_t type = static_cast<size_t>(event.event.type);
+    std::unique_lock<std::shared_mutex> lock(version_runs_mutex_);
+    if (event.version == 0 || type >= kEventTypeCount ||
+        version_runs_.back().versions[type] == event.version) {
+        // Append as regular event (version recorded in the runs)
+        return append_event(event.event);
+    }
+    
+    // The run is recorded before any event of it is appended, at the
+    // sequence the append takes: a concurrent append_event cannot slip in
+    // between the boundary and the event
+    return append_event(event.event, [&](SequenceID sequence) {
+        EventVersionRun run = version_runs_.back();
+        run.first_sequence = sequence;
+        run.versions[type] = event.version;
+        EventVersionRun previous = version_runs_.back();
+        bool replaced = previous.first_sequence == run.first_sequence;
+        if (replaced) {
+            version_runs_.back() = run;
+        } else {
+            version_runs_.push_back(run);
+        }
+        if (!version_runs_path_.empty() && !write_version_runs()) {
+            if (replaced) {
+                version_runs_.back() = previous;
+            } else {
+                version_runs_.pop_back();
+            }
+            return false;
+        }
+        return true;
+    });
+}
+
+std::vector<EventVersionRun> VersionedEventStore::version_runs() const {
+    std::shared_lock<std::shared_mutex> lock(version_runs_mutex_);
+    return version_runs_;
+}
+
+EventVersion VersionedEventStore::version_at(SequenceID sequence, EventType event_type) const {
+    size_t type = static_cast<size_t>(event_type);
+    if (type >= kEventTypeCount) {
+        return 1;
+    }
+    std::shared_lock<std::shared_mutex> lock(version_runs_mutex_);
+    auto it = std::upper_bound(version_runs_.begin(), version_runs_.end(), sequence,
+                               [](SequenceID seq, const EventVersionRun& run) {
+                                   return seq < run.first_sequence;
+                               });
+    return it == version_runs_.begin() ? 1 : std::prev(it)->versions[type];
+}
+
+bool VersionedEventStore::replay_upcast(SequenceID from, SequenceID to, EventVersion target_version,
+                                        const std::function<bool(const Event*, size_t)>& handler,
+                                        size_t batch_size) const {
+    std::vector<EventVersionRun> runs = version_runs();
+    batch_size = std::max<size_t>(1, batch_size);
+    
+    std::vector<Event> batch;
+    batch.reserve(batch_size);
+    std::vector<Event> scratch;
+    std::vector<uint32_t> positions;
+    std::vector<UpcastPlan> plans(kEventTypeCount);
+    bool resolved = false;
+    SequenceID run_end = 0;         // Last sequence of the run plans were resolved for
+    
+    auto flush = [&]() {
+        if (batch.empty()) {
+            return true;
+        }
+        upcast_batch(batch, plans, scratch, positions);
+        bool more = handler(batch.data(), batch.size());
+        batch.clear();
+        return more;
+    };
+    
+    // Plans for the run holding sequence, once per run
+    auto resolve = [&](SequenceID sequence) {
+        auto it = std::upper_bound(runs.begin(), runs.end(), sequence,
+                                   [](SequenceID seq, const EventVersionRun& run) {
+                                       return seq < run.first_sequence;
+                                   });
+        EventVersionRun run = it == runs.begin() ? initial_version_run() : *std::prev(it);
+        run_end = it == runs.end() ? UINT64_MAX : it->first_sequence - 1;
+        for (size_t type = 0; type < kEventTypeCount; ++type) {
+            EventType event_type = static_cast<EventType>(type);
+            plans[type] = version_manager_
+                ? version_manager_->plan_migration(event_type, run.versions[type],
+                      target_version ? target_version : version_manager_->get_current_version(event_type))
+                : UpcastPlan();
+        }
+        resolved = true;
+    };
+    
+    SequenceID undecodable = 0;
+    bool completed = scan_events(from, to, [&](const EventView& view) {
+        // Batches never span two runs
+        if (!resolved || view.sequence_id() > run_end) {
+            if (!flush()) {
+                return false;
+            }
+            resolve(view.sequence_id());
+        }
+        batch.emplace_back();
+        if (!view.decode(batch.back())) {
+            // Unknown format version: hand over what precedes it and stop
+            // rather than upcast a blank event in its place
+            batch.pop_back();
+            undecodable = view.sequence_id();
+            flush();
+            return false;
+        }
+        return batch.size() < batch_size || flush();
+    });
+    if (undecodable != 0) {
+        LOG_ERROR("VersionedEventStore: cannot decode event " + std::to_string(undecodable) +
+                  ", replay stopped");
+        return false;
+    }
+    return completed && flush();
 }
 
 std::vector<VersionedEvent> VersionedEventStore::get_versioned_events(SequenceID from,
                                                                      SequenceID to,
                                                                      EventVersion target_version) const {
-    auto events = get_events(from, to);
     std::vector<VersionedEvent> versioned_events;
-    
-    for (const auto& event : events) {
-        VersionedEvent ve;
-        ve.event = event;
-        ve.version = version_manager_ ? 
-            version_manager_->get_current_version(event.type) : 1;
-        ve.min_supported_version = 1;
-        ve.max_supported_version = ve.version;
-        
-        // Migrate if needed
-        if (target_version > 0 && target_version != ve.version && version_manager_) {
-            ve = version_manager_->migrate_to_version(ve, target_version);
+    replay_upcast(from, to, target_version, [&](const Event* events, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            VersionedEvent ve;
+            ve.event = events[i];
+            EventVersion current = version_manager_ ?
+                version_manager_->get_current_version(ve.event.type) : 1;
+            if (!version_manager_) {
+                ve.version = version_at(ve.event.sequence_id, ve.event.type);
+            } else {
+                ve.version = target_version ? target_version : current;
+            }
+            ve.min_supported_version = 1;
+            ve.max_supported_version = std::max(current, ve.version);
+            versioned_events.push_back(ve);
         }
-        
-        versioned_events.push_back(ve);
-    }
+        return true;
+    });
     
     return versioned_events;
 }
 
 VersionedEventStore::VersionedEventStore() : EventStore() {
+    version_runs_.push_back(initial_version_run());
 }
 
 } // namespace perpetual
@@ -0,0 +1,1256 @@
+#include "core/history_store.h"
+#include "core/journal_segment.h"
+#include "core/logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace perpetual {
+
+namespace {
+
+constexpr uint32_t kSegmentMagic = 0x47455348;    // "HSEG"
+constexpr uint32_t kLogMagic = 0x474f4c48;        // "HLOG"
+constexpr uint32_t kHistoryFormat = 1;
+constexpr uint32_t kCommitMagic = 0x4d4d4348;     // "HCMM"
+constexpr const char* kLogFile = "/active.log";
+constexpr const char* kCommitFile = "/commit.pending";
+constexpr const char* kSegmentSuffix = ".hseg";
+constexpr size_t kLogBufferBytes = 1 << 20;
+constexpr uint64_t kMemtableRank = 0xffffffffULL;
+constexpr size_t kTableCount = 4;                  // Trades, orders, accounts, positions
+
+#pragma pack(push, 1)
+struct ColumnSpec {
+    uint32_t offset;            // Offset of the field in the row struct
+    uint32_t width;
+};
+
+struct LogHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t row_size;
+    uint32_t reserved;
+    uint64_t epoch;             // Bumped every time the log is sealed
+};
+
+struct SegmentHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t row_size;
+    uint32_t column_count;
+    uint64_t rows;
+    int64_t partition;
+    uint64_t epoch;             // Epoch of the log the rows were sealed from
+    int64_t min_time;
+    int64_t max_time;
+    uint64_t min_id;
+    uint64_t max_id;
+    uint64_t user_keys;
+    uint64_t user_entries;
+    uint64_t instrument_keys;
+    uint64_t instrument_entries;
+    uint64_t checksum;          // hash64 of everything after the header
+};
+
+// A committed transaction not yet known to be in every table: the header,
+// one CommitTable per table, then each table's rows in table order
+struct CommitHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t tables;
+    uint32_t reserved;
+    uint64_t checksum;          // hash64 of everything after the header
+};
+
+struct CommitTable {
+    uint64_t epoch;             // Log epoch the rows were appended to
+    uint64_t log_bytes;         // Log size before the rows
+    uint64_t row_bytes;
+};
+#pragma pack(pop)
+
+#define HISTORY_COLUMN(Row, field) \
+    ColumnSpec{static_cast<uint32_t>(offsetof(Row, field)), static_cast<uint32_t>(sizeof(Row::field))}
+
+// Layout of a table: which fields are stored, and which of them are the
+// sort key and the posting list keys
+struct TableSchema {
+    const char* name;
+    uint32_t row_size;
+    std::vector<ColumnSpec> columns;
+    size_t time_column;
+    size_t id_column;
+    std::vector<size_t> user_columns;
+    int instrument_column;      // -1 = no instrument postings
+};
+
+TableSchema trade_schema() {
+    return TableSchema{"trades", sizeof(Trade),
+                       {HISTORY_COLUMN(Trade, timestamp), HISTORY_COLUMN(Trade, sequence_id),
+                        HISTORY_COLUMN(Trade, buy_user_id), HISTORY_COLUMN(Trade, sell_user_id),
+                        HISTORY_COLUMN(Trade, instrument_id), HISTORY_COLUMN(Trade, buy_order_id),
+                        HISTORY_COLUMN(Trade, sell_order_id), HISTORY_COLUMN(Trade, price),
+                        HISTORY_COLUMN(Trade, quantity), HISTORY_COLUMN(Trade, is_taker_buy)},
+                       0, 1, {2, 3}, 4};
+}
+
+TableSchema order_schema() {
+    return TableSchema{"orders", sizeof(OrderHistoryRow),
+                       {HISTORY_COLUMN(OrderHistoryRow, timestamp), HISTORY_COLUMN(OrderHistoryRow, order_id),
+                        HISTORY_COLUMN(OrderHistoryRow, user_id), HISTORY_COLUMN(OrderHistoryRow, instrument_id),
+                        HISTORY_COLUMN(OrderHistoryRow, side), HISTORY_COLUMN(OrderHistoryRow, order_type),
+                        HISTORY_COLUMN(OrderHistoryRow, offset_flag), HISTORY_COLUMN(OrderHistoryRow, status),
+                        HISTORY_COLUMN(OrderHistoryRow, position_side), HISTORY_COLUMN(OrderHistoryRow, price),
+                        HISTORY_COLUMN(OrderHistoryRow, quantity),
+                        HISTORY_COLUMN(OrderHistoryRow, filled_quantity),
+                        HISTORY_COLUMN(OrderHistoryRow, remaining_quantity),
+                        HISTORY_COLUMN(OrderHistoryRow, sequence_id)},
+                       0, 1, {2}, 3};
+}
+
+TableSchema account_schema() {
+    return TableSchema{"accounts", sizeof(AccountHistoryRow),
+                       {HISTORY_COLUMN(AccountHistoryRow, timestamp), HISTORY_COLUMN(AccountHistoryRow, user_id),
+                        HISTORY_COLUMN(AccountHistoryRow, balance), HISTORY_COLUMN(AccountHistoryRow, frozen),
+                        HISTORY_COLUMN(AccountHistoryRow, margin)},
+                       0, 1, {1}, -1};
+}
+
+TableSchema position_schema() {
+    return TableSchema{"positions", sizeof(PositionHistoryRow),
+                       {HISTORY_COLUMN(PositionHistoryRow, timestamp), HISTORY_COLUMN(PositionHistoryRow, user_id),
+                        HISTORY_COLUMN(PositionHistoryRow, instrument_id), HISTORY_COLUMN(PositionHistoryRow, size),
+                        HISTORY_COLUMN(PositionHistoryRow, entry_price)},
+                       0, 1, {1}, -1};
+}
+
+#undef HISTORY_COLUMN
+
+inline uint64_t load_uint(const char* p, uint32_t width) {
+    switch (width) {
+        case 1: { uint8_t v; std::memcpy(&v, p, 1); return v; }
+        case 2: { uint16_t v; std::memcpy(&v, p, 2); return v; }
+        case 4: { uint32_t v; std::memcpy(&v, p, 4); return v; }
+        default: { uint64_t v; std::memcpy(&v, p, 8); return v; }
+    }
+}
+
+inline size_t align8(size_t n) {
+    return (n + 7) & ~size_t(7);
+}
+
+// Byte offsets of the parts of a segment file
+struct SegmentLayout {
+    std::vector<size_t> columns;
+    size_t user_keys, user_offsets, user_rows;
+    size_t instrument_keys, instrument_offsets, instrument_rows;
+    size_t size;
+};
+
+SegmentLayout segment_layout(const TableSchema& schema, const SegmentHeader& header) {
+    SegmentLayout layout;
+    size_t at = sizeof(SegmentHeader) + schema.columns.size() * sizeof(ColumnSpec);
+    for (const ColumnSpec& column : schema.columns) {
+        layout.columns.push_back(at);
+        at = align8(at + column.width * header.rows);
+    }
+    layout.user_keys = at;
+    at += header.user_keys * sizeof(uint64_t);
+    layout.user_offsets = at;
+    at = align8(at + (header.user_keys + 1) * sizeof(uint32_t));
+    layout.user_rows = at;
+    at = align8(at + header.user_entries * sizeof(uint32_t));
+    layout.instrument_keys = at;
+    at += header.instrument_keys * sizeof(uint64_t);
+    layout.instrument_offsets = at;
+    at = align8(at + (header.instrument_keys + 1) * sizeof(uint32_t));
+    layout.instrument_rows = at;
+    at = align8(at + header.instrument_entries * sizeof(uint32_t));
+    layout.size = at;
+    return layout;
+}
+
+// Row lists keyed by user or instrument id
+using PostingMap = std::unordered_map<uint64_t, std::vector<uint32_t>>;
+
+// Posting lists as stored in a segment: sorted keys, and the rows of
+// keys[i] at rows[offsets[i]] up to rows[offsets[i + 1]], ascending
+struct PostingLists {
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> rows;
+};
+
+// Lists of buffered rows, renumbered to the rows' positions in the segment
+PostingLists seal_postings(const PostingMap& lists, const std::vector<uint32_t>& position) {
+    std::vector<std::pair<uint64_t, const std::vector<uint32_t>*>> sorted;
+    sorted.reserve(lists.size());
+    for (const auto& [key, rows] : lists) {
+        sorted.emplace_back(key, &rows);
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    PostingLists postings;
+    postings.keys.reserve(sorted.size());
+    postings.offsets.reserve(sorted.size() + 1);
+    for (const auto& [key, rows] : sorted) {
+        postings.keys.push_back(key);
+        postings.offsets.push_back(static_cast<uint32_t>(postings.rows.size()));
+        size_t from = postings.rows.size();
+        for (uint32_t row : *rows) {
+            postings.rows.push_back(position[row]);
+        }
+        // Arrival order is nearly time order, so this is mostly a scan
+        std::sort(postings.rows.begin() + from, postings.rows.end());
+    }
+    postings.offsets.push_back(static_cast<uint32_t>(postings.rows.size()));
+    return postings;
+}
+
+void write_postings(const PostingLists& postings, char* keys, char* offsets, char* rows) {
+    std::copy(postings.keys.begin(), postings.keys.end(), reinterpret_cast<uint64_t*>(keys));
+    std::copy(postings.offsets.begin(), postings.offsets.end(), reinterpret_cast<uint32_t*>(offsets));
+    std::copy(postings.rows.begin(), postings.rows.end(), reinterpret_cast<uint32_t*>(rows));
+}
+
+// Posting lists of a mapped segment
+struct Postings {
+    const uint64_t* keys = nullptr;
+    const uint32_t* offsets = nullptr;
+    const uint32_t* rows = nullptr;
+    uint64_t count = 0;
+
+    // Rows holding key, ascending
+    std::pair<const uint32_t*, const uint32_t*> find(uint64_t key) const {
+        const uint64_t* it = std::lower_bound(keys, keys + count, key);
+        if (it == keys + count || *it != key) {
+            return {nullptr, nullptr};
+        }
+        size_t i = static_cast<size_t>(it - keys);
+        return {rows + offsets[i], rows + offsets[i + 1]};
+    }
+};
+
+struct Segment {
+    SegmentHeader header;
+    char* map = nullptr;
+    size_t size = 0;
+    std::vector<const char*> columns;
+    Postings users;
+    Postings instruments;
+
+    ~Segment() {
+        if (map) {
+            ::munmap(map, size);
+        }
+    }
+};
+
+// Rows of one partition not yet sealed, in arrival order
+struct MemPartition {
+    std::vector<char> rows;
+    uint32_t count = 0;
+    PostingMap users;
+    PostingMap instruments;
+};
+
+// A commit record left by a crash, checked against its own checksum
+bool load_commit(const std::string& path, size_t tables, std::vector<char>& record) {
+    record.clear();
+    if (FILE* file = std::fopen(path.c_str(), "rb")) {
+        char buffer[1 << 16];
+        size_t n;
+        while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            record.insert(record.end(), buffer, buffer + n);
+        }
+        std::fclose(file);
+    }
+    if (record.empty()) {
+        return false;
+    }
+    CommitHeader header{};
+    size_t rows = sizeof(header) + tables * sizeof(CommitTable);
+    if (record.size() >= rows) {
+        std::memcpy(&header, record.data(), sizeof(header));
+    }
+    bool valid = header.magic == kCommitMagic && header.format == kHistoryFormat && header.tables == tables &&
+                 header.checksum == hash64(record.data() + sizeof(header), record.size() - sizeof(header));
+    for (size_t i = 0; valid && i < tables; ++i) {
+        CommitTable table;
+        std::memcpy(&table, record.data() + sizeof(header) + i * sizeof(table), sizeof(table));
+        valid = table.log_bytes >= sizeof(LogHeader) && table.row_bytes <= record.size() - rows;
+        rows += table.row_bytes;
+    }
+    if (!valid || rows != record.size()) {
+        LOG_WARN("Ignoring damaged history commit record " + path);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+// ============================================================================
+// HistoryStore::Table
+// ============================================================================
+
+class HistoryStore::Table {
+public:
+    enum class Key { NONE, USER, INSTRUMENT, ID };
+
+    struct Probe {
+        int64_t start;
+        int64_t end;
+        Key key;
+        uint64_t value;
+        bool newest_first;
+    };
+
+    Table(TableSchema schema, const HistoryStoreConfig& config)
+        : schema_(std::move(schema)), config_(config), scratch_(schema_.row_size) {}
+
+    ~Table() {
+        close();
+    }
+
+    // commit: this table's part of a commit record left by a crash; its
+    // rows are appended again unless the log already holds all of them
+    bool open(const std::string& dir, const CommitTable* commit = nullptr, const char* commit_rows = nullptr);
+    void close();
+
+    bool append(const void* row);
+    bool flush();
+    bool seal();
+
+    void begin_transaction();
+    void rollback_transaction();
+
+    // Commit (see HistoryStore::commit_transaction), with the table locked
+    // throughout: prepare flushes the log and says where the transaction's
+    // rows will go, apply appends and flushes them, finish ends the
+    // transaction and seals if the rows filled the buffer
+    std::unique_lock<std::shared_mutex> lock() const { return std::unique_lock<std::shared_mutex>(mutex_); }
+    bool prepare_commit_locked(CommitTable& commit);
+    const std::vector<char>& pending_locked() const { return pending_; }
+    bool apply_locked(const char* rows, size_t bytes);
+    bool finish_commit_locked();
+
+    // Visit the rows matching probe in (time, id, arrival) order, or in
+    // reverse with newest_first, until visit returns false
+    void scan(const Probe& probe, const std::function<bool(const char*)>& visit) const;
+
+    template <typename Row>
+    std::vector<Row> rows(const Probe& probe) const {
+        std::vector<Row> result;
+        scan(probe, [&](const char* row) {
+            result.emplace_back();
+            std::memcpy(static_cast<void*>(&result.back()), row, sizeof(Row));
+            return true;
+        });
+        return result;
+    }
+
+    uint64_t segments_scanned() const { return scanned_.load(std::memory_order_relaxed); }
+    size_t segment_count() const;
+
+private:
+    struct Hit {
+        int64_t time;
+        uint64_t id;
+        uint64_t order;             // Segment rank << 32 | row: arrival order within a partition
+        const char* row;            // Memtable row, or null for a segment row
+        const Segment* segment;
+        uint32_t index;
+    };
+
+    int64_t partition_of(int64_t time) const {
+        int64_t partition = time / config_.partition_span;
+        return time % config_.partition_span < 0 ? partition - 1 : partition;
+    }
+    int64_t time_of(const char* row) const {
+        const ColumnSpec& column = schema_.columns[schema_.time_column];
+        return static_cast<int64_t>(load_uint(row + column.offset, column.width));
+    }
+    uint64_t id_of(const char* row) const {
+        const ColumnSpec& column = schema_.columns[schema_.id_column];
+        return load_uint(row + column.offset, column.width);
+    }
+    uint64_t field_of(const char* row, size_t index) const {
+        return load_uint(row + schema_.columns[index].offset, schema_.columns[index].width);
+    }
+
+    void store_fields(const char* row, char* out) const;
+    bool append_locked(const char* row);
+    bool write_row_locked(int64_t partition, const char* row);
+    void buffer_row(int64_t partition, const char* row);
+    bool seal_due() const { return buffered_rows_ >= config_.seal_rows || memtable_.size() > 1; }
+    bool seal_locked();
+    bool flush_locked();
+    bool write_segment(int64_t partition, const MemPartition& mem, std::string& path) const;
+    std::unique_ptr<Segment> map_segment(const std::string& path) const;
+    bool reset_log(uint64_t epoch);
+    std::string segment_path(int64_t partition, uint64_t epoch) const;
+
+    void collect(const Segment& segment, uint64_t rank, const Probe& probe, std::vector<Hit>& hits) const;
+    void collect(const MemPartition& mem, const Probe& probe, std::vector<Hit>& hits) const;
+    void load_row(const Segment& segment, uint32_t index, char* row) const;
+
+    TableSchema schema_;
+    HistoryStoreConfig config_;
+    std::string dir_;
+    FILE* log_ = nullptr;
+    uint64_t epoch_ = 0;
+
+    std::vector<std::unique_ptr<Segment>> segments_;
+    std::map<int64_t, std::vector<const Segment*>> catalog_;    // partition -> segments in seal order
+    std::map<int64_t, MemPartition> memtable_;
+    size_t buffered_rows_ = 0;
+    std::vector<char> scratch_;
+
+    bool in_transaction_ = false;
+    std::vector<char> pending_;
+
+    mutable std::shared_mutex mutex_;
+    mutable std::atomic<uint64_t> scanned_{0};
+};
+
+std::string HistoryStore::Table::segment_path(int64_t partition, uint64_t epoch) const {
+    return dir_ + "/" + std::to_string(partition) + "-" + std::to_string(epoch) + kSegmentSuffix;
+}
+
+bool HistoryStore::Table::open(const std::string& dir, const CommitTable* commit, const char* commit_rows) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (log_) {
+        return true;
+    }
+    dir_ = dir + "/" + schema_.name;
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+
+    for (const auto& entry : std::filesystem::directory_iterator(dir_, ec)) {
+        if (entry.path().extension() != kSegmentSuffix) {
+            continue;
+        }
+        std::unique_ptr<Segment> segment = map_segment(entry.path().string());
+        if (!segment) {
+            LOG_WARN("Ignoring damaged history segment " + entry.path().string());
+            continue;
+        }
+        segments_.push_back(std::move(segment));
+    }
+    std::sort(segments_.begin(), segments_.end(), [](const auto& a, const auto& b) {
+        return a->header.epoch != b->header.epoch ? a->header.epoch < b->header.epoch
+                                                  : a->header.partition < b->header.partition;
+    });
+    uint64_t max_epoch = 0;
+    for (const auto& segment : segments_) {
+        catalog_[segment->header.partition].push_back(segment.get());
+        max_epoch = std::max(max_epoch, segment->header.epoch);
+    }
+
+    // Replay the row log. A crash while sealing can leave segments of the
+    // log's own epoch behind: their partitions are already sealed.
+    std::string log_path = dir_ + kLogFile;
+    std::vector<char> log;
+    if (FILE* file = std::fopen(log_path.c_str(), "rb")) {
+        char buffer[1 << 16];
+        size_t n;
+        while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            log.insert(log.end(), buffer, buffer + n);
+        }
+        std::fclose(file);
+    }
+    LogHeader header{};
+    if (log.size() >= sizeof(header)) {
+        std::memcpy(&header, log.data(), sizeof(header));
+    }
+    bool interrupted = false;
+    bool recommit = false;
+    if (header.magic == kLogMagic && header.format == kHistoryFormat && header.row_size == schema_.row_size) {
+        // A commit cut short: drop what reached the log and append it all
+        // again below. A log of a later epoch sealed the rows already.
+        if (commit && commit->row_bytes > 0 && commit->row_bytes % schema_.row_size == 0 &&
+            header.epoch == commit->epoch) {
+            recommit = log.size() < commit->log_bytes + commit->row_bytes ||
+                       std::memcmp(log.data() + commit->log_bytes, commit_rows, commit->row_bytes) != 0;
+            if (recommit) {
+                log.resize(std::min<size_t>(log.size(), commit->log_bytes));
+            }
+        }
+        std::set<int64_t> sealed;
+        for (const auto& segment : segments_) {
+            if (segment->header.epoch == header.epoch) {
+                sealed.insert(segment->header.partition);
+            }
+        }
+        interrupted = !sealed.empty();
+        size_t rows = (log.size() - sizeof(header)) / schema_.row_size;
+        for (size_t i = 0; i < rows; ++i) {
+            const char* row = log.data() + sizeof(header) + i * schema_.row_size;
+            int64_t partition = partition_of(time_of(row));
+            if (sealed.count(partition) == 0) {
+                buffer_row(partition, row);
+            }
+        }
+        epoch_ = interrupted ? header.epoch : std::max(header.epoch, max_epoch + 1);
+    } else {
+        if (!log.empty()) {
+            LOG_WARN("Ignoring damaged history log " + log_path);
+        }
+        epoch_ = max_epoch + 1;
+    }
+
+    // Start from an empty log: replayed rows are sealed right away
+    bool ok;
+    if (!memtable_.empty()) {
+        ok = seal_locked();
+    } else {
+        if (interrupted) {
+            epoch_++;
+        }
+        ok = reset_log(epoch_);
+    }
+    if (ok && recommit) {
+        LOG_INFO("Completing interrupted history commit in " + dir_);
+        ok = apply_locked(commit_rows, commit->row_bytes);
+    }
+    if (!ok) {
+        LOG_ERROR("Failed to open history table " + dir_);
+        lock.unlock();
+        close();
+        return false;
+    }
+    return true;
+}
+
+void HistoryStore::Table::close() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (log_) {
+        if (!seal_locked()) {
+            LOG_ERROR("Failed to seal history table " + dir_ + " on close");
+        }
+        flush_locked();
+        std::fclose(log_);
+        log_ = nullptr;
+    }
+    catalog_.clear();
+    segments_.clear();
+    memtable_.clear();
+    buffered_rows_ = 0;
+    in_transaction_ = false;
+    pending_.clear();
+}
+
+bool HistoryStore::Table::reset_log(uint64_t epoch) {
+    if (log_) {
+        std::fclose(log_);
+        log_ = nullptr;
+    }
+    std::string path = dir_ + kLogFile;
+    LogHeader header{kLogMagic, kHistoryFormat, schema_.row_size, 0, epoch};
+    if (!write_file_atomic(path, &header, sizeof(header))) {
+        return false;
+    }
+    log_ = std::fopen(path.c_str(), "ab");
+    if (!log_) {
+        LOG_ERROR("Failed to open " + path + ": " + strerror(errno));
+        return false;
+    }
+    std::setvbuf(log_, nullptr, _IOFBF, kLogBufferBytes);
+    return true;
+}
+
+bool HistoryStore::Table::append(const void* row) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!log_) {
+        return false;
+    }
+    if (in_transaction_) {
+        pending_.resize(pending_.size() + schema_.row_size);
+        store_fields(static_cast<const char*>(row), pending_.data() + pending_.size() - schema_.row_size);
+        return true;
+    }
+    return append_locked(static_cast<const char*>(row));
+}
+
+void HistoryStore::Table::store_fields(const char* row, char* out) const {
+    // Copy the stored fields only, so padding never reaches the disk
+    std::fill(out, out + schema_.row_size, 0);
+    for (const ColumnSpec& column : schema_.columns) {
+        std::memcpy(out + column.offset, row + column.offset, column.width);
+    }
+}
+
+bool HistoryStore::Table::append_locked(const char* row) {
+    store_fields(row, scratch_.data());
+
+    // Time moved on: seal what is buffered before starting a newer partition
+    int64_t partition = partition_of(time_of(scratch_.data()));
+    if (buffered_rows_ >= config_.seal_rows ||
+        (!memtable_.empty() && partition > memtable_.rbegin()->first)) {
+        if (!seal_locked()) {
+            return false;
+        }
+    }
+    return write_row_locked(partition, scratch_.data());
+}
+
+bool HistoryStore::Table::write_row_locked(int64_t partition, const char* row) {
+    if (std::fwrite(row, schema_.row_size, 1, log_) != 1) {
+        LOG_ERROR("Failed to append to history log in " + dir_ + ": " + strerror(errno));
+        return false;
+    }
+    buffer_row(partition, row);
+    return true;
+}
+
+void HistoryStore::Table::buffer_row(int64_t partition, const char* row) {
+    MemPartition& mem = memtable_[partition];
+    uint32_t index = mem.count++;
+    mem.rows.insert(mem.rows.end(), row, row + schema_.row_size);
+    for (size_t column : schema_.user_columns) {
+        std::vector<uint32_t>& rows = mem.users[field_of(row, column)];
+        if (rows.empty() || rows.back() != index) {
+            rows.push_back(index);
+        }
+    }
+    if (schema_.instrument_column >= 0) {
+        mem.instruments[field_of(row, static_cast<size_t>(schema_.instrument_column))].push_back(index);
+    }
+    buffered_rows_++;
+}
+
+bool HistoryStore::Table::flush() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    return flush_locked();
+}
+
+bool HistoryStore::Table::flush_locked() {
+    if (!log_) {
+        return false;
+    }
+    return std::fflush(log_) == 0 && ::fdatasync(fileno(log_)) == 0;
+}
+
+bool HistoryStore::Table::seal() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    return log_ && seal_locked();
+}
+
+bool HistoryStore::Table::seal_locked() {
+    if (memtable_.empty()) {
+        return true;
+    }
+    std::vector<std::unique_ptr<Segment>> sealed;
+    for (const auto& [partition, mem] : memtable_) {
+        std::string path;
+        if (!write_segment(partition, mem, path)) {
+            return false;
+        }
+        std::unique_ptr<Segment> segment = map_segment(path);
+        if (!segment) {
+            LOG_ERROR("Failed to map history segment " + path);
+            return false;
+        }
+        sealed.push_back(std::move(segment));
+    }
+
+    // The new log epoch marks everything above as sealed
+    if (!reset_log(epoch_ + 1)) {
+        return false;
+    }
+    epoch_++;
+    for (auto& segment : sealed) {
+        catalog_[segment->header.partition].push_back(segment.get());
+        segments_.push_back(std::move(segment));
+    }
+    memtable_.clear();
+    buffered_rows_ = 0;
+    return true;
+}
+
+bool HistoryStore::Table::write_segment(int64_t partition, const MemPartition& mem, std::string& path) const {
+    const size_t row_size = schema_.row_size;
+    auto row_at = [&](uint32_t index) { return mem.rows.data() + static_cast<size_t>(index) * row_size; };
+
+    std::vector<uint32_t> order(mem.count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        int64_t ta = time_of(row_at(a)), tb = time_of(row_at(b));
+        return ta != tb ? ta < tb : id_of(row_at(a)) < id_of(row_at(b));
+    });
+
+    SegmentHeader header{};
+    header.magic = kSegmentMagic;
+    header.format = kHistoryFormat;
+    header.row_size = schema_.row_size;
+    header.column_count = static_cast<uint32_t>(schema_.columns.size());
+    header.rows = mem.count;
+    header.partition = partition;
+    header.epoch = epoch_;
+    header.min_time = time_of(row_at(order.front()));
+    header.max_time = time_of(row_at(order.back()));
+    header.min_id = UINT64_MAX;
+    header.max_id = 0;
+
+    std::vector<uint32_t> position(mem.count);
+    for (uint32_t i = 0; i < mem.count; ++i) {
+        position[order[i]] = i;
+        uint64_t id = id_of(row_at(order[i]));
+        header.min_id = std::min(header.min_id, id);
+        header.max_id = std::max(header.max_id, id);
+    }
+    PostingLists users = seal_postings(mem.users, position);
+    PostingLists instruments = seal_postings(mem.instruments, position);
+    header.user_keys = users.keys.size();
+    header.user_entries = users.rows.size();
+    header.instrument_keys = instruments.keys.size();
+    header.instrument_entries = instruments.rows.size();
+
+    SegmentLayout layout = segment_layout(schema_, header);
+    std::vector<char> file(layout.size, 0);
+    std::memcpy(file.data() + sizeof(header), schema_.columns.data(), schema_.columns.size() * sizeof(ColumnSpec));
+    for (size_t c = 0; c < schema_.columns.size(); ++c) {
+        const ColumnSpec& column = schema_.columns[c];
+        char* out = file.data() + layout.columns[c];
+        for (uint32_t i = 0; i < mem.count; ++i) {
+            std::memcpy(out + static_cast<size_t>(i) * column.width, row_at(order[i]) + column.offset, column.width);
+        }
+    }
+    write_postings(users, file.data() + layout.user_keys, file.data() + layout.user_offsets,
+                   file.data() + layout.user_rows);
+    write_postings(instruments, file.data() + layout.instrument_keys, file.data() + layout.instrument_offsets,
+                   file.data() + layout.instrument_rows);
+    header.checksum = hash64(file.data() + sizeof(header), file.size() - sizeof(header));
+    std::memcpy(file.data(), &header, sizeof(header));
+
+    path = segment_path(partition, epoch_);
+    return write_file_atomic(path, file.data(), file.size());
+}
+
+std::unique_ptr<Segment> HistoryStore::Table::map_segment(const std::string& path) const {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SegmentHeader)) {
+        ::close(fd);
+        return nullptr;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return nullptr;
+    }
+    auto segment = std::make_unique<Segment>();
+    segment->map = static_cast<char*>(map);
+    segment->size = size;
+
+    SegmentHeader& header = segment->header;
+    std::memcpy(&header, segment->map, sizeof(header));
+    if (header.magic != kSegmentMagic || header.format != kHistoryFormat ||
+        header.row_size != schema_.row_size || header.column_count != schema_.columns.size() ||
+        header.rows == 0 || header.rows > size || header.user_keys > size || header.user_entries > size ||
+        header.instrument_keys > size || header.instrument_entries > size) {
+        return nullptr;
+    }
+    SegmentLayout layout = segment_layout(schema_, header);
+    if (layout.size != size ||
+        std::memcmp(segment->map + sizeof(header), schema_.columns.data(),
+                    schema_.columns.size() * sizeof(ColumnSpec)) != 0 ||
+        hash64(segment->map + sizeof(header), size - sizeof(header)) != header.checksum) {
+        return nullptr;
+    }
+
+    for (size_t offset : layout.columns) {
+        segment->columns.push_back(segment->map + offset);
+    }
+    segment->users = Postings{reinterpret_cast<const uint64_t*>(segment->map + layout.user_keys),
+                              reinterpret_cast<const uint32_t*>(segment->map + layout.user_offsets),
+                              reinterpret_cast<const uint32_t*>(segment->map + layout.user_rows),
+                              header.user_keys};
+    segment->instruments = Postings{reinterpret_cast<const uint64_t*>(segment->map + layout.instrument_keys),
+                                    reinterpret_cast<const uint32_t*>(segment->map + layout.instrument_offsets),
+                                    reinterpret_cast<const uint32_t*>(segment->map + layout.instrument_rows),
+                                    header.instrument_keys};
+    return segment;
+}
+
+void HistoryStore::Table::begin_transaction() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    in_transaction_ = true;
+    pending_.clear();
+}
+
+bool HistoryStore::Table::prepare_commit_locked(CommitTable& commit) {
+    if (!log_) {
+        return false;
+    }
+    if (!pending_.empty() && ((seal_due() && !seal_locked()) || !flush_locked())) {
+        return false;
+    }
+    long end = std::ftell(log_);
+    if (end < 0) {
+        return false;
+    }
+    commit = CommitTable{epoch_, static_cast<uint64_t>(end), pending_.size()};
+    return true;
+}
+
+bool HistoryStore::Table::apply_locked(const char* rows, size_t bytes) {
+    // No seal until every row is in: a crash must find them all in the
+    // log of the epoch the commit record names
+    if (!log_ || bytes == 0) {
+        return log_ != nullptr;
+    }
+    bool ok = true;
+    for (size_t at = 0; ok && at < bytes; at += schema_.row_size) {
+        const char* row = rows + at;
+        ok = write_row_locked(partition_of(time_of(row)), row);
+    }
+    return ok && flush_locked();
+}
+
+bool HistoryStore::Table::finish_commit_locked() {
+    in_transaction_ = false;
+    pending_.clear();
+    return !log_ || !seal_due() || seal_locked();
+}
+
+void HistoryStore::Table::rollback_transaction() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    in_transaction_ = false;
+    pending_.clear();
+}
+
+void HistoryStore::Table::collect(const Segment& segment, uint64_t rank, const Probe& probe,
+                                  std::vector<Hit>& hits) const {
+    // Zone map
+    const SegmentHeader& header = segment.header;
+    if (header.max_time < probe.start || header.min_time > probe.end ||
+        (probe.key == Key::ID && (probe.value < header.min_id || probe.value > header.max_id))) {
+        return;
+    }
+    scanned_.fetch_add(1, std::memory_order_relaxed);
+
+    const ColumnSpec& time_column = schema_.columns[schema_.time_column];
+    const ColumnSpec& id_column = schema_.columns[schema_.id_column];
+    const char* times = segment.columns[schema_.time_column];
+    const char* ids = segment.columns[schema_.id_column];
+    auto time_at = [&](uint32_t index) {
+        return static_cast<int64_t>(load_uint(times + static_cast<size_t>(index) * time_column.width,
+                                              time_column.width));
+    };
+    auto add = [&](uint32_t index) {
+        int64_t time = time_at(index);
+        if (time < probe.start || time > probe.end) {
+            return;
+        }
+        uint64_t id = load_uint(ids + static_cast<size_t>(index) * id_column.width, id_column.width);
+        if (probe.key == Key::ID && id != probe.value) {
+            return;
+        }
+        hits.push_back(Hit{time, id, rank << 32 | index, nullptr, &segment, index});
+    };
+
+    if (probe.key == Key::USER || probe.key == Key::INSTRUMENT) {
+        auto rows = (probe.key == Key::USER ? segment.users : segment.instruments).find(probe.value);
+        for (const uint32_t* row = rows.first; row != rows.second; ++row) {
+            add(*row);
+        }
+        return;
+    }
+    // Rows are sorted by time: scan only the slice inside the range
+    uint32_t count = static_cast<uint32_t>(header.rows);
+    uint32_t low = 0, high = count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (time_at(mid) < probe.start) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    for (uint32_t index = low; index < count && time_at(index) <= probe.end; ++index) {
+        add(index);
+    }
+}
+
+void HistoryStore::Table::collect(const MemPartition& mem, const Probe& probe, std::vector<Hit>& hits) const {
+    auto add = [&](uint32_t index) {
+        const char* row = mem.rows.data() + static_cast<size_t>(index) * schema_.row_size;
+        int64_t time = time_of(row);
+        if (time < probe.start || time > probe.end) {
+            return;
+        }
+        uint64_t id = id_of(row);
+        if (probe.key == Key::ID && id != probe.value) {
+            return;
+        }
+        hits.push_back(Hit{time, id, kMemtableRank << 32 | index, row, nullptr, index});
+    };
+
+    if (probe.key == Key::USER || probe.key == Key::INSTRUMENT) {
+        const auto& postings = probe.key == Key::USER ? mem.users : mem.instruments;
+        auto it = postings.find(probe.value);
+        if (it != postings.end()) {
+            for (uint32_t index : it->second) {
+                add(index);
+            }
+        }
+        return;
+    }
+    for (uint32_t index = 0; index < mem.count; ++index) {
+        add(index);
+    }
+}
+
+void HistoryStore::Table::load_row(const Segment& segment, uint32_t index, char* row) const {
+    for (size_t c = 0; c < schema_.columns.size(); ++c) {
+        const ColumnSpec& column = schema_.columns[c];
+        std::memcpy(row + column.offset, segment.columns[c] + static_cast<size_t>(index) * column.width,
+                    column.width);
+    }
+}
+
+void HistoryStore::Table::scan(const Probe& probe, const std::function<bool(const char*)>& visit) const {
+    if (probe.start > probe.end) {
+        return;
+    }
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    // Partitions overlapping the range, sealed or buffered
+    int64_t first = partition_of(probe.start);
+    int64_t last = partition_of(probe.end);
+    std::vector<int64_t> partitions;
+    for (auto it = catalog_.lower_bound(first); it != catalog_.end() && it->first <= last; ++it) {
+        partitions.push_back(it->first);
+    }
+    for (auto it = memtable_.lower_bound(first); it != memtable_.end() && it->first <= last; ++it) {
+        partitions.push_back(it->first);
+    }
+    std::sort(partitions.begin(), partitions.end());
+    partitions.erase(std::unique(partitions.begin(), partitions.end()), partitions.end());
+    if (probe.newest_first) {
+        std::reverse(partitions.begin(), partitions.end());
+    }
+
+    std::vector<Hit> hits;
+    std::vector<char> row(schema_.row_size, 0);
+    for (int64_t partition : partitions) {
+        hits.clear();
+        auto sealed = catalog_.find(partition);
+        if (sealed != catalog_.end()) {
+            for (size_t rank = 0; rank < sealed->second.size(); ++rank) {
+                collect(*sealed->second[rank], rank, probe, hits);
+            }
+        }
+        auto buffered = memtable_.find(partition);
+        if (buffered != memtable_.end()) {
+            collect(buffered->second, probe, hits);
+        }
+        std::sort(hits.begin(), hits.end(), [](const Hit& a, const Hit& b) {
+            if (a.time != b.time) {
+                return a.time < b.time;
+            }
+            return a.id != b.id ? a.id < b.id : a.order < b.order;
+        });
+        for (size_t i = 0; i < hits.size(); ++i) {
+            const Hit& hit = hits[probe.newest_first ? hits.size() - 1 - i : i];
+            const char* data = hit.row;
+            if (!data) {
+                load_row(*hit.segment, hit.index, row.data());
+                data = row.data();
+            }
+            if (!visit(data)) {
+                return;
+            }
+        }
+    }
+}
+
+size_t HistoryStore::Table::segment_count() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return segments_.size();
+}
+
+// ============================================================================
+// HistoryStore
+// ============================================================================
+
+HistoryStore::HistoryStore(const HistoryStoreConfig& config)
+    : config_(config)
+    , trades_(std::make_unique<Table>(trade_schema(), config))
+    , orders_(std::make_unique<Table>(order_schema(), config))
+    , accounts_(std::make_unique<Table>(account_schema(), config))
+    , positions_(std::make_unique<Table>(position_schema(), config)) {
+}
+
+HistoryStore::~HistoryStore() {
+    close();
+}
+
+bool HistoryStore::open(const std::string& dir) {
+    if (open_) {
+        return true;
+    }
+    dir_ = dir;
+
+    // A commit record left behind: finish putting its rows in every table
+    Table* tables[kTableCount] = {trades_.get(), orders_.get(), accounts_.get(), positions_.get()};
+    std::vector<char> record;
+    bool recovering = load_commit(dir + kCommitFile, kTableCount, record);
+    CommitTable commits[kTableCount] = {};
+    const char* rows[kTableCount] = {};
+    if (recovering) {
+        size_t at = sizeof(CommitHeader) + sizeof(commits);
+        std::memcpy(commits, record.data() + sizeof(CommitHeader), sizeof(commits));
+        for (size_t i = 0; i < kTableCount; ++i) {
+            rows[i] = record.data() + at;
+            at += commits[i].row_bytes;
+        }
+    }
+    bool ok = true;
+    for (size_t i = 0; ok && i < kTableCount; ++i) {
+        ok = tables[i]->open(dir, recovering ? &commits[i] : nullptr, rows[i]);
+    }
+    if (!ok) {
+        LOG_ERROR("Failed to open history store in " + dir);
+        trades_->close();
+        orders_->close();
+        accounts_->close();
+        positions_->close();
+        return false;
+    }
+    if (recovering) {
+        std::error_code ec;
+        std::filesystem::remove(dir + kCommitFile, ec);
+    }
+    open_ = true;
+    LOG_INFO("History store opened in " + dir + " with " + std::to_string(segment_count()) + " segments");
+    return true;
+}
+
+void HistoryStore::close() {
+    if (!open_) {
+        return;
+    }
+    trades_->close();
+    orders_->close();
+    accounts_->close();
+    positions_->close();
+    open_ = false;
+}
+
+bool HistoryStore::append_trade(const Trade& trade) {
+    return trades_->append(&trade);
+}
+
+bool HistoryStore::append_order(const Order& order) {
+    OrderHistoryRow row{};
+    row.order_id = order.order_id;
+    row.user_id = order.user_id;
+    row.instrument_id = order.instrument_id;
+    row.side = order.side;
+    row.order_type = order.order_type;
+    row.offset_flag = order.offset_flag;
+    row.status = order.status;
+    row.position_side = order.position_side;
+    row.price = order.price;
+    row.quantity = order.quantity;
+    row.filled_quantity = order.filled_quantity;
+    row.remaining_quantity = order.remaining_quantity;
+    row.timestamp = order.timestamp;
+    row.sequence_id = order.sequence_id;
+    return orders_->append(&row);
+}
+
+bool HistoryStore::append_account(const AccountHistoryRow& row) {
+    return accounts_->append(&row);
+}
+
+bool HistoryStore::append_position(const PositionHistoryRow& row) {
+    return positions_->append(&row);
+}
+
+bool HistoryStore::flush() {
+    bool trades = trades_->flush();
+    bool orders = orders_->flush();
+    bool accounts = accounts_->flush();
+    bool positions = positions_->flush();
+    return trades && orders && accounts && positions;
+}
+
+bool HistoryStore::seal() {
+    bool trades = trades_->seal();
+    bool orders = orders_->seal();
+    bool accounts = accounts_->seal();
+    bool positions = positions_->seal();
+    return trades && orders && accounts && positions;
+}
+
+void HistoryStore::begin_transaction() {
+    trades_->begin_transaction();
+    orders_->begin_transaction();
+    accounts_->begin_transaction();
+    positions_->begin_transaction();
+}
+
+bool HistoryStore::commit_transaction() {
+    // Every table stays locked until all of them hold the rows, so no
+    // query sees part of a transaction
+    Table* tables[kTableCount] = {trades_.get(), orders_.get(), accounts_.get(), positions_.get()};
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+    for (Table* table : tables) {
+        locks.push_back(table->lock());
+    }
+
+    // The commit record says where the rows go in each table's log. Once
+    // it is on disk the transaction has committed: a crash before every
+    // table holds its rows is completed by open().
+    std::vector<char> record(sizeof(CommitHeader));
+    size_t row_bytes = 0;
+    bool ok = open_;
+    for (Table* table : tables) {
+        CommitTable commit{};
+        ok = ok && table->prepare_commit_locked(commit);
+        const char* bytes = reinterpret_cast<const char*>(&commit);
+        record.insert(record.end(), bytes, bytes + sizeof(commit));
+        row_bytes += commit.row_bytes;
+    }
+    bool logged = false;
+    if (ok && row_bytes > 0) {
+        for (Table* table : tables) {
+            const std::vector<char>& rows = table->pending_locked();
+            record.insert(record.end(), rows.begin(), rows.end());
+        }
+        CommitHeader header{kCommitMagic, kHistoryFormat, kTableCount, 0,
+                            hash64(record.data() + sizeof(CommitHeader), record.size() - sizeof(CommitHeader))};
+        std::memcpy(record.data(), &header, sizeof(header));
+        ok = logged = write_file_atomic(dir_ + kCommitFile, record.data(), record.size());
+    }
+    for (Table* table : tables) {
+        ok = ok && table->apply_locked(table->pending_locked().data(), table->pending_locked().size());
+    }
+
+    // A failed apply keeps the record for the next open to finish
+    if (ok && logged) {
+        std::error_code ec;
+        std::filesystem::remove(dir_ + kCommitFile, ec);
+    }
+    for (Table* table : tables) {
+        if (!table->finish_commit_locked()) {
+            LOG_ERROR("Failed to seal history table after commit");
+        }
+    }
+    return ok;
+}
+
+void HistoryStore::rollback_transaction() {
+    trades_->rollback_transaction();
+    orders_->rollback_transaction();
+    accounts_->rollback_transaction();
+    positions_->rollback_transaction();
+}
+
+std::vector<Trade> HistoryStore::trades_by_user(UserID user_id, int64_t start_time, int64_t end_time) const {
+    return trades_->rows<Trade>({start_time, end_time, Table::Key::USER, user_id, false});
+}
+
+std::vector<Trade> HistoryStore::trades_by_instrument(InstrumentID instrument_id, int64_t start_time,
+                                                      int64_t end_time) const {
+    return trades_->rows<Trade>({start_time, end_time, Table::Key::INSTRUMENT, instrument_id, false});
+}
+
+std::vector<OrderHistoryRow> HistoryStore::orders_by_user(UserID user_id, int64_t start_time,
+                                                          int64_t end_time) const {
+    // Newest first, so the first row of each order is its latest revision
+    std::vector<OrderHistoryRow> orders;
+    std::unordered_set<OrderID> seen;
+    orders_->scan({start_time, end_time, Table::Key::USER, user_id, true}, [&](const char* data) {
+        OrderHistoryRow row;
+        std::memcpy(static_cast<void*>(&row), data, sizeof(row));
+        if (seen.insert(row.order_id).second) {
+            orders.push_back(row);
+        }
+        return true;
+    });
+    return orders;
+}
+
+bool HistoryStore::find_order(OrderID order_id, OrderHistoryRow& row) const {
+    bool found = false;
+    orders_->scan({kHistoryBeginning, kHistoryEnd, Table::Key::ID, order_id, true}, [&](const char* data) {
+        std::memcpy(static_cast<void*>(&row), data, sizeof(row));
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+bool HistoryStore::account_at(UserID user_id, int64_t timestamp, AccountHistoryRow& row) const {
+    bool found = false;
+    accounts_->scan({kHistoryBeginning, timestamp, Table::Key::USER, user_id, true}, [&](const char* data) {
+        std::memcpy(static_cast<void*>(&row), data, sizeof(row));
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+std::vector<AccountHistoryRow> HistoryStore::account_history(UserID user_id, int64_t start_time,
+                                                             int64_t end_time) const {
+    return accounts_->rows<AccountHistoryRow>({start_time, end_time, Table::Key::USER, user_id, false});
+}
+
+bool HistoryStore::position_at(UserID user_id, InstrumentID instrument_id, int64_t timestamp,
+                               PositionHistoryRow& row) const {
+    bool found = false;
+    positions_->scan({kHistoryBeginning, timestamp, Table::Key::USER, user_id, true}, [&](const char* data) {
+        std::memcpy(static_cast<void*>(&row), data, sizeof(row));
+        found = row.instrument_id == instrument_id;
+        return !found;
+    });
+    return found;
+}
+
+std::vector<PositionHistoryRow> HistoryStore::position_history(UserID user_id, InstrumentID instrument_id,
+                                                               int64_t start_time, int64_t end_time) const {
+    std::vector<PositionHistoryRow> history =
+        positions_->rows<PositionHistoryRow>({start_time, end_time, Table::Key::USER, user_id, false});
+    history.erase(std::remove_if(history.begin(), history.end(),
+                                 [&](const PositionHistoryRow& row) { return row.instrument_id != instrument_id; }),
+                  history.end());
+    return history;
+}
+
+uint64_t HistoryStore::segments_scanned() const {
+    return trades_->segments_scanned() + orders_->segments_scanned() + accounts_->segments_scanned() +
+           positions_->segments_scanned();
+}
+
+size_t HistoryStore::segment_count() const {
+    return trades_->segment_count() + orders_->segment_count() + accounts_->segment_count() +
+           positions_->segment_count();
+}
+
+} // namespace perpetual
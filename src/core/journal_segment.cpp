@@ -0,0 +1,602 @@
+#include "core/journal_segment.h"
+#include "core/logger.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <filesystem>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+namespace perpetual {
+
+namespace {
+
+constexpr size_t kReadWindow = 1 << 20;
+constexpr size_t kZeroChunk = 1 << 20;
+constexpr const char* kSegmentSuffix = ".seg";
+constexpr const char* kTempSuffix = ".tmp";
+
+#if !defined(__SSE4_2__)
+struct Crc32cTable {
+    uint32_t entries[256];
+
+    Crc32cTable() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78u : (crc >> 1);
+            }
+            entries[i] = crc;
+        }
+    }
+};
+#endif
+
+constexpr uint64_t kPrime64_1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime64_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime64_3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime64_4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime64_5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl64(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t load64(const uint8_t* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint32_t load32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint64_t hash64_round(uint64_t acc, uint64_t input) {
+    acc += input * kPrime64_2;
+    return rotl64(acc, 31) * kPrime64_1;
+}
+
+inline uint64_t hash64_merge(uint64_t acc, uint64_t value) {
+    acc ^= hash64_round(0, value);
+    return acc * kPrime64_1 + kPrime64_4;
+}
+
+} // namespace
+
+void sync_directory(const std::string& dir) {
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+uint32_t crc32c(const void* data, size_t length, uint32_t crc) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+#if defined(__SSE4_2__)
+    while (length >= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        crc = static_cast<uint32_t>(_mm_crc32_u64(crc, word));
+        p += sizeof(word);
+        length -= sizeof(word);
+    }
+    while (length-- > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+#else
+    static const Crc32cTable table;
+    while (length-- > 0) {
+        crc = table.entries[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+#endif
+    return ~crc;
+}
+
+uint64_t hash64(const void* data, size_t length, uint64_t seed) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + length;
+    uint64_t h;
+    
+    if (length >= 32) {
+        uint64_t v1 = seed + kPrime64_1 + kPrime64_2;
+        uint64_t v2 = seed + kPrime64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - kPrime64_1;
+        do {
+            v1 = hash64_round(v1, load64(p));
+            v2 = hash64_round(v2, load64(p + 8));
+            v3 = hash64_round(v3, load64(p + 16));
+            v4 = hash64_round(v4, load64(p + 24));
+            p += 32;
+        } while (end - p >= 32);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = hash64_merge(h, v1);
+        h = hash64_merge(h, v2);
+        h = hash64_merge(h, v3);
+        h = hash64_merge(h, v4);
+    } else {
+        h = seed + kPrime64_5;
+    }
+    h += static_cast<uint64_t>(length);
+    
+    while (end - p >= 8) {
+        h ^= hash64_round(0, load64(p));
+        h = rotl64(h, 27) * kPrime64_1 + kPrime64_4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        h ^= static_cast<uint64_t>(load32(p)) * kPrime64_1;
+        h = rotl64(h, 23) * kPrime64_2 + kPrime64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= static_cast<uint64_t>(*p++) * kPrime64_5;
+        h = rotl64(h, 11) * kPrime64_1;
+    }
+    
+    h ^= h >> 33;
+    h *= kPrime64_2;
+    h ^= h >> 29;
+    h *= kPrime64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint32_t journal_record_crc(const JournalRecordHeader& header, const char* payload) {
+    const char* fields = reinterpret_cast<const char*>(&header) + sizeof(header.crc);
+    uint32_t crc = crc32c(fields, sizeof(header) - sizeof(header.crc));
+    if (header.kind == static_cast<uint16_t>(JournalRecordKind::DATA) && payload) {
+        crc = crc32c(payload, header.length, crc);
+    }
+    return crc;
+}
+
+std::string journal_segment_path(const std::string& dir, uint64_t segment_id) {
+    char name[32];
+    snprintf(name, sizeof(name), "%010llu", static_cast<unsigned long long>(segment_id));
+    return dir + "/" + name + kSegmentSuffix;
+}
+
+std::vector<uint64_t> list_journal_segments(const std::string& dir) {
+    namespace fs = std::filesystem;
+    std::vector<uint64_t> segments;
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        const fs::path& path = it->path();
+        if (path.extension() != kSegmentSuffix) {
+            continue;
+        }
+        const std::string stem = path.stem().string();
+        if (stem.empty() || !std::all_of(stem.begin(), stem.end(), ::isdigit)) {
+            continue;
+        }
+        segments.push_back(std::stoull(stem));
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+// ============================================================================
+// SegmentPreallocator
+// ============================================================================
+
+SegmentPreallocator::SegmentPreallocator(const std::string& dir, uint64_t segment_bytes,
+                                         size_t segments_ahead)
+    : dir_(dir), segment_bytes_(segment_bytes),
+      segments_ahead_(std::max<size_t>(segments_ahead, 1)) {
+}
+
+SegmentPreallocator::~SegmentPreallocator() {
+    stop();
+}
+
+void SegmentPreallocator::start(uint64_t first_missing) {
+    stop();
+
+    // Leftovers from a crash in the middle of preparing a segment
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    for (fs::directory_iterator it(dir_, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() == kTempSuffix) {
+            fs::remove(it->path(), ec);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ready_id_ = first_missing - 1;
+    wanted_id_ = 0;
+    failed_ = false;
+    running_ = true;
+    thread_ = std::thread(&SegmentPreallocator::run, this);
+}
+
+void SegmentPreallocator::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+bool SegmentPreallocator::acquire(uint64_t segment_id, bool rotation) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (segment_id > wanted_id_) {
+        wanted_id_ = segment_id;
+        cv_.notify_all();
+    }
+    if (ready_id_ >= segment_id) {
+        return true;
+    }
+    if (!running_ || failed_) {
+        return false;
+    }
+
+    // The writer caught up with preallocation: rotation now costs a
+    // fallocate + zero-fill on the commit path
+    if (rotation) {
+        stalls_.fetch_add(1, std::memory_order_relaxed);
+        LOG_WARN("Journal: waiting for segment " + std::to_string(segment_id) + " to be preallocated");
+    }
+    cv_.wait(lock, [this, segment_id] {
+        return ready_id_ >= segment_id || failed_ || !running_;
+    });
+    return ready_id_ >= segment_id;
+}
+
+void SegmentPreallocator::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        if (ready_id_ >= wanted_id_ + segments_ahead_) {
+            cv_.wait(lock);
+            continue;
+        }
+
+        uint64_t segment_id = ready_id_ + 1;
+        lock.unlock();
+        bool ok = prepare(segment_id);
+        lock.lock();
+
+        if (!ok) {
+            failed_ = true;
+            cv_.notify_all();
+            break;
+        }
+        ready_id_ = segment_id;
+        cv_.notify_all();
+    }
+}
+
+bool SegmentPreallocator::prepare(uint64_t segment_id) {
+    const std::string path = journal_segment_path(dir_, segment_id);
+    const std::string temp = path + kTempSuffix;
+
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("Journal: failed to create segment " + temp + ": " + strerror(errno));
+        return false;
+    }
+
+#ifdef __linux__
+    // Reserve contiguous extents up front; filesystems without fallocate
+    // still get their blocks from the zero-fill below
+    if (::fallocate(fd, 0, 0, static_cast<off_t>(segment_bytes_)) != 0 && errno != EOPNOTSUPP) {
+        LOG_ERROR("Journal: fallocate failed for " + temp + ": " + strerror(errno));
+        ::close(fd);
+        ::unlink(temp.c_str());
+        return false;
+    }
+#endif
+
+    // Zero-fill so the extents are written rather than unwritten: the
+    // journal's fdatasync then never has an extent conversion to log
+    static const std::vector<char> zeros(kZeroChunk, 0);
+    for (uint64_t offset = 0; offset < segment_bytes_;) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(kZeroChunk, segment_bytes_ - offset));
+        ssize_t n = ::pwrite(fd, zeros.data(), chunk, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Journal: zero-fill failed for " + temp + ": " + strerror(errno));
+            ::close(fd);
+            ::unlink(temp.c_str());
+            return false;
+        }
+        offset += static_cast<uint64_t>(n);
+    }
+
+    if (::fdatasync(fd) != 0) {
+        LOG_ERROR("Journal: fdatasync failed for " + temp + ": " + strerror(errno));
+        ::close(fd);
+        ::unlink(temp.c_str());
+        return false;
+    }
+#ifdef POSIX_FADV_DONTNEED
+    // The writer bypasses the page cache; don't keep the zeros around
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    ::close(fd);
+
+    if (::rename(temp.c_str(), path.c_str()) != 0) {
+        LOG_ERROR("Journal: failed to publish segment " + path + ": " + strerror(errno));
+        ::unlink(temp.c_str());
+        return false;
+    }
+    sync_directory(dir_);
+    return true;
+}
+
+bool write_file_atomic(const std::string& path, const void* data, size_t length) {
+    std::string temp = path + kTempSuffix;
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("Failed to create " + temp + ": " + strerror(errno));
+        return false;
+    }
+    
+    const char* p = static_cast<const char*>(data);
+    size_t written = 0;
+    while (written < length) {
+        ssize_t n = ::write(fd, p + written, length - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        written += static_cast<size_t>(n);
+    }
+    bool ok = written == length && ::fdatasync(fd) == 0;
+    ::close(fd);
+    
+    if (!ok || ::rename(temp.c_str(), path.c_str()) != 0) {
+        LOG_ERROR("Failed to write " + path + ": " + strerror(errno));
+        ::unlink(temp.c_str());
+        return false;
+    }
+    
+    std::string dir = std::filesystem::path(path).parent_path().string();
+    sync_directory(dir.empty() ? "." : dir);
+    return true;
+}
+
+// ============================================================================
+// JournalReader
+// ============================================================================
+
+JournalReader::JournalReader(const std::string& dir)
+    : dir_(dir), segments_(list_journal_segments(dir)) {
+    if (segments_.empty() || !open_segment(0)) {
+        ended_ = true;
+    }
+}
+
+JournalReader::~JournalReader() {
+    close_segment();
+}
+
+bool JournalReader::open_segment(size_t index) {
+    close_segment();
+    segment_index_ = index;
+    offset_ = 0;
+    buffer_length_ = 0;
+
+    fd_ = ::open(journal_segment_path(dir_, segments_[index]).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        close_segment();
+        return false;
+    }
+    segment_size_ = static_cast<uint64_t>(st.st_size);
+    
+    // Segments never shrink, so the whole file can be mapped; records the
+    // writer adds later show up through the page cache
+    if (segment_size_ > 0) {
+        void* map = ::mmap(nullptr, segment_size_, PROT_READ, MAP_SHARED, fd_, 0);
+        if (map != MAP_FAILED) {
+            map_ = static_cast<const char*>(map);
+            ::madvise(map, segment_size_, MADV_SEQUENTIAL);
+            return true;
+        }
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return true;
+}
+
+void JournalReader::close_segment() {
+    if (map_) {
+        ::munmap(const_cast<char*>(map_), segment_size_);
+        map_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+const char* JournalReader::fetch(uint64_t offset, size_t length) {
+    if (map_) {
+        return offset + length <= segment_size_ ? map_ + offset : nullptr;
+    }
+    if (offset >= buffer_offset_ && offset + length <= buffer_offset_ + buffer_length_) {
+        return buffer_.data() + (offset - buffer_offset_);
+    }
+
+    uint64_t start = offset & ~static_cast<uint64_t>(kJournalBlockSize - 1);
+    size_t want = std::max<size_t>(kReadWindow, static_cast<size_t>(offset + length - start));
+    if (buffer_.size() < want) {
+        buffer_.resize(want);
+    }
+
+    size_t filled = 0;
+    while (filled < want) {
+        ssize_t n = ::pread(fd_, buffer_.data() + filled, want - filled,
+                            static_cast<off_t>(start + filled));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        filled += static_cast<size_t>(n);
+    }
+
+    buffer_offset_ = start;
+    buffer_length_ = filled;
+    if (offset + length > start + filled) {
+        return nullptr;
+    }
+    return buffer_.data() + (offset - start);
+}
+
+bool JournalReader::next(const char*& data, size_t& length) {
+    constexpr size_t kHeaderSize = sizeof(JournalRecordHeader);
+
+    while (!ended_) {
+        if (offset_ >= segment_size_) {
+            if (segment_index_ + 1 >= segments_.size() || !open_segment(segment_index_ + 1)) {
+                break;
+            }
+            continue;
+        }
+
+        // Gaps too small for a padding record are skipped implicitly
+        uint64_t to_block = kJournalBlockSize - (offset_ % kJournalBlockSize);
+        if (to_block < kHeaderSize) {
+            offset_ += to_block;
+            continue;
+        }
+
+        const char* raw = fetch(offset_, kHeaderSize);
+        if (!raw) {
+            break;
+        }
+        JournalRecordHeader header;
+        memcpy(&header, raw, kHeaderSize);
+
+        bool is_data = header.kind == static_cast<uint16_t>(JournalRecordKind::DATA);
+        bool is_padding = header.kind == static_cast<uint16_t>(JournalRecordKind::PADDING);
+        if ((!is_data && !is_padding) || header.epoch < epoch_ ||
+            offset_ + kHeaderSize + header.length > segment_size_) {
+            break;
+        }
+
+        const char* payload = nullptr;
+        if (is_data) {
+            payload = fetch(offset_ + kHeaderSize, header.length);
+            if (!payload) {
+                break;
+            }
+        }
+        if (journal_record_crc(header, payload) != header.crc) {
+            break;
+        }
+
+        JournalPosition position{segments_[segment_index_], offset_};
+        epoch_ = header.epoch;
+        offset_ += kHeaderSize + header.length;
+        if (is_padding) {
+            continue;
+        }
+
+        record_position_ = position;
+        data = payload;
+        length = header.length;
+        return true;
+    }
+
+    ended_ = true;
+    return false;
+}
+
+bool JournalReader::seek(const JournalPosition& position) {
+    auto it = std::lower_bound(segments_.begin(), segments_.end(), position.segment);
+    if (it == segments_.end() || *it != position.segment) {
+        // The writer may have rolled since this reader listed the directory
+        segments_ = list_journal_segments(dir_);
+        it = std::lower_bound(segments_.begin(), segments_.end(), position.segment);
+        if (it == segments_.end() || *it != position.segment) {
+            ended_ = true;
+            return false;
+        }
+        close_segment();
+    }
+
+    size_t index = static_cast<size_t>(it - segments_.begin());
+    if (fd_ < 0 || index != segment_index_) {
+        if (!open_segment(index)) {
+            ended_ = true;
+            return false;
+        }
+    }
+
+    // Positions come from records known to be valid, so the epoch check
+    // restarts from here; the read buffer is kept for nearby seeks
+    offset_ = position.offset;
+    epoch_ = 0;
+    ended_ = false;
+    return true;
+}
+
+void JournalReader::resume() {
+    if (!ended_) {
+        return;
+    }
+
+    // Only a reader without a segment or at the end of one needs to look
+    // for segments created since
+    bool opened = fd_ >= 0;
+    if (!opened || offset_ >= segment_size_) {
+        uint64_t current = opened ? segments_[segment_index_] : 0;
+        segments_ = list_journal_segments(dir_);
+        if (!opened) {
+            if (segments_.empty() || !open_segment(0)) {
+                return;
+            }
+        } else {
+            auto it = std::lower_bound(segments_.begin(), segments_.end(), current);
+            if (it == segments_.end() || *it != current) {
+                return;
+            }
+            segment_index_ = static_cast<size_t>(it - segments_.begin());
+        }
+    }
+
+    // A torn or half-written record may have been fetched into the buffer
+    buffer_length_ = 0;
+    ended_ = false;
+}
+
+JournalPosition JournalReader::tail() const {
+    if (segments_.empty()) {
+        return JournalPosition{};
+    }
+    uint64_t segment = segments_[segment_index_];
+    if (offset_ >= segment_size_) {
+        return JournalPosition{segment + 1, 0};
+    }
+    return JournalPosition{segment, offset_};
+}
+
+} // namespace perpetual
@@ -0,0 +1,993 @@
+#include "core/journal_writer.h"
+#include "core/logger.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define PERPETUAL_HAVE_IO_URING 1
+#endif
+
+namespace perpetual {
+
+namespace {
+constexpr size_t kBufferAlignment = kJournalBlockSize;
+constexpr size_t kHeaderSize = sizeof(JournalRecordHeader);
+
+size_t align_block(size_t value) {
+    return (value + kJournalBlockSize - 1) & ~(kJournalBlockSize - 1);
+}
+}
+
+JournalBackend parse_journal_backend(const std::string& name) {
+    if (name == "pwrite") return JournalBackend::PWRITE;
+    if (name == "io_uring" || name == "uring") return JournalBackend::IO_URING;
+    return JournalBackend::AUTO;
+}
+
+// ============================================================================
+// JournalWriter (backend independent part)
+// ============================================================================
+
+JournalWriter::JournalWriter(const JournalWriterConfig& config)
+    : config_(config) {
+    if (config_.max_in_flight == 0) {
+        config_.max_in_flight = 1;
+    }
+    config_.batch_bytes = align_block(config_.batch_bytes);
+    if (config_.segment_bytes > 0) {
+        config_.segment_bytes = std::max<uint64_t>(align_block(config_.segment_bytes),
+                                                   config_.batch_bytes);
+    }
+}
+
+JournalWriter::~JournalWriter() {
+    for (auto& batch : batches_) {
+        free(batch.data);
+    }
+}
+
+bool JournalWriter::allocate_buffers() {
+    // One buffer is filled while max_in_flight are being written
+    batches_.resize(config_.max_in_flight + 1);
+    for (size_t i = 0; i < batches_.size(); ++i) {
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, kBufferAlignment, config_.batch_bytes) != 0) {
+            LOG_ERROR("Journal: failed to allocate batch buffer");
+            return false;
+        }
+        batches_[i].data = static_cast<char*>(ptr);
+        batches_[i].index = static_cast<uint16_t>(i);
+    }
+    return true;
+}
+
+bool JournalWriter::open(const std::string& path, const JournalPosition& resume_from) {
+    if (fd_ >= 0) {
+        close();
+    }
+
+    if (batches_.empty() && !allocate_buffers()) {
+        return false;
+    }
+    if (!start()) {
+        return false;
+    }
+
+    failed_.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        failed_record_ = UINT64_MAX;
+    }
+    bool opened = segmented() ? open_segments(path, resume_from) : open_file(path);
+    if (!opened) {
+        stop();
+        return false;
+    }
+    return current_ != nullptr;
+}
+
+bool JournalWriter::open_file(const std::string& path) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("Journal: failed to open " + path + ": " + strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    fd_ = fd;
+    file_offset_ = static_cast<uint64_t>(st.st_size);
+    current_ = acquire_batch();
+    return true;
+}
+
+bool JournalWriter::open_segments(const std::string& dir, const JournalPosition& resume_from) {
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        LOG_ERROR("Journal: failed to create " + dir + ": " + strerror(errno));
+        return false;
+    }
+
+    // Find the tail: the first record that is zero, torn or from an older epoch
+    JournalPosition tail;
+    {
+        auto reader = std::make_unique<JournalReader>(dir);
+        const char* data = nullptr;
+        size_t length = 0;
+        if (resume_from.segment > 0 && !(reader->seek(resume_from) && reader->next(data, length))) {
+            LOG_WARN("Journal: resume position not found in " + dir + ", scanning from the start");
+            reader = std::make_unique<JournalReader>(dir);
+        }
+        while (reader->next(data, length)) {
+        }
+        tail = reader->tail();
+        epoch_ = reader->last_epoch() + 1;
+    }
+
+    std::vector<uint64_t> segments = list_journal_segments(dir);
+    dir_ = dir;
+    segment_id_ = tail.segment > 0 ? tail.segment : 1;
+    preallocator_ = std::make_unique<SegmentPreallocator>(dir, config_.segment_bytes,
+                                                          config_.segments_ahead);
+    preallocator_->start(segments.empty() ? 1 : segments.back() + 1);
+    if (!preallocator_->acquire(segment_id_, false)) {
+        LOG_ERROR("Journal: failed to preallocate segment in " + dir);
+        return false;
+    }
+
+    int fd = open_segment_file(segment_id_, segment_size_);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Resume at the tail. After a torn write the tail can sit inside a
+    // block; carry the block's valid prefix so the first commit rewrites it.
+    size_t prefix = static_cast<size_t>(tail.offset % kJournalBlockSize);
+    fd_ = fd;
+    file_offset_ = tail.offset - prefix;
+    current_ = acquire_batch();
+    if (prefix > 0) {
+        int read_fd = ::open(journal_segment_path(dir, segment_id_).c_str(), O_RDONLY | O_CLOEXEC);
+        ssize_t n = read_fd >= 0 ? ::pread(read_fd, current_->data, prefix,
+                                           static_cast<off_t>(file_offset_)) : -1;
+        if (read_fd >= 0) {
+            ::close(read_fd);
+        }
+        if (n != static_cast<ssize_t>(prefix)) {
+            LOG_ERROR("Journal: failed to read tail block in " + dir);
+            return false;
+        }
+        current_->length = prefix;
+    }
+    return true;
+}
+
+int JournalWriter::open_segment_file(uint64_t segment_id, uint64_t& size) {
+    const std::string path = journal_segment_path(dir_, segment_id);
+    int flags = O_WRONLY | O_CLOEXEC;
+#ifdef O_DIRECT
+    if (config_.direct_io) {
+        flags |= O_DIRECT;
+    }
+#endif
+
+    int fd = ::open(path.c_str(), flags);
+#ifdef O_DIRECT
+    if (fd < 0 && errno == EINVAL && (flags & O_DIRECT)) {
+        // tmpfs and some network filesystems refuse O_DIRECT
+        LOG_WARN("Journal: O_DIRECT not supported for " + path + ", using buffered writes");
+        config_.direct_io = false;
+        fd = ::open(path.c_str(), flags & ~O_DIRECT);
+    }
+#endif
+    if (fd < 0) {
+        LOG_ERROR("Journal: failed to open segment " + path + ": " + strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    size = static_cast<uint64_t>(st.st_size);
+    return fd;
+}
+
+bool JournalWriter::roll_segment() {
+    finalize_record();
+
+    // Seal the segment with a padding record reaching its end so readers
+    // move on to the next one (gaps below a header are skipped implicitly)
+    skip_header_gap();
+    uint64_t position = file_offset_ + current_->length;
+    if (position + kHeaderSize <= segment_size_) {
+        append_padding(static_cast<size_t>(segment_size_ - position - kHeaderSize));
+        size_t block_end = align_block(current_->length);
+        memset(current_->data + current_->length, 0, block_end - current_->length);
+        current_->length = block_end;
+    }
+    commit();
+    if (!current_) {
+        return false;
+    }
+
+    uint64_t next_id = segment_id_ + 1;
+    uint64_t next_size = 0;
+    int fd = -1;
+    if (preallocator_->acquire(next_id)) {
+        fd = open_segment_file(next_id, next_size);
+    }
+    if (fd < 0) {
+        LOG_ERROR("Journal: cannot roll to segment " + std::to_string(next_id));
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        failed_record_ = std::min(failed_record_, appended_record_ + 1);
+        failed_.store(true, std::memory_order_release);
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        sealed_fds_.push_back(fd_);
+        stats_.segment_rolls++;
+    }
+    fd_ = fd;
+    segment_id_ = next_id;
+    segment_size_ = next_size;
+    file_offset_ = 0;
+    current_->fd = fd_;
+    current_->offset = 0;
+    close_sealed_segments(false);
+    return true;
+}
+
+void JournalWriter::close_sealed_segments(bool all) {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    auto busy = [this](int fd) {
+        for (const auto& batch : batches_) {
+            if (batch.fd == fd && (batch.state == BatchState::IN_FLIGHT ||
+                                   batch.state == BatchState::DONE)) {
+                return true;
+            }
+        }
+        return false;
+    };
+    auto it = sealed_fds_.begin();
+    while (it != sealed_fds_.end()) {
+        if (all || !busy(*it)) {
+            ::close(*it);
+            it = sealed_fds_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void JournalWriter::finalize_record() {
+    if (open_record_ == SIZE_MAX) {
+        return;
+    }
+    char* record = current_->data + open_record_;
+    JournalRecordHeader header;
+    memcpy(&header, record, kHeaderSize);
+    header.crc = journal_record_crc(header, record + kHeaderSize);
+    memcpy(record, &header.crc, sizeof(header.crc));
+    open_record_ = SIZE_MAX;
+}
+
+void JournalWriter::append_padding(size_t payload) {
+    JournalRecordHeader header;
+    header.length = static_cast<uint32_t>(payload);
+    header.kind = static_cast<uint16_t>(JournalRecordKind::PADDING);
+    header.reserved = 0;
+    header.epoch = epoch_;
+    header.crc = journal_record_crc(header, nullptr);
+    memcpy(current_->data + current_->length, &header, kHeaderSize);
+    current_->length += kHeaderSize;
+}
+
+size_t JournalWriter::header_gap() const {
+    if (!segmented()) {
+        return 0;
+    }
+    size_t gap = kJournalBlockSize - current_->length % kJournalBlockSize;
+    return gap < kHeaderSize ? gap : 0;
+}
+
+void JournalWriter::skip_header_gap() {
+    size_t gap = header_gap();
+    memset(current_->data + current_->length, 0, gap);
+    current_->length += gap;
+}
+
+void JournalWriter::pad_to_block() {
+    size_t block_end = align_block(current_->length);
+    size_t gap = block_end - current_->length;
+    if (gap >= kHeaderSize) {
+        append_padding(gap - kHeaderSize);
+    }
+    memset(current_->data + current_->length, 0, block_end - current_->length);
+    current_->length = block_end;
+}
+
+void JournalWriter::close() {
+    if (fd_ < 0) {
+        return;
+    }
+    sync();
+    drain();
+    stop();
+    if (current_) {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        current_->state = BatchState::FREE;
+        current_ = nullptr;
+    }
+    next_batch_ = 0;
+    retire_batch_ = 0;
+    open_record_ = SIZE_MAX;
+    close_sealed_segments(true);
+    if (preallocator_) {
+        preallocator_->stop();
+    }
+    ::close(fd_);
+    fd_ = -1;
+}
+
+JournalWriter::Batch* JournalWriter::acquire_batch() {
+    Batch& batch = batches_[next_batch_];
+
+    // Slots are used round-robin, so waiting on the next slot is waiting on
+    // the oldest in-flight batch
+    std::unique_lock<std::mutex> lock(state_mutex_);
+    state_cv_.wait(lock, [&batch] { return batch.state == BatchState::FREE; });
+
+    next_batch_ = (next_batch_ + 1) % batches_.size();
+    batch.state = BatchState::FILLING;
+    batch.length = 0;
+    batch.fd = fd_;
+    batch.offset = file_offset_;
+    batch.last_record = committed_record_.load(std::memory_order_relaxed);
+    batch.first_record = batch.last_record + 1;
+    batch.ok = true;
+    return &batch;
+}
+
+char* JournalWriter::reserve(size_t len) {
+    size_t needed = segmented() ? len + kHeaderSize : len;
+    if (fd_ < 0 || !current_ || needed > config_.batch_bytes ||
+        failed_.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+
+    if (current_->length + header_gap() + needed > config_.batch_bytes) {
+        commit();
+        if (!current_) {
+            return nullptr;
+        }
+    }
+
+    if (segmented()) {
+        if (file_offset_ + current_->length + header_gap() + needed > segment_size_) {
+            if (!roll_segment()) {
+                return nullptr;
+            }
+        }
+
+        // The CRC is filled in once the caller has written the payload
+        finalize_record();
+        skip_header_gap();
+        JournalRecordHeader header;
+        header.crc = 0;
+        header.length = static_cast<uint32_t>(len);
+        header.kind = static_cast<uint16_t>(JournalRecordKind::DATA);
+        header.reserved = 0;
+        header.epoch = epoch_;
+        memcpy(current_->data + current_->length, &header, kHeaderSize);
+        open_record_ = current_->length;
+    }
+
+    last_position_.segment = segment_id_;
+    last_position_.offset = file_offset_ + current_->length;
+
+    char* ptr = current_->data + current_->length + (segmented() ? kHeaderSize : 0);
+    current_->length += needed;
+    current_->last_record = ++appended_record_;
+    return ptr;
+}
+
+uint64_t JournalWriter::append(const void* data, size_t len) {
+    char* ptr = reserve(len);
+    if (!ptr) {
+        return 0;
+    }
+    memcpy(ptr, data, len);
+    return appended_record_;
+}
+
+uint64_t JournalWriter::commit() {
+    if (!current_ || current_->length == 0) {
+        return committed_record_.load(std::memory_order_relaxed);
+    }
+
+    if (segmented()) {
+        // O_DIRECT needs block-aligned length and offset
+        finalize_record();
+        pad_to_block();
+    }
+
+    Batch* batch = current_;
+    batch->state = BatchState::IN_FLIGHT;
+    file_offset_ += batch->length;
+    committed_record_.store(batch->last_record, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        stats_.batches_committed++;
+        stats_.bytes_written += batch->length;
+        stats_.records_appended = appended_record_;
+    }
+
+    if (!submit(*batch)) {
+        complete_batch(*batch, false);
+    }
+
+    current_ = acquire_batch();
+    if (!sealed_fds_.empty()) {
+        close_sealed_segments(false);
+    }
+    return batch->last_record;
+}
+
+bool JournalWriter::wait_durable(uint64_t record) {
+    if (record <= durable_record()) {
+        return true;
+    }
+    if (record > committed_record_.load(std::memory_order_acquire)) {
+        return false;
+    }
+    // Records before a failed batch still become durable when their own
+    // batches complete; the rest never will
+    std::unique_lock<std::mutex> lock(state_mutex_);
+    state_cv_.wait(lock, [this, record] {
+        return durable_record_.load(std::memory_order_acquire) >= record || record >= failed_record_;
+    });
+    return durable_record_.load(std::memory_order_acquire) >= record;
+}
+
+bool JournalWriter::sync() {
+    return wait_durable(commit());
+}
+
+void JournalWriter::drain() {
+    std::unique_lock<std::mutex> lock(state_mutex_);
+    state_cv_.wait(lock, [this] {
+        for (const auto& batch : batches_) {
+            if (batch.state == BatchState::IN_FLIGHT || batch.state == BatchState::DONE) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+void JournalWriter::complete_batch(Batch& batch, bool ok) {
+    bool advanced = false;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        batch.ok = ok;
+        batch.state = BatchState::DONE;
+        if (!ok) {
+            stats_.write_errors++;
+            failed_record_ = std::min(failed_record_, batch.first_record);
+            failed_.store(true, std::memory_order_release);
+        }
+
+        // Retire finished batches in submission order so the watermark never
+        // covers a batch whose write has not completed. It stops for good
+        // before the first failed batch: later batches may have reached the
+        // disk, but records after the hole must not be reported durable.
+        while (true) {
+            Batch& oldest = batches_[retire_batch_];
+            if (oldest.state != BatchState::DONE) {
+                break;
+            }
+            if (oldest.ok && oldest.last_record < failed_record_) {
+                durable_record_.store(oldest.last_record, std::memory_order_release);
+                stats_.durable_record = oldest.last_record;
+                advanced = true;
+            }
+            oldest.state = BatchState::FREE;
+            retire_batch_ = (retire_batch_ + 1) % batches_.size();
+        }
+        state_cv_.notify_all();
+    }
+
+    if ((advanced || !ok) && durable_listener_) {
+        durable_listener_(durable_record());
+    }
+}
+
+bool JournalWriter::submit_sync(Batch& batch) {
+    bool ok = write_and_sync(batch.fd, batch.data, batch.length, batch.offset);
+    complete_batch(batch, ok);
+    return true;
+}
+
+bool JournalWriter::write_and_sync(int fd, const char* data, size_t length, uint64_t offset) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t n = ::pwrite(fd, data + written, length - written, offset + written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Journal: pwrite failed: " + std::string(strerror(errno)));
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    if (config_.sync_on_commit && ::fdatasync(fd) != 0) {
+        LOG_ERROR("Journal: fdatasync failed: " + std::string(strerror(errno)));
+        return false;
+    }
+    return true;
+}
+
+JournalWriter::Stats JournalWriter::get_stats() const {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    Stats stats = stats_;
+    stats.durable_record = durable_record();
+    if (preallocator_) {
+        stats.preallocation_stalls = preallocator_->stalls();
+    }
+    return stats;
+}
+
+// ============================================================================
+// pwrite backend: write + fdatasync on the committing thread
+// ============================================================================
+
+class PwriteJournalWriter : public JournalWriter {
+public:
+    explicit PwriteJournalWriter(const JournalWriterConfig& config)
+        : JournalWriter(config) {}
+
+    ~PwriteJournalWriter() override {
+        close();
+    }
+
+    const char* backend_name() const override { return "pwrite"; }
+
+protected:
+    bool submit(Batch& batch) override {
+        return submit_sync(batch);
+    }
+};
+
+// ============================================================================
+// io_uring backend
+//
+// Each batch is one WRITE_FIXED from a registered buffer linked to an
+// FSYNC(DATASYNC). Up to max_in_flight batches are queued; a completion
+// thread reaps CQEs and advances the durability watermark, so the
+// journaling thread only pays for filling buffers and one io_uring_enter.
+//
+// If the ring cannot be created when the journal opens (ENOMEM,
+// RLIMIT_MEMLOCK, a seccomp filter), batches are written synchronously
+// exactly as the pwrite backend does.
+// ============================================================================
+
+#ifdef PERPETUAL_HAVE_IO_URING
+
+class IoUringJournalWriter : public JournalWriter {
+public:
+    explicit IoUringJournalWriter(const JournalWriterConfig& config)
+        : JournalWriter(config) {}
+
+    ~IoUringJournalWriter() override {
+        close();
+        teardown_ring();
+    }
+
+    const char* backend_name() const override { return synchronous_ ? "pwrite" : "io_uring"; }
+
+    // Check that the kernel lets us create a ring at all
+    static bool supported() {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, 4, &params));
+        if (fd < 0) {
+            return false;
+        }
+        ::close(fd);
+        return true;
+    }
+
+protected:
+    bool start() override {
+        synchronous_ = false;
+        if (ring_fd_ < 0 && !setup_ring()) {
+            LOG_WARN("Journal: io_uring ring setup failed, falling back to pwrite backend");
+            synchronous_ = true;
+            return true;
+        }
+        if (reaper_running_) {
+            return true;
+        }
+        stop_requested_.store(false, std::memory_order_release);
+        reaper_running_ = true;
+        reaper_thread_ = std::thread(&IoUringJournalWriter::reaper_loop, this);
+        return true;
+    }
+
+    void stop() override {
+        if (!reaper_running_) {
+            return;
+        }
+        // Batches are drained by now. The flag alone ends the reaper once it
+        // wakes; the NOP wakes it, and is retried until the kernel takes it
+        // so a full SQ cannot leave the reaper asleep while we join.
+        stop_requested_.store(true, std::memory_order_release);
+        for (int attempt = 0; !queue_stop(); ++attempt) {
+            if (attempt == 1000) {
+                LOG_WARN("Journal: io_uring stop request still not queued, retrying");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (reaper_thread_.joinable()) {
+            reaper_thread_.join();
+        }
+        reaper_running_ = false;
+    }
+
+    bool submit(Batch& batch) override {
+        if (synchronous_) {
+            return submit_sync(batch);
+        }
+        std::lock_guard<std::mutex> lock(sq_mutex_);
+
+        // Both SQEs of a linked write+fsync or neither: a lone write SQE
+        // left behind would go to the kernel with the next submit
+        unsigned needed = config().sync_on_commit ? 2 : 1;
+        if (sq_free() < needed) {
+            return false;
+        }
+        io_uring_sqe* write_sqe = next_sqe();
+        io_uring_sqe* sync_sqe = config().sync_on_commit ? next_sqe() : nullptr;
+
+        pending_cqes_[batch.index] = config().sync_on_commit ? 2 : 1;
+        batch_failed_[batch.index] = 0;
+
+        write_sqe->opcode = fixed_buffers_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        write_sqe->fd = batch.fd;
+        write_sqe->addr = reinterpret_cast<uint64_t>(batch.data);
+        write_sqe->len = static_cast<uint32_t>(batch.length);
+        write_sqe->off = batch.offset;
+        write_sqe->buf_index = fixed_buffers_ ? batch.index : 0;
+        write_sqe->user_data = make_tag(batch.index, kWriteOp);
+
+        if (sync_sqe) {
+            write_sqe->flags |= IOSQE_IO_LINK;
+            sync_sqe->opcode = IORING_OP_FSYNC;
+            sync_sqe->fd = batch.fd;
+            sync_sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+            sync_sqe->user_data = make_tag(batch.index, kSyncOp);
+        }
+
+        return submit_sqes(needed);
+    }
+
+private:
+    static constexpr uint64_t kWriteOp = 0;
+    static constexpr uint64_t kSyncOp = 1;
+    static constexpr uint64_t kStopTag = ~0ULL;
+    static constexpr long long kReaperWaitNs = 100 * 1000 * 1000;
+
+    static uint64_t make_tag(uint16_t index, uint64_t op) {
+        return (static_cast<uint64_t>(index) << 1) | op;
+    }
+
+    bool setup_ring() {
+        unsigned entries = 1;
+        while (entries < (batches().size() * 2 + 2)) {
+            entries <<= 1;
+        }
+
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ring_fd_ < 0) {
+            LOG_WARN("Journal: io_uring_setup failed: " + std::string(strerror(errno)));
+            return false;
+        }
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+#ifdef IORING_FEAT_EXT_ARG
+        ext_arg_ = (params.features & IORING_FEAT_EXT_ARG) != 0;
+#endif
+        if (single_mmap) {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) {
+            sq_ring_ = nullptr;
+            teardown_ring();
+            return false;
+        }
+        if (single_mmap) {
+            cq_ring_ = sq_ring_;
+        } else {
+            cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+            if (cq_ring_ == MAP_FAILED) {
+                cq_ring_ = nullptr;
+                teardown_ring();
+                return false;
+            }
+        }
+
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            teardown_ring();
+            return false;
+        }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(sq_ring_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        char* cq = static_cast<char*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // Register the batch buffers so writes skip per-I/O page pinning
+        std::vector<iovec> iovs(batches().size());
+        for (size_t i = 0; i < iovs.size(); ++i) {
+            iovs[i].iov_base = batches()[i].data;
+            iovs[i].iov_len = config().batch_bytes;
+        }
+        fixed_buffers_ = syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS,
+                                 iovs.data(), static_cast<unsigned>(iovs.size())) == 0;
+        if (!fixed_buffers_) {
+            LOG_WARN("Journal: io_uring buffer registration failed, using unregistered writes");
+        }
+
+        pending_cqes_.assign(batches().size(), 0);
+        batch_failed_.assign(batches().size(), 0);
+        return true;
+    }
+
+    void teardown_ring() {
+        if (sqes_) {
+            munmap(sqes_, sqes_size_);
+            sqes_ = nullptr;
+        }
+        if (cq_ring_ && cq_ring_ != sq_ring_) {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        cq_ring_ = nullptr;
+        if (sq_ring_) {
+            munmap(sq_ring_, sq_ring_size_);
+            sq_ring_ = nullptr;
+        }
+        if (ring_fd_ >= 0) {
+            ::close(ring_fd_);
+            ring_fd_ = -1;
+        }
+    }
+
+    // Caller holds sq_mutex_
+    unsigned sq_free() const {
+        return sq_entries_ - (local_sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE));
+    }
+
+    // Caller holds sq_mutex_
+    io_uring_sqe* next_sqe() {
+        if (sq_free() == 0) {
+            return nullptr;
+        }
+        unsigned tail = local_sq_tail_;
+        unsigned index = tail & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sq_array_[index] = index;
+        local_sq_tail_ = tail + 1;
+        return sqe;
+    }
+
+    // Queue the stop NOP and hand every queued SQE to the kernel
+    bool queue_stop() {
+        std::lock_guard<std::mutex> lock(sq_mutex_);
+        if (!stop_queued_) {
+            io_uring_sqe* sqe = next_sqe();
+            if (sqe) {
+                sqe->opcode = IORING_OP_NOP;
+                sqe->user_data = kStopTag;
+                stop_queued_ = true;
+            }
+        }
+        unsigned unconsumed = local_sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        bool submitted = unconsumed == 0 || submit_sqes(unconsumed);
+        if (stop_queued_ && submitted) {
+            stop_queued_ = false;
+            return true;
+        }
+        return false;
+    }
+
+    // Caller holds sq_mutex_
+    bool submit_sqes(unsigned count) {
+        __atomic_store_n(sq_tail_, local_sq_tail_, __ATOMIC_RELEASE);
+        while (count > 0) {
+            int ret = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, count, 0, 0, nullptr, 0));
+            if (ret < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+                LOG_ERROR("Journal: io_uring_enter failed: " + std::string(strerror(errno)));
+                return false;
+            }
+            count -= static_cast<unsigned>(ret);
+        }
+        return true;
+    }
+
+    // Block until a completion arrives; with EXT_ARG kernels, for at most
+    // kReaperWaitNs so the stop flag is seen even without the NOP
+    void wait_completion() {
+        int ret;
+#ifdef IORING_FEAT_EXT_ARG
+        if (ext_arg_) {
+            struct { int64_t tv_sec; long long tv_nsec; } timeout{0, kReaperWaitNs};
+            io_uring_getevents_arg arg;
+            memset(&arg, 0, sizeof(arg));
+            arg.ts = reinterpret_cast<uint64_t>(&timeout);
+            ret = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, 0, 1,
+                                           IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                                           &arg, sizeof(arg)));
+        } else
+#endif
+        {
+            ret = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, 0, 1,
+                                           IORING_ENTER_GETEVENTS, nullptr, 0));
+        }
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != ETIME) {
+            LOG_ERROR("Journal: io_uring wait failed: " + std::string(strerror(errno)));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    void reaper_loop() {
+        bool stopping = false;
+        while (!stopping) {
+            unsigned head = *cq_head_;
+            unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            if (head == tail) {
+                if (stop_requested_.load(std::memory_order_acquire)) {
+                    break;
+                }
+                wait_completion();
+                continue;
+            }
+            while (head != tail) {
+                const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+                if (cqe.user_data == kStopTag) {
+                    // A late NOP from an earlier stop must not end this reaper
+                    stopping = stop_requested_.load(std::memory_order_acquire);
+                } else {
+                    handle_completion(cqe.user_data, cqe.res);
+                }
+                ++head;
+            }
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        }
+    }
+
+    void handle_completion(uint64_t tag, int32_t res) {
+        uint16_t index = static_cast<uint16_t>(tag >> 1);
+        Batch& batch = batches()[index];
+        bool is_write = (tag & 1) == kWriteOp;
+
+        if (is_write && res >= 0 && static_cast<size_t>(res) < batch.length) {
+            // Short write breaks the link; finish the batch synchronously
+            bool ok = write_and_sync(batch.fd, batch.data + res, batch.length - res,
+                                     batch.offset + res);
+            batch_failed_[index] = ok ? 0 : 1;
+        } else if (res == -EFAULT || (is_write && res == -ECANCELED)) {
+            // Work deferred to the submitting thread fails with EFAULT (or is
+            // cancelled) once that thread has exited, e.g. a linked fsync
+            // after the journaling thread's last commit. Finish it here.
+            if (is_write) {
+                bool ok = write_and_sync(batch.fd, batch.data, batch.length, batch.offset);
+                batch_failed_[index] = ok ? 0 : 1;
+            } else if (::fdatasync(batch.fd) != 0) {
+                LOG_ERROR("Journal: fdatasync failed: " + std::string(strerror(errno)));
+                batch_failed_[index] = 1;
+            }
+        } else if (res < 0 && !(res == -ECANCELED && !is_write)) {
+            LOG_ERROR("Journal: io_uring " + std::string(is_write ? "write" : "fsync") +
+                      " failed: " + std::string(strerror(-res)));
+            batch_failed_[index] = 1;
+        }
+
+        if (--pending_cqes_[index] == 0) {
+            complete_batch(batch, !batch_failed_[index]);
+        }
+    }
+
+    int ring_fd_ = -1;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    size_t sqes_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned local_sq_tail_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    bool fixed_buffers_ = false;
+    bool ext_arg_ = false;
+    bool synchronous_ = false;      // Ring setup failed: write like the pwrite backend
+    bool stop_queued_ = false;      // Stop NOP in the SQ, not yet taken by the kernel
+    std::atomic<bool> stop_requested_{false};
+
+    // Per batch slot, touched only by the reaper after submit()
+    std::vector<int> pending_cqes_;
+    std::vector<uint8_t> batch_failed_;
+
+    std::mutex sq_mutex_;
+    std::thread reaper_thread_;
+    bool reaper_running_ = false;
+};
+
+#endif // PERPETUAL_HAVE_IO_URING
+
+// ============================================================================
+// Factory
+// ============================================================================
+
+std::unique_ptr<JournalWriter> JournalWriter::create(const JournalWriterConfig& config) {
+#ifdef PERPETUAL_HAVE_IO_URING
+    if (config.backend != JournalBackend::PWRITE && IoUringJournalWriter::supported()) {
+        return std::make_unique<IoUringJournalWriter>(config);
+    }
+    if (config.backend == JournalBackend::IO_URING) {
+        LOG_WARN("Journal: io_uring unavailable, falling back to pwrite backend");
+    }
+#else
+    if (config.backend == JournalBackend::IO_URING) {
+        LOG_WARN("Journal: io_uring not compiled in, falling back to pwrite backend");
+    }
+#endif
+    return std::make_unique<PwriteJournalWriter>(config);
+}
+
+} // namespace perpetual
@@ -0,0 +1,759 @@
+#include "core/log_shipping.h"
+#include "core/logger.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+namespace perpetual {
+
+namespace {
+
+constexpr size_t kReadChunk = 256 * 1024;
+constexpr size_t kMaxReadRound = 4 * 1024 * 1024;   // Replica acks at least this often
+constexpr int kPollIntervalMs = 100;
+constexpr int kListenBacklog = 16;
+
+// Resolve "unix:<path>" or "<host>:<port>" and create a socket for it,
+// bound and listening or connected
+int open_socket(const std::string& address, bool listen, std::string* unix_path) {
+    if (address.compare(0, 5, "unix:") == 0) {
+        sockaddr_un addr{};
+        std::string path = address.substr(5);
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            return -1;
+        }
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        bool ok;
+        if (listen) {
+            ::unlink(path.c_str());
+            ok = ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 &&
+                 ::listen(fd, kListenBacklog) == 0;
+            if (ok && unix_path) {
+                *unix_path = path;
+            }
+        } else {
+            ok = ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        }
+        if (!ok) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        return -1;
+    }
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listen ? AI_PASSIVE : 0;
+    addrinfo* results = nullptr;
+    if (::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &results) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo* ai = results; ai; ai = ai->ai_next) {
+        fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        bool ok;
+        if (listen) {
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            ok = ::bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+                 ::listen(fd, kListenBacklog) == 0;
+        } else {
+            ok = ::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+        }
+        if (ok) {
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    ::freeaddrinfo(results);
+    return fd;
+}
+
+void set_nonblocking(int fd) {
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+bool send_all(int fd, const void* data, size_t length) {
+    const char* p = static_cast<const char*>(data);
+    while (length > 0) {
+        ssize_t n = ::send(fd, p, length, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+ShipFrameHeader make_header(ShipFrameKind kind) {
+    ShipFrameHeader header{};
+    header.magic = kShipFrameMagic;
+    header.kind = static_cast<uint16_t>(kind);
+    return header;
+}
+
+// Next complete frame in buffer at offset. False if more bytes are needed;
+// malformed is set if the stream cannot be a frame stream.
+bool next_frame(const std::string& buffer, size_t offset, ShipFrameHeader& header,
+                bool& malformed) {
+    malformed = false;
+    if (buffer.size() - offset < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, buffer.data() + offset, sizeof(header));
+    if (header.magic != kShipFrameMagic) {
+        malformed = true;
+        return false;
+    }
+    return buffer.size() - offset - sizeof(header) >= header.length;
+}
+
+} // namespace
+
+// ============================================================================
+// LogShipper
+// ============================================================================
+
+LogShipper::~LogShipper() {
+    stop();
+}
+
+bool LogShipper::start(EventStore* store, const LogShipperConfig& config) {
+    if (running_ || !store) {
+        return false;
+    }
+    store_ = store;
+    config_ = config;
+    if (config_.max_in_flight == 0) {
+        config_.max_in_flight = 1;
+    }
+
+    listen_fd_ = open_socket(config_.listen_address, true, &unix_path_);
+    if (listen_fd_ < 0) {
+        LOG_ERROR("LogShipper: cannot listen on " + config_.listen_address +
+                  ": " + strerror(errno));
+        return false;
+    }
+    set_nonblocking(listen_fd_);
+    wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+
+    // Events before the listener are caught up from the log
+    sealed_sequence_ = store_->set_append_listener([this](const EventView& view) {
+        on_append(view);
+    });
+
+    running_ = true;
+    thread_ = std::thread(&LogShipper::run, this);
+    LOG_INFO("LogShipper: listening on " + config_.listen_address);
+    return true;
+}
+
+void LogShipper::stop() {
+    if (!running_) {
+        return;
+    }
+    store_->set_append_listener(nullptr);
+    running_ = false;
+    wake();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    std::lock_guard<std::mutex> lock(status_mutex_);
+    for (auto& replica : replicas_) {
+        if (replica->fd >= 0) {
+            ::close(replica->fd);
+        }
+    }
+    replicas_.clear();
+    window_.clear();
+    window_size_ = 0;
+    ::close(listen_fd_);
+    ::close(wake_fd_);
+    listen_fd_ = wake_fd_ = -1;
+    if (!unix_path_.empty()) {
+        ::unlink(unix_path_.c_str());
+    }
+}
+
+void LogShipper::on_append(const EventView& view) {
+    std::lock_guard<std::mutex> lock(open_mutex_);
+    bool first = open_count_ == 0;
+    if (first) {
+        open_.resize(sizeof(ShipFrameHeader));
+        open_first_ = view.sequence_id();
+    }
+    uint32_t length = static_cast<uint32_t>(view.size());
+    open_.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    open_.append(view.data(), view.size());
+    open_last_ = view.sequence_id();
+    ++open_count_;
+
+    // The shipper only needs a nudge when a batch starts or fills up
+    if (first || open_.size() >= config_.batch_bytes) {
+        wake();
+    }
+}
+
+void LogShipper::wake() {
+    uint64_t one = 1;
+    ssize_t ignored = ::write(wake_fd_, &one, sizeof(one));
+    (void)ignored;
+}
+
+void LogShipper::seal() {
+    auto batch = std::make_shared<Batch>();
+    ShipFrameHeader header = make_header(ShipFrameKind::BATCH);
+    {
+        std::lock_guard<std::mutex> lock(open_mutex_);
+        if (open_count_ == 0) {
+            return;
+        }
+        batch->frame.swap(open_);
+        open_.reserve(config_.batch_bytes + sizeof(ShipFrameHeader));
+        header.first_sequence = open_first_;
+        header.last_sequence = open_last_;
+        header.count = open_count_;
+        open_count_ = 0;
+    }
+
+    header.length = static_cast<uint32_t>(batch->frame.size() - sizeof(header));
+    header.crc = crc32c(batch->frame.data() + sizeof(header), header.length);
+    memcpy(&batch->frame[0], &header, sizeof(header));
+    batch->prev_sequence = sealed_sequence_;
+    batch->last_sequence = header.last_sequence;
+    sealed_sequence_ = header.last_sequence;
+
+    window_size_ += batch->frame.size();
+    window_.push_back(std::move(batch));
+    batches_sealed_.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::shared_ptr<const LogShipper::Batch> LogShipper::catch_up_batch(SequenceID after,
+                                                                    SequenceID through) const {
+    auto batch = std::make_shared<Batch>();
+    batch->frame.resize(sizeof(ShipFrameHeader));
+    ShipFrameHeader header = make_header(ShipFrameKind::BATCH);
+    store_->scan_events(after + 1, through, [&](const EventView& view) {
+        if (header.count == 0) {
+            header.first_sequence = view.sequence_id();
+        }
+        uint32_t length = static_cast<uint32_t>(view.size());
+        batch->frame.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        batch->frame.append(view.data(), view.size());
+        header.last_sequence = view.sequence_id();
+        ++header.count;
+        return batch->frame.size() < config_.batch_bytes;
+    });
+    if (header.count == 0) {
+        return nullptr;
+    }
+
+    header.length = static_cast<uint32_t>(batch->frame.size() - sizeof(header));
+    header.crc = crc32c(batch->frame.data() + sizeof(header), header.length);
+    memcpy(&batch->frame[0], &header, sizeof(header));
+    batch->prev_sequence = after;
+    batch->last_sequence = header.last_sequence;
+    return batch;
+}
+
+void LogShipper::schedule(Replica& replica) {
+    while (replica.hello && replica.fd >= 0 && !replica.sending &&
+           replica.in_flight.size() < config_.max_in_flight) {
+        // First sealed batch the replica has not been sent
+        auto next = std::upper_bound(window_.begin(), window_.end(), replica.sent_sequence,
+                                     [](SequenceID sequence, const std::shared_ptr<const Batch>& batch) {
+                                         return sequence < batch->last_sequence;
+                                     });
+        std::shared_ptr<const Batch> batch;
+        if (next != window_.end() && (*next)->prev_sequence <= replica.sent_sequence) {
+            batch = *next;
+        } else {
+            // Behind the window: read the gap back from the log
+            SequenceID through = next != window_.end() ? (*next)->prev_sequence : sealed_sequence_;
+            if (replica.sent_sequence >= through) {
+                return;   // Up to date
+            }
+            batch = catch_up_batch(replica.sent_sequence, through);
+            if (!batch) {
+                LOG_ERROR("LogShipper: events after " + std::to_string(replica.sent_sequence) +
+                          " are no longer in the log, replica " +
+                          std::to_string(replica.status.node) + " cannot catch up");
+                ::shutdown(replica.fd, SHUT_RDWR);
+                return;
+            }
+        }
+
+        replica.sending = batch;
+        replica.sent_bytes = 0;
+        replica.sent_sequence = batch->last_sequence;
+        replica.in_flight.push_back(batch->last_sequence);
+        {
+            std::lock_guard<std::mutex> lock(status_mutex_);
+            replica.status.in_flight = replica.in_flight.size();
+        }
+        if (!write_replica(replica)) {
+            ::shutdown(replica.fd, SHUT_RDWR);
+            return;
+        }
+    }
+}
+
+bool LogShipper::write_replica(Replica& replica) {
+    while (replica.sending) {
+        const std::string& frame = replica.sending->frame;
+        ssize_t n = ::send(replica.fd, frame.data() + replica.sent_bytes,
+                           frame.size() - replica.sent_bytes, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        replica.sent_bytes += static_cast<size_t>(n);
+        bytes_shipped_.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+        if (replica.sent_bytes == frame.size()) {
+            replica.sending.reset();
+            std::lock_guard<std::mutex> lock(status_mutex_);
+            ++replica.status.batches_sent;
+        }
+    }
+    return true;
+}
+
+bool LogShipper::read_replica(Replica& replica) {
+    char chunk[4096];
+    while (true) {
+        ssize_t n = ::recv(replica.fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (n == 0) {
+            return false;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return false;
+        }
+        replica.input.append(chunk, static_cast<size_t>(n));
+    }
+
+    size_t offset = 0;
+    ShipFrameHeader header;
+    bool malformed = false;
+    bool acked = false;
+    while (next_frame(replica.input, offset, header, malformed)) {
+        offset += sizeof(header) + header.length;
+        std::lock_guard<std::mutex> lock(status_mutex_);
+        if (header.kind == static_cast<uint16_t>(ShipFrameKind::HELLO)) {
+            // A node that reconnects replaces its old entry
+            for (auto& other : replicas_) {
+                if (other.get() != &replica && other->hello && other->status.node == header.node) {
+                    if (other->fd >= 0) {
+                        ::close(other->fd);
+                    }
+                    other->fd = -1;
+                    other->hello = false;
+                }
+            }
+            replica.hello = true;
+            replica.status.node = header.node;
+            replica.status.connected = true;
+            replica.status.acked_sequence = header.last_sequence;
+            replica.sent_sequence = header.last_sequence;
+            LOG_INFO("LogShipper: replica " + std::to_string(header.node) +
+                     " connected at sequence " + std::to_string(header.last_sequence));
+            acked = true;
+        } else if (header.kind == static_cast<uint16_t>(ShipFrameKind::ACK) && replica.hello) {
+            replica.status.acked_sequence = std::max(replica.status.acked_sequence,
+                                                     header.last_sequence);
+            while (!replica.in_flight.empty() &&
+                   replica.in_flight.front() <= replica.status.acked_sequence) {
+                replica.in_flight.pop_front();
+            }
+            replica.status.in_flight = replica.in_flight.size();
+            acked = true;
+        }
+    }
+    replica.input.erase(0, offset);
+    if (acked) {
+        ack_cv_.notify_all();
+    }
+    return !malformed;
+}
+
+void LogShipper::accept_replicas() {
+    while (true) {
+        int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        auto replica = std::make_unique<Replica>();
+        replica->fd = fd;
+        std::lock_guard<std::mutex> lock(status_mutex_);
+        replicas_.push_back(std::move(replica));
+    }
+}
+
+void LogShipper::trim_window() {
+    // Batches every replica has acknowledged are not needed again; past
+    // window_bytes, lagging replicas catch up from the log instead
+    SequenceID acked = UINT64_MAX;
+    bool any = false;
+    {
+        std::lock_guard<std::mutex> lock(status_mutex_);
+        for (const auto& replica : replicas_) {
+            if (replica->hello) {
+                acked = std::min(acked, replica->status.acked_sequence);
+                any = true;
+            }
+        }
+    }
+    while (!window_.empty() &&
+           (window_size_ > config_.window_bytes ||
+            (any && window_.front()->last_sequence <= acked))) {
+        window_size_ -= window_.front()->frame.size();
+        window_.pop_front();
+    }
+}
+
+void LogShipper::run() {
+    std::vector<pollfd> fds;
+    while (running_) {
+        fds.clear();
+        fds.push_back(pollfd{listen_fd_, POLLIN, 0});
+        fds.push_back(pollfd{wake_fd_, POLLIN, 0});
+        size_t polled = replicas_.size();
+        for (const auto& replica : replicas_) {
+            short events = replica->fd >= 0 ? POLLIN : 0;
+            if (replica->sending) {
+                events |= POLLOUT;
+            }
+            fds.push_back(pollfd{replica->fd, events, 0});
+        }
+
+        if (::poll(fds.data(), fds.size(), kPollIntervalMs) < 0 && errno != EINTR) {
+            LOG_ERROR(std::string("LogShipper: poll failed: ") + strerror(errno));
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            ssize_t ignored = ::read(wake_fd_, &count, sizeof(count));
+            (void)ignored;
+        }
+
+        for (size_t i = 0; i < polled; ++i) {
+            Replica& replica = *replicas_[i];
+            short revents = fds[i + 2].revents;
+            if (replica.fd < 0 || revents == 0) {
+                continue;
+            }
+            bool ok = true;
+            if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                ok = read_replica(replica);
+            }
+            if (ok && replica.fd >= 0 && (revents & POLLOUT)) {
+                ok = write_replica(replica);
+            }
+            if (!ok && replica.fd >= 0) {
+                ::close(replica.fd);
+                std::lock_guard<std::mutex> lock(status_mutex_);
+                replica.fd = -1;
+                replica.sending.reset();
+                replica.in_flight.clear();
+                replica.input.clear();
+                replica.status.connected = false;
+                replica.status.in_flight = 0;
+                if (replica.hello) {
+                    LOG_WARN("LogShipper: replica " + std::to_string(replica.status.node) +
+                             " disconnected at sequence " +
+                             std::to_string(replica.status.acked_sequence));
+                }
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            accept_replicas();
+        }
+
+        // Seal the open batch once it is full or a replica is idle waiting
+        // for it; otherwise keep filling it while the replicas are busy
+        size_t open_bytes;
+        {
+            std::lock_guard<std::mutex> lock(open_mutex_);
+            open_bytes = open_count_ > 0 ? open_.size() : 0;
+        }
+        bool idle = false;
+        for (const auto& replica : replicas_) {
+            idle = idle || (replica->hello && replica->fd >= 0 && !replica->sending &&
+                            replica->in_flight.size() < config_.max_in_flight &&
+                            replica->sent_sequence >= sealed_sequence_);
+        }
+        if (open_bytes >= config_.batch_bytes || (open_bytes > 0 && idle)) {
+            seal();
+        }
+
+        for (auto& replica : replicas_) {
+            schedule(*replica);
+        }
+        trim_window();
+
+        // Drop connections that closed before saying hello, and entries
+        // superseded by a reconnect
+        std::lock_guard<std::mutex> lock(status_mutex_);
+        replicas_.erase(std::remove_if(replicas_.begin(), replicas_.end(),
+                                       [](const std::unique_ptr<Replica>& replica) {
+                                           return replica->fd < 0 && !replica->hello;
+                                       }),
+                        replicas_.end());
+    }
+}
+
+SequenceID LogShipper::replicated_sequence(size_t k) const {
+    if (k == 0) {
+        return store_ ? store_->get_latest_sequence() : 0;
+    }
+    std::vector<SequenceID> acked;
+    {
+        std::lock_guard<std::mutex> lock(status_mutex_);
+        for (const auto& replica : replicas_) {
+            if (replica->hello) {
+                acked.push_back(replica->status.acked_sequence);
+            }
+        }
+    }
+    if (acked.size() < k) {
+        return 0;
+    }
+    std::nth_element(acked.begin(), acked.begin() + (k - 1), acked.end(),
+                     std::greater<SequenceID>());
+    return acked[k - 1];
+}
+
+bool LogShipper::wait_replicated(SequenceID sequence, size_t k,
+                                 std::chrono::microseconds timeout) const {
+    std::unique_lock<std::mutex> lock(status_mutex_);
+    return ack_cv_.wait_for(lock, timeout, [&]() {
+        size_t count = 0;
+        for (const auto& replica : replicas_) {
+            if (replica->hello && replica->status.acked_sequence >= sequence) {
+                ++count;
+            }
+        }
+        return count >= k;
+    });
+}
+
+bool LogShipper::is_connected(NodeID node) const {
+    std::lock_guard<std::mutex> lock(status_mutex_);
+    for (const auto& replica : replicas_) {
+        if (replica->hello && replica->status.node == node) {
+            return replica->status.connected;
+        }
+    }
+    return false;
+}
+
+std::vector<ReplicaStatus> LogShipper::replicas() const {
+    std::vector<ReplicaStatus> statuses;
+    std::lock_guard<std::mutex> lock(status_mutex_);
+    for (const auto& replica : replicas_) {
+        if (replica->hello) {
+            statuses.push_back(replica->status);
+        }
+    }
+    return statuses;
+}
+
+// ============================================================================
+// LogReplica
+// ============================================================================
+
+LogReplica::~LogReplica() {
+    stop();
+}
+
+bool LogReplica::start(EventStore* store, const LogReplicaConfig& config) {
+    if (running_ || !store) {
+        return false;
+    }
+    store_ = store;
+    config_ = config;
+    running_ = true;
+    thread_ = std::thread(&LogReplica::run, this);
+    return true;
+}
+
+void LogReplica::stop() {
+    running_ = false;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void LogReplica::run() {
+    bool warned = false;
+    while (running_) {
+        int fd = open_socket(config_.primary_address, false, nullptr);
+        if (fd >= 0) {
+            warned = false;
+            connected_ = true;
+            follow(fd);
+            connected_ = false;
+            ::close(fd);
+        } else if (!warned) {
+            LOG_WARN("LogReplica: cannot connect to " + config_.primary_address + ", retrying");
+            warned = true;
+        }
+        if (running_) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(config_.reconnect_ms));
+        }
+    }
+}
+
+bool LogReplica::follow(int fd) {
+    ShipFrameHeader hello = make_header(ShipFrameKind::HELLO);
+    hello.node = config_.node_id;
+    hello.last_sequence = store_->get_latest_sequence();
+    if (!send_all(fd, &hello, sizeof(hello))) {
+        return false;
+    }
+
+    std::string input;
+    std::vector<char> chunk(kReadChunk);
+    while (running_) {
+        pollfd pfd{fd, POLLIN, 0};
+        int ready = ::poll(&pfd, 1, kPollIntervalMs);
+        if (ready <= 0) {
+            if (ready < 0 && errno != EINTR) {
+                return false;
+            }
+            continue;
+        }
+
+        // Take everything already received, so one flush and one ack
+        // cover as many batches as possible
+        bool first = true;
+        while (input.size() < kMaxReadRound) {
+            ssize_t n = ::recv(fd, chunk.data(), chunk.size(), first ? 0 : MSG_DONTWAIT);
+            if (n == 0) {
+                return false;
+            }
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (!first && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    break;
+                }
+                return false;
+            }
+            input.append(chunk.data(), static_cast<size_t>(n));
+            first = false;
+        }
+
+        size_t offset = 0;
+        ShipFrameHeader header;
+        bool malformed = false;
+        bool applied = false;
+        while (next_frame(input, offset, header, malformed)) {
+            const char* payload = input.data() + offset + sizeof(header);
+            if (header.kind == static_cast<uint16_t>(ShipFrameKind::BATCH)) {
+                if (crc32c(payload, header.length) != header.crc ||
+                    !apply_batch(header, payload)) {
+                    LOG_ERROR("LogReplica: corrupt batch ending at sequence " +
+                              std::to_string(header.last_sequence));
+                    return false;
+                }
+                applied = true;
+            }
+            offset += sizeof(header) + header.length;
+        }
+        if (malformed) {
+            LOG_ERROR("LogReplica: malformed stream from " + config_.primary_address);
+            return false;
+        }
+        input.erase(0, offset);
+
+        if (applied) {
+            if (config_.durable_ack) {
+                store_->flush();
+            }
+            ShipFrameHeader ack = make_header(ShipFrameKind::ACK);
+            ack.node = config_.node_id;
+            ack.last_sequence = store_->get_latest_sequence();
+            if (!send_all(fd, &ack, sizeof(ack))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool LogReplica::apply_batch(const ShipFrameHeader& header, const char* payload) {
+    const char* end = payload + header.length;
+    Event event;
+    for (uint32_t i = 0; i < header.count; ++i) {
+        uint32_t length;
+        if (end - payload < static_cast<ptrdiff_t>(sizeof(length))) {
+            return false;
+        }
+        memcpy(&length, payload, sizeof(length));
+        payload += sizeof(length);
+        if (static_cast<size_t>(end - payload) < length) {
+            return false;
+        }
+        EventView view(payload, length);
+        payload += length;
+
+        // Batches may overlap what the replica already holds after a reconnect
+        if (view.sequence_id() <= store_->get_latest_sequence()) {
+            continue;
+        }
+        if (!view.decode(event) || !store_->append_event(event)) {
+            return false;
+        }
+    }
+    batches_applied_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+} // namespace perpetual
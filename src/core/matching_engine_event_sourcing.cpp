@@ -1,39 +1,129 @@
 #include "core/matching_engine_event_sourcing.h"
 #include "core/matching_engine.h"
 #include "core/deterministic_calculator.h"
+#include "core/logger.h"
+#include "core/metrics.h"
 #include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 namespace perpetual {
 
+namespace {
+
+// Snapshot state layout: SnapshotStateHeader, then bid_count bids and
+// ask_count asks as SnapshotOrder records, best price first and in time
+// priority within a level
+constexpr uint32_t kStateMagic = 0x4b4f4f42;   // "BOOK"
+constexpr uint32_t kStateVersion = 1;
+constexpr size_t kSnapshotsRetained = 2;
+constexpr const char* kSnapshotSuffix = ".snap";
+constexpr const char* kPendingSuffix = ".pending";   // Written by a forked child
+
+// A standby at the end of the log looks for new records this often, and
+// applies at most a batch per index lock
+constexpr auto kStandbyPollInterval = std::chrono::microseconds(100);
+constexpr size_t kStandbyBatch = 4096;
+
+#pragma pack(push, 1)
+struct SnapshotStateHeader {
+    uint32_t magic;
+    uint32_t version;
+    InstrumentID instrument_id;
+    SequenceID trade_sequence;
+    uint64_t total_trades;
+    uint64_t total_volume;
+    uint64_t bid_count;
+    uint64_t ask_count;
+};
+
+struct SnapshotOrder {
+    OrderID order_id;
+    UserID user_id;
+    Price price;
+    Quantity quantity;
+    Quantity filled_quantity;
+    Quantity remaining_quantity;
+    Timestamp timestamp;
+    SequenceID sequence_id;
+    uint8_t side;
+    uint8_t order_type;
+    uint8_t offset_flag;
+    uint8_t status;
+    uint8_t position_side;
+};
+#pragma pack(pop)
+
+SnapshotOrder to_snapshot(const Order& order) {
+    SnapshotOrder record;
+    record.order_id = order.order_id;
+    record.user_id = order.user_id;
+    record.price = order.price;
+    record.quantity = order.quantity;
+    record.filled_quantity = order.filled_quantity;
+    record.remaining_quantity = order.remaining_quantity;
+    record.timestamp = order.timestamp;
+    record.sequence_id = order.sequence_id;
+    record.side = static_cast<uint8_t>(order.side);
+    record.order_type = static_cast<uint8_t>(order.order_type);
+    record.offset_flag = static_cast<uint8_t>(order.offset_flag);
+    record.status = static_cast<uint8_t>(order.status);
+    record.position_side = static_cast<uint8_t>(order.position_side);
+    return record;
+}
+
+std::unique_ptr<Order> from_snapshot(const SnapshotOrder& record, InstrumentID instrument_id) {
+    auto order = std::make_unique<Order>(record.order_id, record.user_id, instrument_id,
+                                         static_cast<OrderSide>(record.side), record.price,
+                                         record.quantity, static_cast<OrderType>(record.order_type));
+    order->offset_flag = static_cast<OffsetFlag>(record.offset_flag);
+    order->status = static_cast<OrderStatus>(record.status);
+    order->position_side = static_cast<PositionSide>(record.position_side);
+    order->filled_quantity = record.filled_quantity;
+    order->remaining_quantity = record.remaining_quantity;
+    order->total_quantity = record.remaining_quantity;
+    order->timestamp = record.timestamp;
+    order->sequence_id = record.sequence_id;
+    return order;
+}
+
+} // namespace
+
 MatchingEngineEventSourcing::MatchingEngineEventSourcing(InstrumentID instrument_id,
                                                           EventStore* event_store)
-    : MatchingEngine(instrument_id), owns_event_store_(false) {
+    : MatchingEngine(instrument_id), event_store_(event_store) {
     if (event_store) {
-        event_store_ = std::unique_ptr<EventStore>(event_store);
         event_publisher_ = std::make_unique<EventPublisher>(event_store);
     }
 }
 
 MatchingEngineEventSourcing::~MatchingEngineEventSourcing() {
+    stop_standby();
+    wait_for_snapshot();
     if (event_publisher_) {
         event_publisher_->flush();
     }
-    if (event_store_ && owns_event_store_) {
-        event_store_->flush();
+    if (owned_event_store_) {
+        owned_event_store_->flush();
     }
 }
 
 bool MatchingEngineEventSourcing::initialize(const std::string& event_store_dir) {
     if (!event_store_) {
-        event_store_ = std::make_unique<EventStore>();
-        owns_event_store_ = true;
+        owned_event_store_ = std::make_unique<EventStore>();
+        event_store_ = owned_event_store_.get();
     }
     
     if (!event_store_->initialize(event_store_dir)) {
         return false;
     }
     
-    event_publisher_ = std::make_unique<EventPublisher>(event_store_.get());
+    event_publisher_ = std::make_unique<EventPublisher>(event_store_);
     return true;
 }
 
@@ -53,13 +143,16 @@ std::vector<Trade> MatchingEngineEventSourcing::process_order_es(Order* order) {
         return {};
     }
     
-    // Use deterministic timestamp if enabled
-    if (deterministic_mode_ && event_store_) {
-        SequenceID seq = event_store_->get_latest_sequence() + 1;
-        order->sequence_id = seq;
-        order->timestamp = DeterministicCalculator::sequence_to_timestamp(seq);
-    } else {
-        order->timestamp = get_current_timestamp();
+    // Use deterministic timestamp if enabled (replayed orders keep the
+    // sequence and timestamp of their event)
+    if (!replaying_) {
+        if (deterministic_mode_ && event_store_) {
+            SequenceID seq = event_store_->get_latest_sequence() + 1;
+            order->sequence_id = seq;
+            order->timestamp = DeterministicCalculator::sequence_to_timestamp(seq);
+        } else {
+            order->timestamp = get_current_timestamp();
+        }
     }
     
     // Emit order placed event
@@ -101,12 +194,14 @@ bool MatchingEngineEventSourcing::cancel_order_es(OrderID order_id, UserID user_
     
     // Emit cancellation event
     if (event_publisher_) {
-        emit_order_cancelled_event(order_id, user_id, old_status, OrderStatus::CANCELLED);
+        emit_order_cancelled_event(order_id, user_id, old_status, OrderStatus::CANCELLED,
+                                   order->instrument_id);
     }
     
     if (order_update_callback_) {
         order_update_callback_(order);
     }
+    release_if_owned(order);
     
     return true;
 }
@@ -116,44 +211,550 @@ bool MatchingEngineEventSourcing::replay_events(SequenceID from, SequenceID to)
         return false;
     }
     
-    // Clear current state by resetting orderbook
-    // Note: This is a simplified replay - in production, we'd properly reset all state
-    // OrderBook doesn't support copy assignment, so we need to clear orders manually
-    // For now, we'll just replay events which will rebuild the state
-    
-    // Replay events
+    // Replay applies events on top of the current state (empty, or a
+    // snapshot's); matching is deterministic so the same trades recur
     return event_store_->replay_events(from, to, [this](const Event& event) -> bool {
-        switch (event.type) {
-            case EventType::ORDER_PLACED: {
-                // Reconstruct order from event
-                auto order = std::make_unique<Order>(
-                    event.data.order_placed.order_id,
-                    event.data.order_placed.user_id,
-                    event.instrument_id,
-                    event.data.order_placed.side,
-                    event.data.order_placed.price,
-                    event.data.order_placed.quantity,
-                    event.data.order_placed.order_type
-                );
-                order->sequence_id = event.sequence_id;
-                order->timestamp = event.event_timestamp;
-                
-                // Process order (this will match and emit events, but we're replaying)
-                // For replay, we should skip event emission
-                process_order_es(order.release());
+        return apply_event(event);
+    });
+}
+
+bool MatchingEngineEventSourcing::apply_event(const Event& event) {
+    replaying_ = true;
+    switch (event.type) {
+        case EventType::ORDER_PLACED: {
+            if (event.instrument_id != instrument_id_) {
+                break;  // Another engine's instrument
+            }
+            // Reconstruct order from event
+            auto order = std::make_unique<Order>(
+                event.data.order_placed.order_id,
+                event.data.order_placed.user_id,
+                event.instrument_id,
+                event.data.order_placed.side,
+                event.data.order_placed.price,
+                event.data.order_placed.quantity,
+                event.data.order_placed.order_type
+            );
+            order->sequence_id = event.sequence_id;
+            order->timestamp = event.event_timestamp;
+            
+            process_order_es(order.get());
+            
+            // Keep it if it came to rest in the book
+            const OrderBookSide& side = order->is_buy() ? orderbook_.bids() : orderbook_.asks();
+            if (side.find_order(order->order_id) == order.get()) {
+                adopt_order(std::move(order));
+            }
+            break;
+        }
+        case EventType::ORDER_CANCELLED: {
+            if (event.instrument_id != 0 && event.instrument_id != instrument_id_) {
                 break;
             }
-            case EventType::ORDER_CANCELLED: {
-                cancel_order_es(event.data.order_cancelled.order_id,
-                               event.data.order_cancelled.user_id);
+            cancel_order_es(event.data.order_cancelled.order_id,
+                           event.data.order_cancelled.user_id);
+            break;
+        }
+        default:
+            // Other events are side effects of order processing
+            break;
+    }
+    replaying_ = false;
+    return true;
+}
+
+bool MatchingEngineEventSourcing::replay_parallel(
+        const std::vector<MatchingEngineEventSourcing*>& engines,
+        SequenceID from, SequenceID to) {
+    return replay_engines(engines, from, to, std::vector<SequenceID>(engines.size(), 0));
+}
+
+bool MatchingEngineEventSourcing::create_snapshot(const std::string& snapshot_path) {
+    if (!event_store_) {
+        return false;
+    }
+    
+    // The snapshot must never be ahead of the durable log
+    event_store_->flush();
+    SequenceID sequence = event_store_->get_latest_sequence();
+    return event_store_->create_snapshot(sequence, snapshot_path, serialize_state());
+}
+
+bool MatchingEngineEventSourcing::create_snapshot() {
+    if (!event_store_ || snapshot_running_) {
+        return false;
+    }
+    if (snapshot_thread_.joinable()) {
+        snapshot_thread_.join();
+    }
+    
+    std::error_code ec;
+    std::filesystem::create_directories(snapshot_dir(), ec);
+    std::string path = next_snapshot_path();
+    
+    if (snapshot_mode_ == SnapshotMode::FORK) {
+        return fork_snapshot(path);
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    bool ok = create_snapshot(path);
+    record_snapshot_pause(start);
+    if (ok) {
+        prune_snapshots();
+    }
+    return ok;
+}
+
+bool MatchingEngineEventSourcing::fork_snapshot(const std::string& path) {
+    // The matcher only stops to pick the sequence point and fork; the
+    // child sees the engine exactly as of that sequence
+    auto start = std::chrono::steady_clock::now();
+    SequenceID sequence = event_store_->get_latest_sequence();
+    std::string pending = path + kPendingSuffix;
+    
+    pid_t pid = ::fork();
+    if (pid == 0) {
+        // Child: only this thread exists here, so no logging (its lock may
+        // have been held by another thread at fork time) and no unwinding
+        std::string buffer = EventStore::encode_snapshot(sequence, serialize_state());
+        int fd = ::open(pending.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        size_t written = 0;
+        while (fd >= 0 && written < buffer.size()) {
+            ssize_t n = ::write(fd, buffer.data() + written, buffer.size() - written);
+            if (n < 0) {
+                if (errno == EINTR) continue;
                 break;
             }
-            default:
-                // Other events are side effects of order processing
+            written += static_cast<size_t>(n);
+        }
+        bool ok = fd >= 0 && written == buffer.size() && ::fdatasync(fd) == 0;
+        _exit(ok ? 0 : 1);
+    }
+    record_snapshot_pause(start);
+    
+    if (pid < 0) {
+        LOG_ERROR("Snapshot fork failed: " + std::string(strerror(errno)));
+        return false;
+    }
+    
+    snapshot_running_ = true;
+    snapshot_published_ = false;
+    snapshot_thread_ = std::thread([this, pid, path, pending]() {
+        int status = 0;
+        while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+        }
+        bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        
+        // Publish only once the log is durable up to the snapshot
+        if (ok) {
+            event_store_->flush();
+            ok = ::rename(pending.c_str(), path.c_str()) == 0;
+        }
+        if (ok) {
+            sync_directory(snapshot_dir());
+            prune_snapshots();
+        } else {
+            LOG_ERROR("Background snapshot failed: " + path);
+            ::unlink(pending.c_str());
+        }
+        snapshot_published_ = ok;
+        snapshot_running_ = false;
+    });
+    return true;
+}
+
+bool MatchingEngineEventSourcing::wait_for_snapshot() {
+    if (snapshot_thread_.joinable()) {
+        snapshot_thread_.join();
+    }
+    return snapshot_published_;
+}
+
+void MatchingEngineEventSourcing::record_snapshot_pause(std::chrono::steady_clock::time_point start) {
+    auto pause = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    last_snapshot_pause_us_ = static_cast<uint64_t>(pause);
+    Metrics::getInstance().recordHistogram("snapshot_pause_us", static_cast<double>(pause));
+}
+
+std::string MatchingEngineEventSourcing::next_snapshot_path() const {
+    char name[32];
+    snprintf(name, sizeof(name), "%020llu",
+             static_cast<unsigned long long>(event_store_->get_latest_sequence()));
+    return snapshot_dir() + "/" + name + kSnapshotSuffix;
+}
+
+void MatchingEngineEventSourcing::prune_snapshots() const {
+    // Zero-padded names sort by sequence; drop all but the newest few
+    std::vector<std::string> snapshots;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(snapshot_dir(), ec)) {
+        if (entry.path().extension() == kSnapshotSuffix) {
+            snapshots.push_back(entry.path().string());
+        }
+    }
+    std::sort(snapshots.begin(), snapshots.end());
+    for (size_t i = 0; i + kSnapshotsRetained < snapshots.size(); ++i) {
+        std::filesystem::remove(snapshots[i], ec);
+    }
+}
+
+bool MatchingEngineEventSourcing::load_snapshot(const std::string& snapshot_path,
+                                                SequenceID& sequence) {
+    std::string state;
+    if (!EventStore::load_snapshot(snapshot_path, sequence, state)) {
+        return false;
+    }
+    return restore_state(state);
+}
+
+bool MatchingEngineEventSourcing::recover() {
+    if (!event_store_) {
+        return false;
+    }
+    
+    // Retention may have removed the events before the log's first
+    SequenceID sequence = 0;
+    load_latest_snapshot(sequence);
+    if (event_store_->first_sequence() > sequence + 1) {
+        LOG_ERROR("Event log starts after the newest snapshot; cannot recover");
+        return false;
+    }
+    if (!replay_events(sequence + 1)) {
+        return false;
+    }
+    applied_sequence_ = std::max(sequence, event_store_->get_latest_sequence());
+    return true;
+}
+
+bool MatchingEngineEventSourcing::start_standby(const std::string& data_dir) {
+    if (event_store_ || standby_thread_.joinable()) {
+        LOG_ERROR("Standby needs an engine without an event store");
+        return false;
+    }
+    
+    // The store follows the log with its indexes kept current, so
+    // promotion does not have to rebuild them
+    owned_event_store_ = std::make_unique<EventStore>();
+    if (!owned_event_store_->open_follower(data_dir)) {
+        owned_event_store_.reset();
+        return false;
+    }
+    standby_dir_ = data_dir;
+    
+    // The store starts at its index checkpoint, which may be behind or
+    // ahead of the newest snapshot
+    SequenceID sequence = 0;
+    load_latest_snapshot(sequence);
+    EventStore& store = *owned_event_store_;
+    if (store.get_latest_sequence() > sequence) {
+        if (store.first_sequence() > sequence + 1) {
+            LOG_ERROR("Event log starts after the newest snapshot; cannot start standby");
+            owned_event_store_.reset();
+            return false;
+        }
+        store.replay_events(sequence + 1, store.get_latest_sequence(),
+                            [this](const Event& event) { return apply_event(event); });
+    }
+    applied_sequence_ = std::max(sequence, store.get_latest_sequence());
+    
+    standby_stop_ = false;
+    standby_draining_ = false;
+    standby_running_ = true;
+    standby_thread_ = std::thread([this]() { standby_loop(); });
+    LOG_INFO("Standby following " + data_dir + " from sequence " +
+             std::to_string(applied_sequence_.load()));
+    return true;
+}
+
+void MatchingEngineEventSourcing::standby_loop() {
+    EventStore& store = *owned_event_store_;
+    Event event;
+    auto apply = [&](const EventView& view) {
+        SequenceID sequence = view.sequence_id();
+        if (sequence <= applied_sequence_.load(std::memory_order_relaxed)) {
+            return;   // Covered by the snapshot
+        }
+        
+        // Only orders of this instrument change the book; the rest is
+        // skipped without decoding
+        bool placed = view.type() == EventType::ORDER_PLACED &&
+                      view.instrument_id() == instrument_id_;
+        bool cancelled = view.type() == EventType::ORDER_CANCELLED &&
+                         (view.instrument_id() == 0 || view.instrument_id() == instrument_id_);
+        if ((placed || cancelled) && view.decode(event)) {
+            apply_event(event);
+        }
+        applied_sequence_.store(sequence, std::memory_order_release);
+    };
+    
+    while (!standby_stop_.load(std::memory_order_relaxed)) {
+        // Sampled before reading, so a promotion sees everything logged
+        // before it asked
+        bool draining = standby_draining_.load(std::memory_order_acquire);
+        if (store.follow(apply, kStandbyBatch) == 0) {
+            if (draining) {
                 break;
+            }
+            std::this_thread::sleep_for(kStandbyPollInterval);
+        }
+    }
+}
+
+SequenceID MatchingEngineEventSourcing::standby_lag() const {
+    SequenceID applied = applied_sequence();
+    SparseIndexEntry entry;
+    if (standby_dir_.empty() || !EventStore::last_index_entry(standby_dir_, entry) ||
+        entry.sequence <= applied) {
+        return 0;
+    }
+    return entry.sequence - applied;
+}
+
+bool MatchingEngineEventSourcing::promote(EventStore* store) {
+    if (!standby_thread_.joinable()) {
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    
+    // Drain what the primary logged, then take over the log
+    standby_draining_ = true;
+    standby_thread_.join();
+    standby_running_ = false;
+    
+    if (store) {
+        owned_event_store_.reset();
+        event_store_ = store;
+    } else {
+        if (!owned_event_store_->take_over()) {
+            LOG_ERROR("Promotion failed: cannot open event log in " + standby_dir_);
+            return false;
+        }
+        event_store_ = owned_event_store_.get();
+    }
+    
+    // Taking over may have found records the standby had not seen yet
+    SequenceID applied = applied_sequence_;
+    if (event_store_->get_latest_sequence() > applied && !replay_events(applied + 1)) {
+        return false;
+    }
+    applied_sequence_ = std::max(applied, event_store_->get_latest_sequence());
+    event_publisher_ = std::make_unique<EventPublisher>(event_store_);
+    
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    Metrics::getInstance().recordHistogram("standby_promote_us", static_cast<double>(elapsed));
+    LOG_INFO("Standby promoted at sequence " + std::to_string(applied_sequence_.load()) +
+             " in " + std::to_string(elapsed) + " us");
+    return true;
+}
+
+void MatchingEngineEventSourcing::stop_standby() {
+    if (standby_thread_.joinable()) {
+        standby_stop_ = true;
+        standby_thread_.join();
+    }
+    standby_running_ = false;
+}
+
+bool MatchingEngineEventSourcing::recover_parallel(
+        const std::vector<MatchingEngineEventSourcing*>& engines) {
+    if (engines.empty()) {
+        return true;
+    }
+    
+    // Replay from the oldest snapshot; engines skip what theirs covers
+    std::vector<SequenceID> applied(engines.size(), 0);
+    SequenceID from = UINT64_MAX;
+    for (size_t i = 0; i < engines.size(); ++i) {
+        if (!engines[i]->event_store_) {
+            return false;
+        }
+        engines[i]->load_latest_snapshot(applied[i]);
+        if (engines[i]->event_store_->first_sequence() > applied[i] + 1) {
+            LOG_ERROR("Event log starts after the newest snapshot; cannot recover");
+            return false;
         }
+        from = std::min(from, applied[i]);
+    }
+    if (!replay_engines(engines, from + 1, UINT64_MAX, applied)) {
+        return false;
+    }
+    for (size_t i = 0; i < engines.size(); ++i) {
+        engines[i]->applied_sequence_ =
+            std::max(applied[i], engines[i]->event_store_->get_latest_sequence());
+    }
+    return true;
+}
+
+bool MatchingEngineEventSourcing::replay_engines(
+        const std::vector<MatchingEngineEventSourcing*>& engines,
+        SequenceID from, SequenceID to, const std::vector<SequenceID>& applied) {
+    if (engines.empty()) {
         return true;
+    }
+    EventStore* store = engines.front()->event_store_;
+    std::unordered_map<InstrumentID, size_t> engine_of;
+    for (size_t i = 0; i < engines.size(); ++i) {
+        if (!engines[i]->event_store_ || engines[i]->event_store_ != store) {
+            LOG_ERROR("Parallel replay needs engines sharing one event store");
+            return false;
+        }
+        engine_of[engines[i]->instrument_id_] = i;
+    }
+    
+    // Engines are spread over at most one worker per core; a worker
+    // always serves the same engines, so each sees its events in order
+    size_t partitions = std::min<size_t>(engines.size(),
+                                         std::max(1u, std::thread::hardware_concurrency()));
+    auto partition_of = [&](const Event& event) -> size_t {
+        if (event.type != EventType::ORDER_PLACED && event.type != EventType::ORDER_CANCELLED) {
+            return EventStore::kReplaySkip;
+        }
+        if (event.instrument_id == 0) {
+            return EventStore::kReplayBarrier;
+        }
+        auto it = engine_of.find(event.instrument_id);
+        return it == engine_of.end() ? EventStore::kReplaySkip : it->second % partitions;
+    };
+    auto handler = [&](size_t partition, const Event& event) -> bool {
+        if (partition == EventStore::kReplayBarrier) {
+            for (size_t i = 0; i < engines.size(); ++i) {
+                if (event.sequence_id > applied[i] && !engines[i]->apply_event(event)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        size_t i = engine_of.find(event.instrument_id)->second;
+        return event.sequence_id <= applied[i] || engines[i]->apply_event(event);
+    };
+    return store->replay_events_parallel(from, to, partitions, partition_of, handler);
+}
+
+bool MatchingEngineEventSourcing::load_latest_snapshot(SequenceID& sequence) {
+    std::vector<std::string> snapshots;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(snapshot_dir(), ec)) {
+        if (entry.path().extension() == kSnapshotSuffix) {
+            snapshots.push_back(entry.path().string());
+        }
+    }
+    std::sort(snapshots.rbegin(), snapshots.rend());
+    
+    // Newest valid snapshot wins; a torn or corrupt one falls back to older
+    for (const auto& path : snapshots) {
+        if (load_snapshot(path, sequence)) {
+            LOG_INFO("Recovering from snapshot " + path);
+            return true;
+        }
+        LOG_WARN("Skipping unusable snapshot " + path);
+    }
+    
+    clear_state();
+    sequence = 0;
+    return false;
+}
+
+std::string MatchingEngineEventSourcing::serialize_state() const {
+    std::vector<SnapshotOrder> bids;
+    std::vector<SnapshotOrder> asks;
+    bids.reserve(orderbook_.bids().size());
+    asks.reserve(orderbook_.asks().size());
+    orderbook_.bids().for_each_order([&bids](const Order* order) {
+        bids.push_back(to_snapshot(*order));
+    });
+    orderbook_.asks().for_each_order([&asks](const Order* order) {
+        asks.push_back(to_snapshot(*order));
     });
+    
+    SnapshotStateHeader header;
+    header.magic = kStateMagic;
+    header.version = kStateVersion;
+    header.instrument_id = instrument_id_;
+    header.trade_sequence = trade_sequence_;
+    header.total_trades = total_trades_;
+    header.total_volume = total_volume_;
+    header.bid_count = bids.size();
+    header.ask_count = asks.size();
+    
+    std::string state;
+    state.reserve(sizeof(header) + (bids.size() + asks.size()) * sizeof(SnapshotOrder));
+    state.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    state.append(reinterpret_cast<const char*>(bids.data()), bids.size() * sizeof(SnapshotOrder));
+    state.append(reinterpret_cast<const char*>(asks.data()), asks.size() * sizeof(SnapshotOrder));
+    return state;
+}
+
+bool MatchingEngineEventSourcing::restore_state(const std::string& state) {
+    SnapshotStateHeader header;
+    if (state.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, state.data(), sizeof(header));
+    if (header.magic != kStateMagic || header.version != kStateVersion ||
+        header.instrument_id != instrument_id_ ||
+        header.bid_count + header.ask_count !=
+            (state.size() - sizeof(header)) / sizeof(SnapshotOrder) ||
+        (state.size() - sizeof(header)) % sizeof(SnapshotOrder) != 0) {
+        LOG_WARN("Snapshot state does not match instrument " + std::to_string(instrument_id_));
+        return false;
+    }
+    
+    clear_state();
+    trade_sequence_ = header.trade_sequence;
+    total_trades_ = header.total_trades;
+    total_volume_ = header.total_volume;
+    
+    // Records are in priority order, so appending to each level restores
+    // time priority
+    const char* in = state.data() + sizeof(header);
+    for (uint64_t i = 0; i < header.bid_count + header.ask_count; ++i) {
+        SnapshotOrder record;
+        memcpy(&record, in, sizeof(record));
+        in += sizeof(record);
+        
+        auto order = from_snapshot(record, instrument_id_);
+        if (orderbook_.insert_order(order.get())) {
+            adopt_order(std::move(order));
+        }
+    }
+    return true;
+}
+
+void MatchingEngineEventSourcing::clear_state() {
+    std::vector<Order*> resting;
+    auto collect = [&resting](const Order* order) {
+        resting.push_back(const_cast<Order*>(order));
+    };
+    orderbook_.bids().for_each_order(collect);
+    orderbook_.asks().for_each_order(collect);
+    for (Order* order : resting) {
+        orderbook_.remove_order(order);
+    }
+    orders_.clear();
+    user_orders_.clear();
+    trade_sequence_ = 0;
+    total_trades_ = 0;
+    total_volume_ = 0;
+}
+
+std::string MatchingEngineEventSourcing::snapshot_dir() const {
+    // Per instrument, so engines sharing a store keep separate snapshots
+    const std::string& data_dir = event_store_ ? event_store_->data_dir() : standby_dir_;
+    return data_dir + "/snapshots/" + std::to_string(instrument_id_);
+}
+
+void MatchingEngineEventSourcing::adopt_order(std::unique_ptr<Order> order) {
+    user_orders_[order->user_id].push_back(order->order_id);
+    orders_[order->order_id] = std::move(order);
+}
+
+void MatchingEngineEventSourcing::release_if_owned(Order* order) {
+    auto it = orders_.find(order->order_id);
+    if (it != orders_.end() && it->second.get() == order) {
+        remove_order_from_book(order);
+    }
 }
 
 std::vector<Trade> MatchingEngineEventSourcing::match_order_deterministic(Order* order) {
@@ -218,7 +819,7 @@ std::vector<Trade> MatchingEngineEventSourcing::match_order_deterministic(Order*
         trade.instrument_id = order->instrument_id;
         trade.price = match_price;
         trade.quantity = actual_qty;
-        trade.timestamp = deterministic_mode_ ? 
+        trade.timestamp = (event_store_ && deterministic_mode_) ? 
             DeterministicCalculator::sequence_to_timestamp(event_store_->get_latest_sequence() + 1) :
             get_current_timestamp();
         trade.sequence_id = (event_store_ && deterministic_mode_) ? 
@@ -250,6 +851,7 @@ std::vector<Trade> MatchingEngineEventSourcing::match_order_deterministic(Order*
             if (order_update_callback_) {
                 order_update_callback_(resting_order);
             }
+            release_if_owned(resting_order);
             if (opposite_side->empty()) {
                 break;
             }
@@ -287,34 +889,36 @@ Quantity MatchingEngineEventSourcing::get_trade_quantity_deterministic(const Ord
 }
 
 void MatchingEngineEventSourcing::emit_order_placed_event(const Order& order) {
-    if (event_publisher_) {
+    if (event_publisher_ && !replaying_) {
         event_publisher_->publish_order_placed(order);
     }
 }
 
 void MatchingEngineEventSourcing::emit_order_matched_event(OrderID taker_id, OrderID maker_id,
                                                             Price price, Quantity quantity) {
-    if (event_publisher_) {
+    if (event_publisher_ && !replaying_) {
         event_publisher_->publish_order_matched(taker_id, maker_id, price, quantity);
     }
 }
 
 void MatchingEngineEventSourcing::emit_order_cancelled_event(OrderID order_id, UserID user_id,
-                                                             OrderStatus old_status, OrderStatus new_status) {
-    if (event_publisher_) {
-        event_publisher_->publish_order_cancelled(order_id, user_id, old_status, new_status);
+                                                             OrderStatus old_status, OrderStatus new_status,
+                                                             InstrumentID instrument_id) {
+    if (event_publisher_ && !replaying_) {
+        event_publisher_->publish_order_cancelled(order_id, user_id, old_status, new_status,
+                                                  instrument_id);
     }
 }
 
 void MatchingEngineEventSourcing::emit_trade_executed_event(const Trade& trade) {
-    if (event_publisher_) {
+    if (event_publisher_ && !replaying_) {
         event_publisher_->publish_trade_executed(trade);
     }
 }
 
 void MatchingEngineEventSourcing::emit_order_rejected_event(OrderID order_id, UserID user_id,
                                                              const std::string& reason) {
-    if (event_publisher_) {
+    if (event_publisher_ && !replaying_) {
         event_publisher_->publish_order_rejected(order_id, user_id, reason);
     }
 }
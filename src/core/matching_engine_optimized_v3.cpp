@@ -1,5 +1,6 @@
 #include "core/matching_engine_optimized_v3.h"
 #include "core/matching_engine_event_sourcing.h"
+#include "core/logger.h"
 #include <algorithm>
 #include <chrono>
 
@@ -52,12 +53,19 @@ void MatchingEngineOptimizedV3::stop() {
     
     running_ = false;
     
-    // 刷新所有待持久化数据
-    {
+    // 刷新所有待持久化数据：worker仍在运行，重试直到积压全部入队
+    if (async_persistence_) {
         std::lock_guard<std::mutex> lock(batch_mutex_);
-        if (!trade_batch_.empty() && async_persistence_) {
-            async_persistence_->persistBatchAsync(trade_batch_);
-            trade_batch_.clear();
+        int stalled = 0;
+        size_t pending = trade_batch_.size();
+        while (!flushPendingTrades()) {
+            stalled = trade_batch_.size() < pending ? 0 : stalled + 1;
+            pending = trade_batch_.size();
+            if (stalled >= STOP_FLUSH_RETRIES) {
+                LOG_ERROR("MatchingEngineOptimizedV3: " + std::to_string(pending) +
+                          " trades could not be queued for persistence on stop");
+                break;
+            }
         }
     }
     
@@ -72,6 +80,14 @@ std::vector<Trade> MatchingEngineOptimizedV3::process_order_es(Order* order) {
         return {};
     }
     
+    // 背压：持久化跟不上时拒绝新订单，而不是丢弃已成交的交易
+    if (async_persistence_ && !admitOrder()) {
+        order->status = OrderStatus::REJECTED;
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.orders_rejected++;
+        return {};
+    }
+    
     auto start_time = std::chrono::high_resolution_clock::now();
     
     // 使用父类方法处理订单
@@ -118,9 +134,10 @@ std::vector<Trade> MatchingEngineOptimizedV3::processOrderBatch(const std::vecto
     auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
         end_time - start_time).count();
     
-    // 批量持久化
+    // 交易已由process_order_es放入积压，这里提交不足一批的剩余部分
     if (!all_trades.empty() && async_persistence_) {
-        async_persistence_->persistBatchAsync(all_trades);
+        std::lock_guard<std::mutex> lock(batch_mutex_);
+        flushPendingTrades();
     }
     
     return all_trades;
@@ -135,11 +152,29 @@ void MatchingEngineOptimizedV3::persistTradesBatch(const std::vector<Trade>& tra
     
     trade_batch_.insert(trade_batch_.end(), trades.begin(), trades.end());
     
-    // 批量达到阈值，立即持久化
+    // 批量达到阈值，立即持久化；未入队的部分留在积压中下次重试
     if (trade_batch_.size() >= BATCH_SIZE) {
-        async_persistence_->persistBatchAsync(trade_batch_);
-        trade_batch_.clear();
+        flushPendingTrades();
+    }
+}
+
+bool MatchingEngineOptimizedV3::flushPendingTrades() {
+    if (trade_batch_.empty()) {
+        return true;
+    }
+    size_t enqueued = 0;
+    bool ok = async_persistence_->persistBatchAsync(trade_batch_.data(), trade_batch_.size(), enqueued);
+    trade_batch_.erase(trade_batch_.begin(), trade_batch_.begin() + enqueued);
+    return ok;
+}
+
+bool MatchingEngineOptimizedV3::admitOrder() {
+    std::lock_guard<std::mutex> lock(batch_mutex_);
+    if (trade_batch_.size() < max_pending_trades_) {
+        return true;
     }
+    flushPendingTrades();
+    return trade_batch_.size() < max_pending_trades_;
 }
 
 Order* MatchingEngineOptimizedV3::allocateOrder() {
@@ -156,6 +191,8 @@ MatchingEngineOptimizedV3::Statistics MatchingEngineOptimizedV3::getStatistics()
     
     if (async_persistence_) {
         stats.persistence_stats = async_persistence_->getStatistics();
+        std::lock_guard<std::mutex> batch_lock(batch_mutex_);
+        stats.pending_trades = trade_batch_.size();
     }
     
     return stats;
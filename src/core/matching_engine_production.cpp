@@ -54,9 +54,17 @@ bool ProductionMatchingEngine::initialize(const std::string& config_file) {
         std::string db_path = config.getString(ConfigKeys::DB_PATH, "./data");
         size_t buffer_size = config.getInt("persistence.buffer_size", 10000);
         size_t flush_interval = config.getInt("persistence.flush_interval_ms", 100);
+        PersistenceLogFormat log_format = config.getString("persistence.log_format", "text") == "binary"
+            ? PersistenceLogFormat::BINARY : PersistenceLogFormat::TEXT;
+        PersistenceOverflowConfig overflow;
+        if (!parsePersistenceOverflowPolicy(config.getString("persistence.overflow_policy", "spin"), overflow.policy)) {
+            LOG_WARN("Unknown persistence.overflow_policy, using spin");
+        }
+        overflow.spin_limit_us = config.getInt("persistence.spin_limit_us", 50);
+        overflow.reject_watermark = config.getDouble("persistence.reject_watermark", 0.75);
         
         optimized_persistence_ = std::make_unique<OptimizedPersistenceManager>();
-        if (!optimized_persistence_->initialize(db_path, buffer_size, flush_interval)) {
+        if (!optimized_persistence_->initialize(db_path, buffer_size, flush_interval, log_format, overflow)) {
             LOG_ERROR("Failed to initialize optimized persistence, falling back to legacy");
             // Fallback to legacy persistence
             persistence_ = std::make_unique<PersistenceManager>();
@@ -116,6 +124,12 @@ std::vector<Trade> ProductionMatchingEngine::process_order_production(Order* ord
             throw OrderRejectedException("Position limit exceeded");
         }
         
+        // Persistence backpressure (overflow policy REJECT)
+        if (optimized_persistence_ && !optimized_persistence_->acceptingOrders()) {
+            Metrics::getInstance().incrementCounter("orders_rejected_persistence_backlog");
+            throw OrderRejectedException("Persistence backlog");
+        }
+        
         // Process order
         auto trades = OptimizedMatchingEngine::process_order(order);
         
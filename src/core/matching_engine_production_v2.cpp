@@ -58,9 +58,19 @@ bool ProductionMatchingEngineV2::initialize(const std::string& config_file) {
         std::string db_path = config.getString(ConfigKeys::DB_PATH, "./data");
         size_t buffer_size = config.getInt("persistence.buffer_size", 50000);  // Larger buffer
         size_t flush_interval = config.getInt("persistence.flush_interval_ms", 500);  // Less frequent
+        PersistenceLogFormat log_format = config.getString("persistence.log_format", "text") == "binary"
+            ? PersistenceLogFormat::BINARY : PersistenceLogFormat::TEXT;
+        PersistenceOverflowConfig overflow;
+        if (!parsePersistenceOverflowPolicy(config.getString("persistence.overflow_policy", "spin"), overflow.policy)) {
+            LOG_WARN("Unknown persistence.overflow_policy, using spin");
+        }
+        overflow.spin_limit_us = config.getInt("persistence.spin_limit_us", 50);
+        overflow.reject_watermark = config.getDouble("persistence.reject_watermark", 0.75);
+        persistence_overflow_config_ = overflow;
+        persistence_overflow_limit_ = std::max<size_t>(1, config.getInt("persistence.overflow_limit", 64 * 1024));
         
         persistence_ = std::make_unique<OptimizedPersistenceManager>();
-        if (persistence_->initialize(db_path, buffer_size, flush_interval)) {
+        if (persistence_->initialize(db_path, buffer_size, flush_interval, log_format, overflow)) {
             LOG_INFO("Optimized async persistence initialized");
             
             // Start persistence worker thread
@@ -117,6 +127,12 @@ std::vector<Trade> ProductionMatchingEngineV2::process_order_production_v2(Order
             throw OrderRejectedException("Rate limit exceeded");
         }
         
+        // Persistence backpressure (overflow policy REJECT)
+        if (enable_async_persistence_ && persistence_ && !persistenceAccepting()) {
+            orders_rejected_backpressure_.fetch_add(1, std::memory_order_relaxed);
+            throw OrderRejectedException("Persistence backlog");
+        }
+        
         // Cached balance check (optional, can be disabled for max performance)
         if (enable_validation_cache_) {
             if (!checkBalanceCached(order->user_id, order->price, order->quantity)) {
@@ -208,30 +224,96 @@ void ProductionMatchingEngineV2::enqueuePersistence(const Order& order, const st
     task.trades = trades;
     task.timestamp = get_current_timestamp();
     
-    // Non-blocking enqueue
-    if (!persistence_queue_.push(task)) {
-        // Queue full, log warning (but don't block!)
-        LOG_WARN("Persistence queue full, dropping task");
+    // Once tasks overflow, later ones queue behind them until the worker has
+    // drained the overflow, so persistence order is kept
+    if (persistence_overflow_size_.load(std::memory_order_acquire) == 0) {
+        if (persistence_queue_.push(task)) {
+            return;
+        }
+        
+        if (persistence_overflow_config_.policy == PersistenceOverflowPolicy::SPIN) {
+            persistence_spin_waits_.fetch_add(1, std::memory_order_relaxed);
+            auto deadline = std::chrono::steady_clock::now() +
+                            std::chrono::microseconds(persistence_overflow_config_.spin_limit_us);
+            do {
+                std::this_thread::yield();
+                if (persistence_queue_.push(task)) {
+                    return;
+                }
+            } while (std::chrono::steady_clock::now() < deadline);
+        }
+    }
+    
+    // Queue full: overflow instead of dropping the task. The trades are
+    // already matched, so at the limit wait for the worker to catch up
+    // (persistenceAccepting() turns new orders away meanwhile).
+    std::unique_lock<std::mutex> lock(persistence_overflow_mutex_);
+    if (persistence_overflow_.size() >= persistence_overflow_limit_) {
+        persistence_overflow_waits_.fetch_add(1, std::memory_order_relaxed);
+        persistence_overflow_cv_.wait(lock, [this] {
+            return persistence_overflow_.size() < persistence_overflow_limit_ ||
+                   !persistence_running_.load(std::memory_order_relaxed);
+        });
+    }
+    persistence_overflow_.push_back(std::move(task));
+    persistence_overflow_size_.store(persistence_overflow_.size(), std::memory_order_release);
+    persistence_tasks_overflowed_.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool ProductionMatchingEngineV2::persistenceAccepting() const {
+    // A full overflow list stops new orders under every policy
+    size_t overflow = persistence_overflow_size_.load(std::memory_order_relaxed);
+    if (overflow >= persistence_overflow_limit_) {
+        return false;
+    }
+    if (persistence_overflow_config_.policy != PersistenceOverflowPolicy::REJECT) {
+        return true;
+    }
+    if (overflow > 0) {
+        return false;
+    }
+    size_t watermark = static_cast<size_t>(
+        persistence_overflow_config_.reject_watermark * persistence_queue_.capacity());
+    if (persistence_queue_.size() >= watermark) {
+        return false;
+    }
+    return persistence_->acceptingOrders();
+}
+
+void ProductionMatchingEngineV2::persistTask(const PersistenceTask& task) {
+    // Batch processing for efficiency
+    try {
+        if (persistence_) {
+            for (const auto& trade : task.trades) {
+                persistence_->logTrade(trade);
+            }
+            persistence_->logOrder(task.order, "PROCESSED");
+        }
+    } catch (const std::exception& e) {
+        LOG_ERROR("Persistence error: " + std::string(e.what()));
     }
 }
 
 void ProductionMatchingEngineV2::persistenceWorker() {
     LOG_INFO("Persistence worker thread started");
     
-    while (persistence_running_.load(std::memory_order_relaxed) || persistence_queue_.size() > 0) {
+    while (persistence_running_.load(std::memory_order_relaxed) || persistence_queue_.size() > 0 ||
+           persistence_overflow_size_.load(std::memory_order_acquire) > 0) {
         PersistenceTask task;
         
         if (persistence_queue_.pop(task)) {
-            // Batch processing for efficiency
-            try {
-                if (persistence_) {
-                    for (const auto& trade : task.trades) {
-                        persistence_->logTrade(trade);
-                    }
-                    persistence_->logOrder(task.order, "PROCESSED");
-                }
-            } catch (const std::exception& e) {
-                LOG_ERROR("Persistence error: " + std::string(e.what()));
+            persistTask(task);
+        } else if (persistence_overflow_size_.load(std::memory_order_acquire) > 0) {
+            // Overflowed tasks are newer than anything that was in the queue
+            std::deque<PersistenceTask> overflow;
+            {
+                std::lock_guard<std::mutex> lock(persistence_overflow_mutex_);
+                overflow.swap(persistence_overflow_);
+                persistence_overflow_size_.store(0, std::memory_order_release);
+            }
+            persistence_overflow_cv_.notify_all();
+            for (const auto& overflowed : overflow) {
+                persistTask(overflowed);
             }
         } else {
             // Queue empty, sleep briefly
@@ -267,6 +349,18 @@ std::string ProductionMatchingEngineV2::getMetrics() const {
     ss << "orders_processed=" << orders_processed_.load(std::memory_order_relaxed) << "\n";
     ss << "orders_rejected=" << orders_rejected_.load(std::memory_order_relaxed) << "\n";
     ss << "trades_executed=" << trades_executed_.load(std::memory_order_relaxed) << "\n";
+    ss << "orders_rejected_backpressure=" << orders_rejected_backpressure_.load(std::memory_order_relaxed) << "\n";
+    ss << "persistence_queue_depth=" << persistence_queue_.size() << "\n";
+    ss << "persistence_overflow_depth=" << persistence_overflow_size_.load(std::memory_order_relaxed) << "\n";
+    ss << "persistence_tasks_overflowed=" << persistence_tasks_overflowed_.load(std::memory_order_relaxed) << "\n";
+    ss << "persistence_spin_waits=" << persistence_spin_waits_.load(std::memory_order_relaxed) << "\n";
+    ss << "persistence_overflow_waits=" << persistence_overflow_waits_.load(std::memory_order_relaxed) << "\n";
+    if (persistence_) {
+        auto stats = persistence_->getStats();
+        ss << "persistence_log_queue_depth=" << stats.trade_queue_depth + stats.order_queue_depth << "\n";
+        ss << "persistence_records_spilled=" << stats.records_spilled << "\n";
+        ss << "persistence_spill_bytes_pending=" << stats.spill_bytes_pending << "\n";
+    }
     return ss.str();
 }
 
@@ -1,5 +1,6 @@
 #include "core/matching_engine_production_v3.h"
 #include <chrono>
+#include <cmath>
 
 using namespace std::chrono;
 
@@ -24,14 +25,30 @@ bool ProductionMatchingEngineV3::initialize(const std::string& config_file, bool
     if (wal_enabled_) {
         // Initialize WAL
         std::string wal_path = "./data/wal";
+        JournalWriterConfig journal_config;
+        Config& config = Config::getInstance();
+        journal_config.backend = parse_journal_backend(
+            config.getString(ConfigKeys::JOURNAL_BACKEND, "auto"));
+        journal_config.segment_bytes =
+            static_cast<uint64_t>(config.getInt(ConfigKeys::JOURNAL_SEGMENT_MB, 64)) * 1024 * 1024;
+        journal_config.direct_io = config.getBool(ConfigKeys::JOURNAL_DIRECT_IO, true);
         try {
-            wal_ = std::make_unique<WriteAheadLog>(wal_path);
-            LOG_INFO("WAL initialized: " + wal_path);
+            wal_ = std::make_unique<WriteAheadLog>(wal_path, journal_config);
+            LOG_INFO("WAL initialized: " + wal_path + " (" + wal_->backend_name() + ")");
         } catch (const std::exception& e) {
             LOG_ERROR("Failed to initialize WAL: " + std::string(e.what()));
             return false;
         }
         
+        // Wake the flush worker whenever a group commit becomes durable
+        wal_->set_durable_listener([this](uint64_t record) {
+            {
+                std::lock_guard<std::mutex> lock(batch_mutex_);
+                notified_watermark_ = record;
+            }
+            flush_cv_.notify_one();
+        });
+        
         // Start flush worker
         flush_running_ = true;
         flush_thread_ = std::thread(&ProductionMatchingEngineV3::flush_worker, this);
@@ -45,12 +62,33 @@ bool ProductionMatchingEngineV3::initialize(const std::string& config_file, bool
 }
 
 std::vector<Trade> ProductionMatchingEngineV3::process_order_safe(Order* order) {
-    // Just process the order
-    // In a full implementation, we would add synchronization here
+    uint64_t record = 0;
+    return process_and_track(order, nullptr, record);
+}
+
+uint64_t ProductionMatchingEngineV3::process_order_durable(Order* order, DurableCallback on_durable) {
+    if (!wal_enabled_) {
+        // Nothing is journaled, so there is nothing to wait for
+        uint64_t record = 0;
+        auto trades = process_and_track(order, nullptr, record);
+        if (on_durable) {
+            on_durable(*order, trades, false);
+        }
+        return 0;
+    }
+    
+    uint64_t record = 0;
+    process_and_track(order, std::move(on_durable), record);
+    return record;
+}
+
+std::vector<Trade> ProductionMatchingEngineV3::process_and_track(Order* order, DurableCallback on_durable,
+                                                                 uint64_t& record) {
+    record = 0;
     
     // 1. Write to WAL (顺序写, ~0.5μs)
     if (wal_enabled_) {
-        if (!wal_->append(*order)) {
+        if (!wal_->append(*order, record)) {
             throw SystemException("WAL append failed");
         }
     }
@@ -58,77 +96,147 @@ std::vector<Trade> ProductionMatchingEngineV3::process_order_safe(Order* order)
     // 2. Process order using V2 (ART+SIMD, ~1.2μs)
     auto trades = ProductionMatchingEngineV2::process_order_production_v2(order);
     
-    // 3. Add to batch buffer
+    if (!wal_enabled_) {
+        return trades;
+    }
+    
+    // 3. Add to batch buffer; the flush worker group-commits it and
+    //    releases on_durable once the watermark passes the record
     {
         std::lock_guard<std::mutex> lock(batch_mutex_);
         
         BatchEntry entry;
+        entry.journal_record = record;
         entry.order = *order;
         entry.trades = trades;
         entry.timestamp = get_current_timestamp();
+        entry.on_durable = std::move(on_durable);
         
         batch_buffer_.push_back(std::move(entry));
+        if (batch_buffer_.size() >= batch_size_) {
+            flush_cv_.notify_one();
+        }
     }
     
-    // Note: In a complete implementation, we should wait for fsync here
-    // For now, we return immediately for performance testing
-    // In production, use condition variables to wait for flush_worker
-    
     return trades;
 }
 
+uint64_t ProductionMatchingEngineV3::durable_watermark() const {
+    return wal_ ? wal_->durable_record() : 0;
+}
+
 void ProductionMatchingEngineV3::flush_worker() {
     LOG_INFO("Flush worker thread started");
     
-    while (flush_running_.load(std::memory_order_relaxed)) {
-        auto flush_start = high_resolution_clock::now();
-        
+    while (true) {
         std::vector<BatchEntry> to_flush;
+        bool running = true;
+        bool buffer_empty = true;
         
-        // 1. Collect batch
+        // 1. Collect batch (woken by a full batch, a durable watermark
+        //    advance or shutdown; the timeout covers partial batches)
         {
-            std::lock_guard<std::mutex> lock(batch_mutex_);
+            std::unique_lock<std::mutex> lock(batch_mutex_);
+            flush_cv_.wait_for(lock, batch_timeout_, [this] {
+                return !flush_running_.load(std::memory_order_relaxed) ||
+                       batch_buffer_.size() >= batch_size_ ||
+                       (!awaiting_durable_.empty() &&
+                        (notified_watermark_ >= awaiting_durable_.front().journal_record || !wal_->healthy()));
+            });
             
-            if (should_flush()) {
-                to_flush = std::move(batch_buffer_);
-                batch_buffer_.clear();
+            running = flush_running_.load(std::memory_order_relaxed);
+            if (should_flush() || (!running && !batch_buffer_.empty())) {
+                to_flush.swap(batch_buffer_);
             }
+            buffer_empty = batch_buffer_.empty();
         }
         
-        // 2. Flush if needed
+        // 2. Group commit: hand the batch to the journal without waiting for
+        //    fsync; acknowledgements follow the durable watermark
         if (!to_flush.empty()) {
             try {
-                // 3. Sync WAL (fsync)
-                if (wal_enabled_) {
-                    wal_->sync();
-                }
+                uint64_t last_record = wal_->commit();
                 
-                // 4. Mark committed
-                if (wal_enabled_ && !to_flush.empty()) {
-                    wal_->mark_committed(to_flush.back().timestamp);
-                }
-                
-                auto flush_end = high_resolution_clock::now();
-                auto flush_time = duration_cast<microseconds>(flush_end - flush_start);
-                
-                // Update stats
-                flush_count_.fetch_add(1);
-                total_flush_time_us_.fetch_add(flush_time.count());
-                
-                last_flush_time_ = to_flush.back().timestamp;
+                CommitGroup group;
+                group.last_record = last_record;
+                group.orders = to_flush.size();
+                group.commit_time = get_current_timestamp();
+                group.last_timestamp = to_flush.back().timestamp;
+                commit_groups_.push_back(group);
                 
+                for (auto& entry : to_flush) {
+                    awaiting_durable_.push_back(std::move(entry));
+                }
+                awaiting_count_.store(awaiting_durable_.size(), std::memory_order_relaxed);
             } catch (const std::exception& e) {
                 LOG_ERROR("Flush failed: " + std::string(e.what()));
             }
         }
         
-        // 5. Sleep
-        std::this_thread::sleep_for(batch_timeout_);
+        if (!running && !commit_groups_.empty()) {
+            // Shutting down: wait for the last group instead of polling
+            wal_->wait_durable(commit_groups_.back().last_record);
+        }
+        
+        // 3. Release responses the watermark now covers
+        release_durable(!wal_->healthy());
+        
+        if (!running && buffer_empty && awaiting_durable_.empty()) {
+            break;
+        }
     }
     
     LOG_INFO("Flush worker thread stopped");
 }
 
+void ProductionMatchingEngineV3::release_durable(bool failed) {
+    uint64_t watermark = wal_->durable_record();
+    Timestamp now = get_current_timestamp();
+    
+    while (!commit_groups_.empty() && (failed || commit_groups_.front().last_record <= watermark)) {
+        const CommitGroup& group = commit_groups_.front();
+        if (!failed) {
+            uint64_t commit_us = static_cast<uint64_t>(now - group.commit_time) / 1000;
+            flush_count_.fetch_add(1);
+            total_flush_time_us_.fetch_add(commit_us);
+            Metrics::getInstance().recordHistogram("wal_group_commit_latency_us", static_cast<double>(commit_us));
+            Metrics::getInstance().recordHistogram("wal_group_commit_orders", static_cast<double>(group.orders));
+            wal_->mark_committed(group.last_timestamp);
+            last_flush_time_ = group.last_timestamp;
+        }
+        commit_groups_.pop_front();
+    }
+    
+    size_t released = 0;
+    while (!awaiting_durable_.empty() && (failed || awaiting_durable_.front().journal_record <= watermark)) {
+        BatchEntry& entry = awaiting_durable_.front();
+        if (!failed) {
+            uint64_t latency_us = now > entry.timestamp ? static_cast<uint64_t>(now - entry.timestamp) / 1000 : 0;
+            size_t bucket = latency_us < 2 ? 0 : static_cast<size_t>(std::log2(static_cast<double>(latency_us)));
+            durable_latency_buckets_[std::min(bucket, kDurableLatencyBuckets - 1)].fetch_add(1, std::memory_order_relaxed);
+            total_durable_latency_us_.fetch_add(latency_us, std::memory_order_relaxed);
+            acks_released_.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (entry.on_durable) {
+            try {
+                entry.on_durable(entry.order, entry.trades, !failed);
+            } catch (const std::exception& e) {
+                LOG_ERROR("Durable callback failed: " + std::string(e.what()));
+            }
+        }
+        awaiting_durable_.pop_front();
+        released++;
+    }
+    
+    if (released > 0) {
+        awaiting_count_.store(awaiting_durable_.size(), std::memory_order_relaxed);
+        auto stats = get_wal_stats();
+        Metrics::getInstance().setGauge("order_durable_latency_p50_us", stats.durable_latency_p50_us);
+        Metrics::getInstance().setGauge("order_durable_latency_p99_us", stats.durable_latency_p99_us);
+        Metrics::getInstance().setGauge("wal_durable_watermark", static_cast<double>(watermark));
+    }
+}
+
 bool ProductionMatchingEngineV3::should_flush() const {
     // Trigger condition 1: batch size
     if (batch_buffer_.size() >= batch_size_) {
@@ -192,14 +300,55 @@ ProductionMatchingEngineV3::WALStats ProductionMatchingEngineV3::get_wal_stats()
     uint64_t count = flush_count_.load();
     stats.avg_flush_time_us = count > 0 ? static_cast<double>(total_time) / count : 0.0;
     
+    stats.durable_watermark = durable_watermark();
+    stats.awaiting_durable = awaiting_count_.load(std::memory_order_relaxed);
+    stats.acks_released = acks_released_.load(std::memory_order_relaxed);
+    stats.avg_durable_latency_us = stats.acks_released > 0
+        ? static_cast<double>(total_durable_latency_us_.load(std::memory_order_relaxed)) / stats.acks_released
+        : 0.0;
+    
+    // Percentiles at bucket resolution (upper bound of the bucket)
+    std::vector<uint64_t> histogram = get_durable_latency_histogram();
+    uint64_t total = 0;
+    for (uint64_t n : histogram) {
+        total += n;
+    }
+    auto percentile = [&](double q) {
+        uint64_t target = static_cast<uint64_t>(std::ceil(q * total));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < histogram.size(); ++i) {
+            seen += histogram[i];
+            if (total > 0 && seen >= target) {
+                return static_cast<double>(uint64_t(1) << (i + 1));
+            }
+        }
+        return 0.0;
+    };
+    stats.durable_latency_p50_us = percentile(0.50);
+    stats.durable_latency_p99_us = percentile(0.99);
+    
     return stats;
 }
 
+std::vector<uint64_t> ProductionMatchingEngineV3::get_durable_latency_histogram() const {
+    std::vector<uint64_t> histogram(kDurableLatencyBuckets);
+    for (size_t i = 0; i < kDurableLatencyBuckets; ++i) {
+        histogram[i] = durable_latency_buckets_[i].load(std::memory_order_relaxed);
+    }
+    return histogram;
+}
+
 void ProductionMatchingEngineV3::shutdown() {
     if (flush_running_.exchange(false)) {
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex_);
+        }
+        flush_cv_.notify_one();
         if (flush_thread_.joinable()) {
             flush_thread_.join();
         }
+        // The listener touches members destroyed before wal_
+        wal_->set_durable_listener(nullptr);
     }
     
     ProductionMatchingEngineV2::shutdown();
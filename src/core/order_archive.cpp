@@ -0,0 +1,350 @@
+#include "core/order_archive.h"
+#include "core/journal_segment.h"
+#include "core/logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace perpetual {
+
+namespace {
+
+constexpr uint32_t kArchiveMagic = 0x4352414f;    // "OARC"
+constexpr uint32_t kIndexMagic = 0x5844494f;      // "OIDX"
+constexpr uint32_t kArchiveVersion = 1;
+constexpr uint64_t kInitialRecords = 64 * 1024;
+constexpr uint64_t kInitialSlots = 256 * 1024;
+constexpr const char* kDataFile = "/orders.dat";
+constexpr const char* kIndexFile = "/orders.idx";
+constexpr const char* kRebuildSuffix = ".rebuild";
+
+inline uint64_t slot_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    return key ^ (key >> 33);
+}
+
+size_t data_bytes(uint64_t records) {
+    return sizeof(OrderArchiveHeader) + records * sizeof(OrderArchiveRecord);
+}
+
+size_t index_bytes(uint64_t slots) {
+    return sizeof(OrderIndexHeader) + slots * sizeof(OrderIndexSlot);
+}
+
+// Map fd at length bytes, growing the file to it first
+char* map_file(int fd, size_t length) {
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        return nullptr;
+    }
+    if (static_cast<size_t>(st.st_size) < length && ::ftruncate(fd, static_cast<off_t>(length)) != 0) {
+        return nullptr;
+    }
+    void* map = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return map == MAP_FAILED ? nullptr : static_cast<char*>(map);
+}
+
+} // namespace
+
+OrderArchive::~OrderArchive() {
+    close();
+}
+
+bool OrderArchive::open(const std::string& dir) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (data_fd_ >= 0) {
+        return true;
+    }
+    dir_ = dir;
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+
+    std::string data_path = dir + kDataFile;
+    data_fd_ = ::open(data_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (data_fd_ < 0) {
+        LOG_ERROR("Failed to open " + data_path + ": " + strerror(errno));
+        return false;
+    }
+
+    // Size the mapping from what is already there
+    struct stat st;
+    ::fstat(data_fd_, &st);
+    uint64_t existing = static_cast<size_t>(st.st_size) > sizeof(OrderArchiveHeader)
+        ? (st.st_size - sizeof(OrderArchiveHeader)) / sizeof(OrderArchiveRecord) : 0;
+    if (!map_data(std::max(kInitialRecords, existing))) {
+        LOG_ERROR("Failed to map " + data_path);
+        lock.unlock();
+        close();
+        return false;
+    }
+    OrderArchiveHeader* header = data_header();
+    if (header->magic == 0) {
+        *header = OrderArchiveHeader{kArchiveMagic, kArchiveVersion,
+                                     static_cast<uint32_t>(sizeof(OrderArchiveRecord)), 0, 0};
+    } else if (header->magic != kArchiveMagic || header->version != kArchiveVersion ||
+               header->record_size != sizeof(OrderArchiveRecord) || header->count > data_capacity_) {
+        LOG_ERROR("Order archive " + data_path + " has an unknown layout");
+        lock.unlock();
+        close();
+        return false;
+    }
+
+    // The index is usable only if it covers exactly the records on disk
+    std::string index_path = dir + kIndexFile;
+    bool usable = false;
+    if (std::filesystem::exists(index_path, ec) && map_index(index_path, 0, false)) {
+        const OrderIndexHeader* index = index_header();
+        usable = index->magic == kIndexMagic && index->version == kArchiveVersion &&
+                 index->records == header->count && index_size_ == index_bytes(index->capacity);
+    }
+    if (!usable && !rebuild_index(kInitialSlots)) {
+        LOG_ERROR("Failed to build order archive index " + index_path);
+        lock.unlock();
+        close();
+        return false;
+    }
+    return true;
+}
+
+void OrderArchive::close() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (data_) {
+        ::msync(data_, data_size_, MS_SYNC);
+        ::munmap(data_, data_size_);
+        data_ = nullptr;
+    }
+    if (index_) {
+        ::msync(index_, index_size_, MS_SYNC);
+        ::munmap(index_, index_size_);
+        index_ = nullptr;
+    }
+    if (data_fd_ >= 0) {
+        ::close(data_fd_);
+        data_fd_ = -1;
+    }
+    if (index_fd_ >= 0) {
+        ::close(index_fd_);
+        index_fd_ = -1;
+    }
+}
+
+bool OrderArchive::map_data(uint64_t capacity) {
+    size_t length = data_bytes(capacity);
+    char* map = map_file(data_fd_, length);
+    if (!map) {
+        return false;
+    }
+    if (data_) {
+        ::munmap(data_, data_size_);
+    }
+    data_ = map;
+    data_size_ = length;
+    data_capacity_ = capacity;
+    return true;
+}
+
+bool OrderArchive::map_index(const std::string& path, uint64_t capacity, bool create) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0), 0644);
+    if (fd < 0) {
+        return false;
+    }
+    size_t length = index_bytes(capacity);
+    if (!create) {
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(OrderIndexHeader)) {
+            ::close(fd);
+            return false;
+        }
+        length = static_cast<size_t>(st.st_size);
+    }
+    char* map = map_file(fd, length);
+    if (!map) {
+        ::close(fd);
+        return false;
+    }
+    if (index_) {
+        ::munmap(index_, index_size_);
+        ::close(index_fd_);
+    }
+    index_fd_ = fd;
+    index_ = map;
+    index_size_ = length;
+    return true;
+}
+
+bool OrderArchive::rebuild_index(uint64_t capacity) {
+    // Built beside the live index and renamed over it, so a crash leaves
+    // either index whole
+    uint64_t count = data_header()->count;
+    while (count * 4 > capacity) {
+        capacity *= 2;
+    }
+    std::string path = dir_ + kIndexFile;
+    std::string temp = path + kRebuildSuffix;
+    char* old_index = index_;
+    size_t old_size = index_size_;
+    int old_fd = index_fd_;
+    index_ = nullptr;
+    index_fd_ = -1;
+    if (!map_index(temp, capacity, true)) {
+        index_ = old_index;
+        index_size_ = old_size;
+        index_fd_ = old_fd;
+        return false;
+    }
+    if (old_index) {
+        ::munmap(old_index, old_size);
+        ::close(old_fd);
+    }
+
+    *index_header() = OrderIndexHeader{kIndexMagic, kArchiveVersion, capacity, 0, 0};
+    const OrderArchiveRecord* record = records();
+    for (uint64_t i = 0; i < count; ++i) {
+        set_slot(record[i].view.order_id, i + 1);
+        set_slot(record[i].view.user_id | kOrderIndexUserTag, i + 1);
+    }
+    index_header()->records = count;
+    ::msync(index_, index_size_, MS_SYNC);
+    if (::rename(temp.c_str(), path.c_str()) != 0) {
+        return false;
+    }
+    sync_directory(dir_);
+    return true;
+}
+
+uint64_t OrderArchive::find_slot(uint64_t key) const {
+    const OrderIndexHeader* header = index_header();
+    const OrderIndexSlot* slot = slots();
+    uint64_t mask = header->capacity - 1;
+    for (uint64_t i = slot_hash(key) & mask, probes = 0; probes <= mask; i = (i + 1) & mask, ++probes) {
+        if (slot[i].record == 0) {
+            return 0;
+        }
+        if (slot[i].key == key) {
+            return slot[i].record;
+        }
+    }
+    return 0;
+}
+
+void OrderArchive::set_slot(uint64_t key, uint64_t record) {
+    OrderIndexHeader* header = index_header();
+    OrderIndexSlot* slot = slots();
+    uint64_t mask = header->capacity - 1;
+    uint64_t i = slot_hash(key) & mask;
+    while (slot[i].record != 0 && slot[i].key != key) {
+        i = (i + 1) & mask;
+    }
+    if (slot[i].record == 0) {
+        slot[i].key = key;
+        header->used++;
+    }
+    slot[i].record = record;
+}
+
+bool OrderArchive::put(const OrderView& view) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (data_fd_ < 0) {
+        return false;
+    }
+
+    uint64_t existing = find_slot(view.order_id);
+    if (existing != 0) {
+        records()[existing - 1].view = view;
+        return true;
+    }
+
+    OrderArchiveHeader* header = data_header();
+    if (header->count == data_capacity_) {
+        if (!map_data(data_capacity_ * 2)) {
+            LOG_ERROR("Failed to grow order archive in " + dir_);
+            return false;
+        }
+        header = data_header();
+    }
+    // Keep the index at most half full (two keys per order at worst)
+    if ((index_header()->used + 2) * 2 > index_header()->capacity &&
+        !rebuild_index(index_header()->capacity * 2)) {
+        LOG_ERROR("Failed to grow order archive index in " + dir_);
+        return false;
+    }
+
+    uint64_t user_key = view.user_id | kOrderIndexUserTag;
+    uint64_t number = header->count;
+    OrderArchiveRecord& record = records()[number];
+    record.view = view;
+    record.older = find_slot(user_key);
+    header->count = number + 1;
+
+    set_slot(view.order_id, number + 1);
+    set_slot(user_key, number + 1);
+    index_header()->records = number + 1;
+    return true;
+}
+
+bool OrderArchive::get(OrderID order_id, OrderView& view) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (data_fd_ < 0) {
+        return false;
+    }
+    uint64_t record = find_slot(order_id);
+    if (record == 0) {
+        return false;
+    }
+    view = records()[record - 1].view;
+    return true;
+}
+
+void OrderArchive::for_each_user_order(UserID user_id,
+                                       const std::function<bool(const OrderView&)>& visit) const {
+    for_each_user_order(user_id, 0, [&](uint64_t, const OrderView& view) { return visit(view); });
+}
+
+void OrderArchive::for_each_user_order(UserID user_id, uint64_t after,
+                                       const std::function<bool(uint64_t, const OrderView&)>& visit) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (data_fd_ < 0) {
+        return;
+    }
+    uint64_t record = find_slot(user_id | kOrderIndexUserTag);
+    if (after != 0) {
+        // Only a record of this user can be resumed from
+        if (after > data_header()->count || records()[after - 1].view.user_id != user_id) {
+            return;
+        }
+        record = records()[after - 1].older;
+    }
+    while (record != 0) {
+        const OrderArchiveRecord& entry = records()[record - 1];
+        if (!visit(record, entry.view)) {
+            break;
+        }
+        record = entry.older;
+    }
+}
+
+size_t OrderArchive::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return data_fd_ >= 0 ? data_header()->count : 0;
+}
+
+void OrderArchive::flush() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (data_) {
+        ::msync(data_, data_size_, MS_SYNC);
+    }
+    if (index_) {
+        ::msync(index_, index_size_, MS_SYNC);
+    }
+}
+
+} // namespace perpetual
@@ -279,6 +279,24 @@ void OrderBookSide::get_depth(size_t n, std::vector<PriceLevel>& levels) const {
     }
 }
 
+void OrderBookSide::for_each_order(const std::function<void(const Order*)>& visit) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto visit_level = [&visit](const PriceLevel& level) {
+        for (const Order* order = level.first_order; order; order = order->next_same_price) {
+            visit(order);
+        }
+    };
+    if (is_buy_) {
+        for (auto it = price_levels_.rbegin(); it != price_levels_.rend(); ++it) {
+            visit_level(it->second);
+        }
+    } else {
+        for (const auto& entry : price_levels_) {
+            visit_level(entry.second);
+        }
+    }
+}
+
 void OrderBookSide::rotate_left(Order* x) {
     Order* y = x->right;
     x->right = y->left;
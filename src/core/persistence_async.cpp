@@ -6,9 +6,55 @@
 #include <chrono>
 #include <stdexcept>
 #include <iostream>
+#include <algorithm>
 
 namespace perpetual {
 
+AsyncPersistenceManager::TradeArena::TradeArena(size_t chunks)
+    : chunks_(chunks) {
+    free_.reserve(chunks);
+    for (size_t i = chunks; i-- > 0; ) {
+        free_.push_back(static_cast<uint32_t>(i));
+    }
+}
+
+uint32_t AsyncPersistenceManager::TradeArena::store(const Trade* trades, size_t count) {
+    size_t needed = (count + CHUNK_TRADES - 1) / CHUNK_TRADES;
+    if (needed == 0) {
+        return NO_CHUNK;
+    }
+    
+    // 取出chunk并串成链（链首是最后取出的chunk）
+    uint32_t first = NO_CHUNK;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.size() < needed) {
+            return NO_CHUNK;
+        }
+        for (size_t i = 0; i < needed; ++i) {
+            uint32_t chunk = free_.back();
+            free_.pop_back();
+            chunks_[chunk].next = first;
+            first = chunk;
+        }
+    }
+    
+    for (uint32_t chunk = first; chunk != NO_CHUNK; chunk = chunks_[chunk].next) {
+        size_t n = std::min(count, CHUNK_TRADES);
+        std::copy(trades, trades + n, chunks_[chunk].trades);
+        trades += n;
+        count -= n;
+    }
+    return first;
+}
+
+void AsyncPersistenceManager::TradeArena::release(uint32_t first) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (uint32_t chunk = first; chunk != NO_CHUNK; chunk = chunks_[chunk].next) {
+        free_.push_back(chunk);
+    }
+}
+
 AsyncPersistenceManager::AsyncPersistenceManager() {
     last_flush_time_ = std::chrono::steady_clock::now();
 }
@@ -17,7 +63,8 @@ AsyncPersistenceManager::~AsyncPersistenceManager() {
     stop();
 }
 
-bool AsyncPersistenceManager::initialize(const std::string& data_dir) {
+bool AsyncPersistenceManager::initialize(const std::string& data_dir,
+                                         const JournalWriterConfig& journal_config) {
     data_dir_ = data_dir;
     std::filesystem::create_directories(data_dir_);
     
@@ -25,9 +72,9 @@ bool AsyncPersistenceManager::initialize(const std::string& data_dir) {
     trades_log_path_ = data_dir_ + "/trades.log";
     wal_path_ = data_dir_ + "/wal.log";
     
-    // 打开WAL文件（追加模式）
-    wal_file_ = std::make_unique<std::ofstream>(wal_path_, std::ios::app | std::ios::binary);
-    if (!wal_file_->is_open()) {
+    // 打开WAL日志（追加到文件末尾）
+    wal_journal_ = JournalWriter::create(journal_config);
+    if (!wal_journal_->open(wal_path_)) {
         return false;
     }
     
@@ -76,127 +123,146 @@ void AsyncPersistenceManager::stop() {
     // 最终刷新
     flush();
     
-    if (wal_file_) {
-        wal_file_->close();
+    if (wal_journal_) {
+        wal_journal_->close();
     }
 }
 
-void AsyncPersistenceManager::persistOrderAsync(const Order& order) {
+bool AsyncPersistenceManager::persistOrderAsync(const Order& order) {
     PersistItem item;
     item.type = PersistType::ORDER;
-    item.order = order;
-    
-    // 非阻塞推送
-    while (!persist_queue_.push(item)) {
-        // 队列满，等待一小段时间
-        std::this_thread::sleep_for(std::chrono::microseconds(1));
+    item.order.order_id = order.order_id;
+    item.order.user_id = order.user_id;
+    item.order.price = order.price;
+    item.order.quantity = order.quantity;
+    item.order.timestamp = order.timestamp;
+    item.order.instrument_id = order.instrument_id;
+    item.order.side = order.side;
+    item.order.order_type = order.order_type;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(ENQUEUE_TIMEOUT_US);
+    if (!enqueue(item, deadline)) {
+        reject(1);
+        return false;
     }
+    return true;
 }
 
-void AsyncPersistenceManager::persistTradeAsync(const Trade& trade) {
+bool AsyncPersistenceManager::persistTradeAsync(const Trade& trade) {
     PersistItem item;
     item.type = PersistType::TRADE;
     item.trade = trade;
-    
-    // 非阻塞推送
-    while (!persist_queue_.push(item)) {
-        std::this_thread::sleep_for(std::chrono::microseconds(1));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(ENQUEUE_TIMEOUT_US);
+    if (!enqueue(item, deadline)) {
+        reject(1);
+        return false;
     }
+    return true;
 }
 
-void AsyncPersistenceManager::persistBatchAsync(const std::vector<Trade>& trades) {
-    PersistItem item;
-    item.type = PersistType::BATCH;
-    item.batch = trades;
-    
-    // 非阻塞推送
+bool AsyncPersistenceManager::persistBatchAsync(const std::vector<Trade>& trades) {
+    size_t enqueued = 0;
+    return persistBatchAsync(trades.data(), trades.size(), enqueued);
+}
+
+bool AsyncPersistenceManager::persistBatchAsync(const Trade* trades, size_t total, size_t& enqueued) {
+    // 大批量拆成多段，每段占用arena中的若干chunk；整批共用一个deadline
+    constexpr size_t PIECE_TRADES = TradeArena::CHUNK_TRADES * 16;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(ENQUEUE_TIMEOUT_US);
+    enqueued = 0;
+    for (size_t pos = 0; pos < total; pos += PIECE_TRADES) {
+        size_t count = std::min(PIECE_TRADES, total - pos);
+        
+        PersistItem item;
+        item.type = PersistType::BATCH;
+        item.count = static_cast<uint32_t>(count);
+        // arena已满，等待worker归还chunk
+        bool stored = true;
+        while ((item.first_chunk = trade_arena_.store(trades + pos, count)) ==
+               TradeArena::NO_CHUNK) {
+            if (!waitForSpace(deadline)) {
+                stored = false;
+                break;
+            }
+        }
+        if (stored && !enqueue(item, deadline)) {
+            trade_arena_.release(item.first_chunk);
+            stored = false;
+        }
+        if (!stored) {
+            size_t remaining = total - pos;
+            reject((remaining + PIECE_TRADES - 1) / PIECE_TRADES);
+            return false;
+        }
+        enqueued = pos + count;
+    }
+    return true;
+}
+
+bool AsyncPersistenceManager::enqueue(const PersistItem& item,
+                                      std::chrono::steady_clock::time_point deadline) {
+    // 非阻塞推送，队列满时等待worker腾出空间
     while (!persist_queue_.push(item)) {
-        std::this_thread::sleep_for(std::chrono::microseconds(1));
+        if (!waitForSpace(deadline)) {
+            return false;
+        }
+    }
+    enqueued_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool AsyncPersistenceManager::waitForSpace(std::chrono::steady_clock::time_point deadline) const {
+    if (!running_.load(std::memory_order_relaxed) || std::chrono::steady_clock::now() >= deadline) {
+        return false;
     }
+    std::this_thread::sleep_for(std::chrono::microseconds(1));
+    return true;
+}
+
+void AsyncPersistenceManager::reject(uint64_t items) {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.items_rejected += items;
 }
 
 void AsyncPersistenceManager::persistenceWorker() {
     std::vector<PersistItem> batch;
+    batch.reserve(BATCH_SIZE);
     auto last_batch_time = std::chrono::steady_clock::now();
     int empty_polls = 0;
-    const int MAX_EMPTY_POLLS = 100;  // 连续空轮询100次后检查退出
+    const int MAX_EMPTY_POLLS = 100;  // 连续空轮询100次后sleep
     
-    // LockFreeMPMCQueue doesn't have empty(), use pop with timeout
-    while (running_ || !batch.empty()) {
+    while (true) {
         PersistItem item;
-        bool has_item = false;
-        
-        // 尝试pop一个item
-        has_item = persist_queue_.pop(item);
-        
+        bool has_item = persist_queue_.pop(item);
         if (has_item) {
             empty_polls = 0;
             batch.push_back(item);
-            
-            // 批量达到阈值或超时
-            auto now = std::chrono::steady_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                now - last_batch_time).count();
-            
-            if (batch.size() >= BATCH_SIZE || elapsed >= BATCH_TIMEOUT_MS) {
-                persistBatch(batch);
-                batch.clear();
-                last_batch_time = now;
-            }
-        } else {
-            empty_polls++;
-            
-            // 如果没有item且running_为false，检查是否应该退出
+        }
+        
+        // 批量达到阈值、超时或停止时写入
+        auto now = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            now - last_batch_time).count();
+        if (!batch.empty() &&
+            (batch.size() >= BATCH_SIZE || elapsed >= BATCH_TIMEOUT_MS || (!has_item && !running_))) {
+            persistBatch(batch);
+            processed_.fetch_add(batch.size(), std::memory_order_release);
+            batch.clear();
+            last_batch_time = now;
+        }
+        
+        if (!has_item) {
+            // 停止后队列已清空则退出
             if (!running_ && batch.empty()) {
-                // 再尝试一次pop，确保队列真的为空
-                if (!persist_queue_.pop(item)) {
-                    break;
-                } else {
-                    // 还有item，继续处理
-                    batch.push_back(item);
-                    empty_polls = 0;
-                }
+                break;
             }
-            
             // 如果连续空轮询太多次，稍微sleep避免CPU占用
-            if (empty_polls > MAX_EMPTY_POLLS) {
+            if (++empty_polls > MAX_EMPTY_POLLS) {
                 std::this_thread::sleep_for(std::chrono::microseconds(100));
                 empty_polls = 0;
             }
         }
         
-        // 尝试pop更多items（批量处理）
-        while (persist_queue_.pop(item)) {
-            empty_polls = 0;
-            batch.push_back(item);
-            
-            // 批量达到阈值或超时
-            auto now = std::chrono::steady_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                now - last_batch_time).count();
-            
-            if (batch.size() >= BATCH_SIZE || elapsed >= BATCH_TIMEOUT_MS) {
-                persistBatch(batch);
-                batch.clear();
-                last_batch_time = now;
-            }
-        }
-        
-        // 处理剩余批次（超时或停止时）
-        if (!batch.empty()) {
-            auto now = std::chrono::steady_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                now - last_batch_time).count();
-            
-            if (!running_ || elapsed >= BATCH_TIMEOUT_MS) {
-                persistBatch(batch);
-                batch.clear();
-                last_batch_time = now;
-            }
-        }
-        
         // 定期刷新
-        auto now = std::chrono::steady_clock::now();
         if (std::chrono::duration_cast<std::chrono::milliseconds>(
             now - last_flush_time_).count() >= 100) {  // 每100ms刷新一次
             flushBatch();
@@ -204,16 +270,27 @@ void AsyncPersistenceManager::persistenceWorker() {
         }
     }
     
-    // 处理最后一批
-    if (!batch.empty()) {
-        persistBatch(batch);
-    }
-    
     // 最终刷新
     flushBatch();
 }
 
-void AsyncPersistenceManager::persistOrder(const Order& order) {
+namespace {
+
+void appendTradeCSV(std::ostringstream& out, const Trade& trade) {
+    out << trade.buy_order_id << ","
+        << trade.sell_order_id << ","
+        << trade.buy_user_id << ","
+        << trade.sell_user_id << ","
+        << trade.instrument_id << ","
+        << trade.price << ","
+        << trade.quantity << ","
+        << trade.timestamp << ","
+        << trade.sequence_id << "\n";
+}
+
+} // namespace
+
+void AsyncPersistenceManager::persistOrder(const OrderRecord& order) {
     // 序列化订单
     std::ostringstream oss;
     oss << order.order_id << ","
@@ -237,18 +314,8 @@ void AsyncPersistenceManager::persistOrder(const Order& order) {
 void AsyncPersistenceManager::persistTrade(const Trade& trade) {
     // 序列化交易
     std::ostringstream oss;
-    oss << trade.buy_order_id << ","
-        << trade.sell_order_id << ","
-        << trade.buy_user_id << ","
-        << trade.sell_user_id << ","
-        << trade.instrument_id << ","
-        << trade.price << ","
-        << trade.quantity << ","
-        << trade.timestamp << ","
-        << trade.sequence_id << "\n";
-    
-    std::string data = oss.str();
-    writeToWAL(data);
+    appendTradeCSV(oss, trade);
+    writeToWAL(oss.str());
     
     {
         std::lock_guard<std::mutex> lock(stats_mutex_);
@@ -262,47 +329,31 @@ void AsyncPersistenceManager::persistBatch(const std::vector<PersistItem>& batch
     auto start_time = std::chrono::high_resolution_clock::now();
     
     std::ostringstream wal_buffer;
+    uint64_t trades = 0;
     
     for (const auto& item : batch) {
         switch (item.type) {
             case PersistType::ORDER:
                 persistOrder(item.order);
                 break;
-            case PersistType::TRADE: {
-                std::ostringstream oss;
-                oss << item.trade.buy_order_id << ","
-                    << item.trade.sell_order_id << ","
-                    << item.trade.buy_user_id << ","
-                    << item.trade.sell_user_id << ","
-                    << item.trade.instrument_id << ","
-                    << item.trade.price << ","
-                    << item.trade.quantity << ","
-                    << item.trade.timestamp << ","
-                    << item.trade.sequence_id << "\n";
-                wal_buffer << oss.str();
+            case PersistType::TRADE:
+                appendTradeCSV(wal_buffer, item.trade);
+                trades++;
                 break;
-            }
             case PersistType::BATCH:
-                for (const auto& trade : item.batch) {
-                    std::ostringstream oss;
-                    oss << trade.buy_order_id << ","
-                        << trade.sell_order_id << ","
-                        << trade.buy_user_id << ","
-                        << trade.sell_user_id << ","
-                        << trade.instrument_id << ","
-                        << trade.price << ","
-                        << trade.quantity << ","
-                        << trade.timestamp << ","
-                        << trade.sequence_id << "\n";
-                    wal_buffer << oss.str();
-                }
+                trade_arena_.forEach(item.first_chunk, item.count, [&](const Trade& trade) {
+                    appendTradeCSV(wal_buffer, trade);
+                });
+                trade_arena_.release(item.first_chunk);
+                trades += item.count;
                 break;
         }
     }
     
     // 批量写入WAL
-    if (wal_buffer.str().size() > 0) {
-        writeToWAL(wal_buffer.str());
+    std::string data = wal_buffer.str();
+    if (!data.empty()) {
+        writeToWAL(data);
     }
     
     auto end_time = std::chrono::high_resolution_clock::now();
@@ -312,7 +363,7 @@ void AsyncPersistenceManager::persistBatch(const std::vector<PersistItem>& batch
     {
         std::lock_guard<std::mutex> lock(stats_mutex_);
         stats_.batches_persisted++;
-        stats_.trades_persisted += batch.size();
+        stats_.trades_persisted += trades;
         if (stats_.batches_persisted > 0) {
             stats_.avg_persist_latency_ns = 
                 (stats_.avg_persist_latency_ns * (stats_.batches_persisted - 1) + latency) / 
@@ -323,39 +374,49 @@ void AsyncPersistenceManager::persistBatch(const std::vector<PersistItem>& batch
 
 void AsyncPersistenceManager::writeToWAL(const std::string& data) {
     std::lock_guard<std::mutex> lock(wal_mutex_);
-    if (wal_file_ && wal_file_->is_open()) {
-        *wal_file_ << data;
-        // 不立即flush，由flushBatch统一处理
+    if (!wal_journal_ || !wal_journal_->is_open()) {
+        return;
+    }
+    // 追加到当前批次，由flushBatch统一提交；超过批次容量时分块写入
+    size_t capacity = wal_journal_->batch_capacity();
+    for (size_t pos = 0; pos < data.size(); pos += capacity) {
+        wal_journal_->append(data.data() + pos, std::min(capacity, data.size() - pos));
     }
 }
 
 void AsyncPersistenceManager::flushBatch() {
     std::lock_guard<std::mutex> lock(wal_mutex_);
-    if (wal_file_ && wal_file_->is_open()) {
-        wal_file_->flush();
+    if (wal_journal_ && wal_journal_->is_open()) {
+        // 异步提交：写入+fdatasync在后端完成，worker继续填充下一批
+        wal_journal_->commit();
     }
 }
 
 void AsyncPersistenceManager::flush() {
-    // 等待队列清空
-    int retries = 0;
-    // LockFreeMPMCQueue doesn't have empty(), try to pop items
-    PersistItem dummy;
-    while (persist_queue_.pop(dummy) && retries < 1000) {
-        retries++;
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        retries++;
+    // 等待已入队的项被worker写入WAL（最多10秒）
+    uint64_t target = enqueued_.load(std::memory_order_relaxed);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (running_ && processed_.load(std::memory_order_acquire) < target &&
+           std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
     
-    // 刷新WAL
-    flushBatch();
+    // 刷新WAL并等待落盘
+    uint64_t record = 0;
+    {
+        std::lock_guard<std::mutex> lock(wal_mutex_);
+        if (!wal_journal_ || !wal_journal_->is_open()) {
+            return;
+        }
+        record = wal_journal_->commit();
+    }
+    wal_journal_->wait_durable(record);
 }
 
 AsyncPersistenceManager::Statistics AsyncPersistenceManager::getStatistics() const {
     std::lock_guard<std::mutex> lock(stats_mutex_);
     Statistics stats = stats_;
-    // Note: LockFreeMPMCQueue doesn't have size() method
-    // We track queue size through push/pop operations if needed
+    stats.queue_size = persist_queue_.size();
     return stats;
 }
 
@@ -1,13 +1,237 @@
 #include "core/persistence_optimized.h"
 #include "core/logger.h"
+#include "core/metrics.h"
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
 #include <numeric>
+#include <filesystem>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 namespace perpetual {
 
-thread_local std::string OptimizedPersistenceManager::serialization_buffer_;
+namespace {
+
+// Fixed-point value with 8 decimals, exact (no round trip through double)
+char* formatDecimal8(char* out, char* end, int64_t value, int64_t scale) {
+    constexpr int64_t UNITS = 100000000LL;
+    bool negative = value < 0;
+    uint64_t magnitude = negative ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    uint64_t units = scale >= UNITS
+        ? (magnitude + static_cast<uint64_t>(scale / UNITS) / 2) / static_cast<uint64_t>(scale / UNITS)
+        : magnitude * static_cast<uint64_t>(UNITS / scale);
+    
+    if (negative) {
+        *out++ = '-';
+    }
+    out = std::to_chars(out, end, units / UNITS).ptr;
+    *out++ = '.';
+    
+    uint64_t fraction = units % UNITS;
+    for (int i = 7; i >= 0; --i) {
+        out[i] = static_cast<char>('0' + fraction % 10);
+        fraction /= 10;
+    }
+    return out + 8;
+}
+
+template<typename T>
+char* formatInteger(char* out, char* end, T value) {
+    return std::to_chars(out, end, value).ptr;
+}
+
+} // namespace
+
+OptimizedPersistenceManager::OutputBuffer::~OutputBuffer() {
+    for (char* page : pages_) {
+        std::free(page);
+    }
+}
+
+bool OptimizedPersistenceManager::OutputBuffer::allocate(size_t bytes) {
+    size_t pages = std::max<size_t>(1, (bytes + PAGE_BYTES - 1) / PAGE_BYTES);
+    for (size_t i = 0; i < pages; ++i) {
+        char* page = static_cast<char*>(std::aligned_alloc(4096, PAGE_BYTES));
+        if (!page) {
+            return false;
+        }
+        pages_.push_back(page);
+    }
+    used_.assign(pages_.size(), 0);
+    iov_.reserve(pages_.size());
+    current_ = 0;
+    return true;
+}
+
+char* OptimizedPersistenceManager::OutputBuffer::reserve(size_t max_bytes) {
+    if (used_[current_] + max_bytes > PAGE_BYTES) {
+        if (current_ + 1 == pages_.size()) {
+            return nullptr;
+        }
+        ++current_;
+    }
+    return pages_[current_] + used_[current_];
+}
+
+size_t OptimizedPersistenceManager::OutputBuffer::size() const {
+    size_t bytes = 0;
+    for (size_t i = 0; i <= current_; ++i) {
+        bytes += used_[i];
+    }
+    return bytes;
+}
+
+bool OptimizedPersistenceManager::OutputBuffer::writeTo(int fd) {
+    iov_.clear();
+    for (size_t i = 0; i <= current_; ++i) {
+        if (used_[i] > 0) {
+            iov_.push_back({pages_[i], used_[i]});
+        }
+    }
+    
+    // One writev per batch; resume after short writes
+    size_t first = 0;
+    while (first < iov_.size()) {
+        int count = static_cast<int>(std::min<size_t>(iov_.size() - first, IOV_MAX));
+        ssize_t written = ::writev(fd, &iov_[first], count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        size_t remaining = static_cast<size_t>(written);
+        while (first < iov_.size() && remaining >= iov_[first].iov_len) {
+            remaining -= iov_[first].iov_len;
+            ++first;
+        }
+        if (remaining > 0) {
+            iov_[first].iov_base = static_cast<char*>(iov_[first].iov_base) + remaining;
+            iov_[first].iov_len -= remaining;
+        }
+    }
+    return true;
+}
+
+void OptimizedPersistenceManager::OutputBuffer::clear() {
+    std::fill(used_.begin(), used_.end(), 0);
+    current_ = 0;
+}
+
+bool parsePersistenceOverflowPolicy(const std::string& name, PersistenceOverflowPolicy& policy) {
+    if (name == "spin") {
+        policy = PersistenceOverflowPolicy::SPIN;
+    } else if (name == "spill") {
+        policy = PersistenceOverflowPolicy::SPILL;
+    } else if (name == "reject") {
+        policy = PersistenceOverflowPolicy::REJECT;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+OptimizedPersistenceManager::SpillFile::~SpillFile() {
+    close();
+}
+
+bool OptimizedPersistenceManager::SpillFile::open(const std::string& path, size_t record_size) {
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        return false;
+    }
+    record_size_ = record_size;
+    
+    // Records left over from a previous run; a torn last record is dropped
+    struct stat st;
+    uint64_t size = ::fstat(fd_, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+    release_offset_ = read_offset_ = 0;
+    write_offset_ = size - size % record_size_;
+    pending_.store(write_offset_, std::memory_order_release);
+    return true;
+}
+
+void OptimizedPersistenceManager::SpillFile::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool OptimizedPersistenceManager::SpillFile::append(const void* record) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ < 0) {
+        return false;
+    }
+    
+    const char* data = static_cast<const char*>(record);
+    size_t done = 0;
+    while (done < record_size_) {
+        ssize_t n = ::pwrite(fd_, data + done, record_size_ - done,
+                             static_cast<off_t>(write_offset_ + done));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    write_offset_ += record_size_;
+    pending_.store(write_offset_ - read_offset_, std::memory_order_release);
+    return true;
+}
+
+size_t OptimizedPersistenceManager::SpillFile::read(char* out, size_t max_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t available = write_offset_ - read_offset_;
+    size_t bytes = static_cast<size_t>(std::min<uint64_t>(available, max_bytes));
+    bytes -= bytes % record_size_;
+    if (bytes == 0) {
+        return 0;
+    }
+    
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t n = ::pread(fd_, out + done, bytes - done, static_cast<off_t>(read_offset_ + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // Unreadable: give the backlog up rather than stall the writer
+            LOG_ERROR("Failed to read persistence spill file, " +
+                      std::to_string(available) + " bytes lost");
+            release_offset_ = read_offset_ = write_offset_ = 0;
+            ::ftruncate(fd_, 0);
+            pending_.store(0, std::memory_order_release);
+            return 0;
+        }
+        done += static_cast<size_t>(n);
+    }
+    
+    // The records stay in the file until release(): the writer may still
+    // crash before they reach the logs
+    read_offset_ += bytes;
+    pending_.store(write_offset_ - read_offset_, std::memory_order_release);
+    return bytes;
+}
+
+void OptimizedPersistenceManager::SpillFile::release(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    release_offset_ = std::min(release_offset_ + bytes, read_offset_);
+    if (release_offset_ == write_offset_ && release_offset_ > 0) {
+        // Drained: start over so the file does not grow across spikes
+        release_offset_ = read_offset_ = write_offset_ = 0;
+        ::ftruncate(fd_, 0);
+    }
+}
 
 OptimizedPersistenceManager::OptimizedPersistenceManager()
     : buffer_size_(10000), flush_interval_ms_(100) {
@@ -19,7 +243,9 @@ OptimizedPersistenceManager::~OptimizedPersistenceManager() {
 
 bool OptimizedPersistenceManager::initialize(const std::string& data_dir,
                                             size_t buffer_size,
-                                            size_t flush_interval_ms) {
+                                            size_t flush_interval_ms,
+                                            PersistenceLogFormat format,
+                                            const PersistenceOverflowConfig& overflow) {
     if (initialized_.load()) {
         LOG_WARN("Persistence manager already initialized");
         return true;
@@ -37,6 +263,9 @@ bool OptimizedPersistenceManager::initialize(const std::string& data_dir,
         data_dir_ = data_dir;
         buffer_size_ = buffer_size;
         flush_interval_ms_ = flush_interval_ms;
+        format_ = format;
+        overflow_ = overflow;
+        log_extension_ = format == PersistenceLogFormat::BINARY ? ".bin" : ".log";
         
         // Initialize lock-free queues (power of 2 for better performance)
         size_t queue_size = 1;
@@ -44,12 +273,31 @@ bool OptimizedPersistenceManager::initialize(const std::string& data_dir,
             queue_size <<= 1;
         }
         
-        trade_queue_ = std::make_unique<LockFreeSPSCQueue<OptimizedLogEntry>>(queue_size);
-        order_queue_ = std::make_unique<LockFreeSPSCQueue<OptimizedLogEntry>>(queue_size);
+        trade_queue_ = std::make_unique<LockFreeSPSCQueue<TradeLogRecord>>(queue_size);
+        order_queue_ = std::make_unique<LockFreeSPSCQueue<OrderLogRecord>>(queue_size);
+        queue_capacity_ = trade_queue_->capacity();
         
-        // Reserve buffer capacity
-        trade_buffer_.reserve(buffer_size);
-        order_buffer_.reserve(buffer_size);
+        // Overflow files; anything left in them is written out first
+        if (!trade_spill_.open(data_dir + "/trades.spill", sizeof(TradeLogRecord)) ||
+            !order_spill_.open(data_dir + "/orders.spill", sizeof(OrderLogRecord))) {
+            LOG_ERROR("Failed to open persistence spill files in " + data_dir);
+            return false;
+        }
+        if (trade_spill_.pending() > 0 || order_spill_.pending() > 0) {
+            LOG_WARN("Replaying " + std::to_string(trade_spill_.pending() + order_spill_.pending()) +
+                     " bytes of spilled persistence records");
+        }
+        spill_buffer_.resize(SPILL_READ_BYTES);
+        
+        // Output buffers sized for a full batch of the largest record
+        size_t record_bytes = format == PersistenceLogFormat::BINARY
+            ? std::max(sizeof(TradeLogRecord), sizeof(OrderLogRecord))
+            : MAX_TEXT_RECORD;
+        size_t output_bytes = std::min(buffer_size * record_bytes, MAX_OUTPUT_BYTES);
+        if (!trade_output_.allocate(output_bytes) || !order_output_.allocate(output_bytes)) {
+            LOG_ERROR("Failed to allocate persistence output buffers");
+            return false;
+        }
         
         // Generate initial log file names
         auto now = std::chrono::system_clock::now();
@@ -58,20 +306,33 @@ bool OptimizedPersistenceManager::initialize(const std::string& data_dir,
         ss << std::put_time(std::localtime(&time_t), "%Y%m%d_%H%M%S");
         std::string timestamp = ss.str();
         
-        current_trade_file_ = data_dir + "/trades_" + timestamp + ".log";
-        current_order_file_ = data_dir + "/orders_" + timestamp + ".log";
-        
         // Open initial log files
-        trade_log_ = std::make_unique<std::ofstream>(current_trade_file_, std::ios::app | std::ios::binary);
-        order_log_ = std::make_unique<std::ofstream>(current_order_file_, std::ios::app | std::ios::binary);
+        PreparedLogFile trade_log = prepareLogFile(
+            data_dir + "/trades_" + timestamp + log_extension_, logFileHeader(true));
+        PreparedLogFile order_log = prepareLogFile(
+            data_dir + "/orders_" + timestamp + log_extension_, logFileHeader(false));
+        current_trade_file_ = trade_log.path;
+        current_order_file_ = order_log.path;
+        trade_fd_ = trade_log.fd;
+        order_fd_ = order_log.fd;
+        trade_file_size_ = trade_log.size;
+        order_file_size_ = order_log.size;
         
-        if (!trade_log_->is_open() || !order_log_->is_open()) {
+        if (trade_fd_ < 0 || order_fd_ < 0) {
+            if (trade_fd_ >= 0) ::close(trade_fd_);
+            if (order_fd_ >= 0) ::close(order_fd_);
+            trade_fd_ = order_fd_ = -1;
             LOG_ERROR("Failed to open log files for persistence");
             return false;
         }
         
+        // Have the next files ready before the first rotation
+        next_trade_log_ = prepareNextLogFile("trades");
+        next_order_log_ = prepareNextLogFile("orders");
+        
         // Start writer thread
         shutdown_requested_ = false;
+        writer_running_ = true;
         writer_thread_ = std::thread(&OptimizedPersistenceManager::writerThread, this);
         
         initialized_ = true;
@@ -89,19 +350,23 @@ void OptimizedPersistenceManager::logTrade(const Trade& trade) {
         return;
     }
     
-    // Serialize trade (fast, no allocation if buffer reused)
-    std::string data = serializeTrade(trade);
-    Timestamp timestamp = get_current_timestamp();
-    
-    // Push to lock-free queue (non-blocking)
-    OptimizedLogEntry entry(data, timestamp, true);
-    
-    // Try to push, if queue is full, log warning but don't block
-    if (!trade_queue_->push(entry)) {
-        // Queue full - increment error counter
+    TradeLogRecord record;
+    record.sequence_id = trade.sequence_id;
+    record.buy_order_id = trade.buy_order_id;
+    record.sell_order_id = trade.sell_order_id;
+    record.buy_user_id = trade.buy_user_id;
+    record.sell_user_id = trade.sell_user_id;
+    record.instrument_id = trade.instrument_id;
+    record.price = trade.price;
+    record.quantity = trade.quantity;
+    record.timestamp = trade.timestamp;
+    record.is_taker_buy = trade.is_taker_buy ? 1 : 0;
+    
+    // Queue full: spin and/or spill according to the overflow policy
+    if (!enqueueRecord(*trade_queue_, trade_spill_, record)) {
         std::lock_guard<std::mutex> lock(stats_mutex_);
         stats_.write_errors++;
-        LOG_WARN("Trade queue full, dropping entry");
+        LOG_ERROR("Failed to spill trade, entry lost");
     } else {
         std::lock_guard<std::mutex> lock(stats_mutex_);
         stats_.trades_logged++;
@@ -116,17 +381,23 @@ void OptimizedPersistenceManager::logOrder(const Order& order, const std::string
         return;
     }
     
-    // Serialize order
-    std::string data = serializeOrder(order, event_type);
-    Timestamp timestamp = get_current_timestamp();
-    
-    // Push to lock-free queue (non-blocking)
-    OptimizedLogEntry entry(data, timestamp, false);
-    
-    if (!order_queue_->push(entry)) {
+    OrderLogRecord record;
+    record.order_id = order.order_id;
+    record.user_id = order.user_id;
+    record.instrument_id = order.instrument_id;
+    record.price = order.price;
+    record.quantity = order.quantity;
+    record.timestamp = order.timestamp;
+    record.side = static_cast<uint8_t>(order.side);
+    record.status = static_cast<uint8_t>(order.status);
+    size_t type_length = std::min(event_type.size(), sizeof(record.event_type));
+    std::memcpy(record.event_type, event_type.data(), type_length);
+    std::memset(record.event_type + type_length, 0, sizeof(record.event_type) - type_length);
+    
+    if (!enqueueRecord(*order_queue_, order_spill_, record)) {
         std::lock_guard<std::mutex> lock(stats_mutex_);
         stats_.write_errors++;
-        LOG_WARN("Order queue full, dropping entry");
+        LOG_ERROR("Failed to spill order, entry lost");
     } else {
         std::lock_guard<std::mutex> lock(stats_mutex_);
         stats_.orders_logged++;
@@ -136,266 +407,469 @@ void OptimizedPersistenceManager::logOrder(const Order& order, const std::string
     writer_cv_.notify_one();
 }
 
-std::string OptimizedPersistenceManager::serializeTrade(const Trade& trade) {
-    // Use thread-local buffer to avoid allocation
-    serialization_buffer_.clear();
-    serialization_buffer_.reserve(128); // Pre-allocate for typical trade size
-    
-    // Fast integer-to-string conversion
-    serialization_buffer_ += std::to_string(trade.sequence_id);
-    serialization_buffer_ += ',';
-    serialization_buffer_ += std::to_string(trade.buy_order_id);
-    serialization_buffer_ += ',';
-    serialization_buffer_ += std::to_string(trade.sell_order_id);
-    serialization_buffer_ += ',';
-    serialization_buffer_ += std::to_string(trade.buy_user_id);
-    serialization_buffer_ += ',';
-    serialization_buffer_ += std::to_string(trade.sell_user_id);
-    serialization_buffer_ += ',';
-    serialization_buffer_ += std::to_string(trade.instrument_id);
-    serialization_buffer_ += ',';
-    
-    // Price and quantity (use fixed precision for performance)
-    char price_buf[32];
-    snprintf(price_buf, sizeof(price_buf), "%.8f", price_to_double(trade.price));
-    serialization_buffer_ += price_buf;
-    serialization_buffer_ += ',';
-    
-    char qty_buf[32];
-    snprintf(qty_buf, sizeof(qty_buf), "%.8f", quantity_to_double(trade.quantity));
-    serialization_buffer_ += qty_buf;
-    serialization_buffer_ += ',';
-    
-    serialization_buffer_ += std::to_string(trade.timestamp);
-    serialization_buffer_ += ',';
-    serialization_buffer_ += (trade.is_taker_buy ? "1" : "0");
-    
-    return serialization_buffer_;
-}
-
-std::string OptimizedPersistenceManager::serializeOrder(const Order& order, const std::string& event_type) {
-    serialization_buffer_.clear();
-    serialization_buffer_.reserve(128);
-    
-    serialization_buffer_ += std::to_string(order.order_id);
-    serialization_buffer_ += ',';
-    serialization_buffer_ += std::to_string(order.user_id);
-    serialization_buffer_ += ',';
-    serialization_buffer_ += std::to_string(order.instrument_id);
-    serialization_buffer_ += ',';
-    serialization_buffer_ += (order.side == OrderSide::BUY ? "BUY" : "SELL");
-    serialization_buffer_ += ',';
-    
-    char price_buf[32];
-    snprintf(price_buf, sizeof(price_buf), "%.8f", price_to_double(order.price));
-    serialization_buffer_ += price_buf;
-    serialization_buffer_ += ',';
-    
-    char qty_buf[32];
-    snprintf(qty_buf, sizeof(qty_buf), "%.8f", quantity_to_double(order.quantity));
-    serialization_buffer_ += qty_buf;
-    serialization_buffer_ += ',';
-    
-    serialization_buffer_ += std::to_string(static_cast<int>(order.status));
-    serialization_buffer_ += ',';
-    serialization_buffer_ += std::to_string(order.timestamp);
-    serialization_buffer_ += ',';
-    serialization_buffer_ += event_type;
-    
-    return serialization_buffer_;
+template<typename Record>
+bool OptimizedPersistenceManager::enqueueRecord(LockFreeSPSCQueue<Record>& queue, SpillFile& spill,
+                                                const Record& record) {
+    // Once records are spilled, later ones follow them into the spill file
+    // until the writer has drained it, so the logs stay in order
+    if (spill.pending() == 0) {
+        if (queue.push(record)) {
+            return true;
+        }
+        
+        if (overflow_.policy == PersistenceOverflowPolicy::SPIN) {
+            spin_waits_.fetch_add(1, std::memory_order_relaxed);
+            writer_cv_.notify_one();
+            auto deadline = std::chrono::steady_clock::now() +
+                            std::chrono::microseconds(overflow_.spin_limit_us);
+            do {
+                std::this_thread::yield();
+                if (queue.push(record)) {
+                    return true;
+                }
+            } while (std::chrono::steady_clock::now() < deadline);
+        }
+    }
+    
+    if (!spill.append(&record)) {
+        return false;
+    }
+    records_spilled_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+template<typename Record, typename Append>
+bool OptimizedPersistenceManager::drainSpill(SpillFile& spill, uint64_t max_bytes, Append append) {
+    bool drained = false;
+    while (max_bytes > 0 && spill.pending() > 0) {
+        size_t bytes = spill.read(spill_buffer_.data(),
+                                  static_cast<size_t>(std::min<uint64_t>(max_bytes, spill_buffer_.size())));
+        if (bytes == 0) {
+            break;
+        }
+        for (size_t offset = 0; offset < bytes; offset += sizeof(Record)) {
+            Record record;
+            std::memcpy(&record, spill_buffer_.data() + offset, sizeof(Record));
+            append(record);
+        }
+        max_bytes -= std::min<uint64_t>(bytes, max_bytes);
+        drained = true;
+    }
+    return drained;
+}
+
+bool OptimizedPersistenceManager::acceptingOrders() const {
+    if (overflow_.policy != PersistenceOverflowPolicy::REJECT || !initialized_.load()) {
+        return true;
+    }
+    if (trade_spill_.pending() > 0 || order_spill_.pending() > 0) {
+        return false;
+    }
+    size_t watermark = static_cast<size_t>(overflow_.reject_watermark * queue_capacity_);
+    return trade_queue_->size() < watermark && order_queue_->size() < watermark;
+}
+
+void OptimizedPersistenceManager::publishMetrics() {
+    auto& metrics = Metrics::getInstance();
+    metrics.setGauge("persistence_trade_queue_depth", static_cast<double>(trade_queue_->size()));
+    metrics.setGauge("persistence_order_queue_depth", static_cast<double>(order_queue_->size()));
+    metrics.setGauge("persistence_spill_bytes_pending",
+                     static_cast<double>(trade_spill_.pending() + order_spill_.pending()));
+    
+    uint64_t spin_waits = spin_waits_.load(std::memory_order_relaxed);
+    uint64_t spilled = records_spilled_.load(std::memory_order_relaxed);
+    if (spin_waits > published_spin_waits_) {
+        metrics.incrementCounter("persistence_spin_waits",
+                                 static_cast<int64_t>(spin_waits - published_spin_waits_));
+        published_spin_waits_ = spin_waits;
+    }
+    if (spilled > published_records_spilled_) {
+        metrics.incrementCounter("persistence_records_spilled",
+                                 static_cast<int64_t>(spilled - published_records_spilled_));
+        published_records_spilled_ = spilled;
+    }
+}
+
+void OptimizedPersistenceManager::appendTrade(const TradeLogRecord& trade) {
+    size_t max_bytes = format_ == PersistenceLogFormat::BINARY ? sizeof(trade) : MAX_TEXT_RECORD;
+    char* out = trade_output_.reserve(max_bytes);
+    if (!out) {
+        writeBatch(trade_output_, pending_trades_, true);
+        pending_trades_ = 0;
+        out = trade_output_.reserve(max_bytes);
+    }
+    
+    if (format_ == PersistenceLogFormat::BINARY) {
+        std::memcpy(out, &trade, sizeof(trade));
+        out += sizeof(trade);
+    } else {
+        char* end = out + max_bytes;
+        out = formatInteger(out, end, trade.sequence_id);
+        *out++ = ',';
+        out = formatInteger(out, end, trade.buy_order_id);
+        *out++ = ',';
+        out = formatInteger(out, end, trade.sell_order_id);
+        *out++ = ',';
+        out = formatInteger(out, end, trade.buy_user_id);
+        *out++ = ',';
+        out = formatInteger(out, end, trade.sell_user_id);
+        *out++ = ',';
+        out = formatInteger(out, end, trade.instrument_id);
+        *out++ = ',';
+        out = formatDecimal8(out, end, trade.price, PRICE_SCALE);
+        *out++ = ',';
+        out = formatDecimal8(out, end, trade.quantity, QTY_SCALE);
+        *out++ = ',';
+        out = formatInteger(out, end, trade.timestamp);
+        *out++ = ',';
+        *out++ = trade.is_taker_buy ? '1' : '0';
+        *out++ = '\n';
+    }
+    trade_output_.commit(out);
+    pending_trades_++;
+}
+
+void OptimizedPersistenceManager::appendOrder(const OrderLogRecord& order) {
+    size_t max_bytes = format_ == PersistenceLogFormat::BINARY ? sizeof(order) : MAX_TEXT_RECORD;
+    char* out = order_output_.reserve(max_bytes);
+    if (!out) {
+        writeBatch(order_output_, pending_orders_, false);
+        pending_orders_ = 0;
+        out = order_output_.reserve(max_bytes);
+    }
+    
+    if (format_ == PersistenceLogFormat::BINARY) {
+        std::memcpy(out, &order, sizeof(order));
+        out += sizeof(order);
+    } else {
+        char* end = out + max_bytes;
+        out = formatInteger(out, end, order.order_id);
+        *out++ = ',';
+        out = formatInteger(out, end, order.user_id);
+        *out++ = ',';
+        out = formatInteger(out, end, order.instrument_id);
+        *out++ = ',';
+        if (order.side == static_cast<uint8_t>(OrderSide::BUY)) {
+            std::memcpy(out, "BUY", 3);
+            out += 3;
+        } else {
+            std::memcpy(out, "SELL", 4);
+            out += 4;
+        }
+        *out++ = ',';
+        out = formatDecimal8(out, end, order.price, PRICE_SCALE);
+        *out++ = ',';
+        out = formatDecimal8(out, end, order.quantity, QTY_SCALE);
+        *out++ = ',';
+        out = formatInteger(out, end, static_cast<int>(order.status));
+        *out++ = ',';
+        out = formatInteger(out, end, order.timestamp);
+        *out++ = ',';
+        size_t type_length = strnlen(order.event_type, sizeof(order.event_type));
+        std::memcpy(out, order.event_type, type_length);
+        out += type_length;
+        *out++ = '\n';
+    }
+    order_output_.commit(out);
+    pending_orders_++;
 }
 
 void OptimizedPersistenceManager::writerThread() {
     auto last_flush = std::chrono::steady_clock::now();
     
+    auto last_metrics = last_flush;
+    
     while (!shutdown_requested_.load() || 
            !trade_queue_->empty() || 
-           !order_queue_->empty()) {
+           !order_queue_->empty() ||
+           trade_spill_.pending() > 0 ||
+           order_spill_.pending() > 0) {
+        
+        // A pending flush covers everything queued before its ticket
+        uint64_t flush_ticket = flush_requested_.load();
+        bool flushing = flush_ticket > flush_completed_;
+        size_t trade_limit = flushing ? std::max(buffer_size_, trade_queue_->size()) : buffer_size_;
+        size_t order_limit = flushing ? std::max(buffer_size_, order_queue_->size()) : buffer_size_;
         
         bool has_data = false;
         
-        // Drain trade queue into buffer
-        OptimizedLogEntry entry;
-        while (trade_queue_->pop(entry)) {
-            trade_buffer_.push_back(std::move(entry));
+        // Drain queues straight into the output buffers. Spilled records are
+        // newer than anything in the queue, so they follow once it is empty.
+        TradeLogRecord trade;
+        size_t trades = 0;
+        while (trades < trade_limit && trade_queue_->pop(trade)) {
+            appendTrade(trade);
+            trades++;
+        }
+        if (trade_queue_->empty() &&
+            drainSpill<TradeLogRecord>(trade_spill_, flushing ? trade_spill_.pending() : SPILL_READ_BYTES,
+                                       [this](const TradeLogRecord& r) {
+                                           appendTrade(r);
+                                           trade_spill_buffered_ += sizeof(r);
+                                       })) {
             has_data = true;
-            
-            // Batch size limit
-            if (trade_buffer_.size() >= buffer_size_) {
-                break;
-            }
         }
         
-        // Drain order queue into buffer
-        while (order_queue_->pop(entry)) {
-            order_buffer_.push_back(std::move(entry));
+        OrderLogRecord order;
+        size_t orders = 0;
+        while (orders < order_limit && order_queue_->pop(order)) {
+            appendOrder(order);
+            orders++;
+        }
+        if (order_queue_->empty() &&
+            drainSpill<OrderLogRecord>(order_spill_, flushing ? order_spill_.pending() : SPILL_READ_BYTES,
+                                       [this](const OrderLogRecord& r) {
+                                           appendOrder(r);
+                                           order_spill_buffered_ += sizeof(r);
+                                       })) {
             has_data = true;
-            
-            if (order_buffer_.size() >= buffer_size_) {
-                break;
-            }
         }
+        has_data = has_data || trades > 0 || orders > 0;
         
-        // Write batches if we have data
+        // Write batches on time, size or a flush request
         auto now = std::chrono::steady_clock::now();
         auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_flush).count();
         
-        if (has_data && (!trade_buffer_.empty() || !order_buffer_.empty())) {
-            // Check if we should flush based on time or buffer size
-            if (elapsed >= flush_interval_ms_ || 
-                trade_buffer_.size() >= buffer_size_ || 
-                order_buffer_.size() >= buffer_size_) {
-                
-                auto write_start = std::chrono::high_resolution_clock::now();
-                
-                if (!trade_buffer_.empty()) {
-                    writeBatch(trade_buffer_);
-                    trade_buffer_.clear();
-                }
-                
-                if (!order_buffer_.empty()) {
-                    writeBatch(order_buffer_);
-                    order_buffer_.clear();
-                }
-                
-                auto write_end = std::chrono::high_resolution_clock::now();
-                auto write_latency = std::chrono::duration_cast<std::chrono::microseconds>(
-                    write_end - write_start).count();
-                
-                // Update statistics
-                {
-                    std::lock_guard<std::mutex> lock(stats_mutex_);
-                    stats_.batches_written++;
-                    // Exponential moving average for latency
-                    stats_.avg_write_latency_us = 
-                        (stats_.avg_write_latency_us * 0.9) + (write_latency * 0.1);
-                }
-                
+        if (pending_trades_ > 0 || pending_orders_ > 0) {
+            if (flushing ||
+                elapsed >= static_cast<int64_t>(flush_interval_ms_) ||
+                pending_trades_ >= buffer_size_ ||
+                pending_orders_ >= buffer_size_) {
+                writeBatches();
                 last_flush = now;
             }
         }
         
+        if (flushing) {
+            {
+                std::lock_guard<std::mutex> lock(writer_mutex_);
+                flush_completed_ = flush_ticket;
+            }
+            flush_cv_.notify_all();
+        }
+        
+        if (std::chrono::duration_cast<std::chrono::milliseconds>(now - last_metrics).count() >=
+            static_cast<int64_t>(flush_interval_ms_)) {
+            publishMetrics();
+            last_metrics = now;
+        }
+        
         // Wait for more data or timeout
         if (!has_data && !shutdown_requested_.load()) {
             std::unique_lock<std::mutex> lock(writer_mutex_);
-            writer_cv_.wait_for(lock, std::chrono::milliseconds(flush_interval_ms_));
+            writer_cv_.wait_for(lock, std::chrono::milliseconds(flush_interval_ms_), [this] {
+                return shutdown_requested_.load() || flush_requested_.load() > flush_completed_;
+            });
         }
     }
     
     // Final flush on shutdown
-    if (!trade_buffer_.empty()) {
-        writeBatch(trade_buffer_);
-    }
-    if (!order_buffer_.empty()) {
-        writeBatch(order_buffer_);
+    writeBatches();
+    publishMetrics();
+    
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        flush_completed_ = flush_requested_.load();
+        writer_running_ = false;
     }
+    flush_cv_.notify_all();
     
     LOG_INFO("Persistence writer thread stopped");
 }
 
-void OptimizedPersistenceManager::writeBatch(const std::vector<OptimizedLogEntry>& batch) {
-    if (batch.empty()) return;
+void OptimizedPersistenceManager::writeBatches() {
+    if (pending_trades_ == 0 && pending_orders_ == 0) {
+        return;
+    }
+    
+    auto write_start = std::chrono::high_resolution_clock::now();
+    
+    writeBatch(trade_output_, pending_trades_, true);
+    pending_trades_ = 0;
+    writeBatch(order_output_, pending_orders_, false);
+    pending_orders_ = 0;
+    
+    auto write_end = std::chrono::high_resolution_clock::now();
+    auto write_latency = std::chrono::duration_cast<std::chrono::microseconds>(
+        write_end - write_start).count();
+    
+    // Update statistics
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.batches_written++;
+    // Exponential moving average for latency
+    stats_.avg_write_latency_us = 
+        (stats_.avg_write_latency_us * 0.9) + (write_latency * 0.1);
+}
+
+void OptimizedPersistenceManager::writeBatch(OutputBuffer& buffer, size_t records, bool is_trade) {
+    if (buffer.empty()) return;
     
     // Check file rotation
     rotateLogFiles();
     
-    std::ofstream* log_file = nullptr;
-    std::atomic<uint64_t>* file_size = nullptr;
+    int fd = is_trade ? trade_fd_ : order_fd_;
+    std::atomic<uint64_t>& file_size = is_trade ? trade_file_size_ : order_file_size_;
+    size_t bytes = buffer.size();
     
-    if (batch[0].is_trade) {
-        log_file = trade_log_.get();
-        file_size = &trade_file_size_;
-    } else {
-        log_file = order_log_.get();
-        file_size = &order_file_size_;
-    }
-    
-    if (!log_file || !log_file->is_open()) {
-        std::lock_guard<std::mutex> lock(stats_mutex_);
-        stats_.write_errors += batch.size();
-        return;
-    }
+    bool written = fd >= 0 && buffer.writeTo(fd);
+    buffer.clear();
     
-    // Batch write (single system call for better performance)
-    for (const auto& entry : batch) {
-        *log_file << entry.data << '\n';
-        file_size->fetch_add(entry.data.size() + 1); // +1 for newline
+    // Spilled records in this batch are done with (a failed write counts
+    // them as errors like the queued ones)
+    uint64_t& spilled = is_trade ? trade_spill_buffered_ : order_spill_buffered_;
+    if (spilled > 0) {
+        (is_trade ? trade_spill_ : order_spill_).release(spilled);
+        spilled = 0;
     }
     
-    // Flush to disk
-    log_file->flush();
-    
-    // Update statistics
-    {
-        std::lock_guard<std::mutex> lock(stats_mutex_);
-        size_t bytes = 0;
-        for (const auto& entry : batch) {
-            bytes += entry.data.size() + 1;
-        }
-        stats_.bytes_written += bytes;
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    if (!written) {
+        stats_.write_errors += records;
+        return;
     }
+    file_size.fetch_add(bytes);
+    stats_.bytes_written += bytes;
 }
 
 void OptimizedPersistenceManager::rotateLogFiles() {
-    // Rotate trade log if needed
-    if (trade_file_size_.load() >= MAX_FILE_SIZE && trade_log_ && trade_log_->is_open()) {
-        trade_log_->close();
+    // Rotate trade log if needed (the next file is already open and preallocated)
+    if (trade_file_size_.load() >= MAX_FILE_SIZE && trade_fd_ >= 0) {
+        ::close(trade_fd_);
         
-        auto now = std::chrono::system_clock::now();
-        auto time_t = std::chrono::system_clock::to_time_t(now);
-        std::stringstream ss;
-        ss << std::put_time(std::localtime(&time_t), "%Y%m%d_%H%M%S");
-        current_trade_file_ = data_dir_ + "/trades_" + ss.str() + ".log";
-        
-        trade_log_ = std::make_unique<std::ofstream>(current_trade_file_, std::ios::app | std::ios::binary);
-        trade_file_size_ = 0;
+        PreparedLogFile next = takePreparedLogFile(next_trade_log_, "trades");
+        current_trade_file_ = next.path;
+        trade_fd_ = next.fd;
+        trade_file_size_ = next.size;
+        next_trade_log_ = prepareNextLogFile("trades");
         
         LOG_INFO("Rotated trade log to: " + current_trade_file_);
     }
     
     // Rotate order log if needed
-    if (order_file_size_.load() >= MAX_FILE_SIZE && order_log_ && order_log_->is_open()) {
-        order_log_->close();
+    if (order_file_size_.load() >= MAX_FILE_SIZE && order_fd_ >= 0) {
+        ::close(order_fd_);
         
-        auto now = std::chrono::system_clock::now();
-        auto time_t = std::chrono::system_clock::to_time_t(now);
-        std::stringstream ss;
-        ss << std::put_time(std::localtime(&time_t), "%Y%m%d_%H%M%S");
-        current_order_file_ = data_dir_ + "/orders_" + ss.str() + ".log";
-        
-        order_log_ = std::make_unique<std::ofstream>(current_order_file_, std::ios::app | std::ios::binary);
-        order_file_size_ = 0;
+        PreparedLogFile next = takePreparedLogFile(next_order_log_, "orders");
+        current_order_file_ = next.path;
+        order_fd_ = next.fd;
+        order_file_size_ = next.size;
+        next_order_log_ = prepareNextLogFile("orders");
         
         LOG_INFO("Rotated order log to: " + current_order_file_);
     }
 }
 
-void OptimizedPersistenceManager::flush() {
-    if (!initialized_.load()) return;
-    
-    // Wait for queues to be empty
-    while (!trade_queue_->empty() || !order_queue_->empty()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+OptimizedPersistenceManager::PreparedLogFile
+OptimizedPersistenceManager::prepareLogFile(const std::string& path, const std::string& header) {
+    PreparedLogFile prepared;
+    prepared.path = path;
+    
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return prepared;
     }
     
-    // Notify writer to flush immediately
-    writer_cv_.notify_one();
+    // Reserve the file's blocks without changing its size, so appends up
+    // to MAX_FILE_SIZE never allocate on the writer thread
+#ifdef __linux__
+    ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(MAX_FILE_SIZE));
+#endif
     
-    // Wait a bit for writer thread to process
-    std::this_thread::sleep_for(std::chrono::milliseconds(flush_interval_ms_ + 10));
+    struct stat st;
+    if (::fstat(fd, &st) == 0) {
+        prepared.size = static_cast<uint64_t>(st.st_size);
+    }
+    prepared.created = prepared.size == 0;
+    if (prepared.created && !header.empty()) {
+        if (::write(fd, header.data(), header.size()) != static_cast<ssize_t>(header.size())) {
+            ::close(fd);
+            return prepared;
+        }
+        prepared.size = header.size();
+    }
     
-    // Final flush of file streams
-    if (trade_log_ && trade_log_->is_open()) {
-        trade_log_->flush();
+    prepared.fd = fd;
+    return prepared;
+}
+
+std::string OptimizedPersistenceManager::logFileHeader(bool is_trade) const {
+    if (format_ != PersistenceLogFormat::BINARY) {
+        return std::string();
     }
-    if (order_log_ && order_log_->is_open()) {
-        order_log_->flush();
+    PersistenceLogHeader header;
+    header.magic = is_trade ? kTradeLogMagic : kOrderLogMagic;
+    header.version = kPersistenceLogVersion;
+    header.record_size = static_cast<uint16_t>(is_trade ? sizeof(TradeLogRecord) : sizeof(OrderLogRecord));
+    return std::string(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+std::future<OptimizedPersistenceManager::PreparedLogFile>
+OptimizedPersistenceManager::prepareNextLogFile(const std::string& prefix) {
+    auto now = std::chrono::system_clock::now();
+    auto time_t = std::chrono::system_clock::to_time_t(now);
+    std::stringstream ss;
+    ss << data_dir_ << "/" << prefix << "_"
+       << std::put_time(std::localtime(&time_t), "%Y%m%d_%H%M%S")
+       << "_" << std::setw(4) << std::setfill('0') << ++log_file_index_ << log_extension_;
+    
+    return std::async(std::launch::async, &OptimizedPersistenceManager::prepareLogFile, ss.str(),
+                      logFileHeader(prefix == "trades"));
+}
+
+OptimizedPersistenceManager::PreparedLogFile
+OptimizedPersistenceManager::takePreparedLogFile(std::future<PreparedLogFile>& next,
+                                                 const std::string& prefix) {
+    if (!next.valid()) {
+        next = prepareNextLogFile(prefix);
+    }
+    PreparedLogFile prepared = next.get();
+    if (prepared.fd < 0) {
+        LOG_ERROR("Failed to prepare log file: " + prepared.path);
     }
+    return prepared;
+}
+
+void OptimizedPersistenceManager::discardPreparedLogFile(std::future<PreparedLogFile>& next) {
+    if (!next.valid()) {
+        return;
+    }
+    PreparedLogFile prepared = next.get();
+    if (prepared.fd >= 0) {
+        ::close(prepared.fd);
+    }
+    // Never written to: drop it along with its reserved blocks
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(prepared.path, ec);
+    if (prepared.created && !ec && size == prepared.size) {
+        std::filesystem::remove(prepared.path, ec);
+    }
+}
+
+void OptimizedPersistenceManager::flush() {
+    if (!initialized_.load()) return;
+    
+    // Ask the writer to write out everything queued so far and wait for it
+    uint64_t ticket = flush_requested_.fetch_add(1) + 1;
+    writer_cv_.notify_one();
+    
+    std::unique_lock<std::mutex> lock(writer_mutex_);
+    flush_cv_.wait(lock, [&] { return flush_completed_ >= ticket || !writer_running_; });
 }
 
 OptimizedPersistenceManager::Stats OptimizedPersistenceManager::getStats() const {
-    std::lock_guard<std::mutex> lock(stats_mutex_);
-    return stats_;
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats = stats_;
+    }
+    if (trade_queue_) {
+        stats.trade_queue_depth = trade_queue_->size();
+        stats.order_queue_depth = order_queue_->size();
+    }
+    stats.spin_waits = spin_waits_.load(std::memory_order_relaxed);
+    stats.records_spilled = records_spilled_.load(std::memory_order_relaxed);
+    stats.spill_bytes_pending = trade_spill_.pending() + order_spill_.pending();
+    return stats;
 }
 
 void OptimizedPersistenceManager::shutdown() {
@@ -410,15 +884,19 @@ void OptimizedPersistenceManager::shutdown() {
         writer_thread_.join();
     }
     
-    // Final flush
-    flush();
-    
-    if (trade_log_ && trade_log_->is_open()) {
-        trade_log_->close();
+    // The writer thread wrote everything out before exiting
+    if (trade_fd_ >= 0) {
+        ::close(trade_fd_);
+        trade_fd_ = -1;
     }
-    if (order_log_ && order_log_->is_open()) {
-        order_log_->close();
+    if (order_fd_ >= 0) {
+        ::close(order_fd_);
+        order_fd_ = -1;
     }
+    discardPreparedLogFile(next_trade_log_);
+    discardPreparedLogFile(next_order_log_);
+    trade_spill_.close();
+    order_spill_.close();
     
     initialized_ = false;
     LOG_INFO("Optimized persistence manager shut down");
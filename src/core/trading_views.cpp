@@ -0,0 +1,1422 @@
+#include "core/trading_views.h"
+#include "core/order_archive.h"
+#include "core/logger.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <thread>
+#include <unordered_set>
+
+namespace perpetual {
+
+namespace {
+
+// Optimistic attempts before a reader waits for the shard's writer
+constexpr int kOptimisticReads = 16;
+constexpr size_t kInitialTableSlots = 64;
+
+// Checkpoint state layout: ViewStateHeader, then per shard a
+// ShardStateHeader followed by its orders (each user's oldest first, each
+// view followed by the time it entered its status), positions and
+// accounts as raw view records
+constexpr uint32_t kViewStateMagic = 0x57454956;   // "VIEW"
+constexpr uint32_t kViewStateVersion = 2;
+constexpr size_t kOrderStateSize = sizeof(OrderView) + sizeof(int64_t);
+constexpr size_t kCheckpointsRetained = 2;
+constexpr const char* kCheckpointSuffix = ".snap";
+
+#pragma pack(push, 1)
+struct ViewStateHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t shards;
+    uint32_t order_size;
+    uint32_t position_size;
+    uint32_t account_size;
+};
+
+struct ShardStateHeader {
+    uint64_t orders;
+    uint64_t positions;
+    uint64_t accounts;
+};
+
+// Page token of query_user_orders: where the previous page stopped
+struct OrderPageCursor {
+    uint32_t magic;
+    uint8_t phase;                  // kResidentPhase or kArchivePhase
+    uint8_t status;                 // Query the token belongs to
+    InstrumentID instrument_id;
+    UserID user_id;
+    int64_t time;                   // Chain time of the last resident order returned
+    OrderID order_id;               // Last resident order returned
+    uint64_t archive_record;        // Last archive record passed (0 = none yet)
+};
+#pragma pack(pop)
+
+constexpr uint32_t kPageCursorMagic = 0x47504f55;  // "UOPG"
+constexpr uint8_t kResidentPhase = 0;
+constexpr uint8_t kArchivePhase = 1;
+
+std::string checkpoint_dir(const EventStore& store) {
+    return store.data_dir() + "/snapshots/views";
+}
+
+std::vector<std::string> list_checkpoints(const std::string& dir) {
+    std::vector<std::string> checkpoints;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (entry.path().extension() == kCheckpointSuffix) {
+            checkpoints.push_back(entry.path().string());
+        }
+    }
+    std::sort(checkpoints.begin(), checkpoints.end());
+    return checkpoints;
+}
+
+size_t default_partitions(size_t partitions) {
+    if (partitions == 0) {
+        partitions = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return std::min(partitions, kTradingViewShards);
+}
+
+inline uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+struct PositionKey {
+    UserID user_id;
+    InstrumentID instrument_id;
+
+    bool operator==(const PositionKey& other) const {
+        return user_id == other.user_id && instrument_id == other.instrument_id;
+    }
+};
+
+inline uint64_t key_hash(uint64_t key) { return mix64(key); }
+inline uint64_t key_hash(const PositionKey& key) {
+    return mix64(key.user_id ^ (static_cast<uint64_t>(key.instrument_id) << 40));
+}
+
+// Open-addressing table of plain records with a single writer. Readers
+// may probe while the writer inserts; the caller's seqlock tells them
+// whether what they copied is consistent. Arrays replaced by a resize are
+// retired and freed by a later write once no optimistic reader of the
+// shard (readers) is in flight.
+template <typename Key, typename Value>
+class FlatTable {
+public:
+    explicit FlatTable(const std::atomic<uint32_t>& readers) : readers_(readers) { reset(); }
+
+    const Value* find(const Key& key) const {
+        const Array* array = array_.load(std::memory_order_seq_cst);   // Ordered after readers_ (reclaim)
+        size_t mask = array->mask;
+        for (size_t i = key_hash(key) & mask, probes = 0; probes <= mask; i = (i + 1) & mask, ++probes) {
+            const Slot& slot = array->slots[i];
+            if (!slot.used) {
+                return nullptr;
+            }
+            if (slot.key == key) {
+                return &slot.value;
+            }
+        }
+        return nullptr;
+    }
+
+    Value* find(const Key& key) {
+        return const_cast<Value*>(static_cast<const FlatTable*>(this)->find(key));
+    }
+
+    // Existing record for key, or a new one initialized to value
+    Value& insert(const Key& key, const Value& value, bool& inserted) {
+        if (Value* existing = find(key)) {
+            inserted = false;
+            return *existing;
+        }
+        reclaim();
+        if ((size_ + 1) * 10 > (current().mask + 1) * 7) {
+            rehash((current().mask + 1) * 2);
+        }
+        inserted = true;
+        size_++;
+        return place(current(), key, value);
+    }
+
+    // Remove key, shifting later entries of its probe run back so no
+    // tombstones are needed. Readers racing this retry on the seqlock.
+    bool erase(const Key& key) {
+        Array& array = current();
+        size_t mask = array.mask;
+        size_t i = key_hash(key) & mask;
+        while (true) {
+            if (!array.slots[i].used) {
+                return false;
+            }
+            if (array.slots[i].key == key) {
+                break;
+            }
+            i = (i + 1) & mask;
+        }
+        for (size_t j = (i + 1) & mask; array.slots[j].used; j = (j + 1) & mask) {
+            // An entry may fill the hole only if its home slot is not in (i, j]
+            size_t home = key_hash(array.slots[j].key) & mask;
+            bool stays = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+            if (!stays) {
+                array.slots[i] = array.slots[j];
+                i = j;
+            }
+        }
+        array.slots[i].used = false;
+        size_--;
+        return true;
+    }
+
+    size_t size() const { return size_; }
+
+    // Grow ahead of a known number of inserts (writer side)
+    void reserve(size_t count) {
+        size_t slots = current().mask + 1;
+        while (count * 10 > slots * 7) {
+            slots *= 2;
+        }
+        if (slots != current().mask + 1) {
+            rehash(slots);
+        }
+    }
+
+    // Shrink after bulk erases so an eviction spike does not pin the
+    // table at its peak size (writer side; invalidates value pointers)
+    void compact() {
+        size_t slots = current().mask + 1;
+        if (slots <= kInitialTableSlots || size_ * 8 >= slots) {
+            reclaim();
+            return;
+        }
+        size_t target = kInitialTableSlots;
+        while (size_ * 4 > target) {
+            target *= 2;
+        }
+        rehash(target);
+    }
+
+    // Writer side (or with writers excluded)
+    template <typename Visit>
+    void for_each(Visit&& visit) const {
+        const Array& array = *current_;
+        for (size_t i = 0; i <= array.mask; ++i) {
+            if (array.slots[i].used) {
+                visit(array.slots[i].key, array.slots[i].value);
+            }
+        }
+    }
+
+    // Drop every entry. Under the write guard the old arrays are freed at
+    // once unless a reader is still probing them.
+    void reset() {
+        publish(kInitialTableSlots);
+        size_ = 0;
+        reclaim();
+    }
+
+private:
+    struct Slot {
+        Key key;
+        Value value;
+        bool used;
+    };
+
+    struct Array {
+        size_t mask;
+        std::unique_ptr<Slot[]> slots;
+    };
+
+    Array& current() { return *current_; }
+
+    static Value& place(Array& array, const Key& key, const Value& value) {
+        size_t i = key_hash(key) & array.mask;
+        while (array.slots[i].used) {
+            i = (i + 1) & array.mask;
+        }
+        Slot& slot = array.slots[i];
+        slot.key = key;
+        slot.value = value;
+        slot.used = true;
+        return slot.value;
+    }
+
+    Array& publish(size_t slots) {
+        auto array = std::make_unique<Array>();
+        array->mask = slots - 1;
+        array->slots.reset(new Slot[slots]());
+        if (current_) {
+            retired_.push_back(std::move(current_));
+        }
+        current_ = std::move(array);
+        array_.store(current_.get(), std::memory_order_seq_cst);
+        return *current_;
+    }
+
+    // The filled array is published before the old one is retired, so the
+    // old one is only freed by the next write
+    void rehash(size_t slots) {
+        std::unique_ptr<Array> filled = std::make_unique<Array>();
+        filled->mask = slots - 1;
+        filled->slots.reset(new Slot[slots]());
+        const Array& old = current();
+        for (size_t i = 0; i <= old.mask; ++i) {
+            if (old.slots[i].used) {
+                place(*filled, old.slots[i].key, old.slots[i].value);
+            }
+        }
+        retired_.push_back(std::move(current_));
+        current_ = std::move(filled);
+        array_.store(current_.get(), std::memory_order_seq_cst);
+    }
+
+    // Readers announce themselves before loading array_ (both seq_cst), so
+    // with none in flight nobody can still hold a retired array
+    void reclaim() {
+        if (!retired_.empty() && readers_.load(std::memory_order_seq_cst) == 0) {
+            retired_.clear();
+        }
+    }
+
+    const std::atomic<uint32_t>& readers_;
+    std::atomic<const Array*> array_{nullptr};
+    std::unique_ptr<Array> current_;
+    std::vector<std::unique_ptr<Array>> retired_;   // Replaced, maybe still probed
+    size_t size_ = 0;
+};
+
+// Shard sequence: odd while the writer is changing the shard
+struct SeqLock {
+    mutable std::mutex mutex;
+    std::atomic<uint64_t> sequence{0};
+    mutable std::atomic<uint32_t> readers{0};   // Optimistic reads in flight (see FlatTable)
+
+    void begin_write() {
+        mutex.lock();
+        sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void end_write() {
+        sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        mutex.unlock();
+    }
+
+    // Run read (which must be restartable) until it saw a consistent
+    // shard. Returns false if it had to lock out the writer.
+    template <typename Read>
+    bool read(Read&& read) const {
+        readers.fetch_add(1, std::memory_order_seq_cst);
+        for (int attempt = 0; attempt < kOptimisticReads; ++attempt) {
+            uint64_t before = sequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                continue;
+            }
+            read();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before) {
+                readers.fetch_sub(1, std::memory_order_release);
+                return true;
+            }
+        }
+        readers.fetch_sub(1, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(mutex);
+        read();
+        return false;
+    }
+};
+
+struct WriteGuard {
+    explicit WriteGuard(SeqLock& lock) : lock_(lock) { lock_.begin_write(); }
+    ~WriteGuard() { lock_.end_write(); }
+    SeqLock& lock_;
+};
+
+// Every resident order sits on up to kOrderChains newest-first chains of
+// its user, one per query shape. Chains are threaded through the order
+// records; their heads live in Shard::chains.
+enum OrderChain : size_t {
+    kUserChain,                 // All orders, by placement time
+    kInstrumentChain,           // Orders of one instrument, by placement time
+    kStatusChain,               // Orders in one status, by time of entering it
+    kStatusInstrumentChain,     // Both of the above
+    kOpenChain,                 // Pending and partially filled orders, by placement time
+    kOpenInstrumentChain,       // Open orders of one instrument
+    kOrderChains
+};
+
+struct ChainKey {
+    UserID user_id;
+    InstrumentID instrument_id; // 0 on chains without an instrument
+    uint8_t chain;
+    uint8_t status;             // Only on status chains
+
+    bool operator==(const ChainKey& other) const {
+        return user_id == other.user_id && instrument_id == other.instrument_id &&
+               chain == other.chain && status == other.status;
+    }
+};
+
+inline uint64_t key_hash(const ChainKey& key) {
+    return mix64(key.user_id ^ (static_cast<uint64_t>(key.instrument_id) << 32) ^
+                 (static_cast<uint64_t>(key.chain) << 24) ^ (static_cast<uint64_t>(key.status) << 16));
+}
+
+struct ChainHead {
+    OrderID newest = 0;
+    uint32_t count = 0;
+};
+
+struct ChainLink {
+    OrderID older;              // 0 = none
+    OrderID newer;              // 0 = none
+};
+
+inline bool is_terminal(OrderStatus status) {
+    return status == OrderStatus::FILLED || status == OrderStatus::CANCELLED ||
+           status == OrderStatus::REJECTED;
+}
+
+inline bool is_open(OrderStatus status) {
+    return status == OrderStatus::PENDING || status == OrderStatus::PARTIAL_FILLED;
+}
+
+inline bool has_instrument(size_t chain) {
+    return chain == kInstrumentChain || chain == kStatusInstrumentChain || chain == kOpenInstrumentChain;
+}
+
+inline bool by_status(size_t chain) {
+    return chain == kStatusChain || chain == kStatusInstrumentChain;
+}
+
+inline bool only_open(size_t chain) {
+    return chain == kOpenChain || chain == kOpenInstrumentChain;
+}
+
+// Chain answering a query filter
+size_t chain_for(InstrumentID instrument_id, OrderStatus status) {
+    if (status == kAnyOrderStatus) {
+        return instrument_id != 0 ? kInstrumentChain : kUserChain;
+    }
+    if (status == kOpenOrderStatus) {
+        return instrument_id != 0 ? kOpenInstrumentChain : kOpenChain;
+    }
+    return instrument_id != 0 ? kStatusInstrumentChain : kStatusChain;
+}
+
+ChainKey chain_key(UserID user_id, InstrumentID instrument_id, OrderStatus status, size_t chain) {
+    return ChainKey{user_id, has_instrument(chain) ? instrument_id : 0, static_cast<uint8_t>(chain),
+                    by_status(chain) ? static_cast<uint8_t>(status) : uint8_t{0}};
+}
+
+struct OrderRecord {
+    OrderView view;
+    int64_t status_since;       // Time the order entered its status
+    ChainLink links[kOrderChains];
+
+    bool on_chain(size_t chain) const { return !only_open(chain) || is_open(view.status); }
+
+    ChainKey key(size_t chain) const {
+        return chain_key(view.user_id, view.instrument_id, view.status, chain);
+    }
+
+    // Chains are ordered by (time, order id), newest first
+    int64_t time(size_t chain) const { return by_status(chain) ? status_since : view.timestamp; }
+
+    bool newer_than(int64_t other_time, OrderID other_id, size_t chain) const {
+        int64_t own = time(chain);
+        return own != other_time ? own > other_time : view.order_id > other_id;
+    }
+};
+
+struct PositionRecord {
+    PositionView view;
+    InstrumentID older;     // Previous position of the user (0 = none)
+};
+
+// Positions of a user are chained newest first through their records
+struct UserRecord {
+    InstrumentID newest_position = 0;
+    uint32_t position_count = 0;
+    bool has_account = false;
+    AccountView account{};
+};
+
+} // namespace
+
+struct TradingViews::Shard {
+    SeqLock lock;
+    FlatTable<UserID, UserRecord> users{lock.readers};
+    FlatTable<OrderID, OrderRecord> orders{lock.readers};
+    FlatTable<ChainKey, ChainHead> chains{lock.readers};
+    FlatTable<PositionKey, PositionRecord> positions{lock.readers};
+    std::deque<OrderID> terminal;   // Resident terminal orders, oldest first (archive open only)
+    bool track_terminal = false;    // Set by open_archive; without an archive nothing drains terminal
+
+    // Add a new order to the table and to its chains, except the status
+    // chains when link_status is false (caller holds the write side)
+    OrderRecord* link_order(const OrderView& view, int64_t status_since, bool link_status = true) {
+        bool inserted = false;
+        OrderRecord& record = orders.insert(view.order_id, OrderRecord{view, status_since, {}}, inserted);
+        if (!inserted) {
+            return nullptr;
+        }
+        for (size_t chain = 0; chain < kOrderChains; ++chain) {
+            if (record.on_chain(chain) && (link_status || !by_status(chain))) {
+                link(record, chain);
+            }
+        }
+        if (track_terminal && is_terminal(view.status)) {
+            terminal.push_back(view.order_id);
+        }
+        return &record;
+    }
+
+    // Remove an order from its chains and the table
+    void unlink_order(OrderID order_id) {
+        OrderRecord* record = orders.find(order_id);
+        if (!record) {
+            return;
+        }
+        for (size_t chain = 0; chain < kOrderChains; ++chain) {
+            if (record->on_chain(chain)) {
+                unlink(*record, chain);
+            }
+        }
+        orders.erase(order_id);
+    }
+
+    // Move an order to the chains of its new status
+    void set_status(OrderRecord& record, OrderStatus status, int64_t timestamp) {
+        if (record.view.status == status) {
+            return;
+        }
+        bool was_open = is_open(record.view.status);
+        for (size_t chain = 0; chain < kOrderChains; ++chain) {
+            if (by_status(chain) || (only_open(chain) && was_open && !is_open(status))) {
+                unlink(record, chain);
+            }
+        }
+        record.view.status = status;
+        record.status_since = timestamp;
+        for (size_t chain = 0; chain < kOrderChains; ++chain) {
+            if (by_status(chain) || (only_open(chain) && !was_open && is_open(status))) {
+                link(record, chain);
+            }
+        }
+    }
+
+    // Event times rarely go backwards, so this is almost always a push
+    // at the head
+    void link(OrderRecord& record, size_t chain) {
+        bool inserted = false;
+        ChainHead& head = chains.insert(record.key(chain), ChainHead(), inserted);
+        OrderID self = record.view.order_id;
+        OrderID newer = 0;
+        OrderID older = head.newest;
+        while (older != 0) {
+            OrderRecord* next = orders.find(older);
+            if (!next || !next->newer_than(record.time(chain), self, chain)) {
+                break;
+            }
+            newer = older;
+            older = next->links[chain].older;
+        }
+        record.links[chain] = ChainLink{older, newer};
+        if (OrderRecord* next = orders.find(older)) {
+            next->links[chain].newer = self;
+        }
+        if (OrderRecord* previous = orders.find(newer)) {
+            previous->links[chain].older = self;
+        } else {
+            head.newest = self;
+        }
+        head.count++;
+    }
+
+    void unlink(OrderRecord& record, size_t chain) {
+        ChainKey key = record.key(chain);
+        ChainHead* head = chains.find(key);
+        const ChainLink& link = record.links[chain];
+        if (OrderRecord* next = orders.find(link.older)) {
+            next->links[chain].newer = link.newer;
+        }
+        if (OrderRecord* previous = orders.find(link.newer)) {
+            previous->links[chain].older = link.older;
+        } else if (head) {
+            head->newest = link.older;
+        }
+        if (head && --head->count == 0) {
+            chains.erase(key);
+        }
+    }
+
+    PositionRecord& link_position(const PositionView& view, bool& inserted) {
+        UserRecord& user = users.insert(view.user_id, UserRecord(), inserted);
+        PositionRecord record{view, user.newest_position};
+        PositionRecord& stored = positions.insert(PositionKey{view.user_id, view.instrument_id},
+                                                  record, inserted);
+        if (inserted) {
+            UserRecord& current = *users.find(view.user_id);
+            current.newest_position = view.instrument_id;
+            current.position_count++;
+        }
+        return stored;
+    }
+};
+
+struct TradingViews::OwnerShard {
+    SeqLock lock;
+    FlatTable<OrderID, UserID> owners{lock.readers};
+};
+
+TradingViews::TradingViews()
+    : shards_(new Shard[kTradingViewShards]),
+      owner_shards_(new OwnerShard[kTradingViewShards]) {
+}
+
+TradingViews::~TradingViews() = default;
+
+size_t TradingViews::shard_index(UserID user_id) {
+    return mix64(user_id) % kTradingViewShards;
+}
+
+TradingViews::Shard& TradingViews::shard_of(UserID user_id) const {
+    return shards_[shard_index(user_id)];
+}
+
+TradingViews::OwnerShard& TradingViews::owner_shard_of(OrderID order_id) const {
+    return owner_shards_[mix64(order_id) % kTradingViewShards];
+}
+
+void TradingViews::apply(const Event& event) {
+    std::lock_guard<std::mutex> lock(apply_mutex_);
+    apply_owned(event, 0, 1);
+    if (event.sequence_id > applied_sequence_.load(std::memory_order_relaxed)) {
+        applied_sequence_.store(event.sequence_id, std::memory_order_release);
+    }
+}
+
+void TradingViews::apply_owned(const Event& event, size_t partition, size_t partitions) {
+    switch (event.type) {
+        case EventType::ORDER_PLACED: {
+            const auto& placed = event.data.order_placed;
+            if (!owns(placed.user_id, partition, partitions)) {
+                break;
+            }
+            OrderView view{};
+            view.order_id = placed.order_id;
+            view.user_id = placed.user_id;
+            view.instrument_id = event.instrument_id;
+            view.side = placed.side;
+            view.order_type = placed.order_type;
+            view.price = placed.price;
+            view.quantity = placed.quantity;
+            view.filled_quantity = 0;
+            view.remaining_quantity = placed.quantity;
+            view.status = OrderStatus::PENDING;
+            view.timestamp = event.event_timestamp;
+            view.updated_at = event.event_timestamp;
+            insert_order(view);
+            break;
+        }
+        case EventType::ORDER_CANCELLED:
+            if (owns(event.data.order_cancelled.user_id, partition, partitions)) {
+                apply_order_cancelled(event);
+            }
+            break;
+        case EventType::TRADE_EXECUTED: {
+            const Trade& trade = event.data.trade_executed.trade;
+            if (owns(trade.buy_user_id, partition, partitions)) {
+                fill_order(trade.buy_user_id, trade.buy_order_id, trade.quantity, event.event_timestamp);
+                move_position(trade.buy_user_id, trade.instrument_id, trade.quantity, trade.price,
+                              event.event_timestamp);
+            }
+            if (owns(trade.sell_user_id, partition, partitions)) {
+                fill_order(trade.sell_user_id, trade.sell_order_id, trade.quantity, event.event_timestamp);
+                move_position(trade.sell_user_id, trade.instrument_id, -trade.quantity, trade.price,
+                              event.event_timestamp);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void TradingViews::insert_order(const OrderView& view) {
+    // Owner first: a reader that finds the owner then finds the order
+    {
+        OwnerShard& owner = owner_shard_of(view.order_id);
+        WriteGuard guard(owner.lock);
+        bool inserted = false;
+        owner.owners.insert(view.order_id, view.user_id, inserted);
+    }
+
+    Shard& shard = shard_of(view.user_id);
+    WriteGuard guard(shard.lock);
+    shard.link_order(view, view.timestamp);
+}
+
+void TradingViews::insert_position(const PositionView& view) {
+    Shard& shard = shard_of(view.user_id);
+    WriteGuard guard(shard.lock);
+    bool inserted = false;
+    PositionRecord& stored = shard.link_position(view, inserted);
+    if (!inserted) {
+        stored.view = view;
+    }
+}
+
+void TradingViews::apply_order_cancelled(const Event& event) {
+    const auto& cancelled = event.data.order_cancelled;
+    Shard& shard = shard_of(cancelled.user_id);
+    WriteGuard guard(shard.lock);
+    OrderRecord* record = shard.orders.find(cancelled.order_id);
+    if (!record) {
+        OrderView view;
+        if (archive_ && archive_->get(cancelled.order_id, view)) {
+            view.status = cancelled.new_status;
+            view.updated_at = event.event_timestamp;
+            archive_->put(view);
+        }
+        return;
+    }
+    shard.set_status(*record, cancelled.new_status, event.event_timestamp);
+    record->view.updated_at = event.event_timestamp;
+    if (is_terminal(cancelled.new_status)) {
+        retire_order(shard, cancelled.order_id);
+    }
+}
+
+void TradingViews::retire_order(Shard& shard, OrderID order_id) {
+    if (!shard.track_terminal) {
+        return;
+    }
+    shard.terminal.push_back(order_id);
+
+    // Oldest terminal orders beyond the resident allowance go to disk.
+    // The archive is written before the order leaves memory, so readers
+    // always find it in one of the two.
+    while (shard.terminal.size() > resident_terminal_per_shard_) {
+        OrderID evicted = shard.terminal.front();
+        shard.terminal.pop_front();
+        const OrderRecord* record = shard.orders.find(evicted);
+        if (!record || !is_terminal(record->view.status)) {
+            continue;   // Gone already, or placed again by a replay
+        }
+        if (!archive_->put(record->view)) {
+            shard.terminal.push_front(evicted);
+            break;
+        }
+        shard.unlink_order(evicted);
+        OwnerShard& owner = owner_shard_of(evicted);
+        WriteGuard guard(owner.lock);
+        owner.owners.erase(evicted);
+        owner.owners.compact();
+    }
+    shard.orders.compact();
+    shard.chains.compact();
+}
+
+void TradingViews::fill_order(UserID user_id, OrderID order_id, Quantity quantity,
+                              int64_t timestamp) {
+    auto fill = [&](OrderView& view) {
+        view.filled_quantity += quantity;
+        view.remaining_quantity = std::max<Quantity>(0, view.remaining_quantity - quantity);
+        view.updated_at = timestamp;
+        return view.remaining_quantity == 0 ? OrderStatus::FILLED : OrderStatus::PARTIAL_FILLED;
+    };
+
+    Shard& shard = shard_of(user_id);
+    WriteGuard guard(shard.lock);
+    OrderRecord* record = shard.orders.find(order_id);
+    if (!record) {
+        // Already archived: update it there
+        OrderView view;
+        if (archive_ && archive_->get(order_id, view)) {
+            view.status = fill(view);
+            archive_->put(view);
+        }
+        return;
+    }
+    shard.set_status(*record, fill(record->view), timestamp);
+    if (record->view.status == OrderStatus::FILLED) {
+        retire_order(shard, order_id);
+    }
+}
+
+void TradingViews::move_position(UserID user_id, InstrumentID instrument_id, Quantity delta,
+                                 Price price, int64_t timestamp) {
+    Shard& shard = shard_of(user_id);
+    WriteGuard guard(shard.lock);
+
+    PositionView fresh{};
+    fresh.user_id = user_id;
+    fresh.instrument_id = instrument_id;
+    bool inserted = false;
+    PositionRecord& record = shard.link_position(fresh, inserted);
+
+    // Adding to a position averages the entry price; reducing keeps it;
+    // crossing zero starts a new position at the trade price
+    PositionView& view = record.view;
+    Quantity size = view.size + delta;
+    if (size == 0) {
+        view.entry_price = 0;
+    } else if ((view.size >= 0) != (size >= 0) || view.size == 0) {
+        view.entry_price = price;
+    } else if (std::llabs(size) > std::llabs(view.size)) {
+        double held = static_cast<double>(std::llabs(view.size));
+        double added = static_cast<double>(std::llabs(delta));
+        view.entry_price = static_cast<Price>(std::llround(
+            (static_cast<double>(view.entry_price) * held + static_cast<double>(price) * added) /
+            (held + added)));
+    }
+    view.size = size;
+    view.mark_price = price;
+    view.last_updated = timestamp;
+}
+
+void TradingViews::update_account(const AccountView& account) {
+    Shard& shard = shard_of(account.user_id);
+    WriteGuard guard(shard.lock);
+    bool inserted = false;
+    UserRecord& user = shard.users.insert(account.user_id, UserRecord(), inserted);
+    user.has_account = true;
+    user.account = account;
+}
+
+void TradingViews::clear() {
+    for (size_t i = 0; i < kTradingViewShards; ++i) {
+        {
+            WriteGuard guard(owner_shards_[i].lock);
+            owner_shards_[i].owners.reset();
+        }
+        WriteGuard guard(shards_[i].lock);
+        shards_[i].users.reset();
+        shards_[i].orders.reset();
+        shards_[i].chains.reset();
+        shards_[i].positions.reset();
+        shards_[i].terminal.clear();
+    }
+    applied_sequence_.store(0, std::memory_order_release);
+}
+
+bool TradingViews::get_order(OrderID order_id, OrderView& view) const {
+    UserID user_id = 0;
+    bool owned = false;
+    const OwnerShard& owner = owner_shard_of(order_id);
+    if (!owner.lock.read([&]() {
+            const UserID* found = owner.owners.find(order_id);
+            owned = found != nullptr;
+            user_id = owned ? *found : 0;
+        })) {
+        locked_reads_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!owned) {
+        return archive_ && archive_->get(order_id, view);
+    }
+
+    bool found = false;
+    const Shard& shard = shard_of(user_id);
+    if (!shard.lock.read([&]() {
+            const OrderRecord* record = shard.orders.find(order_id);
+            found = record != nullptr;
+            if (found) {
+                view = record->view;
+            }
+        })) {
+        locked_reads_.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Archived since the owner lookup
+    return found || (archive_ && archive_->get(order_id, view));
+}
+
+std::vector<OrderView> TradingViews::get_user_orders(UserID user_id, InstrumentID instrument_id,
+                                                     OrderStatus status) const {
+    size_t chain = chain_for(instrument_id, status);
+    ChainKey key = chain_key(user_id, instrument_id, status, chain);
+
+    std::vector<OrderView> orders;
+    const Shard& shard = shard_of(user_id);
+    if (!shard.lock.read([&]() {
+            orders.clear();
+            const ChainHead* head = shard.chains.find(key);
+            if (!head) {
+                return;
+            }
+            OrderID next = head->newest;
+            for (uint32_t i = 0, count = head->count; i < count && next != 0; ++i) {
+                const OrderRecord* record = shard.orders.find(next);
+                if (!record) {
+                    break;
+                }
+                orders.push_back(record->view);
+                next = record->links[chain].older;
+            }
+        })) {
+        locked_reads_.fetch_add(1, std::memory_order_relaxed);
+    }
+    std::reverse(orders.begin(), orders.end());
+
+    // Older history from disk. Skip orders listed above (they may have been
+    // archived since) and stale copies of orders resident again.
+    size_t resident_matches = orders.size();
+    if (archive_ && (status == kAnyOrderStatus || is_terminal(status))) {
+        std::unordered_set<OrderID> listed;
+        for (const OrderView& view : orders) {
+            listed.insert(view.order_id);
+        }
+        archive_->for_each_user_order(user_id, [&](const OrderView& view) {
+            if ((instrument_id == 0 || view.instrument_id == instrument_id) &&
+                (status == kAnyOrderStatus || view.status == status) &&
+                !listed.count(view.order_id) && !is_resident(view.order_id)) {
+                orders.push_back(view);
+            }
+            return true;
+        });
+    }
+
+    // Status chains run by time of entering the status; listings by placement
+    if (by_status(chain) || orders.size() != resident_matches) {
+        std::stable_sort(orders.begin(), orders.end(), [](const OrderView& a, const OrderView& b) {
+            return a.timestamp != b.timestamp ? a.timestamp < b.timestamp : a.order_id < b.order_id;
+        });
+    }
+    return orders;
+}
+
+bool TradingViews::query_user_orders(const UserOrderQuery& query, UserOrderPage& page) const {
+    page.orders.clear();
+    page.next_page_token.clear();
+    uint32_t limit = query.limit == 0 ? kDefaultOrderPageSize : std::min(query.limit, kMaxOrderPageSize);
+    size_t chain = chain_for(query.instrument_id, query.status);
+    ChainKey key = chain_key(query.user_id, query.instrument_id, query.status, chain);
+    bool archived = archive_ && (query.status == kAnyOrderStatus || is_terminal(query.status));
+
+    OrderPageCursor cursor{kPageCursorMagic, kResidentPhase, static_cast<uint8_t>(query.status),
+                           query.instrument_id, query.user_id, 0, 0, 0};
+    bool resume = !query.page_token.empty();
+    if (resume) {
+        OrderPageCursor given;
+        if (query.page_token.size() != sizeof(given)) {
+            return false;
+        }
+        memcpy(&given, query.page_token.data(), sizeof(given));
+        if (given.magic != cursor.magic || given.status != cursor.status ||
+            given.instrument_id != cursor.instrument_id || given.user_id != cursor.user_id ||
+            given.phase > kArchivePhase) {
+            return false;
+        }
+        cursor = given;
+    }
+
+    if (cursor.phase == kResidentPhase) {
+        OrderPageCursor last = cursor;
+        bool more = false;
+        const Shard& shard = shard_of(query.user_id);
+        if (!shard.lock.read([&]() {
+                page.orders.clear();
+                last = cursor;
+                more = false;
+                const ChainHead* head = shard.chains.find(key);
+                if (!head) {
+                    return;
+                }
+                uint32_t steps = head->count;
+                OrderID next = head->newest;
+                if (resume) {
+                    // Continue after the last order returned if it is still
+                    // where it was; otherwise skip what sorts at or before it
+                    const OrderRecord* at = shard.orders.find(cursor.order_id);
+                    if (at && at->on_chain(chain) && at->key(chain) == key &&
+                        at->time(chain) == cursor.time) {
+                        next = at->links[chain].older;
+                    } else {
+                        while (next != 0 && steps > 0) {
+                            const OrderRecord* record = shard.orders.find(next);
+                            if (!record) {
+                                next = 0;
+                                break;
+                            }
+                            if (record->view.order_id != cursor.order_id &&
+                                !record->newer_than(cursor.time, cursor.order_id, chain)) {
+                                break;
+                            }
+                            next = record->links[chain].older;
+                            steps--;
+                        }
+                    }
+                }
+                for (; next != 0 && steps > 0 && page.orders.size() < limit; --steps) {
+                    const OrderRecord* record = shard.orders.find(next);
+                    if (!record) {
+                        next = 0;
+                        break;
+                    }
+                    page.orders.push_back(record->view);
+                    last.time = record->time(chain);
+                    last.order_id = next;
+                    next = record->links[chain].older;
+                }
+                more = next != 0 && steps > 0;
+            })) {
+            locked_reads_.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (more) {
+            page.next_page_token.assign(reinterpret_cast<const char*>(&last), sizeof(last));
+            return true;
+        }
+        if (!archived) {
+            return true;
+        }
+        cursor.phase = kArchivePhase;
+        cursor.archive_record = 0;
+        if (page.orders.size() == limit) {
+            page.next_page_token.assign(reinterpret_cast<const char*>(&cursor), sizeof(cursor));
+            return true;
+        }
+    }
+    if (!archived) {
+        return true;
+    }
+
+    // Archived orders, most recently archived first. Filtered listings
+    // scan the user's archived orders; one match past the page is read to
+    // know whether there is another page.
+    std::unordered_set<OrderID> listed;
+    for (const OrderView& view : page.orders) {
+        listed.insert(view.order_id);
+    }
+    bool more = false;
+    uint64_t last_record = cursor.archive_record;
+    archive_->for_each_user_order(query.user_id, cursor.archive_record,
+                                  [&](uint64_t record, const OrderView& view) {
+        if ((query.instrument_id == 0 || view.instrument_id == query.instrument_id) &&
+            (query.status == kAnyOrderStatus || view.status == query.status) &&
+            !listed.count(view.order_id) && !is_resident(view.order_id)) {
+            if (page.orders.size() == limit) {
+                more = true;
+                return false;
+            }
+            page.orders.push_back(view);
+        }
+        last_record = record;
+        return true;
+    });
+    if (more) {
+        cursor.archive_record = last_record;
+        page.next_page_token.assign(reinterpret_cast<const char*>(&cursor), sizeof(cursor));
+    }
+    return true;
+}
+
+bool TradingViews::is_resident(OrderID order_id) const {
+    bool owned = false;
+    const OwnerShard& owner = owner_shard_of(order_id);
+    if (!owner.lock.read([&]() { owned = owner.owners.find(order_id) != nullptr; })) {
+        locked_reads_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return owned;
+}
+
+bool TradingViews::get_account(UserID user_id, AccountView& view) const {
+    bool found = false;
+    const Shard& shard = shard_of(user_id);
+    if (!shard.lock.read([&]() {
+            const UserRecord* user = shard.users.find(user_id);
+            found = user && user->has_account;
+            if (found) {
+                view = user->account;
+            }
+        })) {
+        locked_reads_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return found;
+}
+
+bool TradingViews::get_position(UserID user_id, InstrumentID instrument_id,
+                                PositionView& view) const {
+    bool found = false;
+    const Shard& shard = shard_of(user_id);
+    if (!shard.lock.read([&]() {
+            const PositionRecord* record = shard.positions.find(PositionKey{user_id, instrument_id});
+            found = record != nullptr;
+            if (found) {
+                view = record->view;
+            }
+        })) {
+        locked_reads_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return found;
+}
+
+std::vector<PositionView> TradingViews::get_user_positions(UserID user_id) const {
+    std::vector<PositionView> positions;
+    const Shard& shard = shard_of(user_id);
+    if (!shard.lock.read([&]() {
+            positions.clear();
+            const UserRecord* user = shard.users.find(user_id);
+            if (!user) {
+                return;
+            }
+            InstrumentID next = user->newest_position;
+            for (uint32_t i = 0, count = user->position_count; i < count; ++i) {
+                const PositionRecord* record = shard.positions.find(PositionKey{user_id, next});
+                if (!record) {
+                    break;
+                }
+                positions.push_back(record->view);
+                next = record->older;
+            }
+        })) {
+        locked_reads_.fetch_add(1, std::memory_order_relaxed);
+    }
+    std::reverse(positions.begin(), positions.end());
+    return positions;
+}
+
+bool TradingViews::open_archive(const std::string& dir, size_t resident_terminal_orders) {
+    auto archive = std::make_unique<OrderArchive>();
+    if (!archive->open(dir)) {
+        return false;
+    }
+    resident_terminal_per_shard_ = std::max<size_t>(1, resident_terminal_orders / kTradingViewShards);
+    archive_ = std::move(archive);
+    for (size_t i = 0; i < kTradingViewShards; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].lock.mutex);
+        shards_[i].track_terminal = true;
+    }
+    return true;
+}
+
+size_t TradingViews::archived_order_count() const {
+    return archive_ ? archive_->size() : 0;
+}
+
+size_t TradingViews::order_count() const {
+    size_t count = 0;
+    for (size_t i = 0; i < kTradingViewShards; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].lock.mutex);
+        count += shards_[i].orders.size();
+    }
+    return count;
+}
+
+std::string TradingViews::serialize_state(SequenceID& sequence) const {
+    std::lock_guard<std::mutex> apply_lock(apply_mutex_);
+    return serialize_locked(sequence);
+}
+
+std::string TradingViews::serialize_locked(SequenceID& sequence) const {
+    sequence = applied_sequence_.load(std::memory_order_acquire);
+
+    ViewStateHeader header{kViewStateMagic, kViewStateVersion,
+                           static_cast<uint32_t>(kTradingViewShards),
+                           static_cast<uint32_t>(sizeof(OrderView)),
+                           static_cast<uint32_t>(sizeof(PositionView)),
+                           static_cast<uint32_t>(sizeof(AccountView))};
+    std::string state(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<const OrderRecord*> orders;
+    std::vector<const PositionView*> positions;
+    for (size_t i = 0; i < kTradingViewShards; ++i) {
+        const Shard& shard = shards_[i];
+        std::lock_guard<std::mutex> lock(shard.lock.mutex);
+
+        // Walk each user's chains so a restore re-links them in order
+        ShardStateHeader counts{};
+        size_t counts_at = state.size();
+        state.append(reinterpret_cast<const char*>(&counts), sizeof(counts));
+        shard.chains.for_each([&](const ChainKey& key, const ChainHead& head) {
+            if (key.chain != kUserChain) {
+                return;
+            }
+            orders.clear();
+            for (OrderID next = head.newest; next != 0 && orders.size() < head.count;) {
+                const OrderRecord* record = shard.orders.find(next);
+                if (!record) {
+                    break;
+                }
+                orders.push_back(record);
+                next = record->links[kUserChain].older;
+            }
+            for (auto it = orders.rbegin(); it != orders.rend(); ++it) {
+                state.append(reinterpret_cast<const char*>(&(*it)->view), sizeof(OrderView));
+                state.append(reinterpret_cast<const char*>(&(*it)->status_since), sizeof(int64_t));
+            }
+            counts.orders += orders.size();
+        });
+
+        std::string position_records;
+        shard.users.for_each([&](UserID user_id, const UserRecord& user) {
+            positions.clear();
+            InstrumentID next = user.newest_position;
+            for (uint32_t k = 0; k < user.position_count; ++k) {
+                const PositionRecord* record = shard.positions.find(PositionKey{user_id, next});
+                if (!record) {
+                    break;
+                }
+                positions.push_back(&record->view);
+                next = record->older;
+            }
+            counts.positions += positions.size();
+            for (auto it = positions.rbegin(); it != positions.rend(); ++it) {
+                position_records.append(reinterpret_cast<const char*>(*it), sizeof(PositionView));
+            }
+        });
+        // Positions follow all of the shard's orders
+        state.append(position_records);
+        shard.users.for_each([&](UserID, const UserRecord& user) {
+            if (user.has_account) {
+                state.append(reinterpret_cast<const char*>(&user.account), sizeof(AccountView));
+                counts.accounts++;
+            }
+        });
+        memcpy(&state[counts_at], &counts, sizeof(counts));
+    }
+    return state;
+}
+
+bool TradingViews::restore_state(const std::string& state, SequenceID sequence, size_t partitions) {
+    ViewStateHeader header;
+    if (state.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, state.data(), sizeof(header));
+    if (header.magic != kViewStateMagic || header.version != kViewStateVersion ||
+        header.shards != kTradingViewShards || header.order_size != sizeof(OrderView) ||
+        header.position_size != sizeof(PositionView) || header.account_size != sizeof(AccountView)) {
+        LOG_WARN("View checkpoint does not match this build");
+        return false;
+    }
+
+    // Locate every shard's section before handing shards to threads
+    std::vector<size_t> sections;
+    size_t offset = sizeof(header);
+    for (size_t i = 0; i < kTradingViewShards; ++i) {
+        ShardStateHeader counts;
+        if (state.size() - offset < sizeof(counts)) {
+            return false;
+        }
+        memcpy(&counts, state.data() + offset, sizeof(counts));
+        sections.push_back(offset);
+        uint64_t bytes = counts.orders * kOrderStateSize + counts.positions * sizeof(PositionView) +
+                         counts.accounts * sizeof(AccountView);
+        if (state.size() - offset - sizeof(counts) < bytes) {
+            return false;
+        }
+        offset += sizeof(counts) + bytes;
+    }
+    if (offset != state.size()) {
+        return false;
+    }
+
+    clear();
+    uint64_t total_orders = 0;
+    for (size_t i = 0; i < kTradingViewShards; ++i) {
+        ShardStateHeader counts;
+        memcpy(&counts, state.data() + sections[i], sizeof(counts));
+        total_orders += counts.orders;
+    }
+
+    // Each thread rebuilds whole shards under one write section per shard,
+    // then the owners of the orders in its owner shards
+    auto restore_shards = [&](size_t partition, size_t count) {
+        for (size_t i = partition; i < kTradingViewShards; i += count) {
+            ShardStateHeader counts;
+            const char* in = state.data() + sections[i];
+            memcpy(&counts, in, sizeof(counts));
+            in += sizeof(counts);
+
+            Shard& shard = shards_[i];
+            WriteGuard guard(shard.lock);
+            shard.orders.reserve(counts.orders);
+            shard.positions.reserve(counts.positions);
+            std::vector<std::pair<int64_t, OrderID>> by_status_time;
+            by_status_time.reserve(counts.orders);
+            for (uint64_t k = 0; k < counts.orders; ++k, in += kOrderStateSize) {
+                OrderView view;
+                int64_t status_since;
+                memcpy(&view, in, sizeof(view));
+                memcpy(&status_since, in + sizeof(view), sizeof(status_since));
+                if (shard.link_order(view, status_since, false)) {
+                    by_status_time.emplace_back(status_since, view.order_id);
+                }
+            }
+
+            // Status chains (and the eviction queue) go in the order the
+            // orders entered their status, so every link is at the head
+            std::sort(by_status_time.begin(), by_status_time.end());
+            shard.terminal.clear();
+            for (const auto& entry : by_status_time) {
+                OrderRecord& record = *shard.orders.find(entry.second);
+                shard.link(record, kStatusChain);
+                shard.link(record, kStatusInstrumentChain);
+                if (shard.track_terminal && is_terminal(record.view.status)) {
+                    shard.terminal.push_back(entry.second);
+                }
+            }
+            for (uint64_t k = 0; k < counts.positions; ++k, in += sizeof(PositionView)) {
+                PositionView view;
+                memcpy(&view, in, sizeof(view));
+                bool inserted = false;
+                shard.link_position(view, inserted).view = view;
+            }
+            for (uint64_t k = 0; k < counts.accounts; ++k, in += sizeof(AccountView)) {
+                AccountView view;
+                memcpy(&view, in, sizeof(view));
+                bool inserted = false;
+                UserRecord& user = shard.users.insert(view.user_id, UserRecord(), inserted);
+                user.has_account = true;
+                user.account = view;
+            }
+        }
+
+        for (size_t j = partition; j < kTradingViewShards; j += count) {
+            owner_shards_[j].lock.begin_write();
+            owner_shards_[j].owners.reserve(total_orders / kTradingViewShards * 5 / 4);
+        }
+        for (size_t i = 0; i < kTradingViewShards; ++i) {
+            ShardStateHeader counts;
+            const char* in = state.data() + sections[i];
+            memcpy(&counts, in, sizeof(counts));
+            in += sizeof(counts);
+            for (uint64_t k = 0; k < counts.orders; ++k, in += kOrderStateSize) {
+                OrderID order_id;
+                UserID user_id;
+                memcpy(&order_id, in + offsetof(OrderView, order_id), sizeof(order_id));
+                size_t owner = mix64(order_id) % kTradingViewShards;
+                if (owner % count == partition) {
+                    memcpy(&user_id, in + offsetof(OrderView, user_id), sizeof(user_id));
+                    bool inserted = false;
+                    owner_shards_[owner].owners.insert(order_id, user_id, inserted);
+                }
+            }
+        }
+        for (size_t j = partition; j < kTradingViewShards; j += count) {
+            owner_shards_[j].lock.end_write();
+        }
+    };
+    partitions = default_partitions(partitions);
+    std::vector<std::thread> threads;
+    for (size_t p = 1; p < partitions; ++p) {
+        threads.emplace_back(restore_shards, p, partitions);
+    }
+    restore_shards(0, partitions);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    applied_sequence_.store(sequence, std::memory_order_release);
+    return true;
+}
+
+bool TradingViews::write_checkpoint(EventStore& store) const {
+    std::string dir = checkpoint_dir(store);
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+
+    // Orders evicted up to the checkpoint must be on disk with it: flush
+    // before apply() can evict the next ones
+    SequenceID sequence = 0;
+    std::string state;
+    {
+        std::lock_guard<std::mutex> apply_lock(apply_mutex_);
+        state = serialize_locked(sequence);
+        if (archive_) {
+            archive_->flush();
+        }
+    }
+
+    // The checkpoint must never be ahead of the durable log
+    store.flush();
+    char name[32];
+    snprintf(name, sizeof(name), "%020llu", static_cast<unsigned long long>(sequence));
+    if (!store.create_snapshot(sequence, dir + "/" + name + kCheckpointSuffix, state)) {
+        LOG_ERROR("Failed to write view checkpoint at sequence " + std::to_string(sequence));
+        return false;
+    }
+
+    // Zero-padded names sort by sequence; drop all but the newest few
+    std::vector<std::string> checkpoints = list_checkpoints(dir);
+    for (size_t i = 0; i + kCheckpointsRetained < checkpoints.size(); ++i) {
+        std::filesystem::remove(checkpoints[i], ec);
+    }
+    return true;
+}
+
+bool TradingViews::load_checkpoint(const EventStore& store, SequenceID& sequence, size_t partitions) {
+    std::vector<std::string> checkpoints = list_checkpoints(checkpoint_dir(store));
+
+    // Newest valid checkpoint wins; a torn or corrupt one falls back to older
+    for (auto it = checkpoints.rbegin(); it != checkpoints.rend(); ++it) {
+        std::string state;
+        if (EventStore::load_snapshot(*it, sequence, state) &&
+            restore_state(state, sequence, partitions)) {
+            LOG_INFO("Loaded view checkpoint " + *it);
+            return true;
+        }
+        LOG_WARN("Skipping unusable view checkpoint " + *it);
+    }
+
+    clear();
+    sequence = 0;
+    return false;
+}
+
+bool TradingViews::replay(const EventStore& store, SequenceID after, size_t partitions) {
+    partitions = default_partitions(partitions);
+    SequenceID to = store.get_latest_sequence();
+    if (to <= after) {
+        return true;
+    }
+
+    auto partition_of = [this, partitions](const Event& event) -> size_t {
+        switch (event.type) {
+            case EventType::ORDER_PLACED:
+                return shard_index(event.data.order_placed.user_id) % partitions;
+            case EventType::ORDER_CANCELLED:
+                return shard_index(event.data.order_cancelled.user_id) % partitions;
+            case EventType::TRADE_EXECUTED: {
+                const Trade& trade = event.data.trade_executed.trade;
+                size_t buy = shard_index(trade.buy_user_id) % partitions;
+                size_t sell = shard_index(trade.sell_user_id) % partitions;
+                return buy == sell ? buy : EventStore::kReplayAll;
+            }
+            default:
+                return EventStore::kReplaySkip;
+        }
+    };
+    auto handler = [this, partitions](size_t partition, const Event& event) {
+        apply_owned(event, partition, partitions);
+        return true;
+    };
+    if (!store.replay_events_parallel(after + 1, to, partitions, partition_of, handler)) {
+        return false;
+    }
+    applied_sequence_.store(to, std::memory_order_release);
+    return true;
+}
+
+bool TradingViews::recover(const EventStore& store, size_t partitions) {
+    SequenceID sequence = 0;
+    load_checkpoint(store, sequence, partitions);
+    if (store.first_sequence() > sequence + 1) {
+        LOG_ERROR("Event log starts after the newest view checkpoint; cannot rebuild views");
+        return false;
+    }
+    return replay(store, sequence, partitions);
+}
+
+} // namespace perpetual
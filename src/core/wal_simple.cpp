@@ -7,31 +7,29 @@
 #include <sstream>
 #include <fstream>
 #include <cerrno>
+#include <stdexcept>
 
 namespace perpetual {
 
-WriteAheadLog::WriteAheadLog(const std::string& path) : path_(path) {
+WriteAheadLog::WriteAheadLog(const std::string& path, const JournalWriterConfig& journal_config)
+    : path_(path) {
     // Create directory if not exists
     mkdir(path_.c_str(), 0755);
     
-    // Open WAL file
-    std::string wal_file = path_ + "/wal.log";
-    wal_fd_ = open(wal_file.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
-    
-    if (wal_fd_ < 0) {
+    // Open WAL through the journal (io_uring when available); segmented
+    // journals live in their own directory of preallocated segments
+    std::string wal_file = path_ + (journal_config.segment_bytes > 0 ? "/segments" : "/wal.log");
+    journal_ = JournalWriter::create(journal_config);
+    if (!journal_->open(wal_file)) {
         throw std::runtime_error("Failed to open WAL file: " + wal_file);
     }
     
-    // Get current file size
-    struct stat st;
-    if (fstat(wal_fd_, &st) == 0) {
-        current_offset_.store(st.st_size);
-    }
+    current_offset_.store(journal_->offset());
 }
 
 WriteAheadLog::~WriteAheadLog() {
-    if (wal_fd_ >= 0) {
-        close(wal_fd_);
+    if (journal_) {
+        journal_->close();
     }
 }
 
@@ -39,8 +37,19 @@ bool WriteAheadLog::append(const Order& order) {
     std::lock_guard<std::mutex> lock(write_mutex_);
     
     // Simple append (in real implementation, use proper serialization)
-    ssize_t n = write(wal_fd_, &order, sizeof(Order));
-    if (n != sizeof(Order)) {
+    if (journal_->append(&order, sizeof(Order)) == 0) {
+        return false;
+    }
+    
+    current_offset_.fetch_add(sizeof(Order));
+    return true;
+}
+
+bool WriteAheadLog::append(const Order& order, uint64_t& record) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    
+    record = journal_->append(&order, sizeof(Order));
+    if (record == 0) {
         return false;
     }
     
@@ -51,8 +60,7 @@ bool WriteAheadLog::append(const Order& order) {
 bool WriteAheadLog::append(const Trade& trade) {
     std::lock_guard<std::mutex> lock(write_mutex_);
     
-    ssize_t n = write(wal_fd_, &trade, sizeof(Trade));
-    if (n != sizeof(Trade)) {
+    if (journal_->append(&trade, sizeof(Trade)) == 0) {
         return false;
     }
     
@@ -61,11 +69,21 @@ bool WriteAheadLog::append(const Trade& trade) {
 }
 
 void WriteAheadLog::sync() {
-    if (fsync(wal_fd_) != 0) {
-        throw std::runtime_error("fsync failed: " + std::string(strerror(errno)));
+    uint64_t record = 0;
+    {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        record = journal_->commit();
+    }
+    if (!journal_->wait_durable(record)) {
+        throw std::runtime_error("WAL sync failed");
     }
 }
 
+uint64_t WriteAheadLog::commit() {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    return journal_->commit();
+}
+
 void WriteAheadLog::mark_committed(Timestamp timestamp) {
     last_committed_ts_ = timestamp;
 }
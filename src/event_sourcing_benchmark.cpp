@@ -1,5 +1,7 @@
 #include "core/matching_engine_event_sourcing.h"
 #include "core/event_sourcing_advanced.h"
+#include "core/log_shipping.h"
+#include "core/trading_views.h"
 #include "core/deterministic_calculator.h"
 #include "core/types.h"
 #include "core/order.h"
@@ -10,6 +12,14 @@
 #include <iomanip>
 #include <thread>
 #include <atomic>
+#include <fstream>
+#include <filesystem>
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 using namespace perpetual;
 using namespace std::chrono;
@@ -251,17 +261,24 @@ BenchmarkResult benchmark_event_store_io(size_t num_events) {
 BenchmarkResult benchmark_event_stream_processing(size_t num_events) {
     std::cout << "\n[Benchmark 4] Event Stream Processing (" << num_events << " events)..." << std::endl;
     
+    std::filesystem::remove_all("./benchmark_data_stream");
+    std::filesystem::create_directories("./benchmark_data_stream");
     EventStore store;
     store.initialize("./benchmark_data_stream");
     
     EventStreamProcessor processor(&store);
     
     std::atomic<size_t> events_processed(0);
+    std::atomic<size_t> other_instrument(0);
     
-    // Subscribe to events
-    processor.subscribe([&events_processed](const Event& event) {
+    // Subscribe to events; the second subscription's selector rejects
+    // every event before it is decoded
+    processor.subscribe([&events_processed](const Event&) {
         events_processed++;
     });
+    processor.subscribe([&other_instrument](const Event&) {
+        other_instrument++;
+    }, nullptr, EventSelector::of({EventType::ORDER_PLACED}, 2));
     
     // Generate and append events
     for (size_t i = 0; i < num_events; ++i) {
@@ -386,6 +403,609 @@ BenchmarkResult benchmark_event_compression(size_t num_events) {
     return result;
 }
 
+// Benchmark 7: Binary Event Encoding
+BenchmarkResult benchmark_event_encoding(size_t num_events) {
+    std::cout << "\n[Benchmark 7] Binary Event Encoding (" << num_events << " events)..." << std::endl;
+    
+    std::vector<Event> events(num_events);
+    for (size_t i = 0; i < num_events; ++i) {
+        Event& event = events[i];
+        event.sequence_id = i + 1;
+        event.instrument_id = 1;
+        event.event_timestamp = DeterministicCalculator::sequence_to_timestamp(i + 1);
+        if (i % 2 == 0) {
+            event.type = EventType::ORDER_PLACED;
+            event.data.order_placed.order_id = 1000 + i;
+            event.data.order_placed.user_id = 2000 + i;
+            event.data.order_placed.side = OrderSide::BUY;
+            event.data.order_placed.order_type = OrderType::LIMIT;
+            event.data.order_placed.price = double_to_price(50000.0);
+            event.data.order_placed.quantity = double_to_quantity(1.0);
+        } else {
+            event.type = EventType::TRADE_EXECUTED;
+            event.data.trade_executed.trade.buy_order_id = 1000 + i;
+            event.data.trade_executed.trade.sell_order_id = 999 + i;
+            event.data.trade_executed.trade.price = double_to_price(50000.0);
+            event.data.trade_executed.trade.quantity = double_to_quantity(1.0);
+        }
+    }
+    
+    std::vector<char> buffer(num_events * sizeof(Event));
+    std::vector<nanoseconds> latencies;
+    latencies.reserve(num_events);
+    
+    // Encode + decode round trip per event
+    size_t offset = 0;
+    Event decoded;
+    auto start = high_resolution_clock::now();
+    for (const auto& event : events) {
+        auto op_start = high_resolution_clock::now();
+        size_t len = event.encode(buffer.data() + offset);
+        Event::decode(buffer.data() + offset, len, decoded);
+        auto op_end = high_resolution_clock::now();
+        offset += len;
+        latencies.push_back(duration_cast<nanoseconds>(op_end - op_start));
+    }
+    auto end = high_resolution_clock::now();
+    
+    std::cout << "  In-memory Event:   " << sizeof(Event) << " bytes" << std::endl;
+    std::cout << "  Encoded (average): " << std::fixed << std::setprecision(1)
+              << static_cast<double>(offset) / num_events << " bytes" << std::endl;
+    
+    return calculate_results("Event Encode+Decode", latencies, duration_cast<nanoseconds>(end - start));
+}
+
+// Benchmark 8: Event Chain Verification
+BenchmarkResult benchmark_chain_verification(size_t num_events) {
+    std::cout << "\n[Benchmark 8] Event Chain Verification (" << num_events << " events)..." << std::endl;
+    
+    // Small segments so the sealed ones are verified in parallel
+    EventStoreConfig config;
+    config.journal.segment_bytes = 1024 * 1024;
+    std::filesystem::create_directories("./benchmark_data_chain");
+    EventStore store;
+    store.initialize("./benchmark_data_chain", config);
+    
+    for (size_t i = 0; i < num_events; ++i) {
+        Event event;
+        event.type = EventType::ORDER_PLACED;
+        event.instrument_id = 1;
+        event.data.order_placed.order_id = 1000 + i;
+        event.data.order_placed.user_id = 2000 + i;
+        event.data.order_placed.side = OrderSide::BUY;
+        event.data.order_placed.order_type = OrderType::LIMIT;
+        event.data.order_placed.price = double_to_price(50000.0);
+        event.data.order_placed.quantity = double_to_quantity(1.0);
+        store.append_event(event);
+    }
+    store.flush();
+    
+    auto start = high_resolution_clock::now();
+    bool valid = store.verify_chain();
+    auto end = high_resolution_clock::now();
+    auto total_time = duration_cast<nanoseconds>(end - start);
+    
+    std::cout << "  Chain:    " << std::hex << store.chain_hash() << std::dec
+              << (valid ? " (verified)" : " (MISMATCH)") << std::endl;
+    std::cout << "  Segments: " << store.sealed_segments().size() + 1 << std::endl;
+    
+    BenchmarkResult result;
+    result.name = "Event Chain Verification";
+    result.operations = store.event_count();
+    result.total_time = total_time;
+    double total_seconds = duration_cast<microseconds>(total_time).count() / 1000000.0;
+    result.throughput = (total_seconds > 0) ? (result.operations / total_seconds) : 0;
+    result.avg_latency = result.operations > 0 ? nanoseconds(total_time.count() / result.operations)
+                                               : nanoseconds(0);
+    result.min_latency = result.avg_latency;
+    result.max_latency = result.avg_latency;
+    result.p50_latency = result.avg_latency;
+    result.p90_latency = result.avg_latency;
+    result.p99_latency = result.avg_latency;
+    return result;
+}
+
+// Benchmark 9: Log Shipping to replica processes on this machine
+BenchmarkResult benchmark_log_shipping(size_t num_events) {
+    constexpr size_t kReplicas = 2;
+    const std::string address = "unix:./benchmark_ship.sock";
+    std::cout << "\n[Benchmark 9] Log Shipping (" << num_events << " events, "
+              << kReplicas << " replica processes)..." << std::endl;
+    
+    // Replicas follow until their parent exits
+    std::vector<pid_t> children;
+    for (size_t r = 0; r < kReplicas; ++r) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            std::string dir = "./benchmark_data_replica" + std::to_string(r + 1);
+            std::filesystem::create_directories(dir);
+            EventStore store;
+            store.initialize(dir);
+            LogReplica replica;
+            LogReplicaConfig config;
+            config.primary_address = address;
+            config.node_id = static_cast<NodeID>(r + 1);
+            replica.start(&store, config);
+            while (getppid() != 1 && access("./benchmark_ship.done", F_OK) != 0) {
+                usleep(10000);
+            }
+            replica.stop();
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    
+    std::filesystem::create_directories("./benchmark_data_primary");
+    EventStore store;
+    store.initialize("./benchmark_data_primary");
+    LogShipper shipper;
+    LogShipperConfig config;
+    config.listen_address = address;
+    shipper.start(&store, config);
+    shipper.wait_replicated(store.get_latest_sequence(), kReplicas, seconds(10));
+    
+    // Append and wait until every replica holds the event
+    std::vector<nanoseconds> latencies;
+    latencies.reserve(num_events);
+    auto start = high_resolution_clock::now();
+    for (size_t i = 0; i < num_events; ++i) {
+        Event event;
+        event.type = EventType::ORDER_PLACED;
+        event.instrument_id = 1;
+        event.data.order_placed.order_id = 1000 + i;
+        event.data.order_placed.user_id = 2000 + i;
+        auto op_start = high_resolution_clock::now();
+        store.append_event(event);
+        shipper.wait_replicated(store.get_latest_sequence(), kReplicas, seconds(5));
+        latencies.push_back(duration_cast<nanoseconds>(high_resolution_clock::now() - op_start));
+    }
+    auto end = high_resolution_clock::now();
+    
+    std::cout << "  Batches: " << shipper.batches_sealed()
+              << ", bytes shipped: " << shipper.bytes_shipped() << std::endl;
+    for (const auto& replica : shipper.replicas()) {
+        std::cout << "  Replica " << replica.node << ": acked " << replica.acked_sequence << std::endl;
+    }
+    
+    std::ofstream("./benchmark_ship.done").put('\n');
+    for (pid_t pid : children) {
+        waitpid(pid, nullptr, 0);
+    }
+    shipper.stop();
+    std::remove("./benchmark_ship.done");
+    
+    return calculate_results("Log Shipping (all replicas acked)", latencies,
+                             duration_cast<nanoseconds>(end - start));
+}
+
+// Benchmark 10: Hot standby following a primary process's log, then
+// promoted after the primary is killed
+BenchmarkResult benchmark_hot_standby(size_t num_orders) {
+    const std::string dir = "./benchmark_data_standby";
+    std::cout << "\n[Benchmark 10] Hot Standby (" << num_orders << " orders)..." << std::endl;
+    
+    struct PrimaryReport {
+        SequenceID head;
+        Price best_bid;
+        Price best_ask;
+        uint64_t resting;
+        int64_t total_ns;
+    };
+    
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    int report_pipe[2];
+    if (pipe(report_pipe) != 0) {
+        return calculate_results("Primary with Hot Standby", {}, nanoseconds(0));
+    }
+    
+    // The primary runs flat out in its own process, then reports its book
+    // and per-order latencies and waits to be killed
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(report_pipe[0]);
+        auto orders = generate_orders(num_orders, 1);
+        MatchingEngineEventSourcing primary(1);
+        primary.initialize(dir);
+        std::vector<int64_t> latencies;
+        latencies.reserve(num_orders);
+        auto start = high_resolution_clock::now();
+        for (size_t i = 0; i < num_orders; ++i) {
+            auto order_start = high_resolution_clock::now();
+            primary.process_order_es(orders[i].get());
+            latencies.push_back((high_resolution_clock::now() - order_start).count());
+        }
+        auto end = high_resolution_clock::now();
+        primary.get_event_store()->flush();
+        
+        const OrderBook& book = primary.get_orderbook();
+        PrimaryReport report{primary.get_event_store()->get_latest_sequence(), book.best_bid(),
+                             book.best_ask(), book.bids().size() + book.asks().size(),
+                             duration_cast<nanoseconds>(end - start).count()};
+        std::string out(reinterpret_cast<const char*>(&report), sizeof(report));
+        out.append(reinterpret_cast<const char*>(latencies.data()), latencies.size() * sizeof(int64_t));
+        for (size_t written = 0; written < out.size(); ) {
+            ssize_t n = write(report_pipe[1], out.data() + written, out.size() - written);
+            if (n <= 0) break;
+            written += static_cast<size_t>(n);
+        }
+        while (true) {
+            pause();
+        }
+    }
+    close(report_pipe[1]);
+    
+    MatchingEngineEventSourcing standby(1);
+    standby.start_standby(dir);
+    
+    // Sample the standby's lag until the primary reports
+    SequenceID max_lag = 0;
+    std::string in;
+    char buffer[65536];
+    size_t expected = sizeof(PrimaryReport) + num_orders * sizeof(int64_t);
+    auto start = high_resolution_clock::now();
+    while (in.size() < expected) {
+        max_lag = std::max(max_lag, standby.standby_lag());
+        pollfd ready{report_pipe[0], POLLIN, 0};
+        if (poll(&ready, 1, 10) == 0) {
+            continue;
+        }
+        ssize_t n = read(report_pipe[0], buffer, sizeof(buffer));
+        if (n <= 0) break;
+        in.append(buffer, static_cast<size_t>(n));
+    }
+    close(report_pipe[0]);
+    PrimaryReport report{};
+    if (in.size() >= sizeof(report)) {
+        memcpy(&report, in.data(), sizeof(report));
+    }
+    
+    // How long after the primary's last commit the standby caught up
+    auto drain_start = high_resolution_clock::now();
+    while (standby.applied_sequence() < report.head &&
+           high_resolution_clock::now() - drain_start < seconds(10)) {
+        std::this_thread::sleep_for(microseconds(50));
+    }
+    auto drained = duration_cast<microseconds>(high_resolution_clock::now() - drain_start).count();
+    double applied_rate = standby.applied_sequence() /
+        (duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0);
+    
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    
+    auto promote_start = high_resolution_clock::now();
+    bool promoted = standby.promote();
+    auto promote_us = duration_cast<microseconds>(high_resolution_clock::now() - promote_start).count();
+    
+    const OrderBook& book = standby.get_orderbook();
+    bool match = book.best_bid() == report.best_bid && book.best_ask() == report.best_ask &&
+                 book.bids().size() + book.asks().size() == report.resting;
+    std::cout << "  Standby applied " << std::fixed << std::setprecision(0) << applied_rate
+              << " events/sec, max sampled lag " << max_lag << " events, caught up "
+              << drained << " us after the primary's last commit" << std::endl;
+    std::cout << "  Promoted: " << (promoted ? "yes" : "no") << " in " << promote_us
+              << " us at sequence " << standby.applied_sequence()
+              << ", book " << (match ? "matches" : "DIFFERS from") << " the primary's" << std::endl;
+    
+    std::vector<nanoseconds> latencies;
+    latencies.reserve(num_orders);
+    for (size_t offset = sizeof(report); offset + sizeof(int64_t) <= in.size(); offset += sizeof(int64_t)) {
+        int64_t latency;
+        memcpy(&latency, in.data() + offset, sizeof(latency));
+        latencies.push_back(nanoseconds(latency));
+    }
+    return calculate_results("Primary with Hot Standby", latencies, nanoseconds(report.total_ns));
+}
+
+// Benchmark 11: Query latency on the trading views while events are applied
+// at rising rates (0 = no writer, SIZE_MAX = as fast as possible)
+BenchmarkResult benchmark_view_queries(size_t num_orders) {
+    constexpr UserID kUsers = 10000;
+    std::cout << "\n[Benchmark 11] View Queries under Event Load (" << num_orders << " orders)..." << std::endl;
+    
+    auto placed = [](OrderID order_id) {
+        Event event;
+        event.type = EventType::ORDER_PLACED;
+        event.event_timestamp = order_id;
+        event.instrument_id = 1;
+        event.data.order_placed.order_id = order_id;
+        event.data.order_placed.user_id = 1 + order_id % kUsers;
+        event.data.order_placed.side = (order_id & 1) ? OrderSide::BUY : OrderSide::SELL;
+        event.data.order_placed.order_type = OrderType::LIMIT;
+        event.data.order_placed.price = double_to_price(50000.0);
+        event.data.order_placed.quantity = double_to_quantity(1.0);
+        return event;
+    };
+    
+    TradingViews views;
+    for (OrderID order_id = 1; order_id <= num_orders; ++order_id) {
+        views.apply(placed(order_id));
+    }
+    
+    const size_t rates[] = {0, 100000, 1000000, SIZE_MAX};
+    const size_t queries_per_rate = std::max<size_t>(num_orders, 10000);
+    std::vector<nanoseconds> all_latencies;
+    nanoseconds total_time(0);
+    
+    std::cout << "  " << std::setw(14) << "events/s" << std::setw(14) << "applied/s"
+              << std::setw(12) << "p50 ns" << std::setw(12) << "p99 ns" << std::endl;
+    OrderID next_order = num_orders + 1;
+    for (size_t rate : rates) {
+        // Writer: place new orders and fill older ones at the target rate
+        std::atomic<bool> stop{false};
+        std::atomic<size_t> applied{0};
+        std::thread writer;
+        if (rate != 0) {
+            writer = std::thread([&, rate]() {
+                auto begin = steady_clock::now();
+                size_t count = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    if (rate != SIZE_MAX) {
+                        auto due = begin + nanoseconds(count * 1000000000ULL / rate);
+                        if (steady_clock::now() < due) {
+                            std::this_thread::yield();
+                            continue;
+                        }
+                    }
+                    OrderID order_id = next_order++;
+                    views.apply(placed(order_id));
+                    Event trade;
+                    trade.type = EventType::TRADE_EXECUTED;
+                    trade.event_timestamp = order_id;
+                    trade.instrument_id = 1;
+                    trade.data.trade_executed.trade = Trade();
+                    Trade& t = trade.data.trade_executed.trade;
+                    t.buy_order_id = order_id;
+                    t.sell_order_id = order_id - num_orders;
+                    t.buy_user_id = 1 + t.buy_order_id % kUsers;
+                    t.sell_user_id = 1 + t.sell_order_id % kUsers;
+                    t.instrument_id = 1;
+                    t.price = double_to_price(50000.0);
+                    t.quantity = double_to_quantity(0.5);
+                    views.apply(trade);
+                    count += 2;
+                    applied.store(count, std::memory_order_relaxed);
+                }
+            });
+        }
+        
+        // Reader: alternate point lookups and per-user listings
+        std::mt19937_64 gen(42);
+        std::vector<nanoseconds> latencies;
+        latencies.reserve(queries_per_rate);
+        auto start = high_resolution_clock::now();
+        size_t found = 0;
+        for (size_t i = 0; i < queries_per_rate; ++i) {
+            auto op_start = high_resolution_clock::now();
+            if (i & 1) {
+                found += views.get_user_orders(1 + gen() % kUsers).size();
+            } else {
+                OrderView view;
+                found += views.get_order(1 + gen() % num_orders, view);
+            }
+            latencies.push_back(duration_cast<nanoseconds>(high_resolution_clock::now() - op_start));
+        }
+        auto end = high_resolution_clock::now();
+        stop = true;
+        if (writer.joinable()) {
+            writer.join();
+        }
+        
+        double seconds_taken = duration_cast<microseconds>(end - start).count() / 1000000.0;
+        std::cout << "  " << std::setw(14) << (rate == SIZE_MAX ? std::string("max") : std::to_string(rate))
+                  << std::setw(14) << static_cast<size_t>(seconds_taken > 0 ? applied.load() / seconds_taken : 0)
+                  << std::setw(12) << percentile(latencies, 0.50).count()
+                  << std::setw(12) << percentile(latencies, 0.99).count() << std::endl;
+        if (found == 0) {
+            std::cout << "  Warning: no views found" << std::endl;
+        }
+        all_latencies.insert(all_latencies.end(), latencies.begin(), latencies.end());
+        total_time += duration_cast<nanoseconds>(end - start);
+    }
+    std::cout << "  Reads that waited for the writer: " << views.locked_reads() << std::endl;
+    
+    return calculate_results("View Queries (under event load)", all_latencies, total_time);
+}
+
+// Benchmark 12: Trading view rebuild at startup, full sequential replay
+// against checkpoint plus parallel tail replay
+BenchmarkResult benchmark_view_rebuild(size_t num_events) {
+    constexpr UserID kUsers = 10000;
+    std::cout << "\n[Benchmark 12] View Rebuild (" << num_events << " events)..." << std::endl;
+    
+    std::filesystem::remove_all("./benchmark_data_views");
+    std::filesystem::create_directories("./benchmark_data_views");
+    EventStore store;
+    store.initialize("./benchmark_data_views");
+    
+    // Two placements, then a trade between them
+    OrderID next_order = 1;
+    for (size_t i = 0; i < num_events; ++i) {
+        Event event;
+        event.instrument_id = 1;
+        if (i % 3 == 2) {
+            Trade trade{};
+            trade.buy_order_id = next_order - 2;
+            trade.sell_order_id = next_order - 1;
+            trade.buy_user_id = 1 + trade.buy_order_id % kUsers;
+            trade.sell_user_id = 1 + trade.sell_order_id % kUsers;
+            trade.instrument_id = 1;
+            trade.price = double_to_price(50000.0);
+            trade.quantity = double_to_quantity(0.5);
+            event.type = EventType::TRADE_EXECUTED;
+            event.data.trade_executed.trade = trade;
+        } else {
+            OrderID order_id = next_order++;
+            event.type = EventType::ORDER_PLACED;
+            event.data.order_placed.order_id = order_id;
+            event.data.order_placed.user_id = 1 + order_id % kUsers;
+            event.data.order_placed.side = (order_id & 1) ? OrderSide::BUY : OrderSide::SELL;
+            event.data.order_placed.order_type = OrderType::LIMIT;
+            event.data.order_placed.price = double_to_price(50000.0);
+            event.data.order_placed.quantity = double_to_quantity(1.0);
+        }
+        store.append_event(event);
+    }
+    store.flush();
+    
+    // Sequential replay of the whole log, checkpointing 90% of the way in
+    SequenceID checkpoint_at = num_events * 9 / 10;
+    auto sequential_start = high_resolution_clock::now();
+    {
+        TradingViews views;
+        Event event;
+        store.scan_events(1, UINT64_MAX, [&](const EventView& view) {
+            if (view.decode(event)) {
+                views.apply(event);
+            }
+            if (view.sequence_id() == checkpoint_at) {
+                auto checkpoint_start = high_resolution_clock::now();
+                views.write_checkpoint(store);
+                sequential_start += high_resolution_clock::now() - checkpoint_start;
+            }
+            return true;
+        });
+    }
+    auto sequential = high_resolution_clock::now() - sequential_start;
+    
+    std::vector<nanoseconds> latencies;
+    nanoseconds total_time(0);
+    for (int run = 0; run < 5; ++run) {
+        TradingViews views;
+        auto start = high_resolution_clock::now();
+        views.recover(store);
+        auto elapsed = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+        latencies.push_back(elapsed);
+        total_time += elapsed;
+        if (views.applied_sequence() != store.get_latest_sequence()) {
+            std::cout << "  Warning: views stopped at " << views.applied_sequence() << std::endl;
+        }
+    }
+    
+    std::cout << "  Sequential replay: " << duration_cast<milliseconds>(sequential).count() << " ms" << std::endl;
+    std::cout << "  Checkpoint + parallel tail: " << duration_cast<milliseconds>(percentile(latencies, 0.5)).count()
+              << " ms (" << std::max(1u, std::thread::hardware_concurrency()) << " threads)" << std::endl;
+    
+    return calculate_results("View Rebuild (checkpoint + tail)", latencies, total_time);
+}
+
+// Benchmark 13: Replaying a log written under three schema versions
+BenchmarkResult benchmark_multi_version_replay(size_t num_events) {
+    std::cout << "\n[Benchmark 13] Multi-version Replay (" << num_events << " events)..." << std::endl;
+    
+    // v2 stores order prices in tenths of the v1 tick; v3 adds nothing to
+    // placements but moves trades to the new tick as well
+    EventVersionManager versions;
+    for (EventType type : {EventType::ORDER_PLACED, EventType::TRADE_EXECUTED}) {
+        for (EventVersion version : {2u, 3u}) {
+            EventSchema schema;
+            schema.version = version;
+            schema.schema_name = "v" + std::to_string(version);
+            versions.register_schema(type, schema);
+        }
+    }
+    versions.register_batch_migration(EventType::ORDER_PLACED, 1, 2, [](Event* events, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            events[i].data.order_placed.price *= 10;
+        }
+    });
+    versions.register_batch_migration(EventType::TRADE_EXECUTED, 2, 3, [](Event* events, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            events[i].data.trade_executed.trade.price *= 10;
+        }
+    });
+    
+    std::filesystem::remove_all("./benchmark_data_versions");
+    std::filesystem::create_directories("./benchmark_data_versions");
+    VersionedEventStore store;
+    store.initialize("./benchmark_data_versions");
+    store.set_version_manager(&versions);
+    
+    // A third of the log per version; every third event a trade
+    OrderID next_order = 1;
+    for (size_t i = 0; i < num_events; ++i) {
+        VersionedEvent versioned;
+        versioned.version = static_cast<EventVersion>(1 + i * 3 / num_events);
+        Event& event = versioned.event;
+        event.instrument_id = 1;
+        if (i % 3 == 2) {
+            Trade trade{};
+            trade.buy_order_id = next_order - 2;
+            trade.sell_order_id = next_order - 1;
+            trade.instrument_id = 1;
+            trade.price = double_to_price(50000.0);
+            trade.quantity = double_to_quantity(0.5);
+            event.type = EventType::TRADE_EXECUTED;
+            event.data.trade_executed.trade = trade;
+        } else {
+            event.type = EventType::ORDER_PLACED;
+            event.data.order_placed.order_id = next_order++;
+            event.data.order_placed.user_id = 1 + event.data.order_placed.order_id % 10000;
+            event.data.order_placed.side = OrderSide::BUY;
+            event.data.order_placed.order_type = OrderType::LIMIT;
+            event.data.order_placed.price = double_to_price(50000.0);
+            event.data.order_placed.quantity = double_to_quantity(1.0);
+        }
+        store.append_versioned_event(versioned);
+    }
+    store.flush();
+    
+    auto price_of = [](const Event& event) {
+        return event.type == EventType::TRADE_EXECUTED ? event.data.trade_executed.trade.price
+                                                       : event.data.order_placed.price;
+    };
+    
+    // Per event: look up the version and migrate each event on its own
+    Price per_event_sum = 0;
+    auto per_event_start = high_resolution_clock::now();
+    store.replay_events(1, UINT64_MAX, [&](const Event& event) {
+        VersionedEvent versioned;
+        versioned.event = event;
+        versioned.version = store.version_at(event.sequence_id, event.type);
+        versioned.min_supported_version = 1;
+        versioned.max_supported_version = 3;
+        per_event_sum += price_of(versions.migrate_to_latest(versioned).event);
+        return true;
+    });
+    auto per_event = duration_cast<nanoseconds>(high_resolution_clock::now() - per_event_start);
+    
+    // Batched: plans resolved once per version run
+    std::vector<nanoseconds> latencies;
+    Price batched_sum = 0;
+    for (int run = 0; run < 5; ++run) {
+        batched_sum = 0;
+        auto start = high_resolution_clock::now();
+        store.replay_upcast(1, UINT64_MAX, 0, [&](const Event* events, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                batched_sum += price_of(events[i]);
+            }
+            return true;
+        });
+        latencies.push_back(duration_cast<nanoseconds>(high_resolution_clock::now() - start));
+    }
+    nanoseconds batched = percentile(latencies, 0.5);
+    
+    std::cout << "  Version runs: " << store.version_runs().size() << std::endl;
+    std::cout << "  Per-event migration: " << duration_cast<milliseconds>(per_event).count() << " ms" << std::endl;
+    std::cout << "  Batched upcast:      " << duration_cast<milliseconds>(batched).count() << " ms"
+              << (batched_sum == per_event_sum ? "" : " (RESULTS DIFFER)") << std::endl;
+    
+    BenchmarkResult result;
+    result.name = "Multi-version Replay (batched)";
+    result.operations = store.event_count();
+    result.total_time = batched;
+    double total_seconds = duration_cast<microseconds>(batched).count() / 1000000.0;
+    result.throughput = (total_seconds > 0) ? (result.operations / total_seconds) : 0;
+    result.avg_latency = result.operations > 0 ? nanoseconds(batched.count() / result.operations)
+                                               : nanoseconds(0);
+    result.min_latency = result.avg_latency;
+    result.max_latency = result.avg_latency;
+    result.p50_latency = result.avg_latency;
+    result.p90_latency = result.avg_latency;
+    result.p99_latency = result.avg_latency;
+    return result;
+}
+
 int main(int argc, char* argv[]) {
     std::cout << "========================================" << std::endl;
     std::cout << "Event Sourcing Performance Benchmark" << std::endl;
@@ -411,6 +1031,13 @@ int main(int argc, char* argv[]) {
         results.push_back(benchmark_event_stream_processing(num_orders));
         results.push_back(benchmark_cqrs(num_orders));
         results.push_back(benchmark_event_compression(num_orders));
+        results.push_back(benchmark_event_encoding(num_orders));
+        results.push_back(benchmark_chain_verification(num_orders * 10));
+        results.push_back(benchmark_log_shipping(num_orders));
+        results.push_back(benchmark_hot_standby(num_orders * 10));
+        results.push_back(benchmark_view_queries(num_orders * 10));
+        results.push_back(benchmark_view_rebuild(num_orders * 100));
+        results.push_back(benchmark_multi_version_replay(num_orders * 100));
     } catch (const std::exception& e) {
         std::cerr << "Error during benchmark: " << e.what() << std::endl;
         return 1;
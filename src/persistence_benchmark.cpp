@@ -1,8 +1,10 @@
 #include "core/matching_engine_production.h"
 #include "core/persistence_optimized.h"
+#include "core/history_store.h"
 #include "core/types.h"
 #include <iostream>
 #include <chrono>
+#include <filesystem>
 #include <vector>
 #include <random>
 #include <iomanip>
@@ -10,14 +12,15 @@
 using namespace perpetual;
 using namespace std::chrono;
 
-void benchmarkPersistence() {
+void benchmarkPersistence(PersistenceLogFormat format) {
+    bool binary = format == PersistenceLogFormat::BINARY;
     std::cout << "========================================\n";
-    std::cout << "Persistence Performance Benchmark\n";
+    std::cout << "Persistence Performance Benchmark (" << (binary ? "binary" : "text") << ")\n";
     std::cout << "========================================\n\n";
     
     // Initialize optimized persistence
     OptimizedPersistenceManager persistence;
-    if (!persistence.initialize("./data/benchmark", 10000, 100)) {
+    if (!persistence.initialize(binary ? "./data/benchmark_binary" : "./data/benchmark", 10000, 100, format)) {
         std::cerr << "Failed to initialize persistence\n";
         return;
     }
@@ -133,8 +136,94 @@ void benchmarkPersistence() {
     std::cout << "========================================\n";
 }
 
+void benchmarkHistoryStore() {
+    std::cout << "========================================\n";
+    std::cout << "History Store Benchmark (embedded columnar)\n";
+    std::cout << "========================================\n\n";
+    
+    const std::string dir = "./data/benchmark_history";
+    std::filesystem::remove_all(dir);
+    HistoryStore store;
+    if (!store.open(dir)) {
+        std::cerr << "Failed to open history store\n";
+        return;
+    }
+    
+    const size_t num_trades = 2000000;
+    const size_t num_users = 1000;
+    const int64_t day = 24 * 3600LL * 1000000000LL;
+    const int64_t days = 7;
+    const int64_t begin = get_current_timestamp() - days * day;
+    const int64_t step = days * day / num_trades;
+    
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<uint64_t> user_dist(1, num_users);
+    std::uniform_real_distribution<double> price_dist(40000.0, 60000.0);
+    
+    std::cout << "Ingesting " << num_trades << " trades over " << days << " days...\n\n";
+    
+    // Ingest at engine pace: one trade at a time, durable at the end
+    {
+        auto start = high_resolution_clock::now();
+        for (size_t i = 0; i < num_trades; ++i) {
+            Trade trade{};
+            trade.sequence_id = i + 1;
+            trade.buy_order_id = i * 2 + 1;
+            trade.sell_order_id = i * 2 + 2;
+            trade.buy_user_id = user_dist(gen);
+            trade.sell_user_id = user_dist(gen);
+            trade.instrument_id = 1 + i % 4;
+            trade.price = double_to_price(price_dist(gen));
+            trade.quantity = double_to_quantity(0.1);
+            trade.timestamp = begin + static_cast<int64_t>(i) * step;
+            trade.is_taker_buy = (i % 2 == 0);
+            store.append_trade(trade);
+        }
+        store.flush();
+        auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+        
+        std::cout << "Trade Ingest:\n";
+        std::cout << "  Total time: " << duration.count() / 1000.0 << " ms\n";
+        std::cout << "  Throughput: " << std::fixed << std::setprecision(0)
+                  << (num_trades * 1000000.0) / duration.count() << " trades/sec\n";
+        std::cout << "  Segments: " << store.segment_count() << "\n\n";
+    }
+    
+    // One user's trades over one day, against the user's whole history
+    {
+        const UserID user_id = 7;
+        const int64_t day_start = begin + 3 * day;
+        
+        uint64_t scanned = store.segments_scanned();
+        auto start = high_resolution_clock::now();
+        std::vector<Trade> trades = store.trades_by_user(user_id, day_start, day_start + day - 1);
+        auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+        uint64_t day_segments = store.segments_scanned() - scanned;
+        
+        scanned = store.segments_scanned();
+        start = high_resolution_clock::now();
+        std::vector<Trade> all = store.trades_by_user(user_id, kHistoryBeginning, kHistoryEnd);
+        auto all_duration = duration_cast<microseconds>(high_resolution_clock::now() - start);
+        uint64_t all_segments = store.segments_scanned() - scanned;
+        
+        std::cout << "User Trades Query:\n";
+        std::cout << "  One day: " << trades.size() << " trades in " << std::setprecision(2)
+                  << duration.count() / 1000.0 << " ms (" << day_segments << " segments)\n";
+        std::cout << "  All history: " << all.size() << " trades in "
+                  << all_duration.count() / 1000.0 << " ms (" << all_segments << " segments)\n";
+    }
+    
+    store.close();
+    
+    std::cout << "\n========================================\n";
+    std::cout << "Benchmark completed!\n";
+    std::cout << "========================================\n";
+}
+
 int main() {
-    benchmarkPersistence();
+    benchmarkPersistence(PersistenceLogFormat::TEXT);
+    benchmarkPersistence(PersistenceLogFormat::BINARY);
+    benchmarkHistoryStore();
     return 0;
 }
 
@@ -59,7 +59,7 @@ int main(int argc, char* argv[]) {
     
     // 3. Initialize Database Manager
     std::cout << "  [3/9] Initializing Database Manager..." << std::endl;
-    DatabaseManager db_manager(DatabaseManager::SQLITE, "data/exchange.db");
+    DatabaseManager db_manager(DatabaseManager::EMBEDDED, "data/history");
     if (!db_manager.connect()) {
         std::cerr << "Failed to connect to database" << std::endl;
         return 1;
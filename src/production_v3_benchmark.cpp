@@ -147,6 +147,11 @@ int main(int argc, char* argv[]) {
     std::cout << "  Uncommitted:     " << wal_stats.uncommitted_count << "\n";
     std::cout << "  Flush Count:     " << wal_stats.flush_count << "\n";
     std::cout << "  Avg Flush Time:  " << wal_stats.avg_flush_time_us / 1000.0 << " ms\n";
+    std::cout << "  Durable Up To:   " << wal_stats.durable_watermark << "\n";
+    std::cout << "  Awaiting Ack:    " << wal_stats.awaiting_durable << "\n";
+    std::cout << "  Durable Latency: avg " << wal_stats.avg_durable_latency_us / 1000.0
+              << " ms, p50 <" << wal_stats.durable_latency_p50_us / 1000.0
+              << " ms, p99 <" << wal_stats.durable_latency_p99_us / 1000.0 << " ms\n";
     std::cout << "\n";
     
     // Performance comparison
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include "core/matching_engine_event_sourcing.h"
+#include "core/order.h"
+#include "core/types.h"
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace perpetual;
+
+class EngineSnapshotTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        event_store_dir_ = "./test_engine_snapshot_" + std::to_string(get_current_timestamp());
+        std::filesystem::create_directories(event_store_dir_);
+        user_id_ = 1000000;
+    }
+
+    void TearDown() override {
+        if (std::filesystem::exists(event_store_dir_)) {
+            std::filesystem::remove_all(event_store_dir_);
+        }
+    }
+
+    // Place order i: prices step around 50000 so some orders cross
+    void place(MatchingEngineEventSourcing& engine, OrderID id) {
+        OrderSide side = id % 2 == 0 ? OrderSide::BUY : OrderSide::SELL;
+        double price = side == OrderSide::BUY ? 49990.0 + static_cast<double>(id % 7)
+                                              : 49994.0 + static_cast<double>(id % 11);
+        orders_.push_back(std::make_unique<Order>(id, user_id_ + id % 13, 1, side,
+                                                  double_to_price(price),
+                                                  double_to_quantity(0.1 * static_cast<double>(1 + id % 4)),
+                                                  OrderType::LIMIT));
+        engine.process_order_es(orders_.back().get());
+    }
+
+    // Resting orders as (id, remaining), bids then asks in priority order
+    static std::vector<std::pair<OrderID, Quantity>> book_of(const MatchingEngineEventSourcing& engine) {
+        std::vector<std::pair<OrderID, Quantity>> book;
+        auto visit = [&](const Order* order) {
+            book.emplace_back(order->order_id, order->remaining_quantity);
+        };
+        engine.get_orderbook().bids().for_each_order(visit);
+        engine.get_orderbook().asks().for_each_order(visit);
+        return book;
+    }
+
+    // Snapshots are kept per instrument under <store dir>/snapshots
+    static size_t snapshot_count(const std::string& dir) {
+        size_t count = 0;
+        std::string snapshots = dir + "/snapshots/1";
+        if (!std::filesystem::exists(snapshots)) {
+            return 0;
+        }
+        for (const auto& entry : std::filesystem::directory_iterator(snapshots)) {
+            if (entry.path().extension() == ".snap") {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    std::vector<std::unique_ptr<Order>> orders_;   // Outlive the engines resting them
+    std::string event_store_dir_;
+    UserID user_id_;
+};
+
+TEST_F(EngineSnapshotTest, SnapshotRoundTrip) {
+    MatchingEngineEventSourcing engine(1);
+    ASSERT_TRUE(engine.initialize(event_store_dir_));
+    for (OrderID id = 1; id <= 200; ++id) {
+        place(engine, id);
+    }
+    std::string path = event_store_dir_ + "/manual.snap";
+    ASSERT_TRUE(engine.create_snapshot(path));
+
+    std::string restored_dir = event_store_dir_ + "/restored";
+    std::filesystem::create_directories(restored_dir);
+    MatchingEngineEventSourcing restored(1);
+    ASSERT_TRUE(restored.initialize(restored_dir));
+    SequenceID sequence = 0;
+    ASSERT_TRUE(restored.load_snapshot(path, sequence));
+    EXPECT_EQ(sequence, engine.get_event_store()->get_latest_sequence());
+    EXPECT_EQ(book_of(restored), book_of(engine));
+    EXPECT_EQ(restored.get_orderbook().best_bid(), engine.get_orderbook().best_bid());
+    EXPECT_EQ(restored.get_orderbook().best_ask(), engine.get_orderbook().best_ask());
+}
+
+TEST_F(EngineSnapshotTest, RecoverReplaysOnlyTheTail) {
+    std::vector<std::pair<OrderID, Quantity>> live;
+    SequenceID latest = 0;
+    {
+        MatchingEngineEventSourcing engine(1);
+        ASSERT_TRUE(engine.initialize(event_store_dir_));
+        for (OrderID id = 1; id <= 300; ++id) {
+            place(engine, id);
+        }
+        ASSERT_TRUE(engine.create_snapshot());
+        ASSERT_EQ(snapshot_count(event_store_dir_), 1u);
+
+        // Tail after the snapshot: more orders and some cancels
+        for (OrderID id = 301; id <= 400; ++id) {
+            place(engine, id);
+        }
+        for (OrderID id = 2; id <= 300; id += 10) {
+            if (engine.get_order(id)) {
+                engine.cancel_order_es(id, user_id_ + id % 13);
+            }
+        }
+        live = book_of(engine);
+        latest = engine.get_event_store()->get_latest_sequence();
+    }
+    ASSERT_FALSE(live.empty());
+
+    MatchingEngineEventSourcing recovered(1);
+    ASSERT_TRUE(recovered.initialize(event_store_dir_));
+    ASSERT_TRUE(recovered.recover());
+    EXPECT_EQ(recovered.applied_sequence(), latest);
+    EXPECT_EQ(book_of(recovered), live);
+
+    // The same state from a full replay once the snapshot is gone
+    std::filesystem::remove_all(event_store_dir_ + "/snapshots");
+    MatchingEngineEventSourcing replayed(1);
+    ASSERT_TRUE(replayed.initialize(event_store_dir_));
+    ASSERT_TRUE(replayed.recover());
+    EXPECT_EQ(book_of(replayed), live);
+}
+
+TEST_F(EngineSnapshotTest, CorruptSnapshotIsRejected) {
+    MatchingEngineEventSourcing engine(1);
+    ASSERT_TRUE(engine.initialize(event_store_dir_));
+    for (OrderID id = 1; id <= 50; ++id) {
+        place(engine, id);
+    }
+    std::string path = event_store_dir_ + "/manual.snap";
+    ASSERT_TRUE(engine.create_snapshot(path));
+
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    SequenceID sequence = 0;
+    std::string state;
+    EXPECT_FALSE(EventStore::load_snapshot(path, sequence, state));
+}
@@ -0,0 +1,268 @@
+#include <gtest/gtest.h>
+#include "core/journal_writer.h"
+#include "core/journal_segment.h"
+#include "core/event_sourcing.h"
+#include "core/types.h"
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace perpetual;
+
+class EventJournalTest : public ::testing::Test {
+protected:
+    // Records of kRecordSize bytes tile a block exactly
+    static constexpr size_t kPayloadSize = 112;
+    static constexpr size_t kRecordSize = sizeof(JournalRecordHeader) + kPayloadSize;
+
+    void SetUp() override {
+        journal_dir_ = "./test_event_journal_" + std::to_string(get_current_timestamp());
+        std::filesystem::create_directories(journal_dir_);
+
+        config_.backend = JournalBackend::PWRITE;
+        config_.segment_bytes = 1 << 20;
+        config_.batch_bytes = 64 * 1024;
+    }
+
+    void TearDown() override {
+        if (std::filesystem::exists(journal_dir_)) {
+            std::filesystem::remove_all(journal_dir_);
+        }
+    }
+
+    static std::string payload(uint32_t n) {
+        std::string data(kPayloadSize, static_cast<char>('a' + n % 26));
+        memcpy(&data[0], &n, sizeof(n));
+        return data;
+    }
+
+    // Append records first..last in one batch; returns where each starts
+    std::vector<JournalPosition> write_records(uint32_t first, uint32_t last) {
+        std::vector<JournalPosition> positions;
+        auto writer = JournalWriter::create(config_);
+        EXPECT_TRUE(writer->open(journal_dir_));
+        for (uint32_t n = first; n <= last; ++n) {
+            std::string data = payload(n);
+            EXPECT_NE(writer->append(data.data(), data.size()), 0u);
+            positions.push_back(writer->last_position());
+        }
+        EXPECT_TRUE(writer->sync());
+        writer->close();
+        return positions;
+    }
+
+    std::vector<uint32_t> read_records(uint32_t* last_epoch = nullptr) {
+        std::vector<uint32_t> records;
+        JournalReader reader(journal_dir_);
+        const char* data = nullptr;
+        size_t length = 0;
+        while (reader.next(data, length)) {
+            EXPECT_EQ(length, kPayloadSize);
+            uint32_t n = 0;
+            memcpy(&n, data, sizeof(n));
+            EXPECT_EQ(std::string(data, length), payload(n));
+            records.push_back(n);
+        }
+        if (last_epoch) {
+            *last_epoch = reader.last_epoch();
+        }
+        return records;
+    }
+
+    // Flip one payload byte of the record at position
+    void corrupt(const JournalPosition& position) {
+        std::fstream file(journal_segment_path(journal_dir_, position.segment),
+                          std::ios::in | std::ios::out | std::ios::binary);
+        ASSERT_TRUE(file.is_open());
+        file.seekg(position.offset + sizeof(JournalRecordHeader) + kPayloadSize / 2);
+        char byte = 0;
+        file.read(&byte, 1);
+        byte ^= 0x5a;
+        file.seekp(position.offset + sizeof(JournalRecordHeader) + kPayloadSize / 2);
+        file.write(&byte, 1);
+    }
+
+    std::string journal_dir_;
+    JournalWriterConfig config_;
+};
+
+TEST_F(EventJournalTest, ReopenAppendsAfterLastRecord) {
+    write_records(1, 20);
+    write_records(21, 30);
+
+    uint32_t epoch = 0;
+    std::vector<uint32_t> records = read_records(&epoch);
+    ASSERT_EQ(records.size(), 30u);
+    for (uint32_t i = 0; i < records.size(); ++i) {
+        EXPECT_EQ(records[i], i + 1);
+    }
+    EXPECT_EQ(epoch, 2u);
+}
+
+TEST_F(EventJournalTest, TornTailIsDroppedAndOverwritten) {
+    std::vector<JournalPosition> positions = write_records(1, 20);
+    corrupt(positions.back());
+
+    // The torn record ends the log
+    std::vector<uint32_t> records = read_records();
+    ASSERT_EQ(records.size(), 19u);
+    EXPECT_EQ(records.back(), 19u);
+
+    // The next writer resumes at the torn record and replaces it
+    std::vector<JournalPosition> resumed = write_records(100, 101);
+    EXPECT_EQ(resumed.front().segment, positions.back().segment);
+    EXPECT_EQ(resumed.front().offset, positions.back().offset);
+
+    records = read_records();
+    ASSERT_EQ(records.size(), 21u);
+    EXPECT_EQ(records[18], 19u);
+    EXPECT_EQ(records[19], 100u);
+    EXPECT_EQ(records[20], 101u);
+}
+
+TEST_F(EventJournalTest, StaleRecordsOfOlderEpochEndTheLog) {
+    // Three blocks of records from the first writer
+    size_t per_block = kJournalBlockSize / kRecordSize;
+    std::vector<JournalPosition> positions = write_records(1, static_cast<uint32_t>(per_block * 3));
+    ASSERT_EQ(positions[per_block * 2].offset % kJournalBlockSize, 0u);
+
+    // Tear a record in the second block, as a crash mid-write would
+    size_t torn = per_block + per_block / 2;
+    corrupt(positions[torn]);
+
+    // The second writer rewrites the second block up to the torn record,
+    // adds one record and pads the block. The third block still holds
+    // intact records of the first writer, which must not be read back.
+    write_records(500, 500);
+
+    uint32_t epoch = 0;
+    std::vector<uint32_t> records = read_records(&epoch);
+    ASSERT_EQ(records.size(), torn + 1);
+    EXPECT_EQ(records[torn - 1], torn);
+    EXPECT_EQ(records.back(), 500u);
+    EXPECT_EQ(epoch, 2u);
+}
+
+TEST_F(EventJournalTest, EventStoreRecoversFromTornTail) {
+    EventStoreConfig config;
+    config.journal.backend = JournalBackend::PWRITE;
+    config.journal.segment_bytes = 1 << 20;
+    config.journal.direct_io = false;
+
+    Event event;
+    event.type = EventType::ORDER_PLACED;
+    event.instrument_id = 1;
+    event.data.order_placed.user_id = 1000000;
+    event.data.order_placed.side = OrderSide::BUY;
+    event.data.order_placed.order_type = OrderType::LIMIT;
+    event.data.order_placed.price = double_to_price(50000.0);
+    event.data.order_placed.quantity = double_to_quantity(0.1);
+    {
+        EventStore store;
+        ASSERT_TRUE(store.initialize(journal_dir_, config));
+        for (OrderID id = 1; id <= 50; ++id) {
+            event.data.order_placed.order_id = id;
+            ASSERT_TRUE(store.append_event(event));
+        }
+        store.flush();
+    }
+
+    // Tear the last event and drop the index checkpoint so the log is scanned
+    std::string log_dir = EventStore::event_log_dir(journal_dir_);
+    JournalPosition last;
+    {
+        JournalReader reader(log_dir);
+        const char* data = nullptr;
+        size_t length = 0;
+        while (reader.next(data, length)) {
+            last = reader.record_position();
+        }
+    }
+    {
+        std::fstream file(journal_segment_path(log_dir, last.segment),
+                          std::ios::in | std::ios::out | std::ios::binary);
+        ASSERT_TRUE(file.is_open());
+        file.seekp(last.offset + sizeof(JournalRecordHeader) + 4);
+        file.put('\x7f');
+    }
+    for (const auto& entry : std::filesystem::directory_iterator(journal_dir_)) {
+        if (entry.path().extension() == ".ckpt") {
+            std::filesystem::remove(entry.path());
+        }
+    }
+
+    EventStore store;
+    ASSERT_TRUE(store.initialize(journal_dir_, config));
+    EXPECT_EQ(store.get_latest_sequence(), 49u);
+
+    event.data.order_placed.order_id = 51;
+    ASSERT_TRUE(store.append_event(event));
+    store.flush();
+    EXPECT_EQ(store.get_latest_sequence(), 50u);
+
+    std::vector<Event> events = store.get_events(1, UINT64_MAX);
+    ASSERT_EQ(events.size(), 50u);
+    EXPECT_EQ(events[48].data.order_placed.order_id, 49u);
+    EXPECT_EQ(events[49].data.order_placed.order_id, 51u);
+    EXPECT_TRUE(store.verify_chain());
+}
+
+TEST_F(EventJournalTest, UndecodableEventIsSkipped) {
+    EventStoreConfig config;
+    config.journal.backend = JournalBackend::PWRITE;
+    config.journal.segment_bytes = 1 << 20;
+    config.journal.direct_io = false;
+
+    Event event;
+    event.type = EventType::ORDER_PLACED;
+    event.instrument_id = 1;
+    event.data.order_placed.user_id = 1000000;
+    event.data.order_placed.side = OrderSide::BUY;
+    event.data.order_placed.order_type = OrderType::LIMIT;
+    event.data.order_placed.price = double_to_price(50000.0);
+    event.data.order_placed.quantity = double_to_quantity(0.1);
+    {
+        EventStore store;
+        ASSERT_TRUE(store.initialize(journal_dir_, config));
+        for (OrderID id = 1; id <= 10; ++id) {
+            event.data.order_placed.order_id = id;
+            ASSERT_TRUE(store.append_event(event));
+        }
+        store.flush();
+    }
+
+    // Event 11 in a format version this build does not know
+    {
+        Event future = event;
+        future.sequence_id = 11;
+        future.data.order_placed.order_id = 11;
+        std::string data(future.encoded_size(), '\0');
+        future.encode(&data[0]);
+        data[offsetof(EncodedEventHeader, version)] = static_cast<char>(EVENT_FORMAT_VERSION + 1);
+        auto writer = JournalWriter::create(config.journal);
+        ASSERT_TRUE(writer->open(EventStore::event_log_dir(journal_dir_)));
+        ASSERT_NE(writer->append(data.data(), data.size()), 0u);
+        ASSERT_TRUE(writer->sync());
+        writer->close();
+    }
+
+    EventStore store;
+    ASSERT_TRUE(store.initialize(journal_dir_, config));
+    EXPECT_EQ(store.get_latest_sequence(), 11u);
+    EXPECT_TRUE(store.get_order_events(0).empty());
+    EXPECT_TRUE(store.get_order_events(11).empty());
+
+    std::vector<Event> events = store.get_events(1, UINT64_MAX);
+    ASSERT_EQ(events.size(), 10u);
+    EXPECT_EQ(events.back().data.order_placed.order_id, 10u);
+
+    // Later events are indexed as usual
+    event.data.order_placed.order_id = 12;
+    ASSERT_TRUE(store.append_event(event));
+    store.flush();
+    std::vector<Event> placed = store.get_order_events(12);
+    ASSERT_EQ(placed.size(), 1u);
+    EXPECT_EQ(placed[0].sequence_id, 12u);
+    EXPECT_TRUE(store.verify_chain());
+}
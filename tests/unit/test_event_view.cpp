@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+#include "core/event_sourcing.h"
+#include "core/types.h"
+#include <filesystem>
+#include <vector>
+
+using namespace perpetual;
+
+namespace {
+
+Event make_placed(SequenceID sequence, OrderID order_id) {
+    Event event;
+    event.type = EventType::ORDER_PLACED;
+    event.sequence_id = sequence;
+    event.event_timestamp = 1700000000000000000LL + sequence;
+    event.instrument_id = 7;
+    event.data.order_placed.order_id = order_id;
+    event.data.order_placed.user_id = 1000001;
+    event.data.order_placed.side = OrderSide::SELL;
+    event.data.order_placed.order_type = OrderType::LIMIT;
+    event.data.order_placed.price = double_to_price(50123.5);
+    event.data.order_placed.quantity = double_to_quantity(0.25);
+    return event;
+}
+
+Event make_trade(SequenceID sequence) {
+    Event event;
+    event.type = EventType::TRADE_EXECUTED;
+    event.sequence_id = sequence;
+    event.event_timestamp = 1700000000000000000LL + sequence;
+    event.instrument_id = 7;
+    event.data.trade_executed.trade = Trade{};
+    Trade& trade = event.data.trade_executed.trade;
+    trade.buy_order_id = 11;
+    trade.sell_order_id = 12;
+    trade.buy_user_id = 1000001;
+    trade.sell_user_id = 1000002;
+    trade.instrument_id = 7;
+    trade.price = double_to_price(50000.0);
+    trade.quantity = double_to_quantity(0.1);
+    trade.timestamp = event.event_timestamp;
+    trade.sequence_id = sequence;
+    trade.is_taker_buy = true;
+    return event;
+}
+
+std::vector<char> encode(const Event& event) {
+    std::vector<char> buffer(event.encoded_size());
+    EXPECT_EQ(event.encode(buffer.data()), buffer.size());
+    return buffer;
+}
+
+} // namespace
+
+TEST(EventViewTest, HeaderReadInPlace) {
+    Event event = make_placed(42, 9001);
+    std::vector<char> buffer = encode(event);
+    ASSERT_LE(buffer.size(), kMaxEncodedEventSize);
+
+    EventView view(buffer.data(), buffer.size());
+    EXPECT_EQ(view.type(), EventType::ORDER_PLACED);
+    EXPECT_EQ(view.sequence_id(), 42u);
+    EXPECT_EQ(view.event_timestamp(), event.event_timestamp);
+    EXPECT_EQ(view.instrument_id(), 7u);
+    EXPECT_EQ(view.size(), buffer.size());
+}
+
+TEST(EventViewTest, OrderPlacedRoundTrip) {
+    Event event = make_placed(42, 9001);
+    std::vector<char> buffer = encode(event);
+
+    Event decoded;
+    ASSERT_TRUE(EventView(buffer.data(), buffer.size()).decode(decoded));
+    EXPECT_EQ(decoded.type, event.type);
+    EXPECT_EQ(decoded.sequence_id, event.sequence_id);
+    EXPECT_EQ(decoded.event_timestamp, event.event_timestamp);
+    EXPECT_EQ(decoded.instrument_id, event.instrument_id);
+    EXPECT_EQ(decoded.data.order_placed.order_id, 9001u);
+    EXPECT_EQ(decoded.data.order_placed.user_id, 1000001u);
+    EXPECT_EQ(decoded.data.order_placed.side, OrderSide::SELL);
+    EXPECT_EQ(decoded.data.order_placed.order_type, OrderType::LIMIT);
+    EXPECT_EQ(decoded.data.order_placed.price, event.data.order_placed.price);
+    EXPECT_EQ(decoded.data.order_placed.quantity, event.data.order_placed.quantity);
+    EXPECT_EQ(decoded.hash(), event.hash());
+}
+
+TEST(EventViewTest, EveryPayloadRoundTrips) {
+    std::vector<Event> events;
+    events.push_back(make_placed(1, 11));
+
+    Event matched;
+    matched.type = EventType::ORDER_MATCHED;
+    matched.sequence_id = 2;
+    matched.instrument_id = 7;
+    matched.data.order_matched.taker_order_id = 11;
+    matched.data.order_matched.maker_order_id = 12;
+    matched.data.order_matched.match_price = double_to_price(50000.0);
+    matched.data.order_matched.match_quantity = double_to_quantity(0.1);
+    events.push_back(matched);
+
+    Event cancelled;
+    cancelled.type = EventType::ORDER_CANCELLED;
+    cancelled.sequence_id = 3;
+    cancelled.instrument_id = 7;
+    cancelled.data.order_cancelled.order_id = 13;
+    cancelled.data.order_cancelled.user_id = 1000003;
+    cancelled.data.order_cancelled.old_status = OrderStatus::PARTIAL_FILLED;
+    cancelled.data.order_cancelled.new_status = OrderStatus::CANCELLED;
+    events.push_back(cancelled);
+
+    Event rejected;
+    rejected.type = EventType::ORDER_REJECTED;
+    rejected.sequence_id = 4;
+    rejected.instrument_id = 7;
+    rejected.data.order_rejected.order_id = 14;
+    rejected.data.order_rejected.user_id = 1000004;
+    rejected.data.order_rejected.reason_id = 3;
+    events.push_back(rejected);
+
+    events.push_back(make_trade(5));
+
+    for (const auto& event : events) {
+        std::vector<char> buffer = encode(event);
+        Event decoded;
+        ASSERT_TRUE(EventView(buffer.data(), buffer.size()).decode(decoded));
+        EXPECT_EQ(decoded.type, event.type);
+        EXPECT_EQ(decoded.sequence_id, event.sequence_id);
+
+        // The encoded form is canonical: re-encoding gives the same bytes
+        EXPECT_EQ(encode(decoded), buffer);
+
+        Event deserialized = Event::deserialize(event.serialize());
+        EXPECT_EQ(deserialized.hash(), event.hash());
+    }
+
+    Event trade;
+    std::vector<char> buffer = encode(events.back());
+    ASSERT_TRUE(Event::decode(buffer.data(), buffer.size(), trade));
+    EXPECT_EQ(trade.data.trade_executed.trade.buy_order_id, 11u);
+    EXPECT_EQ(trade.data.trade_executed.trade.sell_user_id, 1000002u);
+    EXPECT_EQ(trade.data.trade_executed.trade.quantity, double_to_quantity(0.1));
+    EXPECT_TRUE(trade.data.trade_executed.trade.is_taker_buy);
+}
+
+TEST(EventViewTest, TruncatedBufferIsRejected) {
+    std::vector<char> buffer = encode(make_trade(9));
+
+    Event decoded;
+    EXPECT_FALSE(Event::decode(buffer.data(), buffer.size() - 1, decoded));
+    EXPECT_FALSE(Event::decode(buffer.data(), sizeof(EncodedEventHeader) - 1, decoded));
+    EXPECT_FALSE(EventView().decode(decoded));
+}
+
+TEST(EventViewTest, ScanEventsYieldsStoredEvents) {
+    std::string dir = "./test_event_view_" + std::to_string(get_current_timestamp());
+    std::filesystem::create_directories(dir);
+    {
+        EventStore store;
+        ASSERT_TRUE(store.initialize(dir));
+        for (OrderID id = 1; id <= 100; ++id) {
+            ASSERT_TRUE(store.append_event(make_placed(0, id)));
+        }
+        store.flush();
+
+        OrderID expected = 1;
+        ASSERT_TRUE(store.scan_events(1, UINT64_MAX, [&](const EventView& view) {
+            Event event;
+            EXPECT_EQ(view.type(), EventType::ORDER_PLACED);
+            EXPECT_EQ(view.sequence_id(), expected);
+            EXPECT_TRUE(view.decode(event));
+            EXPECT_EQ(event.data.order_placed.order_id, expected);
+            expected++;
+            return true;
+        }));
+        EXPECT_EQ(expected, 101u);
+    }
+    std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,228 @@
+#include <gtest/gtest.h>
+#include "core/history_store.h"
+#include "core/order.h"
+#include "core/types.h"
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace perpetual;
+
+class HistoryStoreTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        history_dir_ = "./test_history_store_" + std::to_string(get_current_timestamp());
+        std::filesystem::create_directories(history_dir_);
+
+        // Small partitions and seals so a few rows span several segments
+        config_.partition_span = 1000;
+        config_.seal_rows = 4;
+    }
+
+    void TearDown() override {
+        if (std::filesystem::exists(history_dir_)) {
+            std::filesystem::remove_all(history_dir_);
+        }
+    }
+
+    static Trade make_trade(uint64_t n, int64_t timestamp) {
+        Trade trade{};
+        trade.buy_order_id = 2 * n;
+        trade.sell_order_id = 2 * n + 1;
+        trade.buy_user_id = 1000001;
+        trade.sell_user_id = n % 2 == 0 ? 1000002 : 1000003;
+        trade.instrument_id = 1 + n % 2;
+        trade.price = double_to_price(50000.0) + static_cast<Price>(n);
+        trade.quantity = double_to_quantity(0.1);
+        trade.timestamp = timestamp;
+        trade.sequence_id = n;
+        trade.is_taker_buy = true;
+        return trade;
+    }
+
+    static Order make_order(OrderID order_id, OrderStatus status, Quantity filled, SequenceID sequence) {
+        Order order(order_id, 1000001, 1, OrderSide::BUY, double_to_price(50000.0),
+                    double_to_quantity(1.0), OrderType::LIMIT);
+        order.timestamp = 1500;
+        order.status = status;
+        order.filled_quantity = filled;
+        order.remaining_quantity = order.quantity - filled;
+        order.sequence_id = sequence;
+        return order;
+    }
+
+    std::string history_dir_;
+    HistoryStoreConfig config_;
+};
+
+TEST_F(HistoryStoreTest, SealedSegmentsSurviveReopen) {
+    {
+        HistoryStore store(config_);
+        ASSERT_TRUE(store.open(history_dir_));
+        // 30 trades over three partitions
+        for (uint64_t n = 0; n < 30; ++n) {
+            ASSERT_TRUE(store.append_trade(make_trade(n, 100 * static_cast<int64_t>(n))));
+        }
+        ASSERT_TRUE(store.seal());
+        EXPECT_GE(store.segment_count(), 3u);
+        store.close();
+    }
+
+    HistoryStore store(config_);
+    ASSERT_TRUE(store.open(history_dir_));
+    EXPECT_GE(store.segment_count(), 3u);
+
+    std::vector<Trade> trades = store.trades_by_user(1000001, kHistoryBeginning, kHistoryEnd);
+    ASSERT_EQ(trades.size(), 30u);
+    for (size_t i = 0; i < trades.size(); ++i) {
+        EXPECT_EQ(trades[i].sequence_id, i);   // Oldest first
+        EXPECT_EQ(trades[i].price, double_to_price(50000.0) + static_cast<Price>(i));
+    }
+
+    std::vector<Trade> seller = store.trades_by_user(1000003, kHistoryBeginning, kHistoryEnd);
+    EXPECT_EQ(seller.size(), 15u);
+
+    // A range inside one partition opens only that partition's segments
+    uint64_t scanned = store.segments_scanned();
+    std::vector<Trade> ranged = store.trades_by_instrument(1, 1000, 1999);
+    ASSERT_EQ(ranged.size(), 5u);
+    for (const auto& trade : ranged) {
+        EXPECT_EQ(trade.instrument_id, 1u);
+        EXPECT_GE(trade.timestamp, 1000);
+        EXPECT_LE(trade.timestamp, 1999);
+    }
+    EXPECT_LT(store.segments_scanned() - scanned, store.segment_count());
+}
+
+TEST_F(HistoryStoreTest, UnsealedRowsAreReplayedOnOpen) {
+    // Copy of the files while the store is open, as a crash would leave them
+    std::string crashed_dir = history_dir_ + "/crashed";
+    {
+        HistoryStore store(config_);
+        ASSERT_TRUE(store.open(history_dir_ + "/live"));
+        ASSERT_TRUE(store.append_trade(make_trade(1, 100)));
+        ASSERT_TRUE(store.append_trade(make_trade(2, 200)));
+        ASSERT_TRUE(store.flush());
+        EXPECT_EQ(store.segment_count(), 0u);
+        std::filesystem::copy(history_dir_ + "/live", crashed_dir,
+                              std::filesystem::copy_options::recursive);
+    }
+
+    HistoryStore store(config_);
+    ASSERT_TRUE(store.open(crashed_dir));
+    std::vector<Trade> trades = store.trades_by_user(1000001, kHistoryBeginning, kHistoryEnd);
+    ASSERT_EQ(trades.size(), 2u);
+    EXPECT_EQ(trades[0].sequence_id, 1u);
+    EXPECT_EQ(trades[1].sequence_id, 2u);
+}
+
+TEST_F(HistoryStoreTest, LatestOrderRevisionWins) {
+    {
+        HistoryStore store(config_);
+        ASSERT_TRUE(store.open(history_dir_));
+
+        // Each revision in a different place: two sealed segments and the row log
+        ASSERT_TRUE(store.append_order(make_order(7, OrderStatus::PENDING, 0, 1)));
+        ASSERT_TRUE(store.seal());
+        ASSERT_TRUE(store.append_order(make_order(7, OrderStatus::PARTIAL_FILLED, double_to_quantity(0.4), 5)));
+        ASSERT_TRUE(store.seal());
+        ASSERT_TRUE(store.append_order(make_order(7, OrderStatus::FILLED, double_to_quantity(1.0), 9)));
+        ASSERT_TRUE(store.append_order(make_order(8, OrderStatus::PENDING, 0, 10)));
+        ASSERT_TRUE(store.flush());
+
+        OrderHistoryRow row;
+        ASSERT_TRUE(store.find_order(7, row));
+        EXPECT_EQ(row.status, OrderStatus::FILLED);
+        EXPECT_EQ(row.sequence_id, 9u);
+    }
+
+    // Closing sealed the last revisions into a third segment
+    HistoryStore store(config_);
+    ASSERT_TRUE(store.open(history_dir_));
+    EXPECT_EQ(store.segment_count(), 3u);
+    OrderHistoryRow row;
+    ASSERT_TRUE(store.find_order(7, row));
+    EXPECT_EQ(row.status, OrderStatus::FILLED);
+    EXPECT_EQ(row.sequence_id, 9u);
+    EXPECT_EQ(row.remaining_quantity, 0);
+
+    std::vector<OrderHistoryRow> orders = store.orders_by_user(1000001, kHistoryBeginning, kHistoryEnd);
+    ASSERT_EQ(orders.size(), 2u);
+    for (const auto& order : orders) {
+        if (order.order_id == 7) {
+            EXPECT_EQ(order.status, OrderStatus::FILLED);
+        } else {
+            EXPECT_EQ(order.order_id, 8u);
+            EXPECT_EQ(order.status, OrderStatus::PENDING);
+        }
+    }
+    EXPECT_FALSE(store.find_order(9, row));
+}
+
+TEST_F(HistoryStoreTest, AccountAtReturnsNewestRowBefore) {
+    HistoryStore store(config_);
+    ASSERT_TRUE(store.open(history_dir_));
+    for (int64_t t = 1; t <= 10; ++t) {
+        AccountHistoryRow account{1000001, 100.0 * static_cast<double>(t), 0.0, 0.0, t * 300};
+        ASSERT_TRUE(store.append_account(account));
+    }
+    ASSERT_TRUE(store.seal());
+
+    AccountHistoryRow row;
+    ASSERT_TRUE(store.account_at(1000001, 1000, row));
+    EXPECT_EQ(row.timestamp, 900);
+    EXPECT_DOUBLE_EQ(row.balance, 300.0);
+    EXPECT_FALSE(store.account_at(1000001, 299, row));
+    EXPECT_EQ(store.account_history(1000001, 600, 1500).size(), 4u);
+}
+
+TEST_F(HistoryStoreTest, RolledBackAppendsAreDropped) {
+    HistoryStore store(config_);
+    ASSERT_TRUE(store.open(history_dir_));
+
+    store.begin_transaction();
+    ASSERT_TRUE(store.append_order(make_order(1, OrderStatus::PENDING, 0, 1)));
+    store.rollback_transaction();
+
+    store.begin_transaction();
+    ASSERT_TRUE(store.append_order(make_order(2, OrderStatus::PENDING, 0, 2)));
+    ASSERT_TRUE(store.commit_transaction());
+
+    OrderHistoryRow row;
+    EXPECT_FALSE(store.find_order(1, row));
+    EXPECT_TRUE(store.find_order(2, row));
+}
+
+TEST_F(HistoryStoreTest, CommittedTransactionReachesEveryTable) {
+    {
+        HistoryStore store(config_);
+        ASSERT_TRUE(store.open(history_dir_));
+        store.begin_transaction();
+        ASSERT_TRUE(store.append_trade(make_trade(1, 100)));
+        ASSERT_TRUE(store.append_trade(make_trade(2, 200)));
+        ASSERT_TRUE(store.append_order(make_order(4, OrderStatus::FILLED, double_to_quantity(1.0), 2)));
+        ASSERT_TRUE(store.append_account(AccountHistoryRow{1000001, 50.0, 0.0, 0.0, 200}));
+
+        // Nothing is visible before the commit
+        OrderHistoryRow row;
+        EXPECT_FALSE(store.find_order(4, row));
+        EXPECT_TRUE(store.trades_by_user(1000001, kHistoryBeginning, kHistoryEnd).empty());
+
+        ASSERT_TRUE(store.commit_transaction());
+        EXPECT_EQ(store.trades_by_user(1000001, kHistoryBeginning, kHistoryEnd).size(), 2u);
+        EXPECT_TRUE(store.find_order(4, row));
+
+        // The commit record is gone once every table holds the rows
+        EXPECT_FALSE(std::filesystem::exists(history_dir_ + "/commit.pending"));
+    }
+
+    HistoryStore store(config_);
+    ASSERT_TRUE(store.open(history_dir_));
+    EXPECT_EQ(store.trades_by_user(1000001, kHistoryBeginning, kHistoryEnd).size(), 2u);
+    OrderHistoryRow row;
+    ASSERT_TRUE(store.find_order(4, row));
+    EXPECT_EQ(row.status, OrderStatus::FILLED);
+    AccountHistoryRow account;
+    ASSERT_TRUE(store.account_at(1000001, 200, account));
+    EXPECT_DOUBLE_EQ(account.balance, 50.0);
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include "core/matching_engine_optimized_v3.h"
+#include "core/order.h"
+#include "core/types.h"
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+using namespace perpetual;
+
+class OptimizedV3PersistenceTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        data_dir_ = "./test_v3_persistence_" + std::to_string(get_current_timestamp());
+        std::filesystem::create_directories(data_dir_ + "/events");
+
+        engine_ = std::make_unique<MatchingEngineOptimizedV3>(1);
+        ASSERT_TRUE(engine_->initialize(data_dir_ + "/events", data_dir_ + "/persistence"));
+        engine_->set_deterministic_mode(true);
+    }
+
+    void TearDown() override {
+        engine_.reset();
+        if (std::filesystem::exists(data_dir_)) {
+            std::filesystem::remove_all(data_dir_);
+        }
+    }
+
+    // A resting sell and a buy that fills it: one trade per call unless
+    // the buy is rejected
+    size_t cross() {
+        Price price = double_to_price(50000.0);
+        Quantity quantity = double_to_quantity(0.1);
+        orders_.push_back(std::make_unique<Order>(++next_id_, 1000001, 1, OrderSide::SELL,
+                                                  price, quantity, OrderType::LIMIT));
+        engine_->process_order_es(orders_.back().get());
+        orders_.push_back(std::make_unique<Order>(++next_id_, 1000002, 1, OrderSide::BUY,
+                                                  price, quantity, OrderType::LIMIT));
+        return engine_->process_order_es(orders_.back().get()).size();
+    }
+
+    std::unique_ptr<MatchingEngineOptimizedV3> engine_;
+    std::vector<std::unique_ptr<Order>> orders_;   // Outlive the engine resting them
+    std::string data_dir_;
+    OrderID next_id_ = 0;
+};
+
+TEST_F(OptimizedV3PersistenceTest, NoTradeLostWhenQueueFills) {
+    // The persistence worker is not running yet, so the trade arena
+    // (64K trades) fills and the rest stays pending in the engine
+    constexpr size_t kTrades = 80000;
+    size_t trades = 0;
+    for (size_t i = 0; i < kTrades; ++i) {
+        trades += cross();
+    }
+    ASSERT_EQ(trades, kTrades);
+
+    auto stats = engine_->getStatistics();
+    EXPECT_GT(stats.pending_trades, 0u);
+    EXPECT_GT(stats.persistence_stats.items_rejected, 0u);
+    EXPECT_EQ(stats.orders_rejected, 0u);
+
+    engine_->start();
+    for (size_t i = 0; i < 100; ++i) {
+        trades += cross();
+    }
+    engine_->stop();
+
+    stats = engine_->getStatistics();
+    EXPECT_EQ(stats.trades_executed, trades);
+    EXPECT_EQ(stats.pending_trades, 0u);
+    EXPECT_EQ(stats.persistence_stats.trades_persisted, trades);
+}
+
+TEST_F(OptimizedV3PersistenceTest, RejectsOrdersWhenBacklogIsFull) {
+    engine_->setMaxPendingTrades(1000);
+
+    // Arena full, then the backlog: further orders are rejected
+    size_t trades = 0;
+    size_t rejected = 0;
+    for (size_t i = 0; i < 70000 && rejected == 0; ++i) {
+        trades += cross();
+        if (orders_.back()->status == OrderStatus::REJECTED) {
+            rejected++;
+        }
+    }
+    ASSERT_EQ(rejected, 1u);
+
+    auto stats = engine_->getStatistics();
+    EXPECT_GE(stats.orders_rejected, 1u);
+    EXPECT_EQ(stats.trades_executed, trades);
+    EXPECT_GE(stats.pending_trades, 1000u);
+
+    // Once persistence catches up, orders are accepted again and every
+    // matched trade is written
+    engine_->start();
+    EXPECT_EQ(cross(), 1u);
+    trades++;
+    engine_->stop();
+
+    stats = engine_->getStatistics();
+    EXPECT_EQ(stats.trades_executed, trades);
+    EXPECT_EQ(stats.pending_trades, 0u);
+    EXPECT_EQ(stats.persistence_stats.trades_persisted, trades);
+}
@@ -0,0 +1,285 @@
+#include <gtest/gtest.h>
+#include "core/order_archive.h"
+#include "core/trading_views.h"
+#include "core/event_sourcing.h"
+#include "core/types.h"
+#include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace perpetual;
+
+class OrderArchiveTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        archive_dir_ = "./test_order_archive_" + std::to_string(get_current_timestamp());
+        std::filesystem::create_directories(archive_dir_);
+    }
+
+    void TearDown() override {
+        if (std::filesystem::exists(archive_dir_)) {
+            std::filesystem::remove_all(archive_dir_);
+        }
+    }
+
+    static OrderView make_view(OrderID order_id, UserID user_id, OrderStatus status) {
+        OrderView view{};
+        view.order_id = order_id;
+        view.user_id = user_id;
+        view.instrument_id = 1;
+        view.side = order_id % 2 == 0 ? OrderSide::BUY : OrderSide::SELL;
+        view.order_type = OrderType::LIMIT;
+        view.price = double_to_price(50000.0) + static_cast<Price>(order_id);
+        view.quantity = double_to_quantity(1.0);
+        view.filled_quantity = status == OrderStatus::FILLED ? view.quantity : 0;
+        view.remaining_quantity = view.quantity - view.filled_quantity;
+        view.status = status;
+        view.timestamp = static_cast<int64_t>(order_id) * 1000;
+        view.updated_at = view.timestamp + 1;
+        return view;
+    }
+
+    static std::vector<OrderID> user_orders(const OrderArchive& archive, UserID user_id) {
+        std::vector<OrderID> ids;
+        archive.for_each_user_order(user_id, [&](const OrderView& view) {
+            EXPECT_EQ(view.user_id, user_id);
+            ids.push_back(view.order_id);
+            return true;
+        });
+        return ids;
+    }
+
+    // Cancelled orders first..last, alternating between users 1 and 2
+    static void fill(OrderArchive& archive, OrderID first, OrderID last) {
+        for (OrderID id = first; id <= last; ++id) {
+            ASSERT_TRUE(archive.put(make_view(id, 1 + id % 2, OrderStatus::CANCELLED)));
+        }
+    }
+
+    static void expect_all(const OrderArchive& archive, OrderID count) {
+        ASSERT_EQ(archive.size(), count);
+        for (OrderID id = 1; id <= count; ++id) {
+            OrderView view;
+            ASSERT_TRUE(archive.get(id, view)) << "order " << id;
+            EXPECT_EQ(view.user_id, 1 + id % 2);
+            EXPECT_EQ(view.price, double_to_price(50000.0) + static_cast<Price>(id));
+        }
+        OrderView missing;
+        EXPECT_FALSE(archive.get(count + 1, missing));
+
+        // Newest archived first
+        std::vector<OrderID> odd = user_orders(archive, 2);
+        ASSERT_EQ(odd.size(), (count + 1) / 2);
+        for (size_t i = 1; i < odd.size(); ++i) {
+            EXPECT_GT(odd[i - 1], odd[i]);
+        }
+    }
+
+    std::string archive_dir_;
+};
+
+TEST_F(OrderArchiveTest, ReopenKeepsRecordsAndIndex) {
+    {
+        OrderArchive archive;
+        ASSERT_TRUE(archive.open(archive_dir_));
+        fill(archive, 1, 1000);
+        archive.flush();
+    }
+    OrderArchive archive;
+    ASSERT_TRUE(archive.open(archive_dir_));
+    expect_all(archive, 1000);
+}
+
+TEST_F(OrderArchiveTest, PutOverwritesArchivedOrder) {
+    OrderArchive archive;
+    ASSERT_TRUE(archive.open(archive_dir_));
+    fill(archive, 1, 10);
+    ASSERT_TRUE(archive.put(make_view(4, 1, OrderStatus::FILLED)));
+
+    EXPECT_EQ(archive.size(), 10u);
+    OrderView view;
+    ASSERT_TRUE(archive.get(4, view));
+    EXPECT_EQ(view.status, OrderStatus::FILLED);
+    EXPECT_EQ(view.remaining_quantity, 0);
+    EXPECT_EQ(user_orders(archive, 1).size(), 5u);
+}
+
+TEST_F(OrderArchiveTest, MissingIndexIsRebuilt) {
+    {
+        OrderArchive archive;
+        ASSERT_TRUE(archive.open(archive_dir_));
+        fill(archive, 1, 500);
+    }
+    std::filesystem::remove(archive_dir_ + "/orders.idx");
+
+    OrderArchive archive;
+    ASSERT_TRUE(archive.open(archive_dir_));
+    expect_all(archive, 500);
+}
+
+TEST_F(OrderArchiveTest, StaleIndexIsRebuilt) {
+    std::string index = archive_dir_ + "/orders.idx";
+    std::string saved = archive_dir_ + "/orders.idx.saved";
+    {
+        OrderArchive archive;
+        ASSERT_TRUE(archive.open(archive_dir_));
+        fill(archive, 1, 300);
+    }
+    std::filesystem::copy_file(index, saved);
+    {
+        OrderArchive archive;
+        ASSERT_TRUE(archive.open(archive_dir_));
+        fill(archive, 301, 400);
+    }
+
+    // An index from before the last records, as after a crash
+    std::filesystem::copy_file(saved, index, std::filesystem::copy_options::overwrite_existing);
+
+    OrderArchive archive;
+    ASSERT_TRUE(archive.open(archive_dir_));
+    expect_all(archive, 400);
+}
+
+class UserOrderPagingTest : public OrderArchiveTest {
+protected:
+    static constexpr UserID kUser = 1000001;
+
+    void SetUp() override {
+        OrderArchiveTest::SetUp();
+        // One resident terminal order per shard
+        ASSERT_TRUE(views_.open_archive(archive_dir_, kTradingViewShards));
+    }
+
+    void place(OrderID order_id, UserID user_id) {
+        Event event;
+        event.type = EventType::ORDER_PLACED;
+        event.sequence_id = ++sequence_;
+        event.event_timestamp = static_cast<Timestamp>(sequence_) * 1000;
+        event.instrument_id = 1;
+        event.data.order_placed.order_id = order_id;
+        event.data.order_placed.user_id = user_id;
+        event.data.order_placed.side = OrderSide::BUY;
+        event.data.order_placed.order_type = OrderType::LIMIT;
+        event.data.order_placed.price = double_to_price(50000.0);
+        event.data.order_placed.quantity = double_to_quantity(1.0);
+        views_.apply(event);
+    }
+
+    void cancel(OrderID order_id, UserID user_id) {
+        Event event;
+        event.type = EventType::ORDER_CANCELLED;
+        event.sequence_id = ++sequence_;
+        event.event_timestamp = static_cast<Timestamp>(sequence_) * 1000;
+        event.instrument_id = 1;
+        event.data.order_cancelled.order_id = order_id;
+        event.data.order_cancelled.user_id = user_id;
+        event.data.order_cancelled.old_status = OrderStatus::PENDING;
+        event.data.order_cancelled.new_status = OrderStatus::CANCELLED;
+        views_.apply(event);
+    }
+
+    // Every page of a query, in order
+    std::vector<OrderID> list(UserOrderQuery query, size_t* pages = nullptr) {
+        std::vector<OrderID> ids;
+        size_t count = 0;
+        do {
+            UserOrderPage page;
+            EXPECT_TRUE(views_.query_user_orders(query, page));
+            EXPECT_LE(page.orders.size(), query.limit);
+            for (const auto& view : page.orders) {
+                EXPECT_EQ(view.user_id, query.user_id);
+                ids.push_back(view.order_id);
+            }
+            query.page_token = page.next_page_token;
+            if (++count > 1000) {
+                ADD_FAILURE() << "listing does not end";
+                break;
+            }
+        } while (!query.page_token.empty());
+        if (pages) {
+            *pages = count;
+        }
+        return ids;
+    }
+
+    TradingViews views_;
+    SequenceID sequence_ = 0;
+};
+
+TEST_F(UserOrderPagingTest, PagesCrossFromResidentToArchive) {
+    // Orders 1..30; 1..20 cancelled, all but the newest of them archived
+    for (OrderID id = 1; id <= 30; ++id) {
+        place(id, kUser);
+    }
+    for (OrderID id = 1; id <= 20; ++id) {
+        cancel(id, kUser);
+    }
+    EXPECT_EQ(views_.archived_order_count(), 19u);
+    EXPECT_EQ(views_.order_count(), 11u);
+
+    UserOrderQuery query;
+    query.user_id = kUser;
+    query.limit = 7;
+    size_t pages = 0;
+    std::vector<OrderID> ids = list(query, &pages);
+    ASSERT_EQ(ids.size(), 30u);
+    EXPECT_EQ(pages, 5u);
+    EXPECT_EQ(std::set<OrderID>(ids.begin(), ids.end()).size(), 30u);
+    for (size_t i = 0; i < ids.size(); ++i) {
+        EXPECT_EQ(ids[i], 30 - i);   // Resident 30..20, then archived 19..1
+    }
+
+    // A page that ends exactly at the resident/archive boundary
+    query.limit = 11;
+    ids = list(query, &pages);
+    EXPECT_EQ(ids.size(), 30u);
+    EXPECT_EQ(pages, 3u);
+
+    query.status = OrderStatus::CANCELLED;
+    query.limit = 4;
+    ids = list(query);
+    ASSERT_EQ(ids.size(), 20u);
+    for (size_t i = 0; i < ids.size(); ++i) {
+        EXPECT_EQ(ids[i], 20 - i);
+    }
+
+    // Open orders never reach the archive
+    query.status = kOpenOrderStatus;
+    query.limit = 3;
+    ids = list(query);
+    ASSERT_EQ(ids.size(), 10u);
+    EXPECT_EQ(ids.front(), 30u);
+    EXPECT_EQ(ids.back(), 21u);
+}
+
+TEST_F(UserOrderPagingTest, ArchivedOrdersStayQueryable) {
+    for (OrderID id = 1; id <= 10; ++id) {
+        place(id, kUser);
+        cancel(id, kUser);
+    }
+    OrderView view;
+    ASSERT_TRUE(views_.get_order(3, view));
+    EXPECT_EQ(view.status, OrderStatus::CANCELLED);
+    EXPECT_EQ(views_.get_user_orders(kUser).size(), 10u);
+}
+
+TEST_F(UserOrderPagingTest, ForeignPageTokenIsRejected) {
+    for (OrderID id = 1; id <= 10; ++id) {
+        place(id, kUser);
+        place(100 + id, kUser + 1);
+    }
+    UserOrderQuery query;
+    query.user_id = kUser;
+    query.limit = 3;
+    UserOrderPage page;
+    ASSERT_TRUE(views_.query_user_orders(query, page));
+    ASSERT_FALSE(page.next_page_token.empty());
+
+    query.user_id = kUser + 1;
+    query.page_token = page.next_page_token;
+    EXPECT_FALSE(views_.query_user_orders(query, page));
+
+    query.page_token = "garbage";
+    EXPECT_FALSE(views_.query_user_orders(query, page));
+}